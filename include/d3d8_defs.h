@@ -52,8 +52,24 @@ typedef enum _D3DPRIMITIVETYPE {
 
 typedef enum _D3DFORMAT {
     D3DFMT_UNKNOWN    = 0,
+    D3DFMT_R8G8B8     = 20,
     D3DFMT_A8R8G8B8   = 21,
     D3DFMT_X8R8G8B8   = 22,
+    D3DFMT_R5G6B5     = 23,
+    D3DFMT_X1R5G5B5   = 24,
+    D3DFMT_A1R5G5B5   = 25,
+    D3DFMT_A4R4G4B4   = 26,
+    D3DFMT_A8         = 28,
+    D3DFMT_X4R4G4B4   = 30,
+    D3DFMT_P8         = 41,
+    D3DFMT_DXT1       = 0x31545844, // MAKEFOURCC('D', 'X', 'T', '1')
+    D3DFMT_DXT2       = 0x32545844,
+    D3DFMT_DXT3       = 0x33545844,
+    D3DFMT_DXT4       = 0x34545844,
+    D3DFMT_DXT5       = 0x35545844,
+    D3DFMT_ETC1       = 0x31435445, // MAKEFOURCC('E', 'T', 'C', '1'), shim extension
+    D3DFMT_L8         = 50,
+    D3DFMT_A8L8       = 51,
     D3DFMT_D16        = 80,
     D3DFMT_VERTEXDATA = 100,
     D3DFMT_INDEX16    = 101
@@ -155,6 +171,7 @@ typedef enum _D3DRENDERSTATETYPE {
     D3DRS_STENCILREF       = 57,
     D3DRS_STENCILMASK      = 58,
     D3DRS_STENCILWRITEMASK = 59,
+    D3DRS_TEXTUREFACTOR    = 60,
     D3DRS_LIGHTING         = 137,
     D3DRS_AMBIENT          = 139,
     D3DRS_SOFTWAREVERTEXPROCESSING = 153,
@@ -170,6 +187,14 @@ typedef enum _D3DRENDERSTATETYPE {
 typedef enum _D3DTRANSFORMSTATETYPE {
     D3DTS_VIEW       = 2,
     D3DTS_PROJECTION = 3,
+    D3DTS_TEXTURE0   = 16,
+    D3DTS_TEXTURE1   = 17,
+    D3DTS_TEXTURE2   = 18,
+    D3DTS_TEXTURE3   = 19,
+    D3DTS_TEXTURE4   = 20,
+    D3DTS_TEXTURE5   = 21,
+    D3DTS_TEXTURE6   = 22,
+    D3DTS_TEXTURE7   = 23,
     D3DTS_WORLD      = 256
 } D3DTRANSFORMSTATETYPE;
 
@@ -180,14 +205,72 @@ typedef enum _D3DTEXTURESTAGESTATETYPE {
     D3DTSS_ALPHAOP   = 4,
     D3DTSS_ALPHAARG1 = 5,
     D3DTSS_ALPHAARG2 = 6,
-    D3DTSS_TEXCOORDINDEX = 11
+    D3DTSS_TEXCOORDINDEX = 11,
+    D3DTSS_ADDRESSU  = 13,
+    D3DTSS_ADDRESSV  = 14,
+    D3DTSS_MAGFILTER = 16,
+    D3DTSS_MINFILTER = 17,
+    D3DTSS_MIPFILTER = 18,
+    D3DTSS_MIPMAPLODBIAS = 19,
+    D3DTSS_MAXMIPLEVEL = 20,
+    D3DTSS_TEXTURETRANSFORMFLAGS = 24,
+    D3DTSS_COLORARG0 = 26,
+    D3DTSS_ALPHAARG0 = 27,
+    D3DTSS_RESULTARG = 28
 } D3DTEXTURESTAGESTATETYPE;
 
+typedef enum _D3DTEXTUREFILTERTYPE {
+    D3DTEXF_NONE        = 0,
+    D3DTEXF_POINT       = 1,
+    D3DTEXF_LINEAR      = 2,
+    D3DTEXF_ANISOTROPIC = 3,
+    D3DTEXF_FORCE_DWORD = 0x7fffffff
+} D3DTEXTUREFILTERTYPE;
+
+typedef enum _D3DTEXTUREADDRESS {
+    D3DTADDRESS_WRAP   = 1,
+    D3DTADDRESS_MIRROR = 2,
+    D3DTADDRESS_CLAMP  = 3,
+    D3DTADDRESS_FORCE_DWORD = 0x7fffffff
+} D3DTEXTUREADDRESS;
+
+typedef enum _D3DTEXTURETRANSFORMFLAGS {
+    D3DTTFF_DISABLE   = 0,
+    D3DTTFF_COUNT1    = 1,
+    D3DTTFF_COUNT2    = 2,
+    D3DTTFF_COUNT3    = 3,
+    D3DTTFF_COUNT4    = 4,
+    D3DTTFF_PROJECTED = 256,
+    D3DTTFF_FORCE_DWORD = 0x7fffffff
+} D3DTEXTURETRANSFORMFLAGS;
+
 typedef enum _D3DTEXTUREOP {
     D3DTOP_DISABLE    = 1,
     D3DTOP_SELECTARG1 = 2,
     D3DTOP_SELECTARG2 = 3,
     D3DTOP_MODULATE   = 4,
+    D3DTOP_MODULATE2X = 5,
+    D3DTOP_MODULATE4X = 6,
+    D3DTOP_ADD        = 7,
+    D3DTOP_ADDSIGNED  = 8,
+    D3DTOP_ADDSIGNED2X = 9,
+    D3DTOP_SUBTRACT   = 10,
+    D3DTOP_ADDSMOOTH  = 11,
+    D3DTOP_BLENDDIFFUSEALPHA = 12,
+    D3DTOP_BLENDTEXTUREALPHA = 13,
+    D3DTOP_BLENDFACTORALPHA = 14,
+    D3DTOP_BLENDTEXTUREALPHAPM = 15,
+    D3DTOP_BLENDCURRENTALPHA = 16,
+    D3DTOP_PREMODULATE = 17,
+    D3DTOP_MODULATEALPHA_ADDCOLOR = 18,
+    D3DTOP_MODULATECOLOR_ADDALPHA = 19,
+    D3DTOP_MODULATEINVALPHA_ADDCOLOR = 20,
+    D3DTOP_MODULATEINVCOLOR_ADDALPHA = 21,
+    D3DTOP_BUMPENVMAP = 22,
+    D3DTOP_BUMPENVMAPLUMINANCE = 23,
+    D3DTOP_DOTPRODUCT3 = 24,
+    D3DTOP_MULTIPLYADD = 25,
+    D3DTOP_LERP       = 26,
     D3DTOP_FORCE_DWORD = 0x7fffffff
 } D3DTEXTUREOP;
 
@@ -195,6 +278,11 @@ typedef enum _D3DTEXTUREOP {
 #define D3DTA_DIFFUSE        0x00000000
 #define D3DTA_CURRENT        0x00000001
 #define D3DTA_TEXTURE        0x00000002
+#define D3DTA_TFACTOR        0x00000003
+#define D3DTA_SPECULAR       0x00000004
+#define D3DTA_TEMP           0x00000005
+#define D3DTA_COMPLEMENT     0x00000010
+#define D3DTA_ALPHAREPLICATE 0x00000020
 
 typedef enum _D3DSWAPEFFECT {
     D3DSWAPEFFECT_DISCARD    = 1,
@@ -205,6 +293,8 @@ typedef enum _D3DSWAPEFFECT {
 } D3DSWAPEFFECT;
 
 /* Structures */
+typedef DWORD D3DCOLOR; // A8R8G8B8
+
 typedef struct _D3DVIEWPORT8 {
     DWORD X;
     DWORD Y;
@@ -286,6 +376,10 @@ typedef struct _D3DSURFACE_DESC {
     UINT            Height;
 } D3DSURFACE_DESC;
 
+typedef struct _D3DXVECTOR2 {
+    float x, y;
+} D3DXVECTOR2;
+
 typedef struct _D3DXVECTOR3 {
     float x, y, z;
 } D3DXVECTOR3;
@@ -425,8 +519,11 @@ typedef struct _D3DCAPS8 {
 #define D3DPSHADECAPS_FOGGOURAUD        0x00080000L
 
 #define D3DPTEXTURECAPS_PERSPECTIVE     0x00000001L
+#define D3DPTEXTURECAPS_POW2            0x00000002L
 #define D3DPTEXTURECAPS_ALPHA           0x00000004L
 #define D3DPTEXTURECAPS_MIPMAP          0x00000040L
+#define D3DPTEXTURECAPS_ALPHAPALETTE    0x00000080L
+#define D3DPTEXTURECAPS_NONPOW2CONDITIONAL 0x00000100L
 #define D3DPTEXTURECAPS_CUBEMAP         0x00000800L
 
 #define D3DPTFILTERCAPS_MINFPOINT       0x00000100L
@@ -457,11 +554,20 @@ typedef struct _D3DCAPS8 {
 #define D3DTEXOPCAPS_SELECTARG2         0x00000004L
 #define D3DTEXOPCAPS_MODULATE           0x00000008L
 #define D3DTEXOPCAPS_MODULATE2X         0x00000010L
+#define D3DTEXOPCAPS_MODULATE4X         0x00000020L
 #define D3DTEXOPCAPS_ADD                0x00000040L
+#define D3DTEXOPCAPS_ADDSIGNED          0x00000080L
+#define D3DTEXOPCAPS_ADDSIGNED2X        0x00000100L
+#define D3DTEXOPCAPS_SUBTRACT           0x00000200L
+#define D3DTEXOPCAPS_BLENDDIFFUSEALPHA  0x00000800L
+#define D3DTEXOPCAPS_BLENDTEXTUREALPHA  0x00001000L
+#define D3DTEXOPCAPS_BLENDFACTORALPHA   0x00002000L
+#define D3DTEXOPCAPS_BLENDCURRENTALPHA  0x00008000L
 #define D3DTEXOPCAPS_MODULATEALPHA_ADDCOLOR 0x00020000L
 #define D3DTEXOPCAPS_BUMPENVMAP         0x00200000L
 #define D3DTEXOPCAPS_BUMPENVMAPLUMINANCE 0x00400000L
 #define D3DTEXOPCAPS_DOTPRODUCT3        0x00800000L
+#define D3DTEXOPCAPS_LERP               0x02000000L
 
 #define D3DFVFCAPS_TEXCOORDCOUNTMASK    0x0000ffffL
 
@@ -486,21 +592,72 @@ typedef struct _D3DCAPS8 {
 #define D3DFVF_TEXCOUNT_MASK 0xF00
 #define D3DFVF_TEXCOUNT_SHIFT 8
 
-#define D3DVSD_STREAM(_StreamNumber) ((DWORD)((0 << 29) | (_StreamNumber)))
+// Vertex shader declaration tokens
+#define D3DVSD_TOKENTYPESHIFT   29
+#define D3DVSD_TOKENTYPEMASK    (7u << D3DVSD_TOKENTYPESHIFT)
+#define D3DVSD_STREAMNUMBERMASK 0xF
+#define D3DVSD_DATALOADTYPESHIFT 28
+#define D3DVSD_DATALOADTYPEMASK (1 << D3DVSD_DATALOADTYPESHIFT)
+#define D3DVSD_DATATYPESHIFT    16
+#define D3DVSD_DATATYPEMASK     (0xF << D3DVSD_DATATYPESHIFT)
+#define D3DVSD_SKIPCOUNTSHIFT   16
+#define D3DVSD_SKIPCOUNTMASK    (0xF << D3DVSD_SKIPCOUNTSHIFT)
+#define D3DVSD_VERTEXREGMASK    0x1F
+#define D3DVSD_CONSTCOUNTSHIFT  25
+#define D3DVSD_CONSTCOUNTMASK   (0xF << D3DVSD_CONSTCOUNTSHIFT)
+#define D3DVSD_EXTCOUNTSHIFT    24
+#define D3DVSD_EXTCOUNTMASK     (0x1F << D3DVSD_EXTCOUNTSHIFT)
+#define D3DVSD_STREAMTESSSHIFT  28
+#define D3DVSD_STREAMTESSMASK   (1 << D3DVSD_STREAMTESSSHIFT)
+
+#define D3DVSD_TOKEN_NOP         0
+#define D3DVSD_TOKEN_STREAM      1
+#define D3DVSD_TOKEN_STREAMDATA  2
+#define D3DVSD_TOKEN_TESSELLATOR 3
+#define D3DVSD_TOKEN_CONSTMEM    4
+#define D3DVSD_TOKEN_EXT         5
+#define D3DVSD_TOKEN_END         7
+
+#define D3DVSD_MAKETOKENTYPE(_TokenType) \
+    (((unsigned)(_TokenType) << D3DVSD_TOKENTYPESHIFT) & D3DVSD_TOKENTYPEMASK)
+#define D3DVSD_STREAM(_StreamNumber) \
+    ((DWORD)(D3DVSD_MAKETOKENTYPE(D3DVSD_TOKEN_STREAM) | (_StreamNumber)))
 #define D3DVSD_REG(_VertexRegister, _Type) \
-    ((DWORD)((1 << 29) | ((_Type) << 16) | (_VertexRegister)))
+    ((DWORD)(D3DVSD_MAKETOKENTYPE(D3DVSD_TOKEN_STREAMDATA) | \
+             ((_Type) << D3DVSD_DATATYPESHIFT) | (_VertexRegister)))
+#define D3DVSD_SKIP(_DWORDCount) \
+    ((DWORD)(D3DVSD_MAKETOKENTYPE(D3DVSD_TOKEN_STREAMDATA) | 0x10000000 | \
+             ((_DWORDCount) << D3DVSD_SKIPCOUNTSHIFT)))
+#define D3DVSD_CONST(_ConstantAddress, _Count) \
+    ((DWORD)(D3DVSD_MAKETOKENTYPE(D3DVSD_TOKEN_CONSTMEM) | \
+             ((_Count) << D3DVSD_CONSTCOUNTSHIFT) | (_ConstantAddress)))
+#define D3DVSD_NOP() 0x00000000
 #define D3DVSD_END() 0xFFFFFFFF
 
-#define D3DVSDT_FLOAT2 0x01
-#define D3DVSDT_FLOAT3 0x02
-#define D3DVSDT_FLOAT4 0x03
+#define D3DVSDT_FLOAT1   0x00
+#define D3DVSDT_FLOAT2   0x01
+#define D3DVSDT_FLOAT3   0x02
+#define D3DVSDT_FLOAT4   0x03
 #define D3DVSDT_D3DCOLOR 0x04
-#define D3DVSDE_POSITION 0
-#define D3DVSDE_NORMAL   3
-#define D3DVSDE_DIFFUSE  5
-#define D3DVSDE_SPECULAR 6
-#define D3DVSDE_TEXCOORD0 7
-#define D3DVSDE_TEXCOORD1 8
+#define D3DVSDT_UBYTE4   0x05
+#define D3DVSDT_SHORT2   0x06
+#define D3DVSDT_SHORT4   0x07
+
+#define D3DVSDE_POSITION     0
+#define D3DVSDE_BLENDWEIGHT  1
+#define D3DVSDE_BLENDINDICES 2
+#define D3DVSDE_NORMAL       3
+#define D3DVSDE_PSIZE        4
+#define D3DVSDE_DIFFUSE      5
+#define D3DVSDE_SPECULAR     6
+#define D3DVSDE_TEXCOORD0    7
+#define D3DVSDE_TEXCOORD1    8
+#define D3DVSDE_TEXCOORD2    9
+#define D3DVSDE_TEXCOORD3    10
+#define D3DVSDE_TEXCOORD4    11
+#define D3DVSDE_TEXCOORD5    12
+#define D3DVSDE_TEXCOORD6    13
+#define D3DVSDE_TEXCOORD7    14
 
 #define D3DUSAGE_WRITEONLY    0x00000008L
 #define D3DUSAGE_DYNAMIC      0x00000200L
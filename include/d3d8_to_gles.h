@@ -19,12 +19,26 @@
 #define D3DX_DEFAULT ULONG_MAX
 #define D3DX_DEFAULT_FLOAT FLT_MAX
 
+// D3DXFilterTexture and D3DXCreateTextureFromFile*Ex filters
+#define D3DX_FILTER_NONE 1
+#define D3DX_FILTER_POINT 2
+#define D3DX_FILTER_LINEAR 3
+#define D3DX_FILTER_TRIANGLE 4
+#define D3DX_FILTER_BOX 5
+
 // Error codes
 #define D3D_OK 0
 #define D3DERR_INVALIDCALL -1
 #define MAKE_D3DHRESULT(code) (0x88760000 | (code))
 #define D3DERR_OUTOFVIDEOMEMORY MAKE_D3DHRESULT(380)
 #define D3DERR_NOTAVAILABLE MAKE_D3DHRESULT(2154)
+#define D3DERR_UNSUPPORTEDCOLOROPERATION MAKE_D3DHRESULT(2073)
+#define D3DERR_UNSUPPORTEDCOLORARG MAKE_D3DHRESULT(2074)
+#define D3DERR_UNSUPPORTEDALPHAOPERATION MAKE_D3DHRESULT(2075)
+#define D3DERR_UNSUPPORTEDALPHAARG MAKE_D3DHRESULT(2076)
+#define D3DERR_TOOMANYOPERATIONS MAKE_D3DHRESULT(2077)
+#define D3DERR_NOTFOUND MAKE_D3DHRESULT(2150)
+#define D3DERR_WASSTILLDRAWING MAKE_D3DHRESULT(540)
 #define D3DXERR_NOTAVAILABLE MAKE_DDHRESULT(2154)
 #ifndef D3DXERR_INVALIDMESH
 #define D3DXERR_INVALIDMESH MAKE_DDHRESULT(2901)
@@ -32,6 +46,9 @@
 #ifndef D3DXERR_SKINNINGNOTSUPPORTED
 #define D3DXERR_SKINNINGNOTSUPPORTED MAKE_DDHRESULT(2903)
 #endif
+#ifndef D3DXERR_INVALIDDATA
+#define D3DXERR_INVALIDDATA MAKE_DDHRESULT(2905)
+#endif
 
 #ifndef D3DADAPTER_DEFAULT
 #define D3DADAPTER_DEFAULT 0
@@ -102,6 +119,7 @@ typedef struct ID3DXRenderToEnvMap ID3DXRenderToEnvMap;
 typedef struct ID3DXEffect ID3DXEffect;
 typedef struct IDirect3DSurface8 IDirect3DSurface8;
 typedef struct IDirect3DSwapChain8 IDirect3DSwapChain8;
+typedef struct ID3DGLESMultiDraw ID3DGLESMultiDraw;
 
 typedef IDirect3D8 *LPDIRECT3D8;
 typedef IDirect3DDevice8 *LPDIRECT3DDEVICE8;
@@ -127,6 +145,484 @@ typedef ID3DXEffect *LPD3DXEFFECT;
 typedef IDirect3DSurface8 *LPDIRECT3DSURFACE8;
 typedef IDirect3DSwapChain8 *LPDIRECT3DSWAPCHAIN8;
 
+// Textures and buffers share the device's GL memory budget. Managed-pool
+// ones keep a CPU copy of their contents, so the least recently bound can
+// give up their GL storage and be re-uploaded when next bound.
+typedef struct GLES_Resource {
+    struct GLES_Resource *prev; // device list, least recently bound first
+    struct GLES_Resource *next;
+    BOOL is_texture;            // a GLES_Texture, else a GLES_Buffer
+    BOOL managed;               // may be evicted
+    BOOL evicted;               // GL storage released until the next bind
+    DWORD priority;             // SetPriority; lower priorities are evicted first
+    size_t gl_bytes;            // GL storage currently held
+} GLES_Resource;
+
+#define GLES_DEFAULT_MANAGED_BUDGET (256u << 20)
+
+// Vertex/index buffer structure
+typedef struct {
+    GLES_Resource resource;     // first, so resource lists can hold both kinds
+    GLuint vbo_id;
+    UINT length;
+    DWORD usage;
+    DWORD fvf;
+    D3DFORMAT format;
+    D3DPOOL pool;
+    BYTE *shadow;      // CPU copy of the contents, used for CPU vertex processing
+    BOOL locked;
+    DWORD version;     // bumped on every Unlock so cached results can be invalidated
+    DWORD scene_generation; // GLES_Scene.generation when a recorded draw last read it
+    UINT lock_offset;
+    UINT lock_size;
+} GLES_Buffer;
+
+// Staging memory for texture locks. Blocks are recycled by power-of-two
+// size class so repeated locks of similar rectangles do not hit malloc.
+#define GLES_STAGING_MIN_SHIFT 8
+#define GLES_STAGING_CLASSES 24
+#define GLES_STAGING_POOL_LIMIT (16u << 20) // bytes kept for reuse
+
+typedef struct GLES_StagingBlock {
+    struct GLES_StagingBlock *next;
+    size_t size_class;          // data follows the header
+} GLES_StagingBlock;
+
+typedef struct {
+    GLES_StagingBlock *free_blocks[GLES_STAGING_CLASSES];
+    size_t cached_bytes;
+} GLES_StagingPool;
+
+// Threads for CPU-side texture work (src/d3d8_workers.c)
+typedef struct GLES_WorkerPool GLES_WorkerPool;
+
+// Rectangle packer for atlas pages (src/d3d8_atlas.c)
+typedef struct GLES_AtlasPacker GLES_AtlasPacker;
+
+typedef struct {
+    BYTE *bits;                 // staging memory, NULL while the level is unlocked
+    RECT rect;
+    UINT pitch;
+    DWORD flags;
+    BYTE *blocks;               // decoded DXT levels: the blocks GL currently holds
+} GLES_TextureLock;
+
+// How a D3DFORMAT is stored in GL. Conversions run in place on the locked
+// staging memory, so the GL texel size always equals the D3D one. DXT
+// formats lock as 4x4 blocks and either upload compressed or are decoded
+// into an uncompressed GL format.
+typedef void (*GLES_TexelConvert)(void *dst, const void *src, size_t count);
+typedef void (*GLES_BlockDecode)(const BYTE *blocks, UINT count, void *dst, size_t pitch);
+
+typedef struct {
+    D3DFORMAT d3d_format;
+    GLenum gl_format;           // also the internal format, as GL ES requires
+    GLenum gl_type;
+    UINT texel_size;            // bytes per GL texel, 0 for compressed storage
+    GLES_TexelConvert convert;  // NULL when the data uploads unchanged
+    UINT block_size;            // bytes per DXT block, 0 for texel formats
+    GLES_BlockDecode decode;    // DXT blocks to gl_format texels, NULL to upload compressed
+    GLES_TexelConvert revert;   // GL texels back to D3D ones, NULL when the layouts match
+} GLES_TextureFormat;
+
+// Filtering and wrapping live in each GL texture object, so every object
+// records what it was last given and binds only send the differences
+typedef struct {
+    GLenum min_filter;
+    GLenum mag_filter;
+    GLenum wrap_s;
+    GLenum wrap_t;
+} GLES_SamplerState;
+
+// P8 textures keep one GL copy per recently used palette, since GL ES bakes
+// the palette into the texture image
+#define GLES_PALETTE_CACHE_SLOTS 4
+#define GLES_MAX_PALETTES 65536
+
+typedef struct {
+    GLuint tex_id;              // 0 until first used
+    BOOL valid;                 // holds the current indices with `stamp`'s palette
+    DWORD stamp;
+    DWORD last_used;
+    GLES_SamplerState sampler;
+} GLES_PaletteSlot;
+
+// Textures rewritten every frame rotate through a few GL copies, so an
+// upload never lands in one that frames still in flight may sample
+#define GLES_MAX_TEXTURE_RENAMES 3
+#define GLES_RENAME_STREAK 3        // frames in a row with a full upload before a texture renames
+
+typedef struct {
+    GLuint tex_id;              // 0 until first used
+    GLES_SamplerState sampler;
+} GLES_RenameSlot;
+
+typedef struct {
+    PALETTEENTRY entries[256];  // peFlags is alpha, so this is the GL_PALETTE8_RGBA8_OES layout
+    DWORD stamp;                // changes whenever the entries do, 0 until set
+} GLES_Palette;
+
+// With D3DGLES_OPTION_TEXTURE_DEDUP, managed textures whose level 0 is
+// first written with the same contents share one GL texture until one of
+// them is locked again
+#define GLES_DEDUP_BUCKETS 256
+
+typedef struct GLES_SharedTexture {
+    struct GLES_SharedTexture *next; // in its hash bucket
+    uint64_t hash;
+    const GLES_TextureFormat *gl_format;
+    UINT width;
+    UINT height;
+    UINT levels;
+    struct GLES_Texture *source; // texture whose backing holds level 0 while it still shares
+    BYTE *bits;                 // level 0 in GL layout once `source` stopped sharing
+    size_t size;
+    GLuint tex_id;
+    GLES_SamplerState sampler;  // of tex_id, for every texture sharing it
+    UINT refs;
+    struct GLES_Texture *owner; // the texture holding the GL storage while it is the only user
+    size_t gl_bytes;            // storage accounted here once shared
+} GLES_SharedTexture;
+
+// With D3DGLES_OPTION_TEXTURE_ATLAS, small single-level managed textures
+// are placed on shared pages of their GL format, each inside a border of
+// repeated edge texels, and the texture matrix maps their coordinates
+// onto the page. Pages go away with the last texture on them.
+#define GLES_ATLAS_PAGE_SIZE 512
+#define GLES_ATLAS_MAX_TEXTURE 128   // largest D3DGLES_OPTION_TEXTURE_ATLAS size
+
+typedef struct GLES_AtlasPage {
+    struct GLES_AtlasPage *next;
+    const GLES_TextureFormat *gl_format;
+    GLuint tex_id;
+    GLES_SamplerState sampler;  // of tex_id, for every texture on the page
+    GLES_AtlasPacker *packer;
+    UINT refs;                  // textures placed on it
+    size_t gl_bytes;
+} GLES_AtlasPage;
+
+// How a texture GL cannot take at its own size is stored: padded to the
+// next power of two with its edges repeated, sampled through a texture
+// matrix, or resampled to a power of two
+typedef enum { GLES_NPOT_NONE, GLES_NPOT_PAD, GLES_NPOT_RESCALE } GLES_NpotStorage;
+
+typedef struct GLES_Texture {
+    GLES_Resource resource;     // first, so resource lists can hold both kinds
+    GLuint tex_id;
+    UINT width;
+    UINT height;
+    UINT levels;
+    D3DFORMAT format;
+    D3DPOOL pool;
+    DWORD usage;
+    const GLES_TextureFormat *gl_format;
+    GLES_TextureLock *locks;    // one per level
+    uint32_t allocated_levels;  // levels with GL storage; the rest wait for first use
+    BYTE *mip_source;           // level 0 as last written, kept for D3DXFilterTexture
+    BOOL autogen_mipmap;        // GL_GENERATE_MIPMAP rebuilds the chain from level 0
+    BYTE *palette_image;        // P8: palette then every level's indices, as GL takes them
+    GLES_PaletteSlot palette_slots[GLES_PALETTE_CACHE_SLOTS];
+    DWORD palette_tick;
+    GLuint alpha_tex_id;        // cooked ETC1: GL_ALPHA plane sampled after the last stage, 0 if opaque
+    GLES_SamplerState sampler;  // of tex_id; P8 textures use their slots' instead
+    GLES_SamplerState alpha_sampler;
+    BYTE *backing;              // managed: every level as last uploaded, in GL layout
+    uint32_t backed_levels;     // levels `backing` holds
+    BYTE *alpha_backing;        // managed: every level of the alpha plane
+    GLES_RenameSlot renames[GLES_MAX_TEXTURE_RENAMES]; // copies tex_id rotates through, unused until it first does
+    UINT rename_slot;           // which of them tex_id is
+    DWORD upload_frame;         // frame of the last full upload of level 0
+    UINT upload_streak;         // frames in a row that had one
+    GLES_SharedTexture *shared; // GL texture tex_id shares with identical textures
+    BOOL dedup_checked;         // level 0 was written whole once, so it has been looked up
+    struct GLES_TextureLoad *load; // background load not yet taken over by the device thread
+    HRESULT load_status;        // how the last background load ended
+    GLES_NpotStorage npot;
+    UINT gl_width;              // size of GL level 0, which differs from width x height for NPOT storage
+    UINT gl_height;
+    BYTE *npot_source;          // rescaled: every level as last written, in GL layout, filtered from
+    GLES_AtlasPage *atlas;      // page tex_id is, NULL for a texture with storage of its own
+    DWORD scene_generation;     // GLES_Scene.generation when a recorded draw last sampled it
+    UINT atlas_x;               // where texel (0, 0) is on the page
+    UINT atlas_y;
+} GLES_Texture;
+
+// Vertex input: up to GLES_MAX_STREAMS buffers feed the GL client arrays.
+// Each FVF or vertex shader declaration is compiled once into a plan that
+// lists the arrays to enable and where each one reads from.
+#define GLES_MAX_STREAMS 4
+#define GLES_MAX_VERTEX_ELEMENTS 11 // position, normal, diffuse and eight coordinate sets
+#define GLES_FVF_PLAN_CACHE_SLOTS 16
+// SetVertexShader values above this are declaration handles, below are FVFs
+#define GLES_VERTEX_SHADER_HANDLE_BASE 0xF0000000u
+
+typedef struct {
+    GLES_Buffer *buffer;
+    GLuint vbo;
+    UINT stride;
+} GLES_Stream;
+
+typedef enum {
+    GLES_ARRAY_VERTEX,
+    GLES_ARRAY_NORMAL,
+    GLES_ARRAY_COLOR,
+    GLES_ARRAY_TEXCOORD0,       // one per texture unit
+} GLES_ArrayKind;
+
+typedef struct {
+    BYTE array;                 // GLES_ArrayKind
+    BYTE stream;
+    BYTE size;                  // components
+    BYTE set;                   // texture coordinate set, for texcoord arrays
+    GLenum type;
+    UINT offset;                // bytes from the start of the vertex
+} GLES_VertexElement;
+
+typedef struct {
+    BOOL valid;
+    DWORD fvf;                  // cache key for FVF plans
+    BOOL rhw;                   // positions are pre-transformed
+    UINT element_count;
+    UINT stream_mask;           // streams the elements read from
+    UINT strides[GLES_MAX_STREAMS]; // packed vertex size, used when SetStreamSource gave no stride
+    GLES_VertexElement elements[GLES_MAX_VERTEX_ELEMENTS];
+} GLES_VertexPlan;
+
+// Dynamic batching: small draws that differ only in the world matrix are
+// recorded here and pre-transformed on the CPU into one streaming draw.
+#define GLES_BATCH_MAX_RECORDS 256
+#define GLES_BATCH_CACHE_SLOTS 8
+#define GLES_BATCH_DEFAULT_VERTEX_LIMIT 64
+
+typedef struct {
+    GLES_Buffer *vb;
+    GLES_Buffer *ib;
+    DWORD vb_version;
+    DWORD ib_version;
+    UINT min_index;
+    UINT num_vertices;
+    UINT start_index;
+    UINT index_count;
+    UINT base_vertex;
+    D3DXMATRIX world;
+    GLfloat coords[4];          // stage 0 texture coordinate scale and offset, see texture_coords
+} GLES_BatchRecord;
+
+typedef struct {
+    uint64_t key;
+    GLES_BatchRecord *records;  // exact copy of the batch that produced the buffers
+    UINT record_count;
+    DWORD fvf;
+    UINT stride;
+    UINT index_count;
+    GLfloat coords[4];          // for stage 0 when drawing; identity once baked into the vertices
+    UINT coords_set;            // texture coordinate set stage 0 read when built
+    GLuint vbo;
+    GLuint ibo;
+    DWORD last_used;
+} GLES_BatchCacheSlot;
+
+typedef struct {
+    BOOL enabled;
+    UINT vertex_limit;
+    DWORD fvf;
+    UINT stride;
+    GLES_VertexPlan plan;       // compiled from fvf; kept out of the device cache
+    UINT count;
+    UINT vertex_count;
+    UINT index_count;
+    GLES_BatchRecord records[GLES_BATCH_MAX_RECORDS];
+    BYTE *vertices;             // scratch for CPU-transformed vertices
+    size_t vertices_capacity;
+    WORD *indices;              // scratch for rebased indices
+    size_t indices_capacity;
+    GLES_BatchCacheSlot cache[GLES_BATCH_CACHE_SLOTS];
+    DWORD tick;
+} GLES_Batch;
+
+// Application-visible pipeline state. Masks mark the states the application
+// has set; unset states are left at whatever GL currently has.
+#define GLES_MAX_RENDER_STATES 256
+#define GLES_MAX_TEXTURE_STAGES 8
+#define GLES_MAX_TEXTURE_STAGE_STATES 32
+
+typedef struct {
+    DWORD render_states[GLES_MAX_RENDER_STATES];
+    uint32_t render_state_mask[GLES_MAX_RENDER_STATES / 32];
+    GLES_Texture *textures[GLES_MAX_TEXTURE_STAGES];
+    DWORD texture_stage_states[GLES_MAX_TEXTURE_STAGES][GLES_MAX_TEXTURE_STAGE_STATES];
+    uint32_t texture_stage_state_mask[GLES_MAX_TEXTURE_STAGES];
+    UINT texture_palette;       // SetCurrentTexturePalette
+} GLES_StateBlock;
+
+// Texture stage cascades compile into one GL_COMBINE setup per texture
+// unit. Programs are cached by the stage states they were built from, and
+// the device remembers what each unit's environment holds so switching
+// programs sends only the parameters that differ.
+#define GLES_TEXENV_CACHE_SLOTS 32
+#define GLES_TEXENV_STATES 8        // op and argument states of one stage
+
+typedef struct {
+    GLenum combine_rgb;
+    GLenum combine_alpha;
+    GLenum src_rgb[3];
+    GLenum operand_rgb[3];
+    GLenum src_alpha[3];
+    GLenum operand_alpha[3];
+    GLfloat rgb_scale;
+    GLfloat alpha_scale;
+} GLES_Combiner;
+
+typedef struct {
+    BOOL valid;
+    DWORD key[GLES_MAX_TEXTURE_STAGES][GLES_TEXENV_STATES]; // zero past the last stage
+    UINT textured;              // stages with a texture bound, by bit; part of the key
+    UINT stage_count;           // stages before the first disabled one
+    UINT enabled;               // units GL textures on, by bit
+    UINT white;                 // enabled units without a texture, sampling a white texel
+    UINT constant;              // units reading D3DRS_TEXTUREFACTOR
+    HRESULT status;             // what ValidateDevice reports for the cascade
+    GLES_Combiner units[GLES_MAX_TEXTURE_STAGES];
+} GLES_TexEnvProgram;
+
+// Deferred scene submission: draws between BeginScene and EndScene are
+// recorded with an interned state snapshot and replayed in sorted order.
+typedef struct {
+    UINT state;                 // index into GLES_Scene.states
+    GLES_Stream streams[GLES_MAX_STREAMS];
+    GLES_Buffer *ib;
+    GLuint ibo;
+    DWORD fvf;
+    DWORD vertex_shader;
+    UINT base_vertex;
+    D3DPRIMITIVETYPE type;
+    UINT min_index;
+    UINT num_vertices;
+    UINT start_index;
+    UINT primitive_count;
+    D3DXMATRIX world;
+} GLES_SceneDraw;
+
+typedef struct {
+    uint64_t hash;
+    GLES_StateBlock block;
+    D3DXMATRIX texture_matrices[GLES_MAX_TEXTURE_STAGES]; // D3DTS_TEXTUREn in effect
+} GLES_SceneState;
+
+typedef struct {
+    uint64_t key;
+    UINT index;
+} GLES_SortItem;
+
+typedef struct {
+    BOOL enabled;
+    BOOL recording;
+    GLES_SceneDraw *draws;
+    UINT draw_count;
+    UINT draw_capacity;
+    GLES_SceneState *states;    // interned per flush
+    UINT state_count;
+    UINT state_capacity;
+    BOOL state_dirty;           // device state changed since the last interned snapshot
+    UINT current_state;
+    DWORD generation;           // bumped by every flush, so resources stamped before it no longer match
+    GLES_SortItem *sort_items;  // keys followed by radix sort scratch
+    UINT sort_capacity;
+} GLES_Scene;
+
+// Shim extensions (not part of Direct3D 8)
+typedef enum _D3DGLES_OPTION {
+    D3DGLES_OPTION_DYNAMIC_BATCHING   = 1, // TRUE to CPU-transform and merge small draws
+    D3DGLES_OPTION_BATCH_VERTEX_LIMIT = 2, // largest NumVertices eligible for batching
+    D3DGLES_OPTION_DEFERRED_SCENE     = 3, // TRUE to record and state-sort draws until EndScene
+    D3DGLES_OPTION_TEXTURE_BGRA       = 4, // TRUE to store 32-bit textures as BGRA when GL supports it
+    D3DGLES_OPTION_AUTOGEN_MIPMAP     = 5, // TRUE to let GL build mip chains from level 0 uploads
+    D3DGLES_OPTION_TEXTURE_DXT        = 6, // TRUE to upload DXT blocks compressed when GL supports it
+    D3DGLES_OPTION_MANAGED_BUDGET     = 7, // bytes of GL storage before managed resources are evicted
+    D3DGLES_OPTION_TEXTURE_RENAMES    = 8, // GL copies a texture rewritten every frame rotates through, 1 to disable
+    D3DGLES_OPTION_TEXTURE_DEDUP      = 9, // TRUE to share one GL texture between identical managed textures
+    D3DGLES_OPTION_NPOT_TEXTURES      = 10, // a D3DGLES_NPOT_* mode for non-power-of-two textures
+    D3DGLES_OPTION_TEXTURE_ATLAS      = 11, // largest width and height placed on shared atlas pages, 0 to disable
+    D3DGLES_OPTION_FORCE_DWORD        = 0x7fffffff
+} D3DGLES_OPTION;
+
+// D3DGLES_OPTION_NPOT_TEXTURES values
+typedef enum _D3DGLES_NPOT_MODE {
+    D3DGLES_NPOT_NATIVE  = 0, // GL takes any size (GL_OES_texture_npot and similar)
+    D3DGLES_NPOT_AUTO    = 1, // pad single-level textures that pad cheaply, rescale the rest
+    D3DGLES_NPOT_PAD     = 2, // pad single-level textures, rescale mipmapped ones
+    D3DGLES_NPOT_RESCALE = 3, // rescale every texture
+    D3DGLES_NPOT_FORCE_DWORD = 0x7fffffff
+} D3DGLES_NPOT_MODE;
+
+typedef struct _D3DGLES_STATS {
+    DWORD DrawCalls;        // glDrawElements calls issued by the shim
+    DWORD BatchedDraws;     // application draws merged into CPU-transformed batches
+    DWORD BatchFlushes;     // batches submitted
+    DWORD BatchCacheHits;   // batches reused from a previous frame without re-transforming
+    DWORD DeferredDraws;    // draws recorded for sorted submission at EndScene
+    DWORD StateChanges;     // render states, textures and stage states applied to GL
+    DWORD TextureUploadBytes; // texel bytes uploaded to GL
+    DWORD TextureDeferredBytes; // level storage created but not yet allocated in GL
+    DWORD TextureAvoidedBytes; // level storage of textures released before first use
+    DWORD MipLevelsFiltered; // levels built on the CPU by D3DXFilterTexture
+    DWORD TextureBlocksDecoded; // DXT blocks decoded for GLs without S3TC
+    DWORD PaletteUploads;     // P8 textures re-uploaded for a palette not in their cache
+    DWORD SamplerUpdates;     // glTexParameteri calls for filter and address modes
+    DWORD CombinerCompiles;   // texture stage cascades translated to GL_COMBINE setups
+    DWORD CombinerUpdates;    // glTexEnv calls made switching between them
+    DWORD ResidentBytes;      // GL storage held by textures and buffers
+    DWORD Evictions;          // managed resources that gave up their GL storage
+    DWORD RestoreBytes;       // bytes re-uploaded when evicted resources were bound again
+    DWORD TextureRenames;     // full uploads sent to a fresh GL copy instead of one frames in flight may sample
+    DWORD TextureDedupHits;   // textures that took an identical texture's GL storage instead of uploading
+    DWORD DedupSavedBytes;    // GL storage those textures would hold now
+    DWORD NpotTexelsBuilt;    // padded or rescaled texels built for NPOT textures GL cannot take as they are
+    DWORD AtlasTextures;      // textures currently placed on atlas pages
+    DWORD AtlasSwitches;      // stage 0 texture changes within one atlas page, which kept the pending batch
+    DWORD TextureMatrixLoads; // GL_TEXTURE matrices loaded for texture transforms and partly filled textures
+} D3DGLES_STATS;
+
+// Cooked texture container written by tools/d3d8_texcook and loaded by
+// D3DXCreateTextureFromFileInMemory without conversion. Fields are
+// little-endian. The header is followed by every level's ETC1 blocks, largest
+// level first, then with D3DGLES_COOKED_ALPHA by every level's 8-bit alpha.
+#define D3DGLES_COOKED_MAGIC 0x4B433344u // "D3CK"
+#define D3DGLES_COOKED_VERSION 1
+#define D3DGLES_COOKED_ALPHA 0x1
+
+typedef struct _D3DGLES_COOKED_HEADER {
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t Levels;
+    uint32_t Flags;         // D3DGLES_COOKED_*
+    uint32_t Reserved[2];
+} D3DGLES_COOKED_HEADER;
+
+typedef enum _D3DXIMAGE_FILEFORMAT {
+    D3DXIFF_BMP = 0,
+    D3DXIFF_JPG = 1,
+    D3DXIFF_TGA = 2,
+    D3DXIFF_PNG = 3,
+    D3DXIFF_DDS = 4,
+    D3DXIFF_PPM = 5,
+    D3DXIFF_DIB = 6,
+    D3DXIFF_FORCE_DWORD = 0x7fffffff
+} D3DXIMAGE_FILEFORMAT;
+
+// What an image file held before it was loaded into a texture
+typedef struct _D3DXIMAGE_INFO {
+    UINT Width;
+    UINT Height;
+    UINT Depth;
+    UINT MipLevels;
+    D3DFORMAT Format;
+    D3DRESOURCETYPE ResourceType;
+    D3DXIMAGE_FILEFORMAT ImageFileFormat;
+} D3DXIMAGE_INFO;
+
 // Internal state structure
 typedef struct {
     EGLDisplay display;
@@ -150,41 +646,77 @@ typedef struct {
     GLenum stencil_zfail;
     GLenum stencil_pass;
     GLfloat ambient[4];
-    GLuint current_vbo;
+    GLES_Stream streams[GLES_MAX_STREAMS];
     GLuint current_ibo;
+    GLES_Buffer *index_buffer;
+    UINT base_vertex;           // SetIndices BaseVertexIndex
     D3DXMATRIX world_matrix;
     D3DXMATRIX view_matrix;
     D3DXMATRIX projection_matrix;
     D3DVIEWPORT8 viewport;
+    GLfloat rhw_projection[16]; // pixel-space ortho for XYZRHW vertices
+    BOOL rhw_projection_valid;  // rhw_projection matches viewport
+    BOOL rhw_matrices;          // GL holds rhw_projection and an identity modelview
+    BOOL wvp_valid;             // GL modelview holds world*view*proj
     DWORD fvf;
+    DWORD vertex_shader;        // declaration handle, 0 when drawing with fvf
+    GLES_VertexPlan *vertex_shaders; // indexed by handle - GLES_VERTEX_SHADER_HANDLE_BASE - 1
+    UINT vertex_shader_count;
+    GLES_VertexPlan fvf_plans[GLES_FVF_PLAN_CACHE_SLOTS];
+    UINT enabled_arrays;        // client arrays enabled in GL, by GLES_ArrayKind bit
     DWORD attrib_id;
-    DWORD texcoord_index0;
     D3DPRESENT_PARAMETERS present_params;
     D3DDISPLAYMODE display_mode;
+    GLES_StateBlock state;      // as set by the application
+    GLES_StateBlock applied;    // as last applied to GL
+    GLES_Batch batch;
+    GLES_Scene scene;
+    D3DGLES_STATS stats;
+    ID3DGLESMultiDraw *multi_draw;
+    GLES_StagingPool staging;
+    BOOL bgra_supported;        // GL_EXT_texture_format_BGRA8888
+    BOOL texture_bgra;          // new 32-bit textures use BGRA storage
+    BOOL autogen_mipmap;        // new mipmapped textures use GL_GENERATE_MIPMAP
+    DWORD dxt_supported;        // TEXCONV_DXT* formats GL can sample compressed
+    BOOL texture_dxt;           // new DXT textures upload compressed
+    DWORD etc1_supported;       // TEXCONV_ETC1 when GL samples ETC1 blocks
+    BOOL etc1_sub_texture;      // GL_EXT_compressed_ETC1_RGB8_sub_texture
+    UINT texture_units;         // GL units available to stages, at most GLES_MAX_TEXTURE_STAGES
+    GLES_TexEnvProgram texenv_programs[GLES_TEXENV_CACHE_SLOTS];
+    BOOL texenv_dirty;          // stage ops or texture presence changed since the last draw
+    GLES_Combiner texenv_units[GLES_MAX_TEXTURE_STAGES]; // as last sent to each unit
+    UINT texenv_enabled;        // units with GL_TEXTURE_2D enabled, by bit
+    UINT texenv_white;          // units holding white_tex_id instead of their stage's texture
+    DWORD texenv_factor[GLES_MAX_TEXTURE_STAGES]; // GL_TEXTURE_ENV_COLOR of each unit
+    GLuint white_tex_id;        // 1x1 white, created on first use
+    UINT alpha_plane;           // unit multiplying in stage 0's alpha plane, 0 when none
+    GLES_Resource resources;    // head of the list of every texture and buffer
+    size_t resident_bytes;      // GL storage they hold
+    size_t managed_budget;      // D3DGLES_OPTION_MANAGED_BUDGET
+    UINT texture_renames;       // D3DGLES_OPTION_TEXTURE_RENAMES
+    DWORD frame;                // counts Presents from 1; 0 marks textures never uploaded
+    BOOL texture_dedup;         // D3DGLES_OPTION_TEXTURE_DEDUP
+    GLES_SharedTexture *shared_textures[GLES_DEDUP_BUCKETS];
+    BOOL mirrored_repeat;       // GL_OES_texture_mirrored_repeat
+    BOOL lod_bias;              // GL_EXT_texture_lod_bias
+    BOOL npot_supported;        // GL_OES_texture_npot or an equivalent
+    D3DGLES_NPOT_MODE npot_mode; // D3DGLES_OPTION_NPOT_TEXTURES
+    GLfloat texcoord_transform[GLES_MAX_TEXTURE_STAGES][4]; // scale and offset of each unit's bound texture
+    D3DXMATRIX texture_matrices[GLES_MAX_TEXTURE_STAGES]; // D3DTS_TEXTUREn
+    UINT texcoord_dims[GLES_MAX_TEXTURE_STAGES]; // components of the coordinates each unit last read
+    UINT texture_matrix_dirty;  // units whose GL_TEXTURE matrix is out of date
+    UINT atlas_max_size;        // D3DGLES_OPTION_TEXTURE_ATLAS
+    GLES_AtlasPage *atlas_pages;
+    GLES_WorkerPool *workers;   // started on first use
+    EGLContext loader_context;  // shares objects with `context`, for the upload thread
+    EGLSurface loader_surface;  // EGL_NO_SURFACE when surfaceless contexts are supported
+    struct GLES_Loader *loader; // background texture loads, started on first use
+    UINT loading_stages;        // applied stages whose texture is still loading and binds nothing
+    GLES_Palette *palettes;     // indexed by palette number, grown by SetPaletteEntries
+    UINT palette_count;
+    DWORD palette_stamp;
 } GLES_Device;
 
-// Vertex/index buffer structure
-typedef struct {
-    GLuint vbo_id;
-    UINT length;
-    DWORD usage;
-    DWORD fvf;
-    D3DFORMAT format;
-    D3DPOOL pool;
-    BYTE *temp_buffer;
-    UINT lock_offset;
-    UINT lock_size;
-} GLES_Buffer;
-
-typedef struct {
-    GLuint tex_id;
-    UINT width;
-    UINT height;
-    UINT levels;
-    D3DFORMAT format;
-    BYTE *temp_buffer;
-} GLES_Texture;
-
 // ID3DXBuffer interface
 typedef struct {
     HRESULT (D3DAPI *QueryInterface)(ID3DXBuffer *This, REFIID iid, void **ppv);
@@ -335,6 +867,15 @@ typedef struct {
     HRESULT (D3DAPI *SetViewport)(IDirect3DDevice8 *This, CONST D3DVIEWPORT8 *pViewport);
     HRESULT (D3DAPI *SetTransform)(IDirect3DDevice8 *This, D3DTRANSFORMSTATETYPE State, CONST D3DXMATRIX *pMatrix);
     HRESULT (D3DAPI *DrawIndexedPrimitive)(IDirect3DDevice8 *This, D3DPRIMITIVETYPE PrimitiveType, UINT MinVertexIndex, UINT NumVertices, UINT StartIndex, UINT PrimitiveCount);
+    HRESULT (D3DAPI *CreateVertexShader)(IDirect3DDevice8 *This, CONST DWORD *pDeclaration, CONST DWORD *pFunction, DWORD *pHandle, DWORD Usage);
+    HRESULT (D3DAPI *SetVertexShader)(IDirect3DDevice8 *This, DWORD Handle);
+    HRESULT (D3DAPI *GetVertexShader)(IDirect3DDevice8 *This, DWORD *pHandle);
+    HRESULT (D3DAPI *DeleteVertexShader)(IDirect3DDevice8 *This, DWORD Handle);
+    HRESULT (D3DAPI *SetPaletteEntries)(IDirect3DDevice8 *This, UINT PaletteNumber, CONST PALETTEENTRY *pEntries);
+    HRESULT (D3DAPI *GetPaletteEntries)(IDirect3DDevice8 *This, UINT PaletteNumber, PALETTEENTRY *pEntries);
+    HRESULT (D3DAPI *SetCurrentTexturePalette)(IDirect3DDevice8 *This, UINT PaletteNumber);
+    HRESULT (D3DAPI *GetCurrentTexturePalette)(IDirect3DDevice8 *This, UINT *PaletteNumber);
+    HRESULT (D3DAPI *ValidateDevice)(IDirect3DDevice8 *This, DWORD *pNumPasses);
 } IDirect3DDevice8Vtbl;
 
 struct IDirect3DDevice8 {
@@ -343,6 +884,32 @@ struct IDirect3DDevice8 {
     IDirect3D8 *d3d8;
 };
 
+// Multi-draw extension (not part of Direct3D 8), obtained with
+// IDirect3DDevice8::QueryInterface(&IID_ID3DGLESMultiDraw). The interface is
+// owned by the device and draws with the device's current state, stream
+// source and index buffer.
+DEFINE_GUID(IID_ID3DGLESMultiDraw, 0x6f1c2a4e, 0x8d3b, 0x4c1f, 0x9a, 0x52, 0x3e, 0x7d, 0x10, 0xb4, 0xc6, 0x29);
+
+typedef struct _D3DGLES_DRAW {
+    D3DPRIMITIVETYPE PrimitiveType;
+    UINT StartIndex;
+    UINT PrimitiveCount;
+    UINT BaseVertexIndex;       // added to every index, like SetIndices
+    CONST D3DXMATRIX *pWorld;   // NULL draws with the current world matrix
+} D3DGLES_DRAW;
+
+typedef struct {
+    HRESULT (D3DAPI *QueryInterface)(ID3DGLESMultiDraw *This, REFIID riid, void **ppvObj);
+    ULONG (D3DAPI *AddRef)(ID3DGLESMultiDraw *This);
+    ULONG (D3DAPI *Release)(ID3DGLESMultiDraw *This);
+    HRESULT (D3DAPI *DrawIndexedPrimitives)(ID3DGLESMultiDraw *This, CONST D3DGLES_DRAW *pDraws, UINT DrawCount);
+} ID3DGLESMultiDrawVtbl;
+
+struct ID3DGLESMultiDraw {
+    const ID3DGLESMultiDrawVtbl *lpVtbl;
+    IDirect3DDevice8 *device;
+};
+
 // IDirect3DVertexBuffer8 interface
 typedef struct {
     HRESULT (D3DAPI *QueryInterface)(IDirect3DVertexBuffer8 *This, REFIID riid, void **ppvObj);
@@ -399,6 +966,10 @@ typedef struct {
     HRESULT (D3DAPI *LockRect)(IDirect3DTexture8 *This, UINT Level, D3DLOCKED_RECT *pLockedRect, CONST RECT *pRect, DWORD Flags);
     HRESULT (D3DAPI *UnlockRect)(IDirect3DTexture8 *This, UINT Level);
     HRESULT (D3DAPI *GetLevelDesc)(IDirect3DTexture8 *This, UINT Level, D3DSURFACE_DESC *pDesc);
+    HRESULT (D3DAPI *GetSurfaceLevel)(IDirect3DTexture8 *This, UINT Level, IDirect3DSurface8 **ppSurfaceLevel);
+    DWORD (D3DAPI *SetPriority)(IDirect3DTexture8 *This, DWORD PriorityNew);
+    DWORD (D3DAPI *GetPriority)(IDirect3DTexture8 *This);
+    void (D3DAPI *PreLoad)(IDirect3DTexture8 *This);
 } IDirect3DTexture8Vtbl;
 
 struct IDirect3DTexture8 {
@@ -407,12 +978,44 @@ struct IDirect3DTexture8 {
     IDirect3DDevice8 *device;
 };
 
+// IDirect3DSurface8 interface: a view of one texture level, locked and
+// described through its texture
+typedef struct {
+    HRESULT (D3DAPI *QueryInterface)(IDirect3DSurface8 *This, REFIID riid, void **ppvObj);
+    ULONG (D3DAPI *AddRef)(IDirect3DSurface8 *This);
+    ULONG (D3DAPI *Release)(IDirect3DSurface8 *This);
+    HRESULT (D3DAPI *GetDesc)(IDirect3DSurface8 *This, D3DSURFACE_DESC *pDesc);
+    HRESULT (D3DAPI *LockRect)(IDirect3DSurface8 *This, D3DLOCKED_RECT *pLockedRect, CONST RECT *pRect, DWORD Flags);
+    HRESULT (D3DAPI *UnlockRect)(IDirect3DSurface8 *This);
+} IDirect3DSurface8Vtbl;
+
+struct IDirect3DSurface8 {
+    const IDirect3DSurface8Vtbl *lpVtbl;
+    IDirect3DTexture8 *container;
+    UINT level;
+};
+
 // D3DX function prototypes
 HRESULT WINAPI D3DXCreateBox(LPDIRECT3DDEVICE8 pDevice, FLOAT Width, FLOAT Height, FLOAT Depth, LPD3DXMESH *ppMesh, LPD3DXBUFFER *ppAdjacency);
 HRESULT WINAPI D3DXCreateSphere(LPDIRECT3DDEVICE8 pDevice, FLOAT Radius, UINT Slices, UINT Stacks, LPD3DXMESH *ppMesh, LPD3DXBUFFER *ppAdjacency);
 HRESULT WINAPI D3DXCreateBuffer(DWORD NumBytes, LPD3DXBUFFER *ppBuffer);
 HRESULT WINAPI D3DXGetErrorStringA(HRESULT hr, LPSTR pBuffer, UINT BufferLen);
 HRESULT WINAPI D3DXCreateMatrixStack(DWORD Flags, LPD3DXMATRIXSTACK *ppStack);
+HRESULT WINAPI D3DXFilterTexture(LPDIRECT3DTEXTURE8 pTexture, CONST PALETTEENTRY *pPalette, UINT SrcLevel, DWORD Filter);
+// Called once per texel with its centre and size in texture coordinates;
+// D3DXFillTexture may run it on several threads at once
+typedef void (WINAPI *LPD3DXFILL2D)(D3DXVECTOR4 *pOut, D3DXVECTOR2 *pTexCoord, D3DXVECTOR2 *pTexelSize, LPVOID pData);
+HRESULT WINAPI D3DXFillTexture(LPDIRECT3DTEXTURE8 pTexture, LPD3DXFILL2D pFunction, LPVOID pData);
+// Source texels are read from memory or, since GL ES cannot read textures
+// back, from the CPU copy of a managed, paletted or mipmapped texture's level
+HRESULT WINAPI D3DXLoadSurfaceFromMemory(LPDIRECT3DSURFACE8 pDestSurface, CONST PALETTEENTRY *pDestPalette, CONST RECT *pDestRect, LPCVOID pSrcMemory, D3DFORMAT SrcFormat, UINT SrcPitch, CONST PALETTEENTRY *pSrcPalette, CONST RECT *pSrcRect, DWORD Filter, D3DCOLOR ColorKey);
+HRESULT WINAPI D3DXLoadSurfaceFromSurface(LPDIRECT3DSURFACE8 pDestSurface, CONST PALETTEENTRY *pDestPalette, CONST RECT *pDestRect, LPDIRECT3DSURFACE8 pSrcSurface, CONST PALETTEENTRY *pSrcPalette, CONST RECT *pSrcRect, DWORD Filter, D3DCOLOR ColorKey);
+HRESULT WINAPI D3DXCreateTextureFromFileInMemory(LPDIRECT3DDEVICE8 pDevice, LPCVOID pSrcData, UINT SrcDataSize, LPDIRECT3DTEXTURE8 *ppTexture);
+HRESULT WINAPI D3DXCreateTextureFromFileInMemoryEx(LPDIRECT3DDEVICE8 pDevice, LPCVOID pSrcData, UINT SrcDataSize, UINT Width, UINT Height, UINT MipLevels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, DWORD Filter, DWORD MipFilter, D3DCOLOR ColorKey, D3DXIMAGE_INFO *pSrcInfo, PALETTEENTRY *pPalette, LPDIRECT3DTEXTURE8 *ppTexture);
+HRESULT WINAPI D3DXCreateTextureFromFileA(LPDIRECT3DDEVICE8 pDevice, LPCSTR pSrcFile, LPDIRECT3DTEXTURE8 *ppTexture);
+HRESULT WINAPI D3DXCreateTextureFromFileExA(LPDIRECT3DDEVICE8 pDevice, LPCSTR pSrcFile, UINT Width, UINT Height, UINT MipLevels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, DWORD Filter, DWORD MipFilter, D3DCOLOR ColorKey, D3DXIMAGE_INFO *pSrcInfo, PALETTEENTRY *pPalette, LPDIRECT3DTEXTURE8 *ppTexture);
+#define D3DXCreateTextureFromFile D3DXCreateTextureFromFileA
+#define D3DXCreateTextureFromFileEx D3DXCreateTextureFromFileExA
 
 // Math functions
 D3DXMATRIX* WINAPI D3DXMatrixIdentity(D3DXMATRIX *pOut);
@@ -439,6 +1042,23 @@ D3DXVECTOR3* WINAPI D3DXVec3Subtract(D3DXVECTOR3 *pOut, CONST D3DXVECTOR3 *pV1,
 D3DXVECTOR3* WINAPI D3DXVec3Cross(D3DXVECTOR3 *pOut, CONST D3DXVECTOR3 *pV1, CONST D3DXVECTOR3 *pV2);
 FLOAT WINAPI D3DXVec3Dot(CONST D3DXVECTOR3 *pV1, CONST D3DXVECTOR3 *pV2);
 
+// Shim extension functions
+HRESULT WINAPI D3DGLESSetDeviceOption(LPDIRECT3DDEVICE8 pDevice, D3DGLES_OPTION Option, DWORD Value);
+HRESULT WINAPI D3DGLESGetDeviceStats(LPDIRECT3DDEVICE8 pDevice, D3DGLES_STATS *pStats);
+
+// Background texture loads. The texture is returned at once and binds as
+// NULL until its levels are decoded on worker threads and uploaded through
+// a context shared with the device's. pCallback, when given, runs on the
+// upload thread once the texture is ready (or the load failed) and must not
+// call into the device. In-memory data must stay valid until then.
+typedef void (WINAPI *LPD3DGLESLOADCALLBACK)(LPDIRECT3DTEXTURE8 pTexture, HRESULT hr, void *pContext);
+HRESULT WINAPI D3DGLESCreateTextureFromFileInMemoryAsync(LPDIRECT3DDEVICE8 pDevice, LPCVOID pSrcData, UINT SrcDataSize, UINT Width, UINT Height, UINT MipLevels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, DWORD Filter, DWORD MipFilter, D3DCOLOR ColorKey, D3DXIMAGE_INFO *pSrcInfo, LPD3DGLESLOADCALLBACK pCallback, void *pContext, LPDIRECT3DTEXTURE8 *ppTexture);
+HRESULT WINAPI D3DGLESCreateTextureFromFileAsyncA(LPDIRECT3DDEVICE8 pDevice, LPCSTR pSrcFile, UINT Width, UINT Height, UINT MipLevels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, DWORD Filter, DWORD MipFilter, D3DCOLOR ColorKey, D3DXIMAGE_INFO *pSrcInfo, LPD3DGLESLOADCALLBACK pCallback, void *pContext, LPDIRECT3DTEXTURE8 *ppTexture);
+#define D3DGLESCreateTextureFromFileAsync D3DGLESCreateTextureFromFileAsyncA
+// D3D_OK once the texture is ready, D3DERR_WASSTILLDRAWING while its load
+// runs (waiting for it instead when Wait is TRUE), or why the load failed
+HRESULT WINAPI D3DGLESGetTextureStatus(LPDIRECT3DTEXTURE8 pTexture, BOOL Wait);
+
 // Entry point
 IDirect3D8 *D3DAPI Direct3DCreate8(UINT SDKVersion);
 void fill_d3d_caps(D3DCAPS8 *pCaps, D3DDEVTYPE DeviceType);
@@ -95,6 +95,13 @@ typedef struct tagRECT {
   LONG bottom;
 } RECT, *PRECT, *LPRECT;
 
+typedef struct tagPALETTEENTRY {
+  BYTE peRed;
+  BYTE peGreen;
+  BYTE peBlue;
+  BYTE peFlags;
+} PALETTEENTRY, *PPALETTEENTRY, *LPPALETTEENTRY;
+
 typedef struct _RGNDATA {
   char unused;
 } RGNDATA, *PRGNDATA, *LPRGNDATA;
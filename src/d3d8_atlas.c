@@ -0,0 +1,87 @@
+// src/d3d8_atlas.c
+#include "d3d8_atlas.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    UINT x;
+    UINT y;                     // top of what is packed below this stretch
+    UINT width;
+} GLES_SkylineSegment;
+
+struct GLES_AtlasPacker {
+    UINT width;
+    UINT height;
+    UINT count;
+    GLES_SkylineSegment *segments; // left to right, covering the whole width
+};
+
+GLES_AtlasPacker *atlas_pack_create(UINT width, UINT height) {
+    GLES_AtlasPacker *packer = calloc(1, sizeof(GLES_AtlasPacker));
+    // Segments are at least a texel wide, so there are never more than that
+    GLES_SkylineSegment *segments = packer ? malloc(width * sizeof(GLES_SkylineSegment)) : NULL;
+    if (!segments) {
+        free(packer);
+        return NULL;
+    }
+    segments[0] = (GLES_SkylineSegment){0, 0, width};
+    *packer = (GLES_AtlasPacker){width, height, 1, segments};
+    return packer;
+}
+
+void atlas_pack_destroy(GLES_AtlasPacker *packer) {
+    if (!packer) return;
+    free(packer->segments);
+    free(packer);
+}
+
+// Where a rectangle `width` wide starting at segment `first` would rest
+static UINT skyline_top(const GLES_AtlasPacker *packer, UINT first, UINT width) {
+    UINT top = 0;
+    for (UINT i = first; width; i++) {
+        const GLES_SkylineSegment *segment = &packer->segments[i];
+        if (segment->y > top) top = segment->y;
+        width = segment->width >= width ? 0 : width - segment->width;
+    }
+    return top;
+}
+
+BOOL atlas_pack_insert(GLES_AtlasPacker *packer, UINT width, UINT height, UINT *x, UINT *y) {
+    if (!width || !height || width > packer->width || height > packer->height) return FALSE;
+    GLES_SkylineSegment *segments = packer->segments;
+    UINT best = packer->count, best_top = 0;
+    for (UINT i = 0; i < packer->count && segments[i].x + width <= packer->width; i++) {
+        UINT top = skyline_top(packer, i, width);
+        if (top + height > packer->height) continue;
+        // Lowest bottom edge first, then the leftmost
+        if (best == packer->count || top < best_top) {
+            best = i;
+            best_top = top;
+        }
+    }
+    if (best == packer->count) return FALSE;
+
+    // Segments the rectangle covers give way to its top edge
+    UINT left = segments[best].x, right = left + width;
+    UINT end = best;
+    while (end < packer->count && segments[end].x + segments[end].width <= right) end++;
+    if (end < packer->count && segments[end].x < right) {
+        segments[end].width -= right - segments[end].x;
+        segments[end].x = right;
+    }
+    memmove(segments + best + 1, segments + end, (packer->count - end) * sizeof(GLES_SkylineSegment));
+    packer->count = packer->count + best + 1 - end;
+    segments[best] = (GLES_SkylineSegment){left, best_top + height, width};
+    // Neighbours at the same height become one segment
+    UINT merged = 0;
+    for (UINT i = 1; i < packer->count; i++) {
+        if (segments[i].y == segments[merged].y)
+            segments[merged].width += segments[i].width;
+        else
+            segments[++merged] = segments[i];
+    }
+    packer->count = merged + 1;
+    *x = left;
+    *y = best_top;
+    return TRUE;
+}
@@ -0,0 +1,17 @@
+// src/d3d8_atlas.h
+#ifndef D3D8_ATLAS_H
+#define D3D8_ATLAS_H
+
+#include "d3d8_to_gles.h"
+
+// Skyline rectangle packer for atlas pages. The packer tracks the top edge
+// of everything placed so far as a list of horizontal segments, and puts
+// each rectangle where its bottom ends lowest. Space is never given back.
+GLES_AtlasPacker *atlas_pack_create(UINT width, UINT height);
+void atlas_pack_destroy(GLES_AtlasPacker *packer);
+
+// Finds room for a `width` x `height` rectangle and reserves it. Returns
+// FALSE, changing nothing, when it does not fit.
+BOOL atlas_pack_insert(GLES_AtlasPacker *packer, UINT width, UINT height, UINT *x, UINT *y);
+
+#endif // D3D8_ATLAS_H
@@ -0,0 +1,171 @@
+// src/d3d8_dxt.c
+#include "d3d8_dxt.h"
+#include "d3d8_simd.h"
+#include <stdint.h>
+#include <string.h>
+
+// Texels are decoded to RGBA8 words (red in the low byte) and then packed
+// four at a time into the storage format.
+
+static uint32_t rgb565_to_rgba8(uint16_t c) {
+    uint32_t r = c >> 11 & 31, g = c >> 5 & 63, b = c & 31;
+    return (r << 3 | r >> 2) | (g << 2 | g >> 4) << 8 | (b << 3 | b >> 2) << 16 | 0xFF000000u;
+}
+
+// Mixes two opaque colours channel by channel: (wa * a + wb * b) / (wa + wb)
+static uint32_t mix_rgb(uint32_t a, uint32_t b, uint32_t wa, uint32_t wb) {
+    uint32_t out = 0xFF000000u;
+    for (int shift = 0; shift < 24; shift += 8)
+        out |= ((wa * (a >> shift & 0xFF) + wb * (b >> shift & 0xFF)) / (wa + wb)) << shift;
+    return out;
+}
+
+// DXT1 blocks pick three colours plus transparent black when c0 <= c1; the
+// colour half of DXT3/DXT5 blocks always uses four colours.
+static void decode_colors(const BYTE *block, BOOL four_colors, uint32_t texels[16]) {
+    uint16_t c0 = (uint16_t)(block[0] | block[1] << 8);
+    uint16_t c1 = (uint16_t)(block[2] | block[3] << 8);
+    uint32_t palette[4];
+    palette[0] = rgb565_to_rgba8(c0);
+    palette[1] = rgb565_to_rgba8(c1);
+    if (four_colors || c0 > c1) {
+        palette[2] = mix_rgb(palette[0], palette[1], 2, 1);
+        palette[3] = mix_rgb(palette[0], palette[1], 1, 2);
+    } else {
+        palette[2] = mix_rgb(palette[0], palette[1], 1, 1);
+        palette[3] = 0;
+    }
+    uint32_t indices = (uint32_t)block[4] | (uint32_t)block[5] << 8 | (uint32_t)block[6] << 16 | (uint32_t)block[7] << 24;
+    for (int i = 0; i < 16; i++) texels[i] = palette[indices >> (2 * i) & 3];
+}
+
+// DXT3: sixteen explicit 4-bit alphas
+static void decode_explicit_alpha(const BYTE *block, uint32_t texels[16]) {
+    for (int i = 0; i < 16; i++) {
+        uint32_t a = block[i / 2] >> (4 * (i & 1)) & 0xF;
+        texels[i] = (texels[i] & 0x00FFFFFFu) | (a * 17) << 24;
+    }
+}
+
+// DXT5: two endpoints and 3-bit indices into a 6 or 8 entry ramp
+static void decode_interpolated_alpha(const BYTE *block, uint32_t texels[16]) {
+    uint32_t a0 = block[0], a1 = block[1];
+    uint32_t ramp[8] = {a0, a1};
+    if (a0 > a1) {
+        for (uint32_t i = 1; i < 7; i++) ramp[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+    } else {
+        for (uint32_t i = 1; i < 5; i++) ramp[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+        ramp[6] = 0;
+        ramp[7] = 255;
+    }
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; i++) indices |= (uint64_t)block[2 + i] << (8 * i);
+    for (int i = 0; i < 16; i++) texels[i] = (texels[i] & 0x00FFFFFFu) | ramp[indices >> (3 * i) & 7] << 24;
+}
+
+// Packs one row of four RGBA8 texels into GL_UNSIGNED_SHORT_5_5_5_1
+static void pack_rgba5551(uint16_t *dst, const uint32_t *src) {
+#if defined(D3D8_GLES_SSE2)
+    __m128i v = _mm_loadu_si128((const __m128i *)src);
+    const __m128i top5 = _mm_set1_epi32(0xF8);
+    __m128i r = _mm_slli_epi32(_mm_and_si128(v, top5), 8);
+    __m128i g = _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(v, 8), top5), 3);
+    __m128i b = _mm_srli_epi32(_mm_and_si128(_mm_srli_epi32(v, 16), top5), 2);
+    __m128i a = _mm_srli_epi32(v, 31);
+    __m128i packed = _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, a));
+    // Gather the low halves of the four words
+    packed = _mm_shufflehi_epi16(_mm_shufflelo_epi16(packed, _MM_SHUFFLE(3, 3, 2, 0)), _MM_SHUFFLE(3, 3, 2, 0));
+    _mm_storel_epi64((__m128i *)dst, _mm_shuffle_epi32(packed, _MM_SHUFFLE(3, 3, 2, 0)));
+#elif defined(D3D8_GLES_NEON)
+    uint32x4_t v = vld1q_u32(src);
+    uint32x4_t top5 = vdupq_n_u32(0xF8);
+    uint32x4_t r = vshlq_n_u32(vandq_u32(v, top5), 8);
+    uint32x4_t g = vshlq_n_u32(vandq_u32(vshrq_n_u32(v, 8), top5), 3);
+    uint32x4_t b = vshrq_n_u32(vandq_u32(vshrq_n_u32(v, 16), top5), 2);
+    uint32x4_t a = vshrq_n_u32(v, 31);
+    vst1_u16(dst, vmovn_u32(vorrq_u32(vorrq_u32(r, g), vorrq_u32(b, a))));
+#else
+    for (int i = 0; i < 4; i++) {
+        uint32_t c = src[i];
+        dst[i] = (uint16_t)((c & 0xF8) << 8 | (c >> 8 & 0xF8) << 3 | (c >> 16 & 0xF8) >> 2 | c >> 31);
+    }
+#endif
+}
+
+// Packs one row of four RGBA8 texels into GL_UNSIGNED_SHORT_4_4_4_4
+static void pack_rgba4444(uint16_t *dst, const uint32_t *src) {
+#if defined(D3D8_GLES_SSE2)
+    __m128i v = _mm_loadu_si128((const __m128i *)src);
+    const __m128i top4 = _mm_set1_epi32(0xF0);
+    __m128i r = _mm_slli_epi32(_mm_and_si128(v, top4), 8);
+    __m128i g = _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(v, 8), top4), 4);
+    __m128i b = _mm_and_si128(_mm_srli_epi32(v, 16), top4);
+    __m128i a = _mm_srli_epi32(v, 28);
+    __m128i packed = _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, a));
+    packed = _mm_shufflehi_epi16(_mm_shufflelo_epi16(packed, _MM_SHUFFLE(3, 3, 2, 0)), _MM_SHUFFLE(3, 3, 2, 0));
+    _mm_storel_epi64((__m128i *)dst, _mm_shuffle_epi32(packed, _MM_SHUFFLE(3, 3, 2, 0)));
+#elif defined(D3D8_GLES_NEON)
+    uint32x4_t v = vld1q_u32(src);
+    uint32x4_t top4 = vdupq_n_u32(0xF0);
+    uint32x4_t r = vshlq_n_u32(vandq_u32(v, top4), 8);
+    uint32x4_t g = vshlq_n_u32(vandq_u32(vshrq_n_u32(v, 8), top4), 4);
+    uint32x4_t b = vandq_u32(vshrq_n_u32(v, 16), top4);
+    uint32x4_t a = vshrq_n_u32(v, 28);
+    vst1_u16(dst, vmovn_u32(vorrq_u32(vorrq_u32(r, g), vorrq_u32(b, a))));
+#else
+    for (int i = 0; i < 4; i++) {
+        uint32_t c = src[i];
+        dst[i] = (uint16_t)((c & 0xF0) << 8 | (c >> 8 & 0xF0) << 4 | (c >> 16 & 0xF0) | c >> 28);
+    }
+#endif
+}
+
+void dxt1_decode_rgba5551(const BYTE *blocks, UINT count, void *dst, size_t pitch) {
+    uint32_t texels[16];
+    for (UINT i = 0; i < count; i++, blocks += 8) {
+        decode_colors(blocks, FALSE, texels);
+        for (int row = 0; row < 4; row++)
+            pack_rgba5551((uint16_t *)((BYTE *)dst + row * pitch) + 4 * i, texels + 4 * row);
+    }
+}
+
+void dxt3_decode_rgba4444(const BYTE *blocks, UINT count, void *dst, size_t pitch) {
+    uint32_t texels[16];
+    for (UINT i = 0; i < count; i++, blocks += 16) {
+        decode_colors(blocks + 8, TRUE, texels);
+        decode_explicit_alpha(blocks, texels);
+        for (int row = 0; row < 4; row++)
+            pack_rgba4444((uint16_t *)((BYTE *)dst + row * pitch) + 4 * i, texels + 4 * row);
+    }
+}
+
+static void store_rgba8(const uint32_t texels[16], UINT i, void *dst, size_t pitch) {
+    for (int row = 0; row < 4; row++)
+        memcpy((BYTE *)dst + row * pitch + 16 * i, texels + 4 * row, 16);
+}
+
+void dxt1_decode_rgba8(const BYTE *blocks, UINT count, void *dst, size_t pitch) {
+    uint32_t texels[16];
+    for (UINT i = 0; i < count; i++, blocks += 8) {
+        decode_colors(blocks, FALSE, texels);
+        store_rgba8(texels, i, dst, pitch);
+    }
+}
+
+void dxt3_decode_rgba8(const BYTE *blocks, UINT count, void *dst, size_t pitch) {
+    uint32_t texels[16];
+    for (UINT i = 0; i < count; i++, blocks += 16) {
+        decode_colors(blocks + 8, TRUE, texels);
+        decode_explicit_alpha(blocks, texels);
+        store_rgba8(texels, i, dst, pitch);
+    }
+}
+
+void dxt5_decode_rgba8(const BYTE *blocks, UINT count, void *dst, size_t pitch) {
+    uint32_t texels[16];
+    for (UINT i = 0; i < count; i++, blocks += 16) {
+        decode_colors(blocks + 8, TRUE, texels);
+        decode_interpolated_alpha(blocks, texels);
+        store_rgba8(texels, i, dst, pitch);
+    }
+}
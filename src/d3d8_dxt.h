@@ -0,0 +1,18 @@
+// src/d3d8_dxt.h
+#ifndef D3D8_DXT_H
+#define D3D8_DXT_H
+
+#include "d3d8_to_gles.h"
+
+// Each decoder expands a row of `count` DXT blocks into 4 rows of
+// 4 * `count` texels, `pitch` bytes apart, in the GL layout named by the
+// function.
+void dxt1_decode_rgba5551(const BYTE *blocks, UINT count, void *dst, size_t pitch);
+void dxt3_decode_rgba4444(const BYTE *blocks, UINT count, void *dst, size_t pitch);
+void dxt5_decode_rgba8(const BYTE *blocks, UINT count, void *dst, size_t pitch);
+
+// Full-precision variants for offline readers
+void dxt1_decode_rgba8(const BYTE *blocks, UINT count, void *dst, size_t pitch);
+void dxt3_decode_rgba8(const BYTE *blocks, UINT count, void *dst, size_t pitch);
+
+#endif // D3D8_DXT_H
@@ -0,0 +1,288 @@
+// src/d3d8_etc1.c
+#include "d3d8_etc1.h"
+#include "d3d8_simd.h"
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+// Modifier pairs selected by each subblock's 3-bit table index. Texel index
+// 0 adds the small one, 1 the large one, 2 and 3 subtract them.
+static const int etc1_modifiers[8][2] = {{2, 8},   {5, 17},  {9, 29},  {13, 42},
+                                         {18, 60}, {24, 80}, {33, 106}, {47, 183}};
+
+static int clamp255(int v) { return v < 0 ? 0 : v > 255 ? 255 : v; }
+
+static int modifier(int table, int index) {
+    int m = etc1_modifiers[table][index & 1];
+    return index & 2 ? -m : m;
+}
+
+// The eight texels of one half of a block, channel-planar for SIMD
+typedef struct {
+    int16_t r[8], g[8], b[8];
+    BYTE pixel[8]; // bit position (x * 4 + y) of each texel
+} Etc1Subblock;
+
+// Picks the best of the four modifiers for every texel against `base` and
+// returns the summed squared error
+static uint32_t fit_table(const Etc1Subblock *sb, const int base[3], int table, BYTE indices[8]) {
+    int32_t best[8];
+    int32_t picked[8];
+#if defined(D3D8_GLES_SSE2)
+    __m128i r = _mm_loadu_si128((const __m128i *)sb->r);
+    __m128i g = _mm_loadu_si128((const __m128i *)sb->g);
+    __m128i b = _mm_loadu_si128((const __m128i *)sb->b);
+    __m128i zero = _mm_setzero_si128();
+    __m128i best_lo = _mm_set1_epi32(INT32_MAX), best_hi = best_lo;
+    __m128i index_lo = zero, index_hi = zero;
+    for (int i = 0; i < 4; i++) {
+        int m = modifier(table, i);
+        __m128i dr = _mm_sub_epi16(r, _mm_set1_epi16((int16_t)clamp255(base[0] + m)));
+        __m128i dg = _mm_sub_epi16(g, _mm_set1_epi16((int16_t)clamp255(base[1] + m)));
+        __m128i db = _mm_sub_epi16(b, _mm_set1_epi16((int16_t)clamp255(base[2] + m)));
+        // Interleaving the channel differences lets madd square and sum them
+        __m128i rg = _mm_unpacklo_epi16(dr, dg), bz = _mm_unpacklo_epi16(db, zero);
+        __m128i err_lo = _mm_add_epi32(_mm_madd_epi16(rg, rg), _mm_madd_epi16(bz, bz));
+        rg = _mm_unpackhi_epi16(dr, dg);
+        bz = _mm_unpackhi_epi16(db, zero);
+        __m128i err_hi = _mm_add_epi32(_mm_madd_epi16(rg, rg), _mm_madd_epi16(bz, bz));
+        __m128i index = _mm_set1_epi32(i);
+        __m128i less = _mm_cmplt_epi32(err_lo, best_lo);
+        best_lo = _mm_or_si128(_mm_and_si128(less, err_lo), _mm_andnot_si128(less, best_lo));
+        index_lo = _mm_or_si128(_mm_and_si128(less, index), _mm_andnot_si128(less, index_lo));
+        less = _mm_cmplt_epi32(err_hi, best_hi);
+        best_hi = _mm_or_si128(_mm_and_si128(less, err_hi), _mm_andnot_si128(less, best_hi));
+        index_hi = _mm_or_si128(_mm_and_si128(less, index), _mm_andnot_si128(less, index_hi));
+    }
+    _mm_storeu_si128((__m128i *)best, best_lo);
+    _mm_storeu_si128((__m128i *)(best + 4), best_hi);
+    _mm_storeu_si128((__m128i *)picked, index_lo);
+    _mm_storeu_si128((__m128i *)(picked + 4), index_hi);
+#elif defined(D3D8_GLES_NEON)
+    int16x8_t r = vld1q_s16(sb->r), g = vld1q_s16(sb->g), b = vld1q_s16(sb->b);
+    int32x4_t best_lo = vdupq_n_s32(INT32_MAX), best_hi = best_lo;
+    int32x4_t index_lo = vdupq_n_s32(0), index_hi = index_lo;
+    for (int i = 0; i < 4; i++) {
+        int m = modifier(table, i);
+        int16x8_t dr = vsubq_s16(r, vdupq_n_s16((int16_t)clamp255(base[0] + m)));
+        int16x8_t dg = vsubq_s16(g, vdupq_n_s16((int16_t)clamp255(base[1] + m)));
+        int16x8_t db = vsubq_s16(b, vdupq_n_s16((int16_t)clamp255(base[2] + m)));
+        int32x4_t err_lo = vmull_s16(vget_low_s16(dr), vget_low_s16(dr));
+        err_lo = vmlal_s16(err_lo, vget_low_s16(dg), vget_low_s16(dg));
+        err_lo = vmlal_s16(err_lo, vget_low_s16(db), vget_low_s16(db));
+        int32x4_t err_hi = vmull_s16(vget_high_s16(dr), vget_high_s16(dr));
+        err_hi = vmlal_s16(err_hi, vget_high_s16(dg), vget_high_s16(dg));
+        err_hi = vmlal_s16(err_hi, vget_high_s16(db), vget_high_s16(db));
+        int32x4_t index = vdupq_n_s32(i);
+        uint32x4_t less = vcltq_s32(err_lo, best_lo);
+        best_lo = vbslq_s32(less, err_lo, best_lo);
+        index_lo = vbslq_s32(less, index, index_lo);
+        less = vcltq_s32(err_hi, best_hi);
+        best_hi = vbslq_s32(less, err_hi, best_hi);
+        index_hi = vbslq_s32(less, index, index_hi);
+    }
+    vst1q_s32(best, best_lo);
+    vst1q_s32(best + 4, best_hi);
+    vst1q_s32(picked, index_lo);
+    vst1q_s32(picked + 4, index_hi);
+#else
+    for (int p = 0; p < 8; p++) {
+        best[p] = INT32_MAX;
+        picked[p] = 0;
+        for (int i = 0; i < 4; i++) {
+            int m = modifier(table, i);
+            int dr = sb->r[p] - clamp255(base[0] + m);
+            int dg = sb->g[p] - clamp255(base[1] + m);
+            int db = sb->b[p] - clamp255(base[2] + m);
+            int32_t err = dr * dr + dg * dg + db * db;
+            if (err < best[p]) {
+                best[p] = err;
+                picked[p] = i;
+            }
+        }
+    }
+#endif
+    uint32_t total = 0;
+    for (int p = 0; p < 8; p++) {
+        total += (uint32_t)best[p];
+        indices[p] = (BYTE)picked[p];
+    }
+    return total;
+}
+
+// Tries all eight tables for one subblock
+static uint32_t fit_subblock(const Etc1Subblock *sb, const int base[3], int *table, BYTE indices[8]) {
+    uint32_t best = UINT32_MAX;
+    for (int t = 0; t < 8; t++) {
+        BYTE candidate[8];
+        uint32_t err = fit_table(sb, base, t, candidate);
+        if (err < best) {
+            best = err;
+            *table = t;
+            memcpy(indices, candidate, 8);
+        }
+    }
+    return best;
+}
+
+static int expand4(int c) { return c << 4 | c; }
+static int expand5(int c) { return c << 3 | c >> 2; }
+
+void etc1_encode_block(const uint32_t texels[16], BYTE block[8]) {
+    uint32_t best_err = UINT32_MAX;
+    uint32_t best_hi = 0, best_lo = 0;
+    for (int flip = 0; flip < 2; flip++) {
+        // Flipped blocks split into top and bottom halves, others left and right
+        Etc1Subblock sb[2];
+        int count[2] = {0, 0};
+        int sum[2][3] = {{0}};
+        for (int y = 0; y < 4; y++) {
+            for (int x = 0; x < 4; x++) {
+                int s = flip ? y >= 2 : x >= 2;
+                int k = count[s]++;
+                uint32_t c = texels[y * 4 + x];
+                sb[s].r[k] = (int16_t)(c >> 16 & 0xFF);
+                sb[s].g[k] = (int16_t)(c >> 8 & 0xFF);
+                sb[s].b[k] = (int16_t)(c & 0xFF);
+                sb[s].pixel[k] = (BYTE)(x * 4 + y);
+                sum[s][0] += sb[s].r[k];
+                sum[s][1] += sb[s].g[k];
+                sum[s][2] += sb[s].b[k];
+            }
+        }
+
+        // Differential mode keeps 5 bits per channel when the two averages
+        // are within the 3-bit delta of each other
+        int q5[2][3], q4[2][3], base[2][3];
+        BOOL diff = TRUE;
+        for (int c = 0; c < 3; c++) {
+            for (int s = 0; s < 2; s++) {
+                int avg = (sum[s][c] + 4) / 8;
+                q5[s][c] = (avg * 31 + 127) / 255;
+                q4[s][c] = (avg * 15 + 127) / 255;
+            }
+            int delta = q5[1][c] - q5[0][c];
+            if (delta < -4 || delta > 3) diff = FALSE;
+        }
+        for (int s = 0; s < 2; s++)
+            for (int c = 0; c < 3; c++) base[s][c] = diff ? expand5(q5[s][c]) : expand4(q4[s][c]);
+
+        int table[2] = {0, 0};
+        BYTE indices[2][8];
+        uint32_t err = fit_subblock(&sb[0], base[0], &table[0], indices[0]);
+        if (err >= best_err) continue;
+        err += fit_subblock(&sb[1], base[1], &table[1], indices[1]);
+        if (err >= best_err) continue;
+
+        uint32_t hi = (uint32_t)table[0] << 5 | (uint32_t)table[1] << 2 | (uint32_t)diff << 1 | (uint32_t)flip;
+        for (int c = 0; c < 3; c++) {
+            int shift = 24 - 8 * c;
+            if (diff)
+                hi |= (uint32_t)q5[0][c] << (shift + 3) | (uint32_t)((q5[1][c] - q5[0][c]) & 7) << shift;
+            else
+                hi |= (uint32_t)q4[0][c] << (shift + 4) | (uint32_t)q4[1][c] << shift;
+        }
+        uint32_t lo = 0;
+        for (int s = 0; s < 2; s++) {
+            for (int k = 0; k < 8; k++) {
+                uint32_t index = indices[s][k], bit = sb[s].pixel[k];
+                lo |= (index >> 1) << (16 + bit) | (index & 1) << bit;
+            }
+        }
+        best_err = err;
+        best_hi = hi;
+        best_lo = lo;
+    }
+    for (int i = 0; i < 4; i++) {
+        block[i] = (BYTE)(best_hi >> (24 - 8 * i));
+        block[4 + i] = (BYTE)(best_lo >> (24 - 8 * i));
+    }
+}
+
+typedef struct {
+    const BYTE *src;
+    UINT width, height;
+    size_t pitch;
+    BYTE *blocks;
+} Etc1EncodeJob;
+
+static void encode_rows(void *ctx, size_t begin, size_t end) {
+    const Etc1EncodeJob *job = ctx;
+    UINT cols = (job->width + 3) / 4;
+    for (size_t row = begin; row < end; row++) {
+        for (UINT col = 0; col < cols; col++) {
+            uint32_t texels[16];
+            for (UINT y = 0; y < 4; y++) {
+                UINT sy = (UINT)row * 4 + y;
+                if (sy >= job->height) sy = job->height - 1;
+                const uint32_t *line = (const uint32_t *)(job->src + sy * job->pitch);
+                for (UINT x = 0; x < 4; x++) {
+                    UINT sx = col * 4 + x;
+                    texels[y * 4 + x] = line[sx < job->width ? sx : job->width - 1];
+                }
+            }
+            etc1_encode_block(texels, job->blocks + (row * cols + col) * 8);
+        }
+    }
+}
+
+void etc1_encode_image(const void *argb, UINT width, UINT height, size_t pitch, BYTE *blocks,
+                       GLES_WorkerPool *pool) {
+    Etc1EncodeJob job = {argb, width, height, pitch, blocks};
+    workers_run(pool, (height + 3) / 4, 1, encode_rows, &job);
+}
+
+// Expands one block to A8R8G8B8 texels, row-major
+static void decode_block(const BYTE *block, uint32_t texels[16]) {
+    uint32_t hi = (uint32_t)block[0] << 24 | (uint32_t)block[1] << 16 | (uint32_t)block[2] << 8 | block[3];
+    uint32_t lo = (uint32_t)block[4] << 24 | (uint32_t)block[5] << 16 | (uint32_t)block[6] << 8 | block[7];
+    BOOL diff = hi >> 1 & 1, flip = hi & 1;
+    int table[2] = {(int)(hi >> 5 & 7), (int)(hi >> 2 & 7)};
+    int base[2][3];
+    for (int c = 0; c < 3; c++) {
+        int shift = 24 - 8 * c;
+        if (diff) {
+            int first = (int)(hi >> (shift + 3) & 31);
+            int delta = (int)(hi >> shift & 7);
+            if (delta > 3) delta -= 8;
+            base[0][c] = expand5(first);
+            base[1][c] = expand5((first + delta) & 31);
+        } else {
+            base[0][c] = expand4((int)(hi >> (shift + 4) & 15));
+            base[1][c] = expand4((int)(hi >> shift & 15));
+        }
+    }
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            int s = flip ? y >= 2 : x >= 2;
+            int bit = x * 4 + y;
+            int index = (int)((lo >> (16 + bit) & 1) << 1 | (lo >> bit & 1));
+            int m = modifier(table[s], index);
+            texels[y * 4 + x] = 0xFF000000u | (uint32_t)clamp255(base[s][0] + m) << 16 |
+                                (uint32_t)clamp255(base[s][1] + m) << 8 | (uint32_t)clamp255(base[s][2] + m);
+        }
+    }
+}
+
+void etc1_decode_rgb565(const BYTE *blocks, UINT count, void *dst, size_t pitch) {
+    uint32_t texels[16];
+    for (UINT i = 0; i < count; i++, blocks += 8) {
+        decode_block(blocks, texels);
+        for (int row = 0; row < 4; row++) {
+            uint16_t *out = (uint16_t *)((BYTE *)dst + row * pitch) + 4 * i;
+            for (int x = 0; x < 4; x++) {
+                uint32_t c = texels[row * 4 + x];
+                out[x] = (uint16_t)((c >> 8 & 0xF800) | (c >> 5 & 0x07E0) | (c >> 3 & 0x001F));
+            }
+        }
+    }
+}
+
+void etc1_decode_argb(const BYTE *blocks, UINT count, void *dst, size_t pitch) {
+    uint32_t texels[16];
+    for (UINT i = 0; i < count; i++, blocks += 8) {
+        decode_block(blocks, texels);
+        for (int row = 0; row < 4; row++)
+            memcpy((BYTE *)dst + row * pitch + 16 * i, texels + 4 * row, 16);
+    }
+}
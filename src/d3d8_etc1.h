@@ -0,0 +1,25 @@
+// src/d3d8_etc1.h
+#ifndef D3D8_ETC1_H
+#define D3D8_ETC1_H
+
+#include "d3d8_to_gles.h"
+#include "d3d8_workers.h"
+
+// ETC1 blocks are 8 bytes covering 4x4 texels, stored big-endian as
+// GL_OES_compressed_ETC1_RGB8_texture expects.
+
+// Encodes a 4x4 block of A8R8G8B8 texels, row-major; alpha is ignored
+void etc1_encode_block(const uint32_t texels[16], BYTE block[8]);
+
+// Encodes a whole A8R8G8B8 image into (width + 3) / 4 * (height + 3) / 4
+// blocks, replicating edge texels into partial blocks. Block rows are
+// spread over `pool`.
+void etc1_encode_image(const void *argb, UINT width, UINT height, size_t pitch, BYTE *blocks,
+                       GLES_WorkerPool *pool);
+
+// Expands a row of `count` blocks into 4 rows of texels `pitch` bytes apart,
+// as GLES_BlockDecode does for GLs without ETC1
+void etc1_decode_rgb565(const BYTE *blocks, UINT count, void *dst, size_t pitch);
+void etc1_decode_argb(const BYTE *blocks, UINT count, void *dst, size_t pitch);
+
+#endif // D3D8_ETC1_H
@@ -0,0 +1,807 @@
+// src/d3d8_image.c
+#include "d3d8_image.h"
+#include "d3d8_dxt.h"
+#include "d3d8_simd.h"
+#include "d3d8_workers.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Readers for the BMP, TGA and DDS files games ship. Every format ends up as
+// a set of channel masks over little-endian texels, except 8-bit BMPs
+// (palette lookups), RLE TGAs and compressed DDS levels.
+
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDPF_ALPHAPIXELS 0x1
+#define DDPF_ALPHA 0x2
+#define DDPF_FOURCC 0x4
+#define DDPF_RGB 0x40
+#define DDPF_LUMINANCE 0x20000
+
+static uint32_t read16(const BYTE *p) { return (uint32_t)p[0] | (uint32_t)p[1] << 8; }
+static uint32_t read32(const BYTE *p) { return read16(p) | read16(p + 2) << 16; }
+
+static UINT level_dim(UINT size, UINT level) {
+    size >>= level;
+    return size ? size : 1;
+}
+
+// Bytes between rows of uncompressed level data
+static size_t row_bytes(const GLES_ImageInfo *info, UINT width) {
+    size_t bytes = ((size_t)width * info->bpp + 7) / 8;
+    return info->kind == IMAGE_BMP ? (bytes + 3) & ~(size_t)3 : bytes;
+}
+
+static size_t level_bytes(const GLES_ImageInfo *info, UINT level) {
+    UINT width = level_dim(info->width, level), height = level_dim(info->height, level);
+    if (info->format != D3DFMT_UNKNOWN) {
+        size_t block = info->format == D3DFMT_DXT1 ? 8 : 16;
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * block;
+    }
+    return row_bytes(info, width) * height;
+}
+
+static const BYTE *level_data(const GLES_ImageInfo *info, UINT level) {
+    const BYTE *src = info->pixels;
+    for (UINT i = 0; i < level; i++) src += level_bytes(info, i);
+    return src;
+}
+
+static HRESULT parse_bmp(const BYTE *data, size_t size, GLES_ImageInfo *info) {
+    if (size < 54) return D3DXERR_INVALIDDATA;
+    uint32_t offset = read32(data + 10), header = read32(data + 14);
+    int32_t width = (int32_t)read32(data + 18), height = (int32_t)read32(data + 22);
+    uint32_t bpp = read16(data + 28), compression = read32(data + 30);
+    if (header < 40 || width <= 0 || height == 0 || offset >= size) return D3DXERR_INVALIDDATA;
+    info->kind = IMAGE_BMP;
+    info->width = (UINT)width;
+    info->height = (UINT)(height < 0 ? -height : height);
+    info->bottom_up = height > 0;
+    info->bpp = bpp;
+    if (bpp == 8 && compression == 0) {
+        uint32_t colors = read32(data + 46);
+        info->colors = colors && colors <= 256 ? colors : 256;
+        info->colormap = data + 14 + header;
+        if (info->colormap + info->colors * 4 > data + offset) return D3DXERR_INVALIDDATA;
+    } else if ((bpp == 24 || bpp == 32) && compression == 0) {
+        info->masks[0] = 0xFF0000;
+        info->masks[1] = 0xFF00;
+        info->masks[2] = 0xFF;
+    } else if ((bpp == 16 || bpp == 32) && compression == 3) {
+        // BI_BITFIELDS: masks follow a 40-byte header or sit inside a V4/V5 one
+        if (size < 66) return D3DXERR_INVALIDDATA;
+        for (int c = 0; c < 3; c++) info->masks[c] = read32(data + 54 + 4 * c);
+        if (header >= 56 && size >= 70) info->masks[3] = read32(data + 66);
+        info->alpha = info->masks[3] != 0;
+    } else {
+        return D3DXERR_INVALIDDATA;
+    }
+    info->pixels = data + offset;
+    return D3D_OK;
+}
+
+static HRESULT parse_tga(const BYTE *data, size_t size, GLES_ImageInfo *info) {
+    if (size < 18) return D3DXERR_INVALIDDATA;
+    BYTE type = data[2], bpp = data[16], descriptor = data[17];
+    BOOL color = type == 2 || type == 10, gray = type == 3 || type == 11;
+    if (data[1] > 1 || (!color && !gray)) return D3DXERR_INVALIDDATA;
+    if (color ? bpp != 16 && bpp != 24 && bpp != 32 : bpp != 8) return D3DXERR_INVALIDDATA;
+    info->kind = IMAGE_TGA;
+    info->width = read16(data + 12);
+    info->height = read16(data + 14);
+    if (!info->width || !info->height) return D3DXERR_INVALIDDATA;
+    info->bpp = bpp;
+    info->rle = type >= 10;
+    info->bottom_up = !(descriptor & 0x20);
+    if (gray) {
+        info->masks[0] = info->masks[1] = info->masks[2] = 0xFF;
+    } else if (bpp == 16) {
+        info->masks[0] = 0x7C00;
+        info->masks[1] = 0x03E0;
+        info->masks[2] = 0x001F;
+        if (descriptor & 0xF) info->masks[3] = 0x8000;
+    } else {
+        info->masks[0] = 0xFF0000;
+        info->masks[1] = 0xFF00;
+        info->masks[2] = 0xFF;
+        if (bpp == 32 && (descriptor & 0xF)) info->masks[3] = 0xFF000000u;
+    }
+    info->alpha = info->masks[3] != 0;
+    // Skip the image ID and any colour map the file carries but does not use
+    size_t skip = 18 + (size_t)data[0];
+    if (data[1]) skip += (size_t)read16(data + 5) * ((data[7] + 7) / 8);
+    if (skip > size) return D3DXERR_INVALIDDATA;
+    info->pixels = data + skip;
+    return D3D_OK;
+}
+
+static HRESULT parse_dds(const BYTE *data, size_t size, GLES_ImageInfo *info) {
+    if (size < 128 || read32(data + 4) != 124) return D3DXERR_INVALIDDATA;
+    const BYTE *format = data + 76;
+    uint32_t flags = read32(format + 4);
+    info->kind = IMAGE_DDS;
+    info->height = read32(data + 12);
+    info->width = read32(data + 16);
+    info->levels = read32(data + 8) & DDSD_MIPMAPCOUNT ? read32(data + 28) : 1;
+    if (!info->width || !info->height || !info->levels || info->levels > 32) return D3DXERR_INVALIDDATA;
+    if (flags & DDPF_FOURCC) {
+        switch (read32(format + 8)) {
+        case D3DFMT_DXT1: info->format = D3DFMT_DXT1; break;
+        case D3DFMT_DXT2:
+        case D3DFMT_DXT3: info->format = D3DFMT_DXT3; break;
+        case D3DFMT_DXT4:
+        case D3DFMT_DXT5: info->format = D3DFMT_DXT5; break;
+        default: return D3DXERR_INVALIDDATA;
+        }
+        info->alpha = info->format != D3DFMT_DXT1;
+    } else if (flags & (DDPF_RGB | DDPF_LUMINANCE | DDPF_ALPHA)) {
+        info->bpp = read32(format + 12);
+        if (info->bpp != 8 && info->bpp != 16 && info->bpp != 24 && info->bpp != 32) return D3DXERR_INVALIDDATA;
+        for (int c = 0; c < 3; c++) info->masks[c] = read32(format + 16 + 4 * c);
+        if (flags & DDPF_LUMINANCE) info->masks[1] = info->masks[2] = info->masks[0];
+        if (flags & DDPF_ALPHA) info->masks[0] = info->masks[1] = info->masks[2] = 0;
+        if (flags & (DDPF_ALPHAPIXELS | DDPF_ALPHA)) info->masks[3] = read32(format + 28);
+        info->alpha = info->masks[3] != 0;
+    } else {
+        return D3DXERR_INVALIDDATA;
+    }
+    info->pixels = data + 128;
+    return D3D_OK;
+}
+
+HRESULT image_parse(const void *data, size_t size, GLES_ImageInfo *info) {
+    const BYTE *bytes = data;
+    memset(info, 0, sizeof(*info));
+    info->levels = 1;
+    info->format = D3DFMT_UNKNOWN;
+    info->end = bytes + size;
+    HRESULT hr;
+    if (size >= 4 && !memcmp(bytes, "DDS ", 4))
+        hr = parse_dds(bytes, size, info);
+    else if (size >= 2 && !memcmp(bytes, "BM", 2))
+        hr = parse_bmp(bytes, size, info);
+    else
+        hr = parse_tga(bytes, size, info); // TGA has no signature
+    if (hr != D3D_OK) return hr;
+    if (info->rle) return D3D_OK; // packet data is checked as it decodes
+    size_t total = 0;
+    for (UINT level = 0; level < info->levels; level++) total += level_bytes(info, level);
+    return total <= (size_t)(info->end - info->pixels) ? D3D_OK : D3DXERR_INVALIDDATA;
+}
+
+// Scales a masked field to 8 bits
+typedef struct {
+    uint32_t mask;
+    int shift;
+    uint32_t max;
+} ImageChannel;
+
+static void init_channels(const GLES_ImageInfo *info, ImageChannel channels[4]) {
+    for (int c = 0; c < 4; c++) {
+        uint32_t mask = info->masks[c];
+        channels[c].mask = mask;
+        channels[c].shift = 0;
+        while (mask && !(mask & 1)) {
+            mask >>= 1;
+            channels[c].shift++;
+        }
+        channels[c].max = mask;
+    }
+}
+
+static uint32_t texel_to_argb(const ImageChannel channels[4], uint32_t texel) {
+    uint32_t out = channels[3].mask ? 0 : 0xFF000000u;
+    for (int c = 0; c < 4; c++) {
+        if (!channels[c].mask) continue;
+        uint32_t v = (texel & channels[c].mask) >> channels[c].shift;
+        v = (v * 255 + channels[c].max / 2) / channels[c].max;
+        out |= v << (c == 3 ? 24 : 16 - 8 * c);
+    }
+    return out;
+}
+
+static uint32_t read_texel(const BYTE *p, UINT bytes) {
+    uint32_t v = 0;
+    for (UINT i = 0; i < bytes; i++) v |= (uint32_t)p[i] << (8 * i);
+    return v;
+}
+
+static uint32_t *dst_row(const GLES_ImageInfo *info, void *dst, size_t pitch, UINT height, UINT y) {
+    return (uint32_t *)((BYTE *)dst + (info->bottom_up ? height - 1 - y : y) * pitch);
+}
+
+static HRESULT decode_rle(const GLES_ImageInfo *info, void *dst, size_t pitch) {
+    ImageChannel channels[4];
+    init_channels(info, channels);
+    UINT bytes = info->bpp / 8;
+    const BYTE *src = info->pixels;
+    size_t total = (size_t)info->width * info->height, done = 0;
+    while (done < total) {
+        if (src >= info->end) return D3DXERR_INVALIDDATA;
+        BYTE packet = *src++;
+        size_t count = (size_t)(packet & 0x7F) + 1;
+        BOOL run = packet & 0x80;
+        if (count > total - done || src + (run ? 1 : count) * bytes > info->end) return D3DXERR_INVALIDDATA;
+        for (size_t i = 0; i < count; i++, done++) {
+            uint32_t argb = texel_to_argb(channels, read_texel(src, bytes));
+            if (!run) src += bytes;
+            dst_row(info, dst, pitch, info->height, (UINT)(done / info->width))[done % info->width] = argb;
+        }
+        if (run) src += bytes;
+    }
+    return D3D_OK;
+}
+
+static void decode_blocks(const GLES_ImageInfo *info, const BYTE *src, UINT width, UINT height, void *dst,
+                          size_t pitch) {
+    UINT cols = (width + 3) / 4, block = info->format == D3DFMT_DXT1 ? 8 : 16;
+    uint32_t *strip = malloc((size_t)cols * 4 * 4 * sizeof(uint32_t));
+    if (!strip) return;
+    for (UINT row = 0; row < (height + 3) / 4; row++, src += (size_t)cols * block) {
+        size_t strip_pitch = (size_t)cols * 4 * sizeof(uint32_t);
+        if (info->format == D3DFMT_DXT1)
+            dxt1_decode_rgba8(src, cols, strip, strip_pitch);
+        else if (info->format == D3DFMT_DXT3)
+            dxt3_decode_rgba8(src, cols, strip, strip_pitch);
+        else
+            dxt5_decode_rgba8(src, cols, strip, strip_pitch);
+        for (UINT y = 0; y < 4 && row * 4 + y < height; y++) {
+            uint32_t *out = (uint32_t *)((BYTE *)dst + (row * 4 + y) * pitch);
+            const uint32_t *in = strip + (size_t)y * cols * 4;
+            // RGBA8 words to A8R8G8B8
+            for (UINT x = 0; x < width; x++)
+                out[x] = (in[x] & 0xFF00FF00u) | (in[x] >> 16 & 0xFF) | (in[x] & 0xFF) << 16;
+        }
+    }
+    free(strip);
+}
+
+HRESULT image_decode_argb(const GLES_ImageInfo *info, UINT level, void *dst, size_t pitch) {
+    if (level >= info->levels) return D3DERR_INVALIDCALL;
+    if (info->rle) return decode_rle(info, dst, pitch);
+    const BYTE *src = level_data(info, level);
+    UINT width = level_dim(info->width, level), height = level_dim(info->height, level);
+    if (info->format != D3DFMT_UNKNOWN) {
+        decode_blocks(info, src, width, height, dst, pitch);
+        return D3D_OK;
+    }
+    ImageChannel channels[4];
+    init_channels(info, channels);
+    UINT bytes = info->bpp / 8;
+    size_t stride = row_bytes(info, width);
+    for (UINT y = 0; y < height; y++, src += stride) {
+        uint32_t *out = dst_row(info, dst, pitch, height, y);
+        for (UINT x = 0; x < width; x++) {
+            if (info->colormap) {
+                BYTE index = src[x];
+                const BYTE *entry = info->colormap + 4 * (index < info->colors ? index : 0);
+                out[x] = 0xFF000000u | (uint32_t)entry[2] << 16 | (uint32_t)entry[1] << 8 | entry[0];
+            } else {
+                out[x] = texel_to_argb(channels, read_texel(src + (size_t)x * bytes, bytes));
+            }
+        }
+    }
+    return D3D_OK;
+}
+
+// The D3D format closest to how uncompressed texels are stored
+static D3DFORMAT stored_format(const GLES_ImageInfo *info) {
+    const uint32_t *masks = info->masks;
+    if (info->colormap) return D3DFMT_P8;
+    switch (info->bpp) {
+        case 32: return masks[3] ? D3DFMT_A8R8G8B8 : D3DFMT_X8R8G8B8;
+        case 24: return D3DFMT_R8G8B8;
+        case 16:
+            if (masks[0] == 0xF800) return D3DFMT_R5G6B5;
+            if (masks[0] == 0x7C00) return masks[3] ? D3DFMT_A1R5G5B5 : D3DFMT_X1R5G5B5;
+            if (masks[0] == 0x0F00) return masks[3] ? D3DFMT_A4R4G4B4 : D3DFMT_X4R4G4B4;
+            if (masks[0] == 0xFF && masks[3] == 0xFF00) return D3DFMT_A8L8;
+            return D3DFMT_UNKNOWN;
+        case 8: return masks[0] ? D3DFMT_L8 : D3DFMT_A8;
+        default: return D3DFMT_UNKNOWN;
+    }
+}
+
+void image_describe(const GLES_ImageInfo *info, D3DXIMAGE_INFO *desc) {
+    desc->Width = info->width;
+    desc->Height = info->height;
+    desc->Depth = 1;
+    desc->MipLevels = info->levels;
+    desc->Format = info->format != D3DFMT_UNKNOWN ? info->format : stored_format(info);
+    desc->ResourceType = D3DRTYPE_TEXTURE;
+    desc->ImageFileFormat =
+        info->kind == IMAGE_BMP ? D3DXIFF_BMP : info->kind == IMAGE_TGA ? D3DXIFF_TGA : D3DXIFF_DDS;
+}
+
+HRESULT image_copy_blocks(const GLES_ImageInfo *info, UINT level, void *dst, size_t pitch) {
+    if (level >= info->levels || info->format == D3DFMT_UNKNOWN) return D3DERR_INVALIDCALL;
+    const BYTE *src = level_data(info, level);
+    UINT width = level_dim(info->width, level), height = level_dim(info->height, level);
+    size_t row = (size_t)(width + 3) / 4 * (info->format == D3DFMT_DXT1 ? 8 : 16);
+    for (UINT y = 0; y < (height + 3) / 4; y++) memcpy((BYTE *)dst + y * pitch, src + y * row, row);
+    return D3D_OK;
+}
+
+BOOL image_can_store(D3DFORMAT format) {
+    switch (format) {
+        case D3DFMT_A8R8G8B8: case D3DFMT_X8R8G8B8: case D3DFMT_R5G6B5: case D3DFMT_X1R5G5B5:
+        case D3DFMT_A1R5G5B5: case D3DFMT_A4R4G4B4: case D3DFMT_X4R4G4B4: case D3DFMT_A8:
+        case D3DFMT_L8: case D3DFMT_A8L8: return TRUE;
+        default: return FALSE;
+    }
+}
+
+static uint32_t luminance(uint32_t argb) {
+    return ((argb >> 16 & 0xFF) * 77 + (argb >> 8 & 0xFF) * 150 + (argb & 0xFF) * 29 + 128) >> 8;
+}
+
+// A8R8G8B8 to `format`; X formats set their unused bits
+static void store_row(D3DFORMAT format, const uint32_t *argb, UINT count, void *dst) {
+    uint16_t *out16 = dst;
+    BYTE *out8 = dst;
+    for (UINT x = 0; x < count; x++) {
+        uint32_t c = argb[x], a = c >> 24, r = c >> 16 & 0xFF, g = c >> 8 & 0xFF, b = c & 0xFF;
+        switch (format) {
+            case D3DFMT_R5G6B5: out16[x] = (uint16_t)((r >> 3) << 11 | (g >> 2) << 5 | b >> 3); break;
+            case D3DFMT_X1R5G5B5: a = 0xFF; // fall through
+            case D3DFMT_A1R5G5B5: out16[x] = (uint16_t)((a >> 7) << 15 | (r >> 3) << 10 | (g >> 3) << 5 | b >> 3); break;
+            case D3DFMT_X4R4G4B4: a = 0xFF; // fall through
+            case D3DFMT_A4R4G4B4: out16[x] = (uint16_t)((a >> 4) << 12 | (r >> 4) << 8 | (g >> 4) << 4 | b >> 4); break;
+            case D3DFMT_A8: out8[x] = (BYTE)a; break;
+            case D3DFMT_L8: out8[x] = (BYTE)luminance(c); break;
+            case D3DFMT_A8L8: out16[x] = (uint16_t)(a << 8 | luminance(c)); break;
+            default: break;
+        }
+    }
+    if (format == D3DFMT_A8R8G8B8 || format == D3DFMT_X8R8G8B8) memcpy(dst, argb, (size_t)count * 4);
+}
+
+void image_store_argb(D3DFORMAT format, const uint32_t *argb, UINT count, void *dst) {
+    store_row(format, argb, count, dst);
+}
+
+void image_color_key(uint32_t *texels, size_t count, uint32_t key) {
+    size_t i = 0;
+#if defined(D3D8_GLES_SSE2)
+    const __m128i k = _mm_set1_epi32((int)key);
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(texels + i));
+        _mm_storeu_si128((__m128i *)(texels + i), _mm_andnot_si128(_mm_cmpeq_epi32(v, k), v));
+    }
+#elif defined(D3D8_GLES_NEON)
+    const uint32x4_t k = vdupq_n_u32(key);
+    for (; i + 4 <= count; i += 4) {
+        uint32x4_t v = vld1q_u32(texels + i);
+        vst1q_u32(texels + i, vbicq_u32(v, vceqq_u32(v, k)));
+    }
+#endif
+    for (; i < count; i++) {
+        if (texels[i] == key) texels[i] = 0;
+    }
+}
+
+// Source texels on either side of the centre of destination texel `i`, and
+// how far towards the second one it lies in 1/128ths
+static void bilinear_tap(UINT src_size, UINT size, UINT i, UINT *first, UINT *second, int *weight) {
+    int64_t pos = (int64_t)(2 * (uint64_t)i + 1) * src_size * 64 / size - 64;
+    if (pos < 0) pos = 0;
+    *first = (UINT)(pos >> 7);
+    *weight = (int)(pos & 127);
+    if (*first >= src_size - 1) {
+        *first = src_size - 1;
+        *weight = 0;
+    }
+    *second = *first + (*first + 1 < src_size);
+}
+
+// out = a + (b - a) * weight / 128 for every byte, widened to 16 bits
+static void lerp_rows(const BYTE *a, const BYTE *b, size_t count, int weight, int16_t *out) {
+    size_t i = 0;
+#if defined(D3D8_GLES_SSE2)
+    const __m128i zero = _mm_setzero_si128(), w = _mm_set1_epi16((short)weight);
+    for (; i + 16 <= count; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i)), vb = _mm_loadu_si128((const __m128i *)(b + i));
+        __m128i alo = _mm_unpacklo_epi8(va, zero), ahi = _mm_unpackhi_epi8(va, zero);
+        __m128i dlo = _mm_sub_epi16(_mm_unpacklo_epi8(vb, zero), alo);
+        __m128i dhi = _mm_sub_epi16(_mm_unpackhi_epi8(vb, zero), ahi);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_add_epi16(alo, _mm_srai_epi16(_mm_mullo_epi16(dlo, w), 7)));
+        _mm_storeu_si128((__m128i *)(out + i + 8), _mm_add_epi16(ahi, _mm_srai_epi16(_mm_mullo_epi16(dhi, w), 7)));
+    }
+#elif defined(D3D8_GLES_NEON)
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t va = vld1q_u8(a + i), vb = vld1q_u8(b + i);
+        int16x8_t alo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(va)));
+        int16x8_t ahi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(va)));
+        int16x8_t dlo = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(vb))), alo);
+        int16x8_t dhi = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(vb))), ahi);
+        vst1q_s16(out + i, vaddq_s16(alo, vshrq_n_s16(vmulq_n_s16(dlo, (int16_t)weight), 7)));
+        vst1q_s16(out + i + 8, vaddq_s16(ahi, vshrq_n_s16(vmulq_n_s16(dhi, (int16_t)weight), 7)));
+    }
+#endif
+    for (; i < count; i++) out[i] = (int16_t)(a[i] + (((int)b[i] - a[i]) * weight >> 7));
+}
+
+static void resample_bilinear(const uint32_t *src, UINT src_width, UINT src_height, uint32_t *dst, UINT width,
+                              UINT height) {
+    UINT *taps = malloc((size_t)width * 3 * sizeof(UINT));
+    int16_t *row = malloc((size_t)src_width * 4 * sizeof(int16_t));
+    if (taps && row) {
+        for (UINT x = 0; x < width; x++) {
+            int weight;
+            bilinear_tap(src_width, width, x, &taps[3 * x], &taps[3 * x + 1], &weight);
+            taps[3 * x + 2] = (UINT)weight;
+        }
+        for (UINT y = 0; y < height; y++) {
+            UINT y0, y1;
+            int wy;
+            bilinear_tap(src_height, height, y, &y0, &y1, &wy);
+            lerp_rows((const BYTE *)(src + (size_t)y0 * src_width), (const BYTE *)(src + (size_t)y1 * src_width),
+                      (size_t)src_width * 4, wy, row);
+            BYTE *out = (BYTE *)(dst + (size_t)y * width);
+            for (UINT x = 0; x < width; x++) {
+                const int16_t *p0 = row + taps[3 * x] * 4, *p1 = row + taps[3 * x + 1] * 4;
+                int wx = (int)taps[3 * x + 2];
+                for (int c = 0; c < 4; c++) out[4 * x + c] = (BYTE)(p0[c] + ((p1[c] - p0[c]) * wx >> 7));
+            }
+        }
+    }
+    free(taps);
+    free(row);
+}
+
+void image_resample_argb(const uint32_t *src, UINT src_width, UINT src_height, uint32_t *dst, UINT width,
+                         UINT height, DWORD filter) {
+    switch (filter & 0xFF) {
+        case D3DX_FILTER_NONE:
+            // The image keeps its size; what does not fit is cut off and the rest is transparent black
+            for (UINT y = 0; y < height; y++) {
+                uint32_t *out = dst + (size_t)y * width;
+                UINT copied = y < src_height ? (src_width < width ? src_width : width) : 0;
+                if (copied) memcpy(out, src + (size_t)y * src_width, (size_t)copied * 4);
+                memset(out + copied, 0, (size_t)(width - copied) * 4);
+            }
+            break;
+        case D3DX_FILTER_POINT:
+            for (UINT y = 0; y < height; y++) {
+                const uint32_t *in = src + (size_t)((2 * (uint64_t)y + 1) * src_height / (2 * height)) * src_width;
+                uint32_t *out = dst + (size_t)y * width;
+                for (UINT x = 0; x < width; x++) out[x] = in[(2 * (uint64_t)x + 1) * src_width / (2 * width)];
+            }
+            break;
+        default:
+            // LINEAR, TRIANGLE and BOX all sample bilinearly; mip levels are
+            // filtered from level 0 by D3DXFilterTexture instead
+            resample_bilinear(src, src_width, src_height, dst, width, height);
+            break;
+    }
+}
+
+HRESULT image_load(const GLES_ImageInfo *info, UINT level, D3DFORMAT format, UINT width, UINT height, DWORD filter,
+                   D3DCOLOR color_key, void *dst, size_t pitch) {
+    if (level >= info->levels || !image_can_store(format)) return D3DERR_INVALIDCALL;
+    UINT src_width = level_dim(info->width, level), src_height = level_dim(info->height, level);
+    BOOL scale = src_width != width || src_height != height;
+    if (!scale && (format == D3DFMT_A8R8G8B8 || format == D3DFMT_X8R8G8B8)) {
+        HRESULT hr = image_decode_argb(info, level, dst, pitch);
+        for (UINT y = 0; color_key && hr == D3D_OK && y < height; y++)
+            image_color_key((uint32_t *)((BYTE *)dst + y * pitch), width, (uint32_t)color_key);
+        return hr;
+    }
+    uint32_t *texels = malloc((size_t)src_width * src_height * 4);
+    uint32_t *scaled = scale ? malloc((size_t)width * height * 4) : texels;
+    HRESULT hr = texels && scaled ? image_decode_argb(info, level, texels, (size_t)src_width * 4) : D3DERR_OUTOFVIDEOMEMORY;
+    if (hr == D3D_OK) {
+        if (color_key) image_color_key(texels, (size_t)src_width * src_height, (uint32_t)color_key);
+        if (scale) image_resample_argb(texels, src_width, src_height, scaled, width, height, filter);
+        for (UINT y = 0; y < height; y++) store_row(format, scaled + (size_t)y * width, width, (BYTE *)dst + y * pitch);
+    }
+    if (scaled != texels) free(scaled);
+    free(texels);
+    return hr;
+}
+
+BOOL image_can_fetch(D3DFORMAT format) {
+    return image_can_store(format) || format == D3DFMT_R8G8B8 || format == D3DFMT_P8;
+}
+
+UINT image_texel_size(D3DFORMAT format) {
+    switch (format) {
+        case D3DFMT_A8R8G8B8: case D3DFMT_X8R8G8B8: return 4;
+        case D3DFMT_R8G8B8: return 3;
+        case D3DFMT_A8: case D3DFMT_L8: case D3DFMT_P8: return 1;
+        default: return image_can_fetch(format) ? 2 : 0;
+    }
+}
+
+static uint32_t expand5(uint32_t v) { return v << 3 | v >> 2; }
+static uint32_t expand4(uint32_t v) { return v << 4 | v; }
+
+void image_fetch_argb(D3DFORMAT format, const void *src, UINT count, const PALETTEENTRY *palette, uint32_t *argb) {
+    const uint16_t *in16 = src;
+    const BYTE *in8 = src;
+    size_t i = 0;
+    switch (format) {
+        case D3DFMT_A8R8G8B8: memcpy(argb, src, (size_t)count * 4); break;
+        case D3DFMT_X8R8G8B8: {
+            const uint32_t *in32 = src;
+#if defined(D3D8_GLES_SSE2)
+            const __m128i alpha = _mm_set1_epi32((int)0xFF000000u);
+            for (; i + 4 <= count; i += 4)
+                _mm_storeu_si128((__m128i *)(argb + i), _mm_or_si128(_mm_loadu_si128((const __m128i *)(in32 + i)), alpha));
+#elif defined(D3D8_GLES_NEON)
+            const uint32x4_t alpha = vdupq_n_u32(0xFF000000u);
+            for (; i + 4 <= count; i += 4) vst1q_u32(argb + i, vorrq_u32(vld1q_u32(in32 + i), alpha));
+#endif
+            for (; i < count; i++) argb[i] = in32[i] | 0xFF000000u;
+            break;
+        }
+        case D3DFMT_R8G8B8:
+            for (; i < count; i++) argb[i] = 0xFF000000u | read_texel(in8 + i * 3, 3);
+            break;
+        case D3DFMT_R5G6B5:
+            for (; i < count; i++) {
+                uint32_t c = in16[i], g = c >> 5 & 0x3F;
+                argb[i] = 0xFF000000u | expand5(c >> 11) << 16 | (g << 2 | g >> 4) << 8 | expand5(c & 0x1F);
+            }
+            break;
+        case D3DFMT_X1R5G5B5:
+        case D3DFMT_A1R5G5B5:
+            for (; i < count; i++) {
+                uint32_t c = in16[i], a = format == D3DFMT_X1R5G5B5 || c >> 15 ? 0xFF000000u : 0;
+                argb[i] = a | expand5(c >> 10 & 0x1F) << 16 | expand5(c >> 5 & 0x1F) << 8 | expand5(c & 0x1F);
+            }
+            break;
+        case D3DFMT_X4R4G4B4:
+        case D3DFMT_A4R4G4B4:
+            for (; i < count; i++) {
+                uint32_t c = in16[i], a = format == D3DFMT_X4R4G4B4 ? 0xFF : expand4(c >> 12);
+                argb[i] = a << 24 | expand4(c >> 8 & 0xF) << 16 | expand4(c >> 4 & 0xF) << 8 | expand4(c & 0xF);
+            }
+            break;
+        case D3DFMT_A8:
+            for (; i < count; i++) argb[i] = (uint32_t)in8[i] << 24;
+            break;
+        case D3DFMT_L8:
+            for (; i < count; i++) argb[i] = 0xFF000000u | in8[i] * 0x010101u;
+            break;
+        case D3DFMT_A8L8:
+            for (; i < count; i++) argb[i] = (uint32_t)(in16[i] >> 8) << 24 | (in16[i] & 0xFF) * 0x010101u;
+            break;
+        case D3DFMT_P8:
+            for (; i < count; i++) {
+                const PALETTEENTRY *e = &palette[in8[i]];
+                argb[i] = (uint32_t)e->peFlags << 24 | (uint32_t)e->peRed << 16 | (uint32_t)e->peGreen << 8 | e->peBlue;
+            }
+            break;
+        default: memset(argb, 0, (size_t)count * 4); break;
+    }
+}
+
+// acc[i] += row[i] for every byte
+static void accumulate_row(uint32_t *acc, const BYTE *row, size_t count) {
+    size_t i = 0;
+#if defined(D3D8_GLES_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(row + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+        __m128i *a = (__m128i *)(acc + i);
+        _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), _mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_si128(a + 2, _mm_add_epi32(_mm_loadu_si128(a + 2), _mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_si128(a + 3, _mm_add_epi32(_mm_loadu_si128(a + 3), _mm_unpackhi_epi16(hi, zero)));
+    }
+#elif defined(D3D8_GLES_NEON)
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t v = vld1q_u8(row + i);
+        uint16x8_t lo = vmovl_u8(vget_low_u8(v)), hi = vmovl_u8(vget_high_u8(v));
+        vst1q_u32(acc + i, vaddw_u16(vld1q_u32(acc + i), vget_low_u16(lo)));
+        vst1q_u32(acc + i + 4, vaddw_u16(vld1q_u32(acc + i + 4), vget_high_u16(lo)));
+        vst1q_u32(acc + i + 8, vaddw_u16(vld1q_u32(acc + i + 8), vget_low_u16(hi)));
+        vst1q_u32(acc + i + 12, vaddw_u16(vld1q_u32(acc + i + 12), vget_high_u16(hi)));
+    }
+#endif
+    for (; i < count; i++) acc[i] += row[i];
+}
+
+enum { CONVERT_NONE, CONVERT_POINT, CONVERT_LINEAR, CONVERT_BOX };
+
+typedef struct {
+    const GLES_PixelRect *src;
+    const PALETTEENTRY *palette;
+    const GLES_PixelRect *dst;
+    int mode;
+    uint32_t color_key;
+    const UINT *taps;   // per destination column: POINT 1, LINEAR 3, BOX 2 entries
+    atomic_int failed;
+} ConvertJob;
+
+static void convert_fetch(const ConvertJob *job, UINT y, uint32_t *argb) {
+    const GLES_PixelRect *src = job->src;
+    image_fetch_argb(src->format, src->bits + (size_t)y * src->pitch, src->width, job->palette, argb);
+    if (job->color_key) image_color_key(argb, src->width, job->color_key);
+}
+
+// Destination rows [begin, end): source rows are fetched as ARGB when first
+// needed, filtered, and stored in the destination format row by row
+static void convert_rows(void *ctx, size_t begin, size_t end) {
+    ConvertJob *job = ctx;
+    const GLES_PixelRect *src = job->src, *dst = job->dst;
+    const size_t src_count = (size_t)src->width * 4;
+    // Two fetched source rows, the box filter's per-channel sums and one
+    // destination row
+    uint32_t *rows = malloc((2 * src->width + src_count + dst->width) * sizeof(uint32_t));
+    int16_t *lerped = malloc(src_count * sizeof(int16_t));
+    if (!rows || !lerped) {
+        atomic_store(&job->failed, 1);
+        free(rows);
+        free(lerped);
+        return;
+    }
+    uint32_t *row[2] = {rows, rows + src->width};
+    uint32_t *acc = rows + 2 * src->width;
+    uint32_t *out = acc + src_count;
+    long cached[2] = {-1, -1};
+    for (size_t y = begin; y < end; y++) {
+        switch (job->mode) {
+            case CONVERT_NONE: {
+                UINT copied = y < src->height ? (src->width < dst->width ? src->width : dst->width) : 0;
+                if (copied) convert_fetch(job, (UINT)y, row[0]);
+                memcpy(out, row[0], (size_t)copied * 4);
+                memset(out + copied, 0, (size_t)(dst->width - copied) * 4);
+                break;
+            }
+            case CONVERT_POINT: {
+                UINT sy = (UINT)((2 * (uint64_t)y + 1) * src->height / (2 * dst->height));
+                if (cached[0] != (long)sy) convert_fetch(job, sy, row[0]);
+                cached[0] = sy;
+                for (UINT x = 0; x < dst->width; x++) out[x] = row[0][job->taps[x]];
+                break;
+            }
+            case CONVERT_LINEAR: {
+                UINT y0, y1;
+                int wy;
+                bilinear_tap(src->height, dst->height, (UINT)y, &y0, &y1, &wy);
+                if (cached[1] == (long)y0) {
+                    uint32_t *t = row[0];
+                    row[0] = row[1];
+                    row[1] = t;
+                    cached[0] = cached[1];
+                    cached[1] = -1;
+                }
+                if (cached[0] != (long)y0) convert_fetch(job, y0, row[0]);
+                cached[0] = y0;
+                if (cached[1] != (long)y1) convert_fetch(job, y1, row[1]);
+                cached[1] = y1;
+                lerp_rows((const BYTE *)row[0], (const BYTE *)row[1], src_count, wy, lerped);
+                BYTE *o = (BYTE *)out;
+                for (UINT x = 0; x < dst->width; x++) {
+                    const UINT *tap = job->taps + 3 * x;
+                    const int16_t *p0 = lerped + tap[0] * 4, *p1 = lerped + tap[1] * 4;
+                    int wx = (int)tap[2];
+                    for (int c = 0; c < 4; c++) o[4 * x + c] = (BYTE)(p0[c] + ((p1[c] - p0[c]) * wx >> 7));
+                }
+                break;
+            }
+            default: {
+                // Each source row and column belongs to exactly one
+                // destination texel, so the footprints tile the source
+                UINT sy0 = (UINT)((uint64_t)y * src->height / dst->height);
+                UINT sy1 = (UINT)((uint64_t)(y + 1) * src->height / dst->height);
+                memset(acc, 0, src_count * sizeof(uint32_t));
+                for (UINT sy = sy0; sy < sy1; sy++) {
+                    convert_fetch(job, sy, row[0]);
+                    accumulate_row(acc, (const BYTE *)row[0], src_count);
+                }
+                BYTE *o = (BYTE *)out;
+                for (UINT x = 0; x < dst->width; x++) {
+                    UINT sx0 = job->taps[2 * x], sx1 = job->taps[2 * x + 1];
+                    uint32_t n = (sx1 - sx0) * (sy1 - sy0), sum[4] = {0, 0, 0, 0};
+                    for (UINT sx = sx0; sx < sx1; sx++)
+                        for (int c = 0; c < 4; c++) sum[c] += acc[sx * 4 + c];
+                    for (int c = 0; c < 4; c++) o[4 * x + c] = (BYTE)((sum[c] + n / 2) / n);
+                }
+                break;
+            }
+        }
+        store_row(dst->format, out, dst->width, dst->bits + y * dst->pitch);
+    }
+    free(lerped);
+    free(rows);
+}
+
+HRESULT image_convert(const GLES_PixelRect *src, const PALETTEENTRY *palette, const GLES_PixelRect *dst, DWORD filter,
+                      D3DCOLOR color_key, GLES_WorkerPool *pool) {
+    if (!src->width || !src->height || !dst->width || !dst->height || !image_can_fetch(src->format) ||
+        !image_can_store(dst->format) || (src->format == D3DFMT_P8 && !palette))
+        return D3DERR_INVALIDCALL;
+    ConvertJob job = {.src = src, .palette = palette, .dst = dst, .color_key = (uint32_t)color_key};
+    BOOL shrink = dst->width <= src->width && dst->height <= src->height;
+    switch (filter == D3DX_DEFAULT ? D3DX_FILTER_TRIANGLE : filter & 0xFF) {
+        case D3DX_FILTER_NONE: job.mode = CONVERT_NONE; break;
+        case D3DX_FILTER_POINT: job.mode = CONVERT_POINT; break;
+        case D3DX_FILTER_LINEAR: job.mode = CONVERT_LINEAR; break;
+        // Averaging footprints only works one way; enlarging interpolates
+        case D3DX_FILTER_TRIANGLE:
+        case D3DX_FILTER_BOX: job.mode = shrink ? CONVERT_BOX : CONVERT_LINEAR; break;
+        default: return D3DERR_INVALIDCALL;
+    }
+    // Same size needs no filter at all
+    if (job.mode != CONVERT_NONE && dst->width == src->width && dst->height == src->height) job.mode = CONVERT_POINT;
+    UINT *taps = malloc((size_t)dst->width * 3 * sizeof(UINT));
+    if (!taps) return D3DERR_OUTOFVIDEOMEMORY;
+    for (UINT x = 0; x < dst->width; x++) {
+        if (job.mode == CONVERT_POINT) {
+            taps[x] = (UINT)((2 * (uint64_t)x + 1) * src->width / (2 * dst->width));
+        } else if (job.mode == CONVERT_LINEAR) {
+            int weight;
+            bilinear_tap(src->width, dst->width, x, &taps[3 * x], &taps[3 * x + 1], &weight);
+            taps[3 * x + 2] = (UINT)weight;
+        } else if (job.mode == CONVERT_BOX) {
+            taps[2 * x] = (UINT)((uint64_t)x * src->width / dst->width);
+            taps[2 * x + 1] = (UINT)((uint64_t)(x + 1) * src->width / dst->width);
+        }
+    }
+    job.taps = taps;
+    // About 32K source and destination texels per chunk
+    size_t grain = 32768 / ((size_t)src->width + dst->width) + 1;
+    workers_run(dst->height > grain ? pool : NULL, dst->height, grain, convert_rows, &job);
+    free(taps);
+    return atomic_load(&job.failed) ? D3DERR_OUTOFVIDEOMEMORY : D3D_OK;
+}
+
+HRESULT image_map_file(const char *path, GLES_FileView *view) {
+    memset(view, 0, sizeof(*view));
+    if (!path) return D3DERR_INVALIDCALL;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return D3DERR_NOTFOUND;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            // The decoders read each level front to back
+            posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+            view->data = data;
+            view->size = (size_t)st.st_size;
+            view->mapped = TRUE;
+        }
+    }
+    if (!view->mapped) {
+        // Pipes and file systems without mmap are read instead
+        FILE *file = fdopen(fd, "rb");
+        size_t capacity = 0;
+        BYTE *data = NULL;
+        while (file && !ferror(file) && !feof(file)) {
+            if (view->size == capacity) {
+                BYTE *grown = realloc(data, capacity = capacity ? capacity * 2 : 65536);
+                if (!grown) break;
+                data = grown;
+            }
+            view->size += fread(data + view->size, 1, capacity - view->size, file);
+        }
+        BOOL complete = file && feof(file);
+        if (file) fclose(file); else close(fd);
+        view->data = data;
+        if (!complete || !view->size) {
+            image_unmap_file(view);
+            return D3DXERR_INVALIDDATA;
+        }
+        return D3D_OK;
+    }
+    close(fd);
+    return D3D_OK;
+}
+
+void image_unmap_file(GLES_FileView *view) {
+    if (view->mapped)
+        munmap((void *)view->data, view->size);
+    else
+        free((void *)view->data);
+    memset(view, 0, sizeof(*view));
+}
@@ -0,0 +1,91 @@
+// src/d3d8_image.h
+#ifndef D3D8_IMAGE_H
+#define D3D8_IMAGE_H
+
+#include "d3d8_to_gles.h"
+#include "d3d8_workers.h"
+
+typedef enum { IMAGE_BMP, IMAGE_TGA, IMAGE_DDS } GLES_ImageKind;
+
+// A parsed BMP, TGA or DDS file. Pixel data stays in the caller's buffer.
+typedef struct {
+    GLES_ImageKind kind;
+    UINT width, height, levels;
+    BOOL alpha;         // the file stores an alpha channel
+    D3DFORMAT format;   // DXT1-DXT5 for compressed DDS, D3DFMT_UNKNOWN otherwise
+    const BYTE *pixels; // first row (or block) of level 0
+    const BYTE *end;
+    UINT bpp;             // bits per stored texel for uncompressed images
+    BOOL bottom_up;       // rows are stored last to first
+    BOOL rle;             // TGA run-length packets
+    const BYTE *colormap; // BGRX quads for 8-bit BMPs
+    UINT colors;
+    uint32_t masks[4]; // R, G, B, A bit masks; zero masks leave the channel 0 (alpha 255)
+} GLES_ImageInfo;
+
+// Recognizes the file and validates that its data covers every level.
+// Returns D3DXERR_INVALIDDATA for unknown or truncated files.
+HRESULT image_parse(const void *data, size_t size, GLES_ImageInfo *info);
+
+// Expands `level` to A8R8G8B8 rows `pitch` bytes apart
+HRESULT image_decode_argb(const GLES_ImageInfo *info, UINT level, void *dst, size_t pitch);
+
+// Fills a D3DXIMAGE_INFO with what the file stores
+void image_describe(const GLES_ImageInfo *info, D3DXIMAGE_INFO *desc);
+
+// Copies `level`'s DXT blocks, one row of blocks every `pitch` bytes
+HRESULT image_copy_blocks(const GLES_ImageInfo *info, UINT level, void *dst, size_t pitch);
+
+// Whether image_load can write `format` texels
+BOOL image_can_store(D3DFORMAT format);
+
+// Decodes `level` into `format` texels rows `pitch` bytes apart, scaled to
+// width x height with the D3DX_FILTER_* in `filter`. Texels equal to a
+// non-zero `color_key` become transparent black. 32-bit ARGB levels that
+// need no scaling decode straight into `dst`.
+HRESULT image_load(const GLES_ImageInfo *info, UINT level, D3DFORMAT format, UINT width, UINT height, DWORD filter,
+                   D3DCOLOR color_key, void *dst, size_t pitch);
+
+// Texel kernels
+// Packs `count` A8R8G8B8 texels into a row of an image_can_store format
+void image_store_argb(D3DFORMAT format, const uint32_t *argb, UINT count, void *dst);
+void image_color_key(uint32_t *texels, size_t count, uint32_t key);
+void image_resample_argb(const uint32_t *src, UINT src_width, UINT src_height, uint32_t *dst, UINT width,
+                         UINT height, DWORD filter);
+
+// Texels of some D3D format, `pitch` bytes from one row to the next
+typedef struct {
+    D3DFORMAT format;
+    BYTE *bits;
+    size_t pitch;
+    UINT width, height;
+} GLES_PixelRect;
+
+// Whether image_fetch_argb can read `format` texels: every image_can_store
+// format, R8G8B8, and P8 through a palette
+BOOL image_can_fetch(D3DFORMAT format);
+void image_fetch_argb(D3DFORMAT format, const void *src, UINT count, const PALETTEENTRY *palette, uint32_t *argb);
+// Bytes per texel of an image_can_fetch format, 0 for others
+UINT image_texel_size(D3DFORMAT format);
+
+// Scales `src` to the size of `dst` with a D3DX_FILTER_* filter and converts
+// it to `dst`'s format in the same pass, a band of rows per worker. Source
+// texels equal to a non-zero `color_key` become transparent black. LINEAR
+// interpolates; BOX and TRIANGLE average each destination texel's footprint
+// when shrinking and interpolate when enlarging.
+HRESULT image_convert(const GLES_PixelRect *src, const PALETTEENTRY *palette, const GLES_PixelRect *dst, DWORD filter,
+                      D3DCOLOR color_key, GLES_WorkerPool *pool);
+
+// A whole file, read-only: memory-mapped where the platform allows, read
+// into memory otherwise
+typedef struct {
+    const BYTE *data;
+    size_t size;
+    BOOL mapped;
+} GLES_FileView;
+
+// D3DERR_NOTFOUND when the file cannot be opened
+HRESULT image_map_file(const char *path, GLES_FileView *view);
+void image_unmap_file(GLES_FileView *view);
+
+#endif // D3D8_IMAGE_H
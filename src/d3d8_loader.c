@@ -0,0 +1,214 @@
+// src/d3d8_loader.c
+#include "d3d8_loader.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define LOADER_MAX_DECODE_THREADS 4
+
+enum { LOAD_QUEUED, LOAD_DECODING, LOAD_DECODED, LOAD_UPLOADING, LOAD_DONE };
+
+typedef struct {
+    GLES_LoadJob *head;
+    GLES_LoadJob *tail;
+} LoadQueue;
+
+struct GLES_Loader {
+    pthread_mutex_t mutex;
+    pthread_cond_t decode_ready;    // jobs to decode, or shutting down
+    pthread_cond_t upload_ready;    // jobs to upload, or shutting down
+    pthread_cond_t finished;        // some job reached LOAD_DONE
+    LoadQueue decode_queue;
+    LoadQueue upload_queue;
+    unsigned decoding;              // jobs a decode thread is working on
+    int shutdown;
+    int started;                    // 1 once the upload thread has its context, -1 if it failed
+    EGLDisplay display;
+    EGLSurface surface;
+    EGLContext context;
+    pthread_t decoders[LOADER_MAX_DECODE_THREADS];
+    unsigned decoder_count;
+    pthread_t uploader;
+};
+
+static void queue_push(LoadQueue *queue, GLES_LoadJob *job) {
+    job->next = NULL;
+    if (queue->tail)
+        queue->tail->next = job;
+    else
+        queue->head = job;
+    queue->tail = job;
+}
+
+static GLES_LoadJob *queue_pop(LoadQueue *queue) {
+    GLES_LoadJob *job = queue->head;
+    if (job) {
+        queue->head = job->next;
+        if (!queue->head) queue->tail = NULL;
+    }
+    return job;
+}
+
+static BOOL queue_remove(LoadQueue *queue, GLES_LoadJob *job) {
+    GLES_LoadJob *prev = NULL;
+    for (GLES_LoadJob *it = queue->head; it; prev = it, it = it->next) {
+        if (it != job) continue;
+        if (prev)
+            prev->next = it->next;
+        else
+            queue->head = it->next;
+        if (queue->tail == it) queue->tail = prev;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+// Called with the mutex held
+static void job_finish(GLES_Loader *loader, GLES_LoadJob *job) {
+    atomic_store(&job->state, LOAD_DONE);
+    pthread_cond_broadcast(&loader->finished);
+}
+
+static void *decoder_main(void *arg) {
+    GLES_Loader *loader = arg;
+    pthread_mutex_lock(&loader->mutex);
+    for (;;) {
+        while (!loader->decode_queue.head && !loader->shutdown)
+            pthread_cond_wait(&loader->decode_ready, &loader->mutex);
+        GLES_LoadJob *job = queue_pop(&loader->decode_queue);
+        if (!job) break;
+        atomic_store(&job->state, LOAD_DECODING);
+        loader->decoding++;
+        pthread_mutex_unlock(&loader->mutex);
+        job->decode(job);
+        pthread_mutex_lock(&loader->mutex);
+        loader->decoding--;
+        if (job->cancelled) {
+            job_finish(loader, job);
+        } else {
+            atomic_store(&job->state, LOAD_DECODED);
+            queue_push(&loader->upload_queue, job);
+        }
+        pthread_cond_signal(&loader->upload_ready);
+    }
+    pthread_mutex_unlock(&loader->mutex);
+    return NULL;
+}
+
+static void *uploader_main(void *arg) {
+    GLES_Loader *loader = arg;
+    BOOL current = eglMakeCurrent(loader->display, loader->surface, loader->surface, loader->context);
+    pthread_mutex_lock(&loader->mutex);
+    loader->started = current ? 1 : -1;
+    pthread_cond_broadcast(&loader->finished);
+    while (current) {
+        // Shutting down waits for jobs still being decoded
+        while (!loader->upload_queue.head &&
+               !(loader->shutdown && !loader->decode_queue.head && !loader->decoding))
+            pthread_cond_wait(&loader->upload_ready, &loader->mutex);
+        GLES_LoadJob *job = queue_pop(&loader->upload_queue);
+        if (!job) break;
+        atomic_store(&job->state, LOAD_UPLOADING);
+        pthread_mutex_unlock(&loader->mutex);
+        job->upload(job);
+        if (job->complete) job->complete(job);
+        pthread_mutex_lock(&loader->mutex);
+        job_finish(loader, job);
+    }
+    pthread_mutex_unlock(&loader->mutex);
+    if (current) eglMakeCurrent(loader->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglReleaseThread();
+    return NULL;
+}
+
+GLES_Loader *loader_create(EGLDisplay display, EGLSurface surface, EGLContext context, unsigned decode_threads) {
+    if (!decode_threads) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        decode_threads = cpus > 1 ? (unsigned)cpus - 1 : 1;
+    }
+    if (decode_threads > LOADER_MAX_DECODE_THREADS) decode_threads = LOADER_MAX_DECODE_THREADS;
+    GLES_Loader *loader = calloc(1, sizeof(GLES_Loader));
+    if (!loader) return NULL;
+    pthread_mutex_init(&loader->mutex, NULL);
+    pthread_cond_init(&loader->decode_ready, NULL);
+    pthread_cond_init(&loader->upload_ready, NULL);
+    pthread_cond_init(&loader->finished, NULL);
+    loader->display = display;
+    loader->surface = surface;
+    loader->context = context;
+    if (pthread_create(&loader->uploader, NULL, uploader_main, loader) != 0) {
+        loader->started = -1;
+    } else {
+        pthread_mutex_lock(&loader->mutex);
+        while (!loader->started) pthread_cond_wait(&loader->finished, &loader->mutex);
+        pthread_mutex_unlock(&loader->mutex);
+        if (loader->started < 0) pthread_join(loader->uploader, NULL);
+    }
+    for (unsigned i = 0; loader->started > 0 && i < decode_threads; i++) {
+        if (pthread_create(&loader->decoders[i], NULL, decoder_main, loader) != 0) break;
+        loader->decoder_count++;
+    }
+    if (loader->started < 0 || !loader->decoder_count) {
+        if (loader->started > 0) {
+            loader_destroy(loader);
+            return NULL;
+        }
+        pthread_cond_destroy(&loader->finished);
+        pthread_cond_destroy(&loader->upload_ready);
+        pthread_cond_destroy(&loader->decode_ready);
+        pthread_mutex_destroy(&loader->mutex);
+        free(loader);
+        return NULL;
+    }
+    return loader;
+}
+
+void loader_destroy(GLES_Loader *loader) {
+    if (!loader) return;
+    pthread_mutex_lock(&loader->mutex);
+    loader->shutdown = 1;
+    pthread_cond_broadcast(&loader->decode_ready);
+    pthread_cond_broadcast(&loader->upload_ready);
+    pthread_mutex_unlock(&loader->mutex);
+    for (unsigned i = 0; i < loader->decoder_count; i++) pthread_join(loader->decoders[i], NULL);
+    // With no decoder left, the upload thread drains the queue and exits
+    pthread_mutex_lock(&loader->mutex);
+    pthread_cond_signal(&loader->upload_ready);
+    pthread_mutex_unlock(&loader->mutex);
+    pthread_join(loader->uploader, NULL);
+    pthread_cond_destroy(&loader->finished);
+    pthread_cond_destroy(&loader->upload_ready);
+    pthread_cond_destroy(&loader->decode_ready);
+    pthread_mutex_destroy(&loader->mutex);
+    free(loader);
+}
+
+void loader_submit(GLES_Loader *loader, GLES_LoadJob *job) {
+    job->cancelled = FALSE;
+    atomic_store(&job->state, LOAD_QUEUED);
+    pthread_mutex_lock(&loader->mutex);
+    queue_push(&loader->decode_queue, job);
+    pthread_cond_signal(&loader->decode_ready);
+    pthread_mutex_unlock(&loader->mutex);
+}
+
+BOOL loader_done(const GLES_LoadJob *job) { return atomic_load(&job->state) == LOAD_DONE; }
+
+void loader_wait(GLES_Loader *loader, GLES_LoadJob *job) {
+    if (loader_done(job)) return;
+    pthread_mutex_lock(&loader->mutex);
+    while (!loader_done(job)) pthread_cond_wait(&loader->finished, &loader->mutex);
+    pthread_mutex_unlock(&loader->mutex);
+}
+
+void loader_cancel(GLES_Loader *loader, GLES_LoadJob *job) {
+    if (loader_done(job)) return;
+    pthread_mutex_lock(&loader->mutex);
+    if (queue_remove(&loader->decode_queue, job) || queue_remove(&loader->upload_queue, job))
+        job_finish(loader, job);
+    else
+        job->cancelled = TRUE;
+    while (!loader_done(job)) pthread_cond_wait(&loader->finished, &loader->mutex);
+    pthread_mutex_unlock(&loader->mutex);
+}
@@ -0,0 +1,46 @@
+// src/d3d8_loader.h
+#ifndef D3D8_LOADER_H
+#define D3D8_LOADER_H
+
+#include "d3d8_to_gles.h"
+
+// Background texture loads: decode threads do the CPU work, then a single
+// upload thread with its own EGL context, sharing objects with the device's,
+// hands the results to GL. The device thread never waits unless asked to.
+typedef struct GLES_Loader GLES_Loader;
+typedef struct GLES_LoadJob GLES_LoadJob;
+
+typedef void (*GLES_LoadFn)(GLES_LoadJob *job);
+
+// Embedded in the caller's own job structure
+struct GLES_LoadJob {
+    GLES_LoadFn decode;         // on a decode thread
+    GLES_LoadFn upload;         // on the upload thread, with its context current
+    GLES_LoadFn complete;       // on the upload thread, after upload; skipped for cancelled jobs
+    // Owned by the loader
+    GLES_LoadJob *next;
+    _Atomic BOOL cancelled;
+    _Atomic int state;
+};
+
+// Starts `decode_threads` decoders (0 picks one per spare CPU, at most 4)
+// and the upload thread, which makes `context` current on `surface`
+// (EGL_NO_SURFACE where surfaceless contexts are supported). Returns NULL
+// when the context cannot be made current there.
+GLES_Loader *loader_create(EGLDisplay display, EGLSurface surface, EGLContext context, unsigned decode_threads);
+
+// Finishes every submitted job, then stops the threads
+void loader_destroy(GLES_Loader *loader);
+
+void loader_submit(GLES_Loader *loader, GLES_LoadJob *job);
+
+// Whether every step of the job has run. Never blocks.
+BOOL loader_done(const GLES_LoadJob *job);
+
+void loader_wait(GLES_Loader *loader, GLES_LoadJob *job);
+
+// Drops the steps of the job that have not started and waits for the one
+// running, if any. `complete` does not run unless it already has.
+void loader_cancel(GLES_Loader *loader, GLES_LoadJob *job);
+
+#endif // D3D8_LOADER_H
@@ -0,0 +1,15 @@
+// src/d3d8_simd.h
+#ifndef D3D8_SIMD_H
+#define D3D8_SIMD_H
+
+// Vector paths the texel kernels may take: SSE2 on x86-64 and wherever the
+// compiler enables it, NEON on ARM. With neither, the scalar code runs.
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define D3D8_GLES_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define D3D8_GLES_NEON 1
+#endif
+
+#endif // D3D8_SIMD_H
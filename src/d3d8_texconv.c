@@ -0,0 +1,195 @@
+// src/d3d8_texconv.c
+#include "d3d8_texconv.h"
+#include "d3d8_dxt.h"
+#include "d3d8_etc1.h"
+#include "d3d8_simd.h"
+#include <stdint.h>
+
+// D3D 32-bit formats are little-endian 0xAARRGGBB words, i.e. B, G, R, A in
+// memory. GL_RGBA wants R, G, B, A: swap the red and blue bytes, optionally
+// forcing alpha for the X8 formats.
+static void swap_red_blue(uint32_t *dst, const uint32_t *src, size_t count, uint32_t alpha) {
+    size_t i = 0;
+#if defined(D3D8_GLES_SSE2)
+    const __m128i green_alpha = _mm_set1_epi32((int)0xFF00FF00u);
+    const __m128i red_blue = _mm_set1_epi32(0x00FF00FF);
+    const __m128i alpha4 = _mm_set1_epi32((int)alpha);
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i rb = _mm_and_si128(v, red_blue);
+        rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+        v = _mm_or_si128(_mm_or_si128(_mm_and_si128(v, green_alpha), rb), alpha4);
+        _mm_storeu_si128((__m128i *)(dst + i), v);
+    }
+#elif defined(D3D8_GLES_NEON)
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x4_t v = vld4q_u8((const uint8_t *)(src + i));
+        uint8x16_t blue = v.val[0];
+        v.val[0] = v.val[2];
+        v.val[2] = blue;
+        if (alpha) v.val[3] = vdupq_n_u8(0xFF);
+        vst4q_u8((uint8_t *)(dst + i), v);
+    }
+#endif
+    for (; i < count; i++) {
+        uint32_t c = src[i];
+        dst[i] = (c & 0xFF00FF00u) | (c & 0xFFu) << 16 | (c >> 16 & 0xFFu) | alpha;
+    }
+}
+
+void texconv_a8r8g8b8_to_rgba(void *dst, const void *src, size_t count) {
+    swap_red_blue(dst, src, count, 0);
+}
+
+void texconv_x8r8g8b8_to_rgba(void *dst, const void *src, size_t count) {
+    swap_red_blue(dst, src, count, 0xFF000000u);
+}
+
+// BGRA storage matches the D3D byte order; only the X channel needs fixing
+void texconv_x8r8g8b8_to_bgra(void *dst, const void *src, size_t count) {
+    uint32_t *d = dst;
+    const uint32_t *s = src;
+    size_t i = 0;
+#if defined(D3D8_GLES_SSE2)
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000u);
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_si128((__m128i *)(d + i), _mm_or_si128(_mm_loadu_si128((const __m128i *)(s + i)), alpha));
+#elif defined(D3D8_GLES_NEON)
+    const uint32x4_t alpha = vdupq_n_u32(0xFF000000u);
+    for (; i + 4 <= count; i += 4) vst1q_u32(d + i, vorrq_u32(vld1q_u32(s + i), alpha));
+#endif
+    for (; i < count; i++) d[i] = s[i] | 0xFF000000u;
+}
+
+// D3D 16-bit formats keep alpha in the top bits, GL's 5_5_5_1 and 4_4_4_4
+// types in the bottom ones: rotate each texel left by the alpha width.
+// `fill` forces the alpha bits of the X formats.
+static void rotate_texels16(uint16_t *dst, const uint16_t *src, size_t count, int shift, uint16_t fill) {
+    size_t i = 0;
+#if defined(D3D8_GLES_SSE2)
+    const __m128i left = _mm_cvtsi32_si128(shift);
+    const __m128i right = _mm_cvtsi32_si128(16 - shift);
+    const __m128i fill8 = _mm_set1_epi16((short)fill);
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        v = _mm_or_si128(_mm_or_si128(_mm_sll_epi16(v, left), _mm_srl_epi16(v, right)), fill8);
+        _mm_storeu_si128((__m128i *)(dst + i), v);
+    }
+#elif defined(D3D8_GLES_NEON)
+    const int16x8_t left = vdupq_n_s16((int16_t)shift);
+    const int16x8_t right = vdupq_n_s16((int16_t)(shift - 16));
+    const uint16x8_t fill8 = vdupq_n_u16(fill);
+    for (; i + 8 <= count; i += 8) {
+        uint16x8_t v = vld1q_u16(src + i);
+        vst1q_u16(dst + i, vorrq_u16(vorrq_u16(vshlq_u16(v, left), vshlq_u16(v, right)), fill8));
+    }
+#endif
+    for (; i < count; i++) dst[i] = (uint16_t)(src[i] << shift | src[i] >> (16 - shift) | fill);
+}
+
+void texconv_a1r5g5b5_to_rgba5551(void *dst, const void *src, size_t count) {
+    rotate_texels16(dst, src, count, 1, 0);
+}
+
+void texconv_x1r5g5b5_to_rgba5551(void *dst, const void *src, size_t count) {
+    rotate_texels16(dst, src, count, 1, 0x1);
+}
+
+void texconv_a4r4g4b4_to_rgba4444(void *dst, const void *src, size_t count) {
+    rotate_texels16(dst, src, count, 4, 0);
+}
+
+void texconv_x4r4g4b4_to_rgba4444(void *dst, const void *src, size_t count) {
+    rotate_texels16(dst, src, count, 4, 0xF);
+}
+
+// The swaps and rotations undone, for reading managed copies back
+void texconv_rgba_to_a8r8g8b8(void *dst, const void *src, size_t count) {
+    swap_red_blue(dst, src, count, 0);
+}
+
+void texconv_rgba5551_to_a1r5g5b5(void *dst, const void *src, size_t count) {
+    rotate_texels16(dst, src, count, 15, 0);
+}
+
+void texconv_rgba4444_to_a4r4g4b4(void *dst, const void *src, size_t count) {
+    rotate_texels16(dst, src, count, 12, 0);
+}
+
+// R5G6B5 matches GL_UNSIGNED_SHORT_5_6_5, and L8, A8 and A8L8 match GL's
+// luminance/alpha layouts byte for byte, so they upload without conversion.
+static const GLES_TextureFormat rgba_formats[] = {
+    {.d3d_format = D3DFMT_A8R8G8B8, .gl_format = GL_RGBA, .gl_type = GL_UNSIGNED_BYTE, .texel_size = 4,
+     .convert = texconv_a8r8g8b8_to_rgba, .revert = texconv_rgba_to_a8r8g8b8},
+    {.d3d_format = D3DFMT_X8R8G8B8, .gl_format = GL_RGBA, .gl_type = GL_UNSIGNED_BYTE, .texel_size = 4,
+     .convert = texconv_x8r8g8b8_to_rgba, .revert = texconv_rgba_to_a8r8g8b8},
+    {.d3d_format = D3DFMT_R5G6B5, .gl_format = GL_RGB, .gl_type = GL_UNSIGNED_SHORT_5_6_5, .texel_size = 2},
+    {.d3d_format = D3DFMT_X1R5G5B5, .gl_format = GL_RGBA, .gl_type = GL_UNSIGNED_SHORT_5_5_5_1, .texel_size = 2,
+     .convert = texconv_x1r5g5b5_to_rgba5551, .revert = texconv_rgba5551_to_a1r5g5b5},
+    {.d3d_format = D3DFMT_A1R5G5B5, .gl_format = GL_RGBA, .gl_type = GL_UNSIGNED_SHORT_5_5_5_1, .texel_size = 2,
+     .convert = texconv_a1r5g5b5_to_rgba5551, .revert = texconv_rgba5551_to_a1r5g5b5},
+    {.d3d_format = D3DFMT_A4R4G4B4, .gl_format = GL_RGBA, .gl_type = GL_UNSIGNED_SHORT_4_4_4_4, .texel_size = 2,
+     .convert = texconv_a4r4g4b4_to_rgba4444, .revert = texconv_rgba4444_to_a4r4g4b4},
+    {.d3d_format = D3DFMT_X4R4G4B4, .gl_format = GL_RGBA, .gl_type = GL_UNSIGNED_SHORT_4_4_4_4, .texel_size = 2,
+     .convert = texconv_x4r4g4b4_to_rgba4444, .revert = texconv_rgba4444_to_a4r4g4b4},
+    {.d3d_format = D3DFMT_A8, .gl_format = GL_ALPHA, .gl_type = GL_UNSIGNED_BYTE, .texel_size = 1},
+    {.d3d_format = D3DFMT_L8, .gl_format = GL_LUMINANCE, .gl_type = GL_UNSIGNED_BYTE, .texel_size = 1},
+    {.d3d_format = D3DFMT_A8L8, .gl_format = GL_LUMINANCE_ALPHA, .gl_type = GL_UNSIGNED_BYTE, .texel_size = 2},
+    // Indices only; the palette is prepended when the device uploads the chain
+    {.d3d_format = D3DFMT_P8, .gl_format = GL_PALETTE8_RGBA8_OES, .texel_size = 1},
+    // DXT without driver support decodes to the smallest format that keeps
+    // its alpha: 1 bit for DXT1, 4 bits for DXT2/3, 8 bits for DXT4/5
+    {.d3d_format = D3DFMT_DXT1, .gl_format = GL_RGBA, .gl_type = GL_UNSIGNED_SHORT_5_5_5_1, .texel_size = 2,
+     .block_size = 8, .decode = dxt1_decode_rgba5551},
+    {.d3d_format = D3DFMT_DXT2, .gl_format = GL_RGBA, .gl_type = GL_UNSIGNED_SHORT_4_4_4_4, .texel_size = 2,
+     .block_size = 16, .decode = dxt3_decode_rgba4444},
+    {.d3d_format = D3DFMT_DXT3, .gl_format = GL_RGBA, .gl_type = GL_UNSIGNED_SHORT_4_4_4_4, .texel_size = 2,
+     .block_size = 16, .decode = dxt3_decode_rgba4444},
+    {.d3d_format = D3DFMT_DXT4, .gl_format = GL_RGBA, .gl_type = GL_UNSIGNED_BYTE, .texel_size = 4,
+     .block_size = 16, .decode = dxt5_decode_rgba8},
+    {.d3d_format = D3DFMT_DXT5, .gl_format = GL_RGBA, .gl_type = GL_UNSIGNED_BYTE, .texel_size = 4,
+     .block_size = 16, .decode = dxt5_decode_rgba8},
+    // ETC1 carries no alpha, so 565 keeps all of it
+    {.d3d_format = D3DFMT_ETC1, .gl_format = GL_RGB, .gl_type = GL_UNSIGNED_SHORT_5_6_5, .texel_size = 2,
+     .block_size = 8, .decode = etc1_decode_rgb565},
+};
+
+static const GLES_TextureFormat bgra_formats[] = {
+    {.d3d_format = D3DFMT_A8R8G8B8, .gl_format = GL_BGRA_EXT, .gl_type = GL_UNSIGNED_BYTE, .texel_size = 4},
+    {.d3d_format = D3DFMT_X8R8G8B8, .gl_format = GL_BGRA_EXT, .gl_type = GL_UNSIGNED_BYTE, .texel_size = 4,
+     .convert = texconv_x8r8g8b8_to_bgra},
+};
+
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT3_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT 0x83F2
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// DXT2 and DXT4 hold premultiplied colour but decode like DXT3 and DXT5
+static const struct {
+    DWORD cap;
+    GLES_TextureFormat format;
+} compressed_formats[] = {
+    {TEXCONV_DXT1, {.d3d_format = D3DFMT_DXT1, .gl_format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, .block_size = 8}},
+    {TEXCONV_DXT3, {.d3d_format = D3DFMT_DXT2, .gl_format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, .block_size = 16}},
+    {TEXCONV_DXT3, {.d3d_format = D3DFMT_DXT3, .gl_format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, .block_size = 16}},
+    {TEXCONV_DXT5, {.d3d_format = D3DFMT_DXT4, .gl_format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, .block_size = 16}},
+    {TEXCONV_DXT5, {.d3d_format = D3DFMT_DXT5, .gl_format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, .block_size = 16}},
+    {TEXCONV_ETC1, {.d3d_format = D3DFMT_ETC1, .gl_format = GL_ETC1_RGB8_OES, .block_size = 8}},
+};
+
+const GLES_TextureFormat *texconv_find_format(D3DFORMAT format, DWORD caps) {
+    for (size_t i = 0; i < sizeof(compressed_formats) / sizeof(compressed_formats[0]); i++) {
+        if (compressed_formats[i].format.d3d_format == format && (caps & compressed_formats[i].cap))
+            return &compressed_formats[i].format;
+    }
+    if (caps & TEXCONV_BGRA) {
+        for (size_t i = 0; i < sizeof(bgra_formats) / sizeof(bgra_formats[0]); i++) {
+            if (bgra_formats[i].d3d_format == format) return &bgra_formats[i];
+        }
+    }
+    for (size_t i = 0; i < sizeof(rgba_formats) / sizeof(rgba_formats[0]); i++) {
+        if (rgba_formats[i].d3d_format == format) return &rgba_formats[i];
+    }
+    return NULL;
+}
@@ -0,0 +1,32 @@
+// src/d3d8_texconv.h
+#ifndef D3D8_TEXCONV_H
+#define D3D8_TEXCONV_H
+
+#include "d3d8_to_gles.h"
+
+// Optional GL storage texconv_find_format may choose
+enum {
+    TEXCONV_BGRA = 1 << 0,      // GL_EXT_texture_format_BGRA8888
+    TEXCONV_DXT1 = 1 << 1,      // compressed DXT1
+    TEXCONV_DXT3 = 1 << 2,      // compressed DXT3, also used for DXT2
+    TEXCONV_DXT5 = 1 << 3,      // compressed DXT5, also used for DXT4
+    TEXCONV_ETC1 = 1 << 4,      // GL_OES_compressed_ETC1_RGB8_texture
+};
+
+// GL storage for `format`, or NULL when it cannot be sampled. `caps` is a
+// mask of TEXCONV_* storage to prefer when available.
+const GLES_TextureFormat *texconv_find_format(D3DFORMAT format, DWORD caps);
+
+// Texel kernels; `dst` may equal `src`
+void texconv_a8r8g8b8_to_rgba(void *dst, const void *src, size_t count);
+void texconv_x8r8g8b8_to_rgba(void *dst, const void *src, size_t count);
+void texconv_x8r8g8b8_to_bgra(void *dst, const void *src, size_t count);
+void texconv_a1r5g5b5_to_rgba5551(void *dst, const void *src, size_t count);
+void texconv_x1r5g5b5_to_rgba5551(void *dst, const void *src, size_t count);
+void texconv_a4r4g4b4_to_rgba4444(void *dst, const void *src, size_t count);
+void texconv_x4r4g4b4_to_rgba4444(void *dst, const void *src, size_t count);
+void texconv_rgba_to_a8r8g8b8(void *dst, const void *src, size_t count);
+void texconv_rgba5551_to_a1r5g5b5(void *dst, const void *src, size_t count);
+void texconv_rgba4444_to_a4r4g4b4(void *dst, const void *src, size_t count);
+
+#endif // D3D8_TEXCONV_H
@@ -0,0 +1,208 @@
+// src/d3d8_texenv.c
+#include "d3d8_texenv.h"
+#include <string.h>
+
+enum {
+    KEY_COLOROP,
+    KEY_COLORARG1,
+    KEY_COLORARG2,
+    KEY_COLORARG0,
+    KEY_ALPHAOP,
+    KEY_ALPHAARG1,
+    KEY_ALPHAARG2,
+    KEY_ALPHAARG0,
+};
+
+const D3DTEXTURESTAGESTATETYPE texenv_key_states[GLES_TEXENV_STATES] = {
+    D3DTSS_COLOROP, D3DTSS_COLORARG1, D3DTSS_COLORARG2, D3DTSS_COLORARG0,
+    D3DTSS_ALPHAOP, D3DTSS_ALPHAARG1, D3DTSS_ALPHAARG2, D3DTSS_ALPHAARG0,
+};
+
+DWORD texenv_stage_default(DWORD stage, D3DTEXTURESTAGESTATETYPE type) {
+    switch (type) {
+        case D3DTSS_COLOROP: return stage ? D3DTOP_DISABLE : D3DTOP_MODULATE;
+        case D3DTSS_ALPHAOP: return stage ? D3DTOP_DISABLE : D3DTOP_SELECTARG1;
+        case D3DTSS_COLORARG1:
+        case D3DTSS_ALPHAARG1: return D3DTA_TEXTURE;
+        case D3DTSS_COLORARG2:
+        case D3DTSS_ALPHAARG2:
+        case D3DTSS_COLORARG0:
+        case D3DTSS_ALPHAARG0:
+        case D3DTSS_RESULTARG: return D3DTA_CURRENT;
+        case D3DTSS_TEXCOORDINDEX: return stage;
+        default: return 0;
+    }
+}
+
+void texenv_build_key(const GLES_StateBlock *block, GLES_TexEnvProgram *program) {
+    memset(program->key, 0, sizeof(program->key));
+    program->textured = 0;
+    for (DWORD stage = 0; stage < GLES_MAX_TEXTURE_STAGES; stage++) {
+        const DWORD *states = block->texture_stage_states[stage];
+        uint32_t mask = block->texture_stage_state_mask[stage];
+        DWORD *key = program->key[stage];
+        for (UINT i = 0; i < GLES_TEXENV_STATES; i++) {
+            D3DTEXTURESTAGESTATETYPE type = texenv_key_states[i];
+            key[i] = mask & 1u << type ? states[type] : texenv_stage_default(stage, type);
+        }
+        // A disabled colour op ends the cascade, whatever follows it
+        if (key[KEY_COLOROP] == D3DTOP_DISABLE) {
+            memset(key, 0, sizeof(program->key[stage]));
+            break;
+        }
+        if (block->textures[stage]) program->textured |= 1u << stage;
+    }
+}
+
+uint32_t texenv_hash(const GLES_TexEnvProgram *program) {
+    // FNV-1a over the key
+    const BYTE *bytes = (const BYTE *)program->key;
+    uint32_t hash = 2166136261u ^ program->textured;
+    for (size_t i = 0; i < sizeof(program->key); i++) hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+// The colour or the alpha half of a combiner
+typedef struct {
+    GLenum *combine;
+    GLenum *src;
+    GLenum *operand;
+    GLfloat *scale;
+    BOOL alpha;
+} CombinerHalf;
+
+typedef enum { HALF_OK, HALF_BAD_OP, HALF_BAD_ARG } HalfResult;
+
+// Points `slot` at D3DTA argument `arg`
+static BOOL set_arg(CombinerHalf *half, UINT slot, DWORD arg) {
+    GLenum source;
+    switch (arg & D3DTA_SELECTMASK) {
+        case D3DTA_DIFFUSE: source = GL_PRIMARY_COLOR; break;
+        case D3DTA_CURRENT: source = GL_PREVIOUS; break;
+        case D3DTA_TEXTURE: source = GL_TEXTURE; break;
+        case D3DTA_TFACTOR: source = GL_CONSTANT; break;
+        // GL ES has no specular or temporary register to read
+        default: return FALSE;
+    }
+    GLenum operand = half->alpha || (arg & D3DTA_ALPHAREPLICATE) ? GL_SRC_ALPHA : GL_SRC_COLOR;
+    // Each ONE_MINUS_ operand follows its plain one
+    if (arg & D3DTA_COMPLEMENT) operand++;
+    half->src[slot] = source;
+    half->operand[slot] = operand;
+    return TRUE;
+}
+
+static void set_blend_alpha(CombinerHalf *half, GLenum source) {
+    half->src[2] = source;
+    half->operand[2] = GL_SRC_ALPHA;
+}
+
+static void pass_through(CombinerHalf *half) {
+    memset(half->src, 0, 3 * sizeof(GLenum));
+    memset(half->operand, 0, 3 * sizeof(GLenum));
+    *half->combine = GL_REPLACE;
+    *half->scale = 1.0f;
+    half->src[0] = GL_PREVIOUS;
+    half->operand[0] = half->alpha ? GL_SRC_ALPHA : GL_SRC_COLOR;
+}
+
+// Slots the op does not read stay 0, so switching never sends them
+static HalfResult compile_half(CombinerHalf *half, DWORD op, DWORD arg1, DWORD arg2, DWORD arg0) {
+    GLenum combine;
+    GLfloat scale = 1.0f;
+    BOOL binary = TRUE;
+    switch (op) {
+        case D3DTOP_SELECTARG1: combine = GL_REPLACE; binary = FALSE; break;
+        case D3DTOP_SELECTARG2: combine = GL_REPLACE; binary = FALSE; arg1 = arg2; break;
+        case D3DTOP_MODULATE: combine = GL_MODULATE; break;
+        case D3DTOP_MODULATE2X: combine = GL_MODULATE; scale = 2.0f; break;
+        case D3DTOP_MODULATE4X: combine = GL_MODULATE; scale = 4.0f; break;
+        case D3DTOP_ADD: combine = GL_ADD; break;
+        case D3DTOP_ADDSIGNED: combine = GL_ADD_SIGNED; break;
+        case D3DTOP_ADDSIGNED2X: combine = GL_ADD_SIGNED; scale = 2.0f; break;
+        case D3DTOP_SUBTRACT: combine = GL_SUBTRACT; break;
+        case D3DTOP_BLENDDIFFUSEALPHA: combine = GL_INTERPOLATE; set_blend_alpha(half, GL_PRIMARY_COLOR); break;
+        case D3DTOP_BLENDTEXTUREALPHA: combine = GL_INTERPOLATE; set_blend_alpha(half, GL_TEXTURE); break;
+        case D3DTOP_BLENDFACTORALPHA: combine = GL_INTERPOLATE; set_blend_alpha(half, GL_CONSTANT); break;
+        case D3DTOP_BLENDCURRENTALPHA: combine = GL_INTERPOLATE; set_blend_alpha(half, GL_PREVIOUS); break;
+        case D3DTOP_LERP:
+            combine = GL_INTERPOLATE;
+            if (!set_arg(half, 2, arg0)) return HALF_BAD_ARG;
+            break;
+        case D3DTOP_DOTPRODUCT3:
+            // Colour only; GL_DOT3_RGBA replicates into alpha like D3D does
+            if (half->alpha) return HALF_BAD_OP;
+            combine = GL_DOT3_RGBA;
+            break;
+        default:
+            // ADDSMOOTH, the premultiplied and MODULATE*_ADD* ops, bump
+            // mapping and MULTIPLYADD need more than one GL combiner
+            return HALF_BAD_OP;
+    }
+    if (!set_arg(half, 0, arg1) || (binary && !set_arg(half, 1, arg2))) return HALF_BAD_ARG;
+    *half->combine = combine;
+    *half->scale = scale;
+    return HALF_OK;
+}
+
+static BOOL reads_source(const GLES_Combiner *combiner, GLenum source) {
+    for (UINT i = 0; i < 3; i++) {
+        if (combiner->src_rgb[i] == source || combiner->src_alpha[i] == source) return TRUE;
+    }
+    return FALSE;
+}
+
+void texenv_compile(GLES_TexEnvProgram *program, UINT units) {
+    program->stage_count = 0;
+    program->enabled = 0;
+    program->white = 0;
+    program->constant = 0;
+    program->status = D3D_OK;
+    memset(program->units, 0, sizeof(program->units));
+    for (UINT stage = 0; stage < GLES_MAX_TEXTURE_STAGES && program->key[stage][KEY_COLOROP]; stage++) {
+        program->stage_count = stage + 1;
+        if (stage >= units) {
+            if (program->status == D3D_OK) program->status = D3DERR_TOOMANYOPERATIONS;
+            continue;
+        }
+        const DWORD *key = program->key[stage];
+        GLES_Combiner *combiner = &program->units[stage];
+        CombinerHalf color = {&combiner->combine_rgb, combiner->src_rgb, combiner->operand_rgb, &combiner->rgb_scale,
+                              FALSE};
+        CombinerHalf alpha = {&combiner->combine_alpha, combiner->src_alpha, combiner->operand_alpha,
+                              &combiner->alpha_scale, TRUE};
+        HalfResult result = compile_half(&color, key[KEY_COLOROP], key[KEY_COLORARG1], key[KEY_COLORARG2],
+                                         key[KEY_COLORARG0]);
+        if (result != HALF_OK) {
+            if (program->status == D3D_OK)
+                program->status =
+                    result == HALF_BAD_OP ? D3DERR_UNSUPPORTEDCOLOROPERATION : D3DERR_UNSUPPORTEDCOLORARG;
+            pass_through(&color);
+        }
+        if (combiner->combine_rgb == GL_DOT3_RGBA) {
+            // GL ignores the alpha combiner
+        } else if (key[KEY_ALPHAOP] == D3DTOP_DISABLE) {
+            pass_through(&alpha);
+        } else if ((result = compile_half(&alpha, key[KEY_ALPHAOP], key[KEY_ALPHAARG1], key[KEY_ALPHAARG2],
+                                          key[KEY_ALPHAARG0])) != HALF_OK) {
+            if (program->status == D3D_OK)
+                program->status =
+                    result == HALF_BAD_OP ? D3DERR_UNSUPPORTEDALPHAOPERATION : D3DERR_UNSUPPORTEDALPHAARG;
+            pass_through(&alpha);
+        }
+
+        UINT bit = 1u << stage;
+        if (!(program->textured & bit)) {
+            // An empty stage that samples passes the previous colour through,
+            // as texturing the unit off does; one that only combines other
+            // arguments samples a white texel so GL still runs its combiner
+            if (reads_source(combiner, GL_TEXTURE)) {
+                memset(combiner, 0, sizeof(*combiner));
+                continue;
+            }
+            program->white |= bit;
+        }
+        program->enabled |= bit;
+        if (reads_source(combiner, GL_CONSTANT)) program->constant |= bit;
+    }
+}
@@ -0,0 +1,24 @@
+// src/d3d8_texenv.h
+#ifndef D3D8_TEXENV_H
+#define D3D8_TEXENV_H
+
+#include "d3d8_to_gles.h"
+
+// Stage states that make up GLES_TexEnvProgram.key, in key order
+extern const D3DTEXTURESTAGESTATETYPE texenv_key_states[GLES_TEXENV_STATES];
+
+// D3D's initial value of a texture stage state
+DWORD texenv_stage_default(DWORD stage, D3DTEXTURESTAGESTATETYPE type);
+
+// Fills program->key and program->textured from `block`, using D3D's
+// defaults for states the application never set
+void texenv_build_key(const GLES_StateBlock *block, GLES_TexEnvProgram *program);
+
+uint32_t texenv_hash(const GLES_TexEnvProgram *program);
+
+// Translates the cascade in program->key into GL_COMBINE setups for the
+// first `units` texture units. Stages GL ES cannot express fall back to
+// passing the previous colour through and set program->status.
+void texenv_compile(GLES_TexEnvProgram *program, UINT units);
+
+#endif // D3D8_TEXENV_H
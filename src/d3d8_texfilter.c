@@ -0,0 +1,333 @@
+// src/d3d8_texfilter.c
+#include "d3d8_texfilter.h"
+#include "d3d8_simd.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Filters run on rows widened to one uint16_t per channel: bytes for the
+// 8-bit formats, bit fields for the packed 16-bit ones.
+typedef struct {
+    UINT channels;
+    BOOL packed;
+    uint16_t mask[4];
+    BYTE shift[4];
+} FilterLayout;
+
+static void filter_layout(D3DFORMAT format, UINT texel_size, FilterLayout *layout) {
+    static const FilterLayout rgb565 = {3, TRUE, {0x1F, 0x3F, 0x1F}, {11, 5, 0}};
+    static const FilterLayout argb1555 = {4, TRUE, {0x1, 0x1F, 0x1F, 0x1F}, {15, 10, 5, 0}};
+    static const FilterLayout argb4444 = {4, TRUE, {0xF, 0xF, 0xF, 0xF}, {12, 8, 4, 0}};
+    switch (format) {
+        case D3DFMT_R5G6B5: *layout = rgb565; break;
+        case D3DFMT_X1R5G5B5:
+        case D3DFMT_A1R5G5B5: *layout = argb1555; break;
+        case D3DFMT_A4R4G4B4:
+        case D3DFMT_X4R4G4B4: *layout = argb4444; break;
+        default: *layout = (FilterLayout){texel_size, FALSE, {0}, {0}}; break;
+    }
+}
+
+static void decode_row(const FilterLayout *layout, const BYTE *src, UINT width, uint16_t *out) {
+    size_t i = 0;
+    if (layout->packed) {
+        const uint16_t *texels = (const uint16_t *)src;
+        for (UINT x = 0; x < width; x++) {
+            for (UINT c = 0; c < layout->channels; c++)
+                out[i++] = (uint16_t)(texels[x] >> layout->shift[c] & layout->mask[c]);
+        }
+        return;
+    }
+    size_t count = (size_t)width * layout->channels;
+#if defined(D3D8_GLES_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128((__m128i *)(out + i + 8), _mm_unpackhi_epi8(v, zero));
+    }
+#elif defined(D3D8_GLES_NEON)
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t v = vld1q_u8(src + i);
+        vst1q_u16(out + i, vmovl_u8(vget_low_u8(v)));
+        vst1q_u16(out + i + 8, vmovl_u8(vget_high_u8(v)));
+    }
+#endif
+    for (; i < count; i++) out[i] = src[i];
+}
+
+static void encode_row(const FilterLayout *layout, const uint16_t *in, UINT width, BYTE *dst) {
+    size_t i = 0;
+    if (layout->packed) {
+        uint16_t *texels = (uint16_t *)dst;
+        for (UINT x = 0; x < width; x++) {
+            uint16_t texel = 0;
+            for (UINT c = 0; c < layout->channels; c++) texel |= (uint16_t)(in[i++] << layout->shift[c]);
+            texels[x] = texel;
+        }
+        return;
+    }
+    size_t count = (size_t)width * layout->channels;
+#if defined(D3D8_GLES_SSE2)
+    for (; i + 16 <= count; i += 16) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(in + i + 8));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#elif defined(D3D8_GLES_NEON)
+    for (; i + 16 <= count; i += 16)
+        vst1q_u8(dst + i, vcombine_u8(vmovn_u16(vld1q_u16(in + i)), vmovn_u16(vld1q_u16(in + i + 8))));
+#endif
+    for (; i < count; i++) dst[i] = (BYTE)in[i];
+}
+
+// dst += src
+static void add_rows(uint16_t *dst, const uint16_t *src, size_t count) {
+    size_t i = 0;
+#if defined(D3D8_GLES_SSE2)
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(dst + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_add_epi16(a, _mm_loadu_si128((const __m128i *)(src + i))));
+    }
+#elif defined(D3D8_GLES_NEON)
+    for (; i + 8 <= count; i += 8) vst1q_u16(dst + i, vaddq_u16(vld1q_u16(dst + i), vld1q_u16(src + i)));
+#endif
+    for (; i < count; i++) dst[i] = (uint16_t)(dst[i] + src[i]);
+}
+
+// Vertical 1-3-3-1 tap over rows that already hold horizontal 1-3-3-1 sums
+static void tent_rows(uint16_t *out, const uint16_t *r0, const uint16_t *r1, const uint16_t *r2, const uint16_t *r3,
+                      size_t count) {
+    size_t i = 0;
+#if defined(D3D8_GLES_SSE2)
+    const __m128i bias = _mm_set1_epi16(32);
+    for (; i + 8 <= count; i += 8) {
+        __m128i inner = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(r1 + i)),
+                                      _mm_loadu_si128((const __m128i *)(r2 + i)));
+        __m128i outer = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(r0 + i)),
+                                      _mm_loadu_si128((const __m128i *)(r3 + i)));
+        __m128i sum = _mm_add_epi16(_mm_add_epi16(outer, bias), _mm_add_epi16(inner, _mm_slli_epi16(inner, 1)));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_srli_epi16(sum, 6));
+    }
+#elif defined(D3D8_GLES_NEON)
+    for (; i + 8 <= count; i += 8) {
+        uint16x8_t inner = vaddq_u16(vld1q_u16(r1 + i), vld1q_u16(r2 + i));
+        uint16x8_t sum = vmlaq_n_u16(vaddq_u16(vld1q_u16(r0 + i), vld1q_u16(r3 + i)), inner, 3);
+        vst1q_u16(out + i, vrshrq_n_u16(sum, 6));
+    }
+#endif
+    for (; i < count; i++) out[i] = (uint16_t)((r0[i] + r3[i] + 3 * (r1[i] + r2[i]) + 32) >> 6);
+}
+
+typedef struct {
+    FilterLayout layout;
+    UINT texel_size;
+    const BYTE *src;
+    UINT src_width, src_height;
+    BYTE *dst;
+    UINT dst_width;
+    DWORD filter;
+    atomic_int failed;
+} FilterJob;
+
+static UINT clamp_index(int i, UINT size) {
+    return i < 0 ? 0 : (UINT)i >= size ? size - 1 : (UINT)i;
+}
+
+static const BYTE *src_row(const FilterJob *job, int y) {
+    return job->src + (size_t)clamp_index(y, job->src_height) * job->src_width * job->texel_size;
+}
+
+static void filter_rows(void *ctx, size_t begin, size_t end) {
+    FilterJob *job = ctx;
+    const UINT c = job->layout.channels;
+    const size_t src_count = (size_t)job->src_width * c;
+    const size_t dst_count = (size_t)job->dst_width * c;
+    uint16_t *scratch = malloc((4 * src_count + 5 * dst_count) * sizeof(uint16_t));
+    if (!scratch) {
+        atomic_store(&job->failed, 1);
+        return;
+    }
+    uint16_t *rows[4] = {scratch, scratch + src_count, scratch + 2 * src_count, scratch + 3 * src_count};
+    uint16_t *taps[4];
+    for (int k = 0; k < 4; k++) taps[k] = scratch + 4 * src_count + k * dst_count;
+    uint16_t *out = scratch + 4 * src_count + 4 * dst_count;
+
+    for (size_t y = begin; y < end; y++) {
+        int sy = 2 * (int)y;
+        if (job->filter == D3DX_FILTER_TRIANGLE) {
+            for (int k = 0; k < 4; k++) {
+                decode_row(&job->layout, src_row(job, sy - 1 + k), job->src_width, rows[k]);
+                for (UINT x = 0; x < job->dst_width; x++) {
+                    int sx = 2 * (int)x;
+                    const uint16_t *a = rows[k] + clamp_index(sx - 1, job->src_width) * c;
+                    const uint16_t *b = rows[k] + clamp_index(sx, job->src_width) * c;
+                    const uint16_t *d = rows[k] + clamp_index(sx + 1, job->src_width) * c;
+                    const uint16_t *e = rows[k] + clamp_index(sx + 2, job->src_width) * c;
+                    for (UINT ch = 0; ch < c; ch++)
+                        taps[k][x * c + ch] = (uint16_t)(a[ch] + 3 * (b[ch] + d[ch]) + e[ch]);
+                }
+            }
+            tent_rows(out, taps[0], taps[1], taps[2], taps[3], dst_count);
+        } else if (job->filter == D3DX_FILTER_BOX) {
+            decode_row(&job->layout, src_row(job, sy), job->src_width, rows[0]);
+            decode_row(&job->layout, src_row(job, sy + 1), job->src_width, rows[1]);
+            add_rows(rows[0], rows[1], src_count);
+            for (UINT x = 0; x < job->dst_width; x++) {
+                const uint16_t *a = rows[0] + clamp_index(2 * (int)x, job->src_width) * c;
+                const uint16_t *b = rows[0] + clamp_index(2 * (int)x + 1, job->src_width) * c;
+                for (UINT ch = 0; ch < c; ch++) out[x * c + ch] = (uint16_t)((a[ch] + b[ch] + 2) >> 2);
+            }
+        } else {
+            decode_row(&job->layout, src_row(job, sy), job->src_width, rows[0]);
+            for (UINT x = 0; x < job->dst_width; x++) {
+                const uint16_t *a = rows[0] + clamp_index(2 * (int)x, job->src_width) * c;
+                for (UINT ch = 0; ch < c; ch++) out[x * c + ch] = a[ch];
+            }
+        }
+        encode_row(&job->layout, out, job->dst_width, job->dst + y * job->dst_width * job->texel_size);
+    }
+    free(scratch);
+}
+
+HRESULT texfilter_downsample(D3DFORMAT format, UINT texel_size, const void *src, UINT src_width, UINT src_height,
+                             void *dst, UINT dst_width, UINT dst_height, DWORD filter, GLES_WorkerPool *pool) {
+    FilterJob job = {.texel_size = texel_size, .src = src, .src_width = src_width, .src_height = src_height,
+                     .dst = dst, .dst_width = dst_width};
+    filter_layout(format, texel_size, &job.layout);
+    switch (filter & 0xFF) {
+        case D3DX_FILTER_NONE:
+        case D3DX_FILTER_POINT: job.filter = D3DX_FILTER_POINT; break;
+        // A 2:1 bilinear tap lands between four texels, which is the box
+        case D3DX_FILTER_LINEAR:
+        case D3DX_FILTER_BOX: job.filter = D3DX_FILTER_BOX; break;
+        case D3DX_FILTER_TRIANGLE: job.filter = D3DX_FILTER_TRIANGLE; break;
+        default:
+            if (filter != D3DX_DEFAULT) return D3DERR_INVALIDCALL;
+            job.filter = D3DX_FILTER_BOX;
+            break;
+    }
+    // About 16K destination texels per chunk
+    size_t grain = dst_width >= 16384 ? 1 : 16384 / dst_width;
+    workers_run(pool, dst_height, grain, filter_rows, &job);
+    return atomic_load(&job.failed) ? D3DERR_OUTOFVIDEOMEMORY : D3D_OK;
+}
+
+// Texels in GL layout: the packed 16-bit types keep GL's field order, and
+// the byte formats filter each byte alike whatever channel it holds
+static void gl_filter_layout(const GLES_TextureFormat *format, FilterLayout *layout) {
+    static const FilterLayout rgba5551 = {4, TRUE, {0x1F, 0x1F, 0x1F, 0x1}, {11, 6, 1, 0}};
+    switch (format->gl_type) {
+        case GL_UNSIGNED_SHORT_5_6_5: filter_layout(D3DFMT_R5G6B5, 2, layout); break;
+        case GL_UNSIGNED_SHORT_5_5_5_1: *layout = rgba5551; break;
+        case GL_UNSIGNED_SHORT_4_4_4_4: filter_layout(D3DFMT_A4R4G4B4, 2, layout); break;
+        default: filter_layout(D3DFMT_UNKNOWN, format->texel_size, layout); break;
+    }
+}
+
+// out = a * (256 - weight) + b * weight, which stays within 16 bits for
+// channels of up to 8 bits
+static void lerp_rows16(uint16_t *out, const uint16_t *a, const uint16_t *b, size_t count, UINT weight) {
+    size_t i = 0;
+#if defined(D3D8_GLES_SSE2)
+    const __m128i wa = _mm_set1_epi16((short)(256 - weight)), wb = _mm_set1_epi16((short)weight);
+    for (; i + 8 <= count; i += 8) {
+        __m128i va = _mm_mullo_epi16(_mm_loadu_si128((const __m128i *)(a + i)), wa);
+        __m128i vb = _mm_mullo_epi16(_mm_loadu_si128((const __m128i *)(b + i)), wb);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_add_epi16(va, vb));
+    }
+#elif defined(D3D8_GLES_NEON)
+    for (; i + 8 <= count; i += 8)
+        vst1q_u16(out + i, vmlaq_n_u16(vmulq_n_u16(vld1q_u16(a + i), (uint16_t)(256 - weight)), vld1q_u16(b + i),
+                                       (uint16_t)weight));
+#endif
+    for (; i < count; i++) out[i] = (uint16_t)(a[i] * (256 - weight) + b[i] * weight);
+}
+
+// Bilinear tap for destination index `i`: the two source indices and the
+// weight of the second in 1/256ths, with texel centres lined up and edges
+// clamped
+static void resample_tap(UINT src_size, UINT dst_size, UINT i, UINT tap[3]) {
+    int64_t pos = (int64_t)(2 * i + 1) * src_size * 256 / (2 * (int64_t)dst_size) - 128;
+    if (pos < 0) pos = 0;
+    tap[0] = (UINT)(pos >> 8) < src_size ? (UINT)(pos >> 8) : src_size - 1;
+    tap[1] = tap[0] + 1 < src_size ? tap[0] + 1 : tap[0];
+    tap[2] = (UINT)(pos & 0xFF);
+}
+
+typedef struct {
+    FilterLayout layout;
+    UINT texel_size;
+    const BYTE *src;
+    size_t src_pitch;
+    UINT src_width, src_height;
+    BYTE *dst;
+    size_t dst_pitch;
+    UINT dst_height;
+    RECT window;
+    const UINT (*taps)[3];      // per window column
+    UINT first, last;           // source columns the window reads
+    atomic_int failed;
+} ResampleJob;
+
+static void resample_rows(void *ctx, size_t begin, size_t end) {
+    ResampleJob *job = ctx;
+    const UINT c = job->layout.channels;
+    const UINT columns = job->last - job->first + 1;
+    const UINT width = (UINT)(job->window.right - job->window.left);
+    const size_t src_count = (size_t)columns * c;
+    uint16_t *scratch = malloc((3 * src_count + (size_t)width * c) * sizeof(uint16_t));
+    if (!scratch) {
+        atomic_store(&job->failed, 1);
+        return;
+    }
+    uint16_t *rows[2] = {scratch, scratch + src_count};
+    uint16_t *mixed = scratch + 2 * src_count, *out = scratch + 3 * src_count;
+    UINT held[2] = {UINT32_MAX, UINT32_MAX};
+    for (size_t y = begin; y < end; y++) {
+        UINT tap[3];
+        resample_tap(job->src_height, job->dst_height, (UINT)job->window.top + (UINT)y, tap);
+        // Neighbouring destination rows mostly read the same two source rows
+        for (int k = 0; k < 2; k++) {
+            if (held[k] == tap[k]) continue;
+            if (held[1 - k] == tap[k]) {
+                uint16_t *swap = rows[k];
+                rows[k] = rows[1 - k];
+                rows[1 - k] = swap;
+                held[1 - k] = held[k];
+            } else {
+                decode_row(&job->layout, job->src + tap[k] * job->src_pitch + (size_t)job->first * job->texel_size,
+                           columns, rows[k]);
+            }
+            held[k] = tap[k];
+        }
+        lerp_rows16(mixed, rows[0], rows[1], src_count, tap[2]);
+        for (UINT x = 0; x < width; x++) {
+            const uint16_t *a = mixed + (job->taps[x][0] - job->first) * c;
+            const uint16_t *b = mixed + (job->taps[x][1] - job->first) * c;
+            UINT wb = job->taps[x][2], wa = 256 - wb;
+            for (UINT ch = 0; ch < c; ch++) out[x * c + ch] = (uint16_t)((a[ch] * wa + b[ch] * wb + 32768) >> 16);
+        }
+        encode_row(&job->layout, out, width, job->dst + y * job->dst_pitch);
+    }
+    free(scratch);
+}
+
+HRESULT texfilter_resample(const GLES_TextureFormat *format, const void *src, size_t src_pitch, UINT src_width,
+                           UINT src_height, void *dst, size_t dst_pitch, UINT dst_width, UINT dst_height,
+                           const RECT *window, GLES_WorkerPool *pool) {
+    UINT width = (UINT)(window->right - window->left), height = (UINT)(window->bottom - window->top);
+    UINT (*taps)[3] = malloc(width * sizeof(*taps));
+    if (!taps) return D3DERR_OUTOFVIDEOMEMORY;
+    for (UINT x = 0; x < width; x++) resample_tap(src_width, dst_width, (UINT)window->left + x, taps[x]);
+    ResampleJob job = {.texel_size = format->texel_size, .src = src, .src_pitch = src_pitch,
+                       .src_width = src_width, .src_height = src_height, .dst = dst, .dst_pitch = dst_pitch,
+                       .dst_height = dst_height, .window = *window, .taps = (const UINT (*)[3])taps,
+                       .first = taps[0][0], .last = taps[width - 1][1]};
+    gl_filter_layout(format, &job.layout);
+    // About 16K destination texels per chunk
+    size_t grain = width >= 16384 ? 1 : 16384 / width;
+    workers_run(height > grain ? pool : NULL, height, grain, resample_rows, &job);
+    free(taps);
+    return atomic_load(&job.failed) ? D3DERR_OUTOFVIDEOMEMORY : D3D_OK;
+}
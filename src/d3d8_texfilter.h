@@ -0,0 +1,23 @@
+// src/d3d8_texfilter.h
+#ifndef D3D8_TEXFILTER_H
+#define D3D8_TEXFILTER_H
+
+#include "d3d8_to_gles.h"
+#include "d3d8_workers.h"
+
+// Filters a level of `format` texels down to the next mip level. Both images
+// are tightly packed in D3D layout. `filter` is a D3DX_FILTER_* value; rows
+// are spread over `pool` for large levels.
+HRESULT texfilter_downsample(D3DFORMAT format, UINT texel_size, const void *src, UINT src_width, UINT src_height,
+                             void *dst, UINT dst_width, UINT dst_height, DWORD filter, GLES_WorkerPool *pool);
+
+// Scales a level of `format` texels, in GL layout, to dst_width x dst_height
+// with bilinear filtering and clamped edges. Only the destination texels in
+// `window` are written, to `dst` rows `dst_pitch` apart from the window's
+// top-left corner, so a change to part of the source can be refiltered
+// locally. Rows are spread over `pool` for large windows.
+HRESULT texfilter_resample(const GLES_TextureFormat *format, const void *src, size_t src_pitch, UINT src_width,
+                           UINT src_height, void *dst, size_t dst_pitch, UINT dst_width, UINT dst_height,
+                           const RECT *window, GLES_WorkerPool *pool);
+
+#endif // D3D8_TEXFILTER_H
@@ -1,5 +1,12 @@
 // src/d3d8_to_gles.c
 #include "d3d8_to_gles.h"
+#include "d3d8_atlas.h"
+#include "d3d8_image.h"
+#include "d3d8_loader.h"
+#include "d3d8_simd.h"
+#include "d3d8_texconv.h"
+#include "d3d8_texenv.h"
+#include "d3d8_texfilter.h"
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
@@ -58,7 +65,8 @@ void fill_d3d_caps(D3DCAPS8 *pCaps, D3DDEVTYPE DeviceType) {
     glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
     pCaps->MaxTextureWidth = pCaps->MaxTextureHeight = max_texture_size;
     pCaps->TextureCaps = D3DPTEXTURECAPS_PERSPECTIVE | D3DPTEXTURECAPS_ALPHA |
-                         D3DPTEXTURECAPS_MIPMAP | D3DPTEXTURECAPS_CUBEMAP;
+                         D3DPTEXTURECAPS_MIPMAP | D3DPTEXTURECAPS_CUBEMAP |
+                         D3DPTEXTURECAPS_ALPHAPALETTE;
     pCaps->TextureFilterCaps = pCaps->CubeTextureFilterCaps =
         D3DPTFILTERCAPS_MINFPOINT | D3DPTFILTERCAPS_MINFLINEAR |
         D3DPTFILTERCAPS_MIPFPOINT | D3DPTFILTERCAPS_MIPFLINEAR |
@@ -72,7 +80,14 @@ void fill_d3d_caps(D3DCAPS8 *pCaps, D3DDEVTYPE DeviceType) {
                          D3DSTENCILCAPS_INCR | D3DSTENCILCAPS_DECR;
     pCaps->TextureOpCaps = D3DTEXOPCAPS_DISABLE | D3DTEXOPCAPS_SELECTARG1 |
                            D3DTEXOPCAPS_SELECTARG2 | D3DTEXOPCAPS_MODULATE |
-                           D3DTEXOPCAPS_MODULATE2X | D3DTEXOPCAPS_ADD;
+                           D3DTEXOPCAPS_MODULATE2X | D3DTEXOPCAPS_MODULATE4X |
+                           D3DTEXOPCAPS_ADD | D3DTEXOPCAPS_ADDSIGNED |
+                           D3DTEXOPCAPS_ADDSIGNED2X | D3DTEXOPCAPS_SUBTRACT |
+                           D3DTEXOPCAPS_BLENDDIFFUSEALPHA |
+                           D3DTEXOPCAPS_BLENDTEXTUREALPHA |
+                           D3DTEXOPCAPS_BLENDFACTORALPHA |
+                           D3DTEXOPCAPS_BLENDCURRENTALPHA |
+                           D3DTEXOPCAPS_DOTPRODUCT3 | D3DTEXOPCAPS_LERP;
     pCaps->FVFCaps = D3DFVFCAPS_TEXCOORDCOUNTMASK & 0x8;
     pCaps->VertexProcessingCaps = D3DVTXPCAPS_TEXGEN |
                                   D3DVTXPCAPS_MATERIALSOURCE7 |
@@ -81,12 +96,15 @@ void fill_d3d_caps(D3DCAPS8 *pCaps, D3DDEVTYPE DeviceType) {
     pCaps->MaxActiveLights = 8;
     pCaps->MaxUserClipPlanes = 0;
     pCaps->MaxVertexBlendMatrices = 4;
-    pCaps->MaxStreams = 1;
+    pCaps->MaxStreams = GLES_MAX_STREAMS;
     pCaps->MaxStreamStride = 256;
-    pCaps->VertexShaderVersion = D3DVS_VERSION(1, 1);
+    // Declarations are supported, shader functions are not
+    pCaps->VertexShaderVersion = D3DVS_VERSION(0, 0);
     pCaps->MaxVertexShaderConst = 96;
     pCaps->PixelShaderVersion = 0;
     pCaps->MaxPixelShaderValue = 0.0f;
+    // Every GL ES 1.1 implementation has two texture units; devices report
+    // what their driver has
     pCaps->MaxTextureBlendStages = 2;
     pCaps->MaxSimultaneousTextures = 2;
     pCaps->MaxPrimitiveCount = 65535;
@@ -122,9 +140,18 @@ static HRESULT D3DAPI d3d8_set_indices(IDirect3DDevice8 *This, IDirect3DIndexBuf
 static HRESULT D3DAPI d3d8_create_texture(IDirect3DDevice8 *This, UINT Width, UINT Height, UINT Levels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, IDirect3DTexture8 **ppTexture);
 static HRESULT D3DAPI d3d8_set_texture(IDirect3DDevice8 *This, DWORD Stage, IDirect3DTexture8 *pTexture);
 static HRESULT D3DAPI d3d8_set_texture_stage_state(IDirect3DDevice8 *This, DWORD Stage, D3DTEXTURESTAGESTATETYPE Type, DWORD Value);
+static HRESULT D3DAPI d3d8_validate_device(IDirect3DDevice8 *This, DWORD *pNumPasses);
 static HRESULT D3DAPI d3d8_set_viewport(IDirect3DDevice8 *This, CONST D3DVIEWPORT8 *pViewport);
 static HRESULT D3DAPI d3d8_set_transform(IDirect3DDevice8 *This, D3DTRANSFORMSTATETYPE State, CONST D3DXMATRIX *pMatrix);
 static HRESULT D3DAPI d3d8_draw_indexed_primitive(IDirect3DDevice8 *This, D3DPRIMITIVETYPE PrimitiveType, UINT MinVertexIndex, UINT NumVertices, UINT StartIndex, UINT PrimitiveCount);
+static HRESULT D3DAPI d3d8_create_vertex_shader(IDirect3DDevice8 *This, CONST DWORD *pDeclaration, CONST DWORD *pFunction, DWORD *pHandle, DWORD Usage);
+static HRESULT D3DAPI d3d8_set_vertex_shader(IDirect3DDevice8 *This, DWORD Handle);
+static HRESULT D3DAPI d3d8_get_vertex_shader(IDirect3DDevice8 *This, DWORD *pHandle);
+static HRESULT D3DAPI d3d8_delete_vertex_shader(IDirect3DDevice8 *This, DWORD Handle);
+static HRESULT D3DAPI d3d8_set_palette_entries(IDirect3DDevice8 *This, UINT PaletteNumber, CONST PALETTEENTRY *pEntries);
+static HRESULT D3DAPI d3d8_get_palette_entries(IDirect3DDevice8 *This, UINT PaletteNumber, PALETTEENTRY *pEntries);
+static HRESULT D3DAPI d3d8_set_current_texture_palette(IDirect3DDevice8 *This, UINT PaletteNumber);
+static HRESULT D3DAPI d3d8_get_current_texture_palette(IDirect3DDevice8 *This, UINT *PaletteNumber);
 
 // Forward declarations for vertex buffer methods
 static HRESULT D3DAPI d3d8_vb_get_device(IDirect3DVertexBuffer8 *This, IDirect3DDevice8 **ppDevice);
@@ -170,6 +197,10 @@ static ULONG D3DAPI tex_release(IDirect3DTexture8 *This);
 static HRESULT D3DAPI tex_lock_rect(IDirect3DTexture8 *This, UINT Level, D3DLOCKED_RECT *pLockedRect, const RECT *pRect, DWORD Flags);
 static HRESULT D3DAPI tex_unlock_rect(IDirect3DTexture8 *This, UINT Level);
 static HRESULT D3DAPI tex_get_level_desc(IDirect3DTexture8 *This, UINT Level, D3DSURFACE_DESC *pDesc);
+static DWORD D3DAPI tex_set_priority(IDirect3DTexture8 *This, DWORD PriorityNew);
+static DWORD D3DAPI tex_get_priority(IDirect3DTexture8 *This);
+static void D3DAPI tex_pre_load(IDirect3DTexture8 *This);
+static HRESULT D3DAPI tex_get_surface_level(IDirect3DTexture8 *This, UINT Level, IDirect3DSurface8 **ppSurfaceLevel);
 
 // Forward declarations for ID3DXBuffer helper methods
 static HRESULT D3DAPI d3dx_buffer_query_interface(ID3DXBuffer *This, REFIID iid, void **ppv);
@@ -178,6 +209,27 @@ static ULONG D3DAPI d3dx_buffer_release(ID3DXBuffer *This);
 static LPVOID d3dx_buffer_get_buffer_pointer(ID3DXBuffer *This);
 static DWORD d3dx_buffer_get_buffer_size(ID3DXBuffer *This);
 
+// Forward declarations for dynamic batching and deferred scenes
+static void batch_flush(GLES_Device *gles);
+static void texenv_apply(GLES_Device *gles);
+static void texture_apply_sampler(GLES_Device *gles, DWORD stage, GLES_Texture *texture);
+static GLES_WorkerPool *device_workers(GLES_Device *gles);
+static void texture_unshare(GLES_Device *gles, GLES_Texture *texture, BOOL copy);
+static void texture_unatlas(GLES_Device *gles, GLES_Texture *texture, BOOL copy);
+static void texture_leave_atlas(GLES_Device *gles, GLES_Texture *texture);
+static HRESULT texture_read_rect(GLES_Device *gles, GLES_Texture *texture, UINT level, const RECT *rect, BYTE *dst,
+                                 size_t pitch);
+static void texcoord_load(GLES_Device *gles, UINT unit, const GLfloat coords[4]);
+static void texture_apply_coords(GLES_Device *gles, UINT unit, const GLES_Texture *texture);
+static void texture_matrices_load(GLES_Device *gles);
+static void batch_forget_buffer(GLES_Device *gles, GLES_Buffer *buffer);
+static void scene_flush(GLES_Device *gles);
+static BOOL scene_defer_state(GLES_Device *gles);
+static void texture_evict(GLES_Device *gles, GLES_Texture *texture);
+static ID3DGLESMultiDraw *multi_draw_create(IDirect3DDevice8 *device);
+static void apply_texture(GLES_Device *gles, DWORD stage, GLES_Texture *texture);
+static void apply_texture_stage_state(GLES_Device *gles, DWORD stage, D3DTEXTURESTAGESTATETYPE type, DWORD value);
+
 // Forward declarations for basic D3DX helpers
 UINT WINAPI D3DXGetFVFVertexSize(DWORD FVF);
 HRESULT WINAPI D3DXDeclaratorFromFVF(DWORD FVF, DWORD Declaration[MAX_FVF_DECL_SIZE]);
@@ -346,6 +398,10 @@ static void set_render_state(GLES_Device *gles, D3DRENDERSTATETYPE state, DWORD
         case D3DRS_STENCILWRITEMASK:
             glStencilMask(value);
             break;
+        case D3DRS_TEXTUREFACTOR:
+            // Reaches the units reading it with the next draw's combiners
+            gles->texenv_dirty = TRUE;
+            break;
         case D3DRS_STENCILFAIL:
             gles->stencil_fail = stencil_op_to_gl((D3DSTENCILOP)value);
             glStencilOp(gles->stencil_fail, gles->stencil_zfail, gles->stencil_pass);
@@ -381,6 +437,16 @@ static void set_render_state(GLES_Device *gles, D3DRENDERSTATETYPE state, DWORD
     }
 }
 
+// Apply a render state to GL and remember it as the applied value
+static void apply_render_state(GLES_Device *gles, D3DRENDERSTATETYPE state, DWORD value) {
+    set_render_state(gles, state, value);
+    if ((DWORD)state < GLES_MAX_RENDER_STATES) {
+        gles->applied.render_states[state] = value;
+        gles->applied.render_state_mask[state / 32] |= 1u << (state % 32);
+    }
+    gles->stats.StateChanges++;
+}
+
 // Helper: Map D3DPRESENT_PARAMETERS to EGL config
 static EGLConfig choose_egl_config(EGLDisplay display,
                                    D3DPRESENT_PARAMETERS *params,
@@ -417,70 +483,245 @@ static void d3d_to_gl_matrix(GLfloat *restrict gl_matrix,
     gl_matrix[3] = d3d_matrix->_14; gl_matrix[7] = d3d_matrix->_24; gl_matrix[11] = d3d_matrix->_34; gl_matrix[15] = d3d_matrix->_44;
 }
 
-// Helper: Setup vertex attributes based on FVF
-static void setup_vertex_attributes(GLES_Device *gles, DWORD fvf, BYTE *data,
-                                    UINT stride) {
-    GLint offset = 0;
+static void plan_add_element(GLES_VertexPlan *plan, GLES_ArrayKind array, UINT stream, UINT size,
+                             GLenum type, UINT offset, UINT set) {
+    GLES_VertexElement *element = &plan->elements[plan->element_count++];
+    element->array = (BYTE)array;
+    element->stream = (BYTE)stream;
+    element->size = (BYTE)size;
+    element->set = (BYTE)set;
+    element->type = type;
+    element->offset = offset;
+    plan->stream_mask |= 1u << stream;
+}
+
+// Helper: Compile an FVF into a vertex plan reading from stream 0
+static void compile_fvf_plan(DWORD fvf, GLES_VertexPlan *plan) {
+    UINT offset = 0;
+    memset(plan, 0, sizeof(*plan));
+    plan->valid = TRUE;
+    plan->fvf = fvf;
 
     if (fvf & D3DFVF_XYZRHW) {
-        glDisable(GL_DEPTH_TEST);
-        glMatrixMode(GL_MODELVIEW);
-        glLoadIdentity();
-        glEnableClientState(GL_VERTEX_ARRAY);
-        glVertexPointer(4, GL_FLOAT, stride, data + offset);
+        // Screen-space x, y, z; RHW is skipped and the cached pixel-space
+        // projection (see load_draw_transform) does the mapping
+        plan_add_element(plan, GLES_ARRAY_VERTEX, 0, 3, GL_FLOAT, offset, 0);
+        plan->rhw = TRUE;
         offset += 16;
     } else if (fvf & D3DFVF_XYZ) {
-        glEnableClientState(GL_VERTEX_ARRAY);
-        glVertexPointer(3, GL_FLOAT, stride, data + offset);
+        plan_add_element(plan, GLES_ARRAY_VERTEX, 0, 3, GL_FLOAT, offset, 0);
         offset += 12;
-    } else {
-        glDisableClientState(GL_VERTEX_ARRAY);
     }
-
     if (fvf & D3DFVF_NORMAL) {
-        glEnableClientState(GL_NORMAL_ARRAY);
-        glNormalPointer(GL_FLOAT, stride, data + offset);
+        plan_add_element(plan, GLES_ARRAY_NORMAL, 0, 3, GL_FLOAT, offset, 0);
         offset += 12;
-    } else {
-        glDisableClientState(GL_NORMAL_ARRAY);
     }
-
     if (fvf & D3DFVF_DIFFUSE) {
-        glEnableClientState(GL_COLOR_ARRAY);
-        glColorPointer(4, GL_UNSIGNED_BYTE, stride, data + offset);
+        plan_add_element(plan, GLES_ARRAY_COLOR, 0, 4, GL_UNSIGNED_BYTE, offset, 0);
         offset += 4;
-    } else {
-        glDisableClientState(GL_COLOR_ARRAY);
     }
-
     if (fvf & D3DFVF_SPECULAR) {
         /* Skip specular color for now; GL ES 1.1 lacks secondary color arrays */
         offset += 4;
     }
 
-    int tex_count = (fvf & D3DFVF_TEXCOUNT_MASK) >> D3DFVF_TEXCOUNT_SHIFT;
-    int limit = tex_count > 2 ? 2 : tex_count;
-    for (int i = 0; i < limit; i++) {
-        int unit = i;
-        if (gles->texcoord_index0 < limit) {
-            if (i == gles->texcoord_index0) {
-                unit = 0;
-            } else if (i < gles->texcoord_index0) {
-                unit = i + 1;
-            }
-        }
-        glClientActiveTexture(GL_TEXTURE0 + unit);
-        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-        glTexCoordPointer(2, GL_FLOAT, stride, data + offset);
+    UINT tex_count = (fvf & D3DFVF_TEXCOUNT_MASK) >> D3DFVF_TEXCOUNT_SHIFT;
+    for (UINT i = 0; i < tex_count; i++) {
+        if (i < GLES_MAX_TEXTURE_STAGES) plan_add_element(plan, GLES_ARRAY_TEXCOORD0, 0, 2, GL_FLOAT, offset, i);
         offset += 8;
     }
-    for (int i = limit; i < 2; i++) {
-        glClientActiveTexture(GL_TEXTURE0 + i);
-        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    plan->strides[0] = offset;
+}
+
+// Helper: Plan for an FVF, compiled on first use
+static const GLES_VertexPlan *fvf_plan(GLES_Device *gles, DWORD fvf) {
+    GLES_VertexPlan *plan = &gles->fvf_plans[(fvf ^ fvf >> 8) % GLES_FVF_PLAN_CACHE_SLOTS];
+    if (!plan->valid || plan->fvf != fvf) compile_fvf_plan(fvf, plan);
+    return plan;
+}
+
+// Helper: Plan for the current vertex shader declaration or FVF
+static const GLES_VertexPlan *current_vertex_plan(GLES_Device *gles) {
+    if (gles->vertex_shader)
+        return &gles->vertex_shaders[gles->vertex_shader - GLES_VERTEX_SHADER_HANDLE_BASE - 1];
+    return fvf_plan(gles, gles->fvf);
+}
+
+static BOOL vertex_streams_bound(const GLES_Device *gles, const GLES_VertexPlan *plan) {
+    if (!plan->stream_mask) return gles->streams[0].vbo != 0;
+    for (UINT i = 0; i < GLES_MAX_STREAMS; i++) {
+        if ((plan->stream_mask & (1u << i)) && !gles->streams[i].vbo) return FALSE;
+    }
+    return TRUE;
+}
+
+static void set_client_array(GLES_Device *gles, UINT array, BOOL enable) {
+    GLenum cap = GL_TEXTURE_COORD_ARRAY;
+    switch (array) {
+        case GLES_ARRAY_VERTEX: cap = GL_VERTEX_ARRAY; break;
+        case GLES_ARRAY_NORMAL: cap = GL_NORMAL_ARRAY; break;
+        case GLES_ARRAY_COLOR: cap = GL_COLOR_ARRAY; break;
+        default: glClientActiveTexture(GL_TEXTURE0 + array - GLES_ARRAY_TEXCOORD0); break;
+    }
+    if (enable) {
+        glEnableClientState(cap);
+        gles->enabled_arrays |= 1u << array;
+    } else {
+        glDisableClientState(cap);
+        gles->enabled_arrays &= ~(1u << array);
+    }
+}
+
+// `stage`'s D3DTSS_TEXTURETRANSFORMFLAGS in `block`, 0 when never set
+static DWORD texture_transform_flags(const GLES_StateBlock *block, DWORD stage) {
+    return block->texture_stage_state_mask[stage] & 1u << D3DTSS_TEXTURETRANSFORMFLAGS
+               ? block->texture_stage_states[stage][D3DTSS_TEXTURETRANSFORMFLAGS]
+               : D3DTTFF_DISABLE;
+}
+
+// Has the units transforming coordinates as `stage` does reload their
+// texture matrices at the next draw
+static void texture_matrix_touch(GLES_Device *gles, DWORD stage) {
+    gles->texture_matrix_dirty |= 1u << stage;
+    if (stage == 0 && gles->alpha_plane) gles->texture_matrix_dirty |= 1u << gles->alpha_plane;
+}
+
+// Helper: Point the GL client arrays at the plan's streams. GL ES has no base
+// vertex, so the attribute pointers are offset by base_vertex instead.
+// Coordinate sets go to the units that read them: each stage's
+// D3DTSS_TEXCOORDINDEX names its set, and the alpha plane follows stage 0.
+static void bind_vertex_arrays(GLES_Device *gles, const GLES_VertexPlan *plan, const GLES_Stream *streams,
+                               UINT base_vertex) {
+    struct {
+        const GLES_VertexElement *element;
+        UINT array;             // GLES_ArrayKind, with texcoord arrays by unit
+    } bindings[GLES_MAX_VERTEX_ELEMENTS + GLES_MAX_TEXTURE_STAGES];
+    const GLES_VertexElement *sets[GLES_MAX_TEXTURE_STAGES] = {NULL};
+    UINT binding_count = 0;
+    for (UINT i = 0; i < plan->element_count; i++) {
+        const GLES_VertexElement *element = &plan->elements[i];
+        if (element->array >= GLES_ARRAY_TEXCOORD0) {
+            sets[element->set] = element;
+        } else {
+            bindings[binding_count].element = element;
+            bindings[binding_count++].array = element->array;
+        }
+    }
+    for (UINT unit = 0; unit < gles->texture_units; unit++) {
+        DWORD stage = unit == gles->alpha_plane ? 0 : unit;
+        DWORD set = gles->applied.texture_stage_state_mask[stage] & 1u << D3DTSS_TEXCOORDINDEX
+                        ? gles->applied.texture_stage_states[stage][D3DTSS_TEXCOORDINDEX]
+                        : stage;
+        if (set >= GLES_MAX_TEXTURE_STAGES || !sets[set]) continue;
+        bindings[binding_count].element = sets[set];
+        bindings[binding_count++].array = GLES_ARRAY_TEXCOORD0 + unit;
+        // Texture transforms place the implied 1 after the last component
+        if (gles->texcoord_dims[unit] != sets[set]->size) {
+            gles->texcoord_dims[unit] = sets[set]->size;
+            if (texture_transform_flags(&gles->applied, stage)) gles->texture_matrix_dirty |= 1u << unit;
+        }
+    }
+
+    UINT wanted = 0;
+    GLuint bound = 0;
+    BOOL any_bound = FALSE;
+    for (UINT i = 0; i < binding_count; i++) {
+        const GLES_VertexElement *element = bindings[i].element;
+        UINT array = bindings[i].array;
+        const GLES_Stream *stream = &streams[element->stream];
+        UINT stride = stream->stride ? stream->stride : plan->strides[element->stream];
+        const BYTE *data = (const BYTE *)NULL + (size_t)base_vertex * stride + element->offset;
+        if (!any_bound || stream->vbo != bound) {
+            glBindBuffer(GL_ARRAY_BUFFER, stream->vbo);
+            bound = stream->vbo;
+            any_bound = TRUE;
+        }
+        switch (array) {
+            case GLES_ARRAY_VERTEX:
+                glVertexPointer(element->size, element->type, stride, data);
+                break;
+            case GLES_ARRAY_NORMAL:
+                glNormalPointer(element->type, stride, data);
+                break;
+            case GLES_ARRAY_COLOR:
+                glColorPointer(element->size, element->type, stride, data);
+                break;
+            default:
+                glClientActiveTexture(GL_TEXTURE0 + array - GLES_ARRAY_TEXCOORD0);
+                glTexCoordPointer(element->size, element->type, stride, data);
+                break;
+        }
+        wanted |= 1u << array;
+        if (!(gles->enabled_arrays & (1u << array))) set_client_array(gles, array, TRUE);
+    }
+    UINT stale = gles->enabled_arrays & ~wanted;
+    for (UINT array = 0; stale; array++, stale >>= 1) {
+        if (stale & 1) set_client_array(gles, array, FALSE);
     }
     glClientActiveTexture(GL_TEXTURE0);
 }
 
+// Helper: Ortho projection from D3D pixel coordinates (origin top-left,
+// pixel centers on integers) to the current viewport
+static void build_rhw_projection(GLfloat *m, const D3DVIEWPORT8 *viewport) {
+    GLfloat w = viewport->Width ? (GLfloat)viewport->Width : 1.0f;
+    GLfloat h = viewport->Height ? (GLfloat)viewport->Height : 1.0f;
+    GLfloat sx = 2.0f / w;
+    GLfloat sy = -2.0f / h;
+    memset(m, 0, 16 * sizeof(GLfloat));
+    m[0] = sx;
+    m[5] = sy;
+    m[10] = 2.0f;
+    m[12] = sx * (0.5f - (GLfloat)viewport->X) - 1.0f;
+    m[13] = sy * (0.5f - (GLfloat)viewport->Y) + 1.0f;
+    m[14] = -1.0f;
+    m[15] = 1.0f;
+}
+
+// Helper: Load the transform for a draw. Pre-transformed vertices use the
+// cached pixel-space projection; everything else uses world*view*proj (or
+// view*proj when world is NULL). GL matrices are only reloaded when the
+// kind of draw or the matrices changed.
+static void load_draw_transform(GLES_Device *gles, BOOL rhw, const D3DXMATRIX *world) {
+    if (rhw) {
+        if (!gles->rhw_projection_valid) {
+            build_rhw_projection(gles->rhw_projection, &gles->viewport);
+            gles->rhw_projection_valid = TRUE;
+            gles->rhw_matrices = FALSE;
+        }
+        if (!gles->rhw_matrices) {
+            glMatrixMode(GL_PROJECTION);
+            glLoadMatrixf(gles->rhw_projection);
+            glMatrixMode(GL_MODELVIEW);
+            glLoadIdentity();
+            gles->rhw_matrices = TRUE;
+            gles->wvp_valid = FALSE;
+        }
+        return;
+    }
+    if (gles->rhw_matrices) {
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        glMatrixMode(GL_MODELVIEW);
+        gles->rhw_matrices = FALSE;
+    }
+    BOOL current = world == &gles->world_matrix;
+    if (current && gles->wvp_valid) return;
+
+    D3DXMATRIX wvp;
+    if (world) {
+        D3DXMatrixMultiply(&wvp, world, &gles->view_matrix);
+        D3DXMatrixMultiply(&wvp, &wvp, &gles->projection_matrix);
+    } else {
+        D3DXMatrixMultiply(&wvp, &gles->view_matrix, &gles->projection_matrix);
+    }
+    GLfloat gl_matrix[16];
+    d3d_to_gl_matrix(gl_matrix, &wvp);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadMatrixf(gl_matrix);
+    gles->wvp_valid = current;
+}
+
 // Math functions
 D3DXMATRIX* WINAPI D3DXMatrixIdentity(D3DXMATRIX *pOut) {
     memset(pOut, 0, sizeof(D3DXMATRIX));
@@ -798,7 +1039,6 @@ static ULONG D3DAPI d3dx_mesh_release(void *ptr) {
     ID3DXMesh *This = ptr;
     if (This->vb) This->vb->lpVtbl->Release(This->vb);
     if (This->ib) This->ib->lpVtbl->Release(This->ib);
-    if (This->device) This->device->lpVtbl->Release(This->device);
     free(This->attrib_table);
     free(This->attrib_buffer);
     free(This);
@@ -812,7 +1052,7 @@ static HRESULT D3DAPI d3dx_mesh_draw_subset(void *ptr, DWORD AttribId) {
     D3DXATTRIBUTERANGE *range = &This->attrib_table[AttribId];
     This->device->lpVtbl->SetStreamSource(This->device, 0, This->vb, D3DXGetFVFVertexSize(This->fvf));
     This->device->lpVtbl->SetIndices(This->device, This->ib, 0);
-    This->device->gles->fvf = This->fvf;
+    This->device->lpVtbl->SetVertexShader(This->device, This->fvf);
     This->device->gles->attrib_id = AttribId;
     return This->device->lpVtbl->DrawIndexedPrimitive(This->device, D3DPT_TRIANGLELIST, range->VertexStart,
                                                      range->VertexCount, range->FaceStart * 3, range->FaceCount);
@@ -947,203 +1187,1732 @@ static ULONG D3DAPI common_add_ref(void *This) { (void)This; return 1; }
 static ULONG D3DAPI common_release(void *This) { free(This); return 0; }
 
 // IUnknown-style helper implementations
+const GUID IID_ID3DGLESMultiDraw = {0x6f1c2a4e, 0x8d3b, 0x4c1f, {0x9a, 0x52, 0x3e, 0x7d, 0x10, 0xb4, 0xc6, 0x29}};
+
 static HRESULT D3DAPI d3d8_device_query_interface(IDirect3DDevice8 *This, REFIID riid, void **ppv) {
+    if (This && riid && ppv && !memcmp(riid, &IID_ID3DGLESMultiDraw, sizeof(GUID))) {
+        if (!This->gles->multi_draw) This->gles->multi_draw = multi_draw_create(This);
+        if (!This->gles->multi_draw) return E_OUTOFMEMORY;
+        *ppv = This->gles->multi_draw;
+        return D3D_OK;
+    }
     return common_query_interface(This, riid, ppv);
 }
 static ULONG D3DAPI d3d8_device_add_ref(IDirect3DDevice8 *This) { return common_add_ref(This); }
-static ULONG D3DAPI d3d8_device_release(IDirect3DDevice8 *This) { return common_release(This); }
+static void batch_destroy(GLES_Batch *batch);
+static void scene_destroy(GLES_Scene *scene);
+static void staging_destroy(GLES_StagingPool *pool);
+static void shared_texture_free(GLES_Device *gles, GLES_SharedTexture *entry);
+static void atlas_page_free(GLES_Device *gles, GLES_AtlasPage *page);
+static ULONG D3DAPI d3d8_device_release(IDirect3DDevice8 *This) {
+    if (This && This->gles) {
+        scene_flush(This->gles);
+        scene_destroy(&This->gles->scene);
+        batch_destroy(&This->gles->batch);
+        free(This->gles->multi_draw);
+        This->gles->multi_draw = NULL;
+        free(This->gles->vertex_shaders);
+        This->gles->vertex_shaders = NULL;
+        This->gles->vertex_shader_count = 0;
+        staging_destroy(&This->gles->staging);
+        workers_destroy(This->gles->workers);
+        This->gles->workers = NULL;
+        // Loads still running finish before their context goes
+        loader_destroy(This->gles->loader);
+        This->gles->loader = NULL;
+        if (This->gles->loader_context != EGL_NO_CONTEXT) eglDestroyContext(This->gles->display, This->gles->loader_context);
+        if (This->gles->loader_surface != EGL_NO_SURFACE) eglDestroySurface(This->gles->display, This->gles->loader_surface);
+        This->gles->loader_context = EGL_NO_CONTEXT;
+        This->gles->loader_surface = EGL_NO_SURFACE;
+        for (UINT i = 0; i < GLES_DEDUP_BUCKETS; i++) {
+            while (This->gles->shared_textures[i]) shared_texture_free(This->gles, This->gles->shared_textures[i]);
+        }
+        while (This->gles->atlas_pages) atlas_page_free(This->gles, This->gles->atlas_pages);
+        free(This->gles->palettes);
+        This->gles->palettes = NULL;
+        This->gles->palette_count = 0;
+        if (This->gles->white_tex_id) glDeleteTextures(1, &This->gles->white_tex_id);
+        This->gles->white_tex_id = 0;
+    }
+    return common_release(This);
+}
+// Every texture and buffer is on the device's resource list in the order
+// they were last bound. When GL storage would pass the budget, managed ones
+// that are not bound give theirs up: lowest priority first, then least
+// recently bound.
+static void resource_link(GLES_Device *gles, GLES_Resource *resource) {
+    GLES_Resource *head = &gles->resources;
+    resource->prev = head->prev;
+    resource->next = head;
+    head->prev->next = resource;
+    head->prev = resource;
+}
+
+static void resource_unlink(GLES_Device *gles, GLES_Resource *resource) {
+    if (!resource->next) return;
+    resource->prev->next = resource->next;
+    resource->next->prev = resource->prev;
+    resource->prev = resource->next = NULL;
+    gles->resident_bytes -= resource->gl_bytes;
+    gles->stats.ResidentBytes = (DWORD)gles->resident_bytes;
+    resource->gl_bytes = 0;
+}
+
+static void resource_touch(GLES_Device *gles, GLES_Resource *resource) {
+    if (!resource->next || resource->next == &gles->resources) return;
+    resource->prev->next = resource->next;
+    resource->next->prev = resource->prev;
+    resource_link(gles, resource);
+}
+
+static BOOL resource_in_use(const GLES_Device *gles, const GLES_Resource *resource) {
+    if (resource->is_texture) {
+        for (UINT stage = 0; stage < GLES_MAX_TEXTURE_STAGES; stage++) {
+            if ((const GLES_Resource *)gles->applied.textures[stage] == resource) return TRUE;
+        }
+        return FALSE;
+    }
+    // Recorded and batched draws hold on to buffer names
+    if (gles->batch.count || gles->scene.draw_count) return TRUE;
+    if ((const GLES_Resource *)gles->index_buffer == resource) return TRUE;
+    for (UINT i = 0; i < GLES_MAX_STREAMS; i++) {
+        if ((const GLES_Resource *)gles->streams[i].buffer == resource) return TRUE;
+    }
+    return FALSE;
+}
+
+// Releases the GL storage of unbound managed resources until `bytes` are
+// freed or none are left, sparing `keep`. Returns the bytes freed.
+static size_t resource_evict(GLES_Device *gles, size_t bytes, const GLES_Resource *keep) {
+    size_t freed = 0;
+    while (freed < bytes) {
+        GLES_Resource *victim = NULL;
+        for (GLES_Resource *resource = gles->resources.next; resource != &gles->resources; resource = resource->next) {
+            if (resource == keep || !resource->managed || !resource->gl_bytes || resource_in_use(gles, resource))
+                continue;
+            if (!victim || resource->priority < victim->priority) victim = resource;
+        }
+        if (!victim) break;
+        if (victim->is_texture) {
+            texture_evict(gles, (GLES_Texture *)victim);
+        } else {
+            GLES_Buffer *buffer = (GLES_Buffer *)victim;
+            glDeleteBuffers(1, &buffer->vbo_id);
+            buffer->vbo_id = 0;
+        }
+        freed += victim->gl_bytes;
+        gles->resident_bytes -= victim->gl_bytes;
+        victim->gl_bytes = 0;
+        victim->evicted = TRUE;
+        gles->stats.Evictions++;
+    }
+    gles->stats.ResidentBytes = (DWORD)gles->resident_bytes;
+    return freed;
+}
+
+// Accounts for `bytes` more GL storage held by `resource`, first evicting
+// others as far as it takes to stay within the budget
+static void resource_grow(GLES_Device *gles, GLES_Resource *resource, size_t bytes) {
+    if (gles->resident_bytes + bytes > gles->managed_budget)
+        resource_evict(gles, gles->resident_bytes + bytes - gles->managed_budget, resource);
+    resource->gl_bytes += bytes;
+    gles->resident_bytes += bytes;
+    gles->stats.ResidentBytes = (DWORD)gles->resident_bytes;
+}
+
+// Only managed resources have a priority; the old one is returned
+static DWORD resource_set_priority(GLES_Resource *resource, DWORD priority) {
+    if (!resource->managed) return 0;
+    DWORD old = resource->priority;
+    resource->priority = priority;
+    return old;
+}
+
+static GLenum buffer_gl_usage(const GLES_Buffer *buffer) {
+    return (buffer->usage & D3DUSAGE_DYNAMIC) ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW;
+}
+
+// Binding a buffer marks it used; an evicted one gets GL storage back from
+// its shadow copy. Leaves `target` unbound.
+static void buffer_make_resident(GLES_Device *gles, GLES_Buffer *buffer, GLenum target) {
+    resource_touch(gles, &buffer->resource);
+    if (!buffer->resource.evicted) return;
+    buffer->resource.evicted = FALSE;
+    resource_grow(gles, &buffer->resource, buffer->length);
+    glGenBuffers(1, &buffer->vbo_id);
+    glBindBuffer(target, buffer->vbo_id);
+    glBufferData(target, buffer->length, buffer->shadow, buffer_gl_usage(buffer));
+    glBindBuffer(target, 0);
+    gles->stats.RestoreBytes += buffer->length;
+}
+
+static void buffer_destroy(IDirect3DDevice8 *device, GLES_Buffer *buffer) {
+    if (!buffer) return;
+    if (device && device->gles) {
+        batch_forget_buffer(device->gles, buffer);
+        resource_unlink(device->gles, &buffer->resource);
+    }
+    glDeleteBuffers(1, &buffer->vbo_id);
+    free(buffer->shadow);
+    free(buffer);
+}
 static HRESULT D3DAPI vb_query_interface(IDirect3DVertexBuffer8 *This, REFIID riid, void **ppv) {
     return common_query_interface(This, riid, ppv);
 }
 static ULONG D3DAPI vb_add_ref(IDirect3DVertexBuffer8 *This) { return common_add_ref(This); }
-static ULONG D3DAPI vb_release(IDirect3DVertexBuffer8 *This) { return common_release(This); }
+static ULONG D3DAPI vb_release(IDirect3DVertexBuffer8 *This) {
+    if (This) buffer_destroy(This->device, This->buffer);
+    return common_release(This);
+}
 static HRESULT D3DAPI ib_query_interface(IDirect3DIndexBuffer8 *This, REFIID riid, void **ppv) {
     return common_query_interface(This, riid, ppv);
 }
 static ULONG D3DAPI ib_add_ref(IDirect3DIndexBuffer8 *This) { return common_add_ref(This); }
-static ULONG D3DAPI ib_release(IDirect3DIndexBuffer8 *This) { return common_release(This); }
+static ULONG D3DAPI ib_release(IDirect3DIndexBuffer8 *This) {
+    if (This) buffer_destroy(This->device, This->buffer);
+    return common_release(This);
+}
 static HRESULT D3DAPI tex_query_interface(IDirect3DTexture8 *This, REFIID riid, void **ppv) { return common_query_interface(This, riid, ppv); }
 static ULONG D3DAPI tex_add_ref(IDirect3DTexture8 *This) { return common_add_ref(This); }
-static ULONG D3DAPI tex_release(IDirect3DTexture8 *This) {
-    if (This && This->texture) {
-        glDeleteTextures(1, &This->texture->tex_id);
-        free(This->texture->temp_buffer);
-        free(This->texture);
+// Uploads bind the texture being updated on unit 0; put back the one draws
+// expect
+static void restore_texture_binding(GLES_Device *gles) {
+    GLES_Texture *texture = gles->applied.textures[0];
+    if (gles->texenv_white & 1)
+        glBindTexture(GL_TEXTURE_2D, gles->white_tex_id);
+    else
+        glBindTexture(GL_TEXTURE_2D, texture && !(gles->loading_stages & 1) ? texture->tex_id : 0);
+}
+
+// Staging pool for texture locks
+static size_t staging_class(size_t size) {
+    size_t size_class = 0;
+    while (((size_t)1 << (size_class + GLES_STAGING_MIN_SHIFT)) < size) size_class++;
+    return size_class;
+}
+
+static BYTE *staging_acquire(GLES_StagingPool *pool, size_t size) {
+    size_t size_class = staging_class(size);
+    if (size_class >= GLES_STAGING_CLASSES) return NULL;
+    size_t block_size = (size_t)1 << (size_class + GLES_STAGING_MIN_SHIFT);
+    GLES_StagingBlock *block = pool->free_blocks[size_class];
+    if (block) {
+        pool->free_blocks[size_class] = block->next;
+        pool->cached_bytes -= block_size;
+    } else {
+        block = malloc(sizeof(GLES_StagingBlock) + block_size);
+        if (!block) return NULL;
+        block->size_class = size_class;
     }
-    return common_release(This);
+    block->next = NULL;
+    return (BYTE *)(block + 1);
 }
-static HRESULT D3DAPI tex_lock_rect(IDirect3DTexture8 *This, UINT Level, D3DLOCKED_RECT *pLockedRect, const RECT *pRect, DWORD Flags) {
-    (void)Flags;
-    if (!pLockedRect || Level >= This->texture->levels) return D3DERR_INVALIDCALL;
-    UINT w = This->texture->width >> Level;
-    UINT h = This->texture->height >> Level;
-    if (w == 0) w = 1;
-    if (h == 0) h = 1;
-    This->texture->temp_buffer = malloc(w * h * 4);
-    if (!This->texture->temp_buffer) return D3DERR_OUTOFVIDEOMEMORY;
-    pLockedRect->Pitch = w * 4;
-    pLockedRect->pBits = This->texture->temp_buffer;
-    return D3D_OK;
+
+static void staging_release(GLES_StagingPool *pool, BYTE *bits) {
+    if (!bits) return;
+    GLES_StagingBlock *block = (GLES_StagingBlock *)bits - 1;
+    size_t block_size = (size_t)1 << (block->size_class + GLES_STAGING_MIN_SHIFT);
+    if (pool->cached_bytes + block_size > GLES_STAGING_POOL_LIMIT) {
+        free(block);
+        return;
+    }
+    block->next = pool->free_blocks[block->size_class];
+    pool->free_blocks[block->size_class] = block;
+    pool->cached_bytes += block_size;
 }
-static HRESULT D3DAPI tex_unlock_rect(IDirect3DTexture8 *This, UINT Level) {
-    if (!This->texture->temp_buffer || Level >= This->texture->levels) return D3DERR_INVALIDCALL;
-    UINT w = This->texture->width >> Level;
-    UINT h = This->texture->height >> Level;
-    if (w == 0) w = 1;
-    if (h == 0) h = 1;
-    glBindTexture(GL_TEXTURE_2D, This->texture->tex_id);
-    glTexSubImage2D(GL_TEXTURE_2D, Level, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, This->texture->temp_buffer);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    free(This->texture->temp_buffer);
-    This->texture->temp_buffer = NULL;
-    return D3D_OK;
+
+static void staging_destroy(GLES_StagingPool *pool) {
+    for (int i = 0; i < GLES_STAGING_CLASSES; i++) {
+        while (pool->free_blocks[i]) {
+            GLES_StagingBlock *next = pool->free_blocks[i]->next;
+            free(pool->free_blocks[i]);
+            pool->free_blocks[i] = next;
+        }
+    }
+    pool->cached_bytes = 0;
 }
-static HRESULT D3DAPI tex_get_level_desc(IDirect3DTexture8 *This, UINT Level, D3DSURFACE_DESC *pDesc) {
-    if (!pDesc || Level >= This->texture->levels) return D3DERR_INVALIDCALL;
-    pDesc->Format = This->texture->format;
-    pDesc->Type = D3DRTYPE_TEXTURE;
-    pDesc->Usage = 0;
-    pDesc->Pool = D3DPOOL_MANAGED;
-    pDesc->Width = This->texture->width >> Level ? This->texture->width >> Level : 1;
-    pDesc->Height = This->texture->height >> Level ? This->texture->height >> Level : 1;
-    return D3D_OK;
+
+// What GL gives a new texture object
+static const GLES_SamplerState gl_default_sampler = {GL_NEAREST_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT, GL_REPEAT};
+
+static void texture_level_size(const GLES_Texture *texture, UINT level, UINT *width, UINT *height) {
+    *width = texture->width >> level ? texture->width >> level : 1;
+    *height = texture->height >> level ? texture->height >> level : 1;
 }
 
-static const IDirect3DDevice8Vtbl device_vtbl = {
-    .QueryInterface = d3d8_device_query_interface,
-    .AddRef = d3d8_device_add_ref,
-    .Release = d3d8_device_release,
-    .TestCooperativeLevel = d3d8_test_cooperative_level,
-    .GetAvailableTextureMem = d3d8_get_available_texture_mem,
-    .ResourceManagerDiscardBytes = d3d8_resource_manager_discard_bytes,
-    .GetDirect3D = d3d8_get_direct3d,
-    .GetDeviceCaps = device_get_device_caps,
-    .GetDisplayMode = d3d8_get_display_mode,
-    .GetCreationParameters = d3d8_get_creation_parameters,
-    .SetCursorProperties = d3d8_set_cursor_properties,
-    .SetCursorPosition = d3d8_set_cursor_position,
-    .ShowCursor = d3d8_show_cursor,
-    .CreateAdditionalSwapChain = d3d8_create_additional_swap_chain,
-    .Reset = d3d8_reset,
-    .Present = d3d8_present,
-    .GetBackBuffer = d3d8_get_back_buffer,
-    .GetRasterStatus = d3d8_get_raster_status,
-    .SetGammaRamp = d3d8_set_gamma_ramp,
-    .GetGammaRamp = d3d8_get_gamma_ramp,
-    .CreateVertexBuffer = d3d8_create_vertex_buffer,
-    .CreateIndexBuffer = d3d8_create_index_buffer,
-    .CreateTexture = d3d8_create_texture,
-    .SetTexture = d3d8_set_texture,
-    .SetTextureStageState = d3d8_set_texture_stage_state,
-    .SetRenderState = d3d8_set_render_state,
-    .BeginScene = d3d8_begin_scene,
-    .EndScene = d3d8_end_scene,
-    .SetStreamSource = d3d8_set_stream_source,
-    .SetIndices = d3d8_set_indices,
-    .SetViewport = d3d8_set_viewport,
-    .SetTransform = d3d8_set_transform,
-    .DrawIndexedPrimitive = d3d8_draw_indexed_primitive
-};
-static HRESULT D3DAPI d3d8_register_software_device(IDirect3D8 *This, void *pInitializeFunction) { return D3DERR_NOTAVAILABLE; }
-static UINT D3DAPI d3d8_get_adapter_count(IDirect3D8 *This) { return 1; }
-static HRESULT D3DAPI d3d8_get_adapter_identifier(IDirect3D8 *This,
-                                                  UINT Adapter,
-                                                  DWORD Flags,
-                                                  D3DADAPTER_IDENTIFIER8 *pIdentifier) {
-    if (Adapter != D3DADAPTER_DEFAULT || !pIdentifier) return D3DERR_INVALIDCALL;
+// Size of `level` in GL, which NPOT storage pads or rescales
+static void texture_storage_size(const GLES_Texture *texture, UINT level, UINT *width, UINT *height) {
+    *width = texture->gl_width >> level ? texture->gl_width >> level : 1;
+    *height = texture->gl_height >> level ? texture->gl_height >> level : 1;
+}
 
-    memset(pIdentifier, 0, sizeof(*pIdentifier));
+static const GLfloat texcoord_identity[4] = {1.0f, 1.0f, 0.0f, 0.0f};
+
+// Scale, then offset, taking `texture`'s coordinates to the part of tex_id
+// it fills: the top-left corner of padded NPOT storage, or its place on an
+// atlas page
+static void texture_coords(const GLES_Texture *texture, GLfloat coords[4]) {
+    memcpy(coords, texcoord_identity, sizeof(texcoord_identity));
+    if (texture && texture->atlas) {
+        const GLfloat page = (GLfloat)GLES_ATLAS_PAGE_SIZE;
+        coords[0] = (GLfloat)texture->width / page;
+        coords[1] = (GLfloat)texture->height / page;
+        coords[2] = (GLfloat)texture->atlas_x / page;
+        coords[3] = (GLfloat)texture->atlas_y / page;
+    } else if (texture && texture->npot == GLES_NPOT_PAD) {
+        coords[0] = (GLfloat)texture->width / (GLfloat)texture->gl_width;
+        coords[1] = (GLfloat)texture->height / (GLfloat)texture->gl_height;
+    }
+}
 
-    const char *renderer = (const char *)glGetString(GL_RENDERER);
-    if (!renderer) renderer = "d3d8_to_gles";
-    strncpy(pIdentifier->Driver, renderer, sizeof(pIdentifier->Driver) - 1);
+static UINT texture_texel_size(const GLES_Texture *texture) {
+    return texture->gl_format->texel_size;
+}
 
-    const char *vendor = (const char *)glGetString(GL_VENDOR);
-    if (!vendor) vendor = "Unknown";
-    strncpy(pIdentifier->Description, vendor, sizeof(pIdentifier->Description) - 1);
+// DXT levels whose blocks GL stores as they are
+static BOOL texture_compressed(const GLES_Texture *texture) {
+    return texture->gl_format->block_size && !texture->gl_format->decode;
+}
 
-    return D3D_OK;
+// Bytes of GL storage for `level`
+static size_t texture_level_bytes(const GLES_Texture *texture, UINT level) {
+    UINT w, h;
+    texture_storage_size(texture, level, &w, &h);
+    if (texture_compressed(texture)) return (size_t)((w + 3) / 4) * ((h + 3) / 4) * texture->gl_format->block_size;
+    return (size_t)w * h * texture_texel_size(texture);
 }
-static UINT D3DAPI d3d8_get_adapter_mode_count(IDirect3D8 *This, UINT Adapter) { return 1; }
-static HRESULT D3DAPI d3d8_enum_adapter_modes(IDirect3D8 *This,
-                                              UINT Adapter,
-                                              UINT Mode,
-                                              D3DDISPLAYMODE *pMode) {
-    if (Adapter != D3DADAPTER_DEFAULT || Mode > 0 || !pMode)
-        return D3DERR_INVALIDCALL;
 
-    *pMode = g_current_display_mode;
-    return D3D_OK;
+// Where `level` starts in memory holding the whole chain in GL layout;
+// passing the level count gives the size of the whole chain
+static size_t texture_level_offset(const GLES_Texture *texture, UINT level) {
+    size_t offset = 0;
+    for (UINT i = 0; i < level; i++) offset += texture_level_bytes(texture, i);
+    return offset;
 }
-static HRESULT D3DAPI d3d8_get_adapter_display_mode(IDirect3D8 *This, UINT Adapter, D3DDISPLAYMODE *pMode) { return D3DERR_NOTAVAILABLE; }
-static HRESULT D3DAPI d3d8_check_device_type(IDirect3D8 *This, UINT Adapter, D3DDEVTYPE CheckType, D3DFORMAT DisplayFormat, D3DFORMAT BackBufferFormat, BOOL Windowed) { return D3D_OK; }
-static HRESULT D3DAPI d3d8_check_device_format(IDirect3D8 *This, UINT Adapter, D3DDEVTYPE DeviceType, D3DFORMAT AdapterFormat, DWORD Usage, D3DRESOURCETYPE RType, D3DFORMAT CheckFormat) { return D3D_OK; }
-static HRESULT D3DAPI d3d8_check_device_multi_sample_type(IDirect3D8 *This, UINT Adapter, D3DDEVTYPE DeviceType, D3DFORMAT SurfaceFormat, BOOL Windowed, D3DMULTISAMPLE_TYPE MultiSampleType) { return D3DERR_NOTAVAILABLE; }
-static HRESULT D3DAPI d3d8_check_depth_stencil_match(IDirect3D8 *This, UINT Adapter, D3DDEVTYPE DeviceType, D3DFORMAT AdapterFormat, D3DFORMAT RenderTargetFormat, D3DFORMAT DepthStencilFormat) { return D3D_OK; }
-static HRESULT D3DAPI d3d8_get_device_caps(IDirect3D8 *This, UINT Adapter, D3DDEVTYPE DeviceType, D3DCAPS8 *pCaps) {
-    fill_d3d_caps(pCaps, DeviceType);
-    return D3D_OK;
+
+// Where `level`'s indices start in a P8 texture's palette image
+static size_t texture_palette_offset(const GLES_Texture *texture, UINT level) {
+    return sizeof(((GLES_Palette *)0)->entries) + texture_level_offset(texture, level);
 }
-static HMONITOR D3DAPI d3d8_get_adapter_monitor(IDirect3D8 *This, UINT Adapter) { return NULL; }
 
-static HRESULT D3DAPI d3d8_create_device(IDirect3D8 *This, UINT Adapter, D3DDEVTYPE DeviceType,
-                                        HWND hFocusWindow, DWORD BehaviorFlags,
-                                        D3DPRESENT_PARAMETERS *pPresentationParameters,
-                                        IDirect3DDevice8 **ppReturnedDeviceInterface) {
-    if (Adapter != D3DADAPTER_DEFAULT || !pPresentationParameters || DeviceType == D3DDEVTYPE_SW) {
-        return D3DERR_INVALIDCALL;
+// Where `level` starts in the copy of a texture's alpha plane, which has
+// the same GL size as the texture
+static size_t texture_alpha_offset(const GLES_Texture *texture, UINT level) {
+    size_t offset = 0;
+    for (UINT i = 0; i < level; i++) {
+        UINT w, h;
+        texture_storage_size(texture, i, &w, &h);
+        offset += (size_t)w * h;
     }
+    return offset;
+}
 
-    GLES_Device *gles = calloc(1, sizeof(GLES_Device));
-    if (!gles) return D3DERR_OUTOFVIDEOMEMORY;
+// Where `level` starts in a rescaled texture's npot_source, which holds
+// every level at its own size
+static size_t texture_source_offset(const GLES_Texture *texture, UINT level) {
+    size_t offset = 0;
+    for (UINT i = 0; i < level; i++) {
+        UINT w, h;
+        texture_level_size(texture, i, &w, &h);
+        offset += (size_t)w * h * texture_texel_size(texture);
+    }
+    return offset;
+}
 
-    gles->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
-    if (!eglInitialize(gles->display, NULL, NULL)) {
-        gles->display =
-            eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
-                                  (void *)(intptr_t)EGL_DEFAULT_DISPLAY,
-                                  NULL);
-        if (!eglInitialize(gles->display, NULL, NULL)) {
-            free(gles);
-            return D3DERR_INVALIDCALL;
+// The copy of `level` a managed texture restores from, allocated on first
+// use. NULL for P8 textures, whose palette image is their copy, and for
+// textures that stay resident.
+static BYTE *texture_backing_level(GLES_Texture *texture, UINT level) {
+    if (!texture->resource.managed || texture->palette_image) return NULL;
+    if (!texture->backing) {
+        texture->backing = malloc(texture_level_offset(texture, texture->levels));
+        // Without a copy the texture cannot be restored, so it is never evicted
+        if (!texture->backing) {
+            texture->resource.managed = FALSE;
+            return NULL;
         }
     }
+    return texture->backing + texture_level_offset(texture, level);
+}
 
-    BOOL want_window = hFocusWindow != NULL;
-    EGLConfig config =
-        choose_egl_config(gles->display, pPresentationParameters, want_window);
-    if (!config) {
-        eglTerminate(gles->display);
-        free(gles);
-        return D3DERR_INVALIDCALL;
+// Row pitch and row count of locked memory for `rect`: texels, or rows of
+// 4x4 blocks for DXT formats
+static void texture_lock_layout(const GLES_Texture *texture, const RECT *rect, UINT *pitch, UINT *rows) {
+    UINT w = (UINT)(rect->right - rect->left), h = (UINT)(rect->bottom - rect->top);
+    if (texture->gl_format->block_size) {
+        *pitch = (w + 3) / 4 * texture->gl_format->block_size;
+        *rows = (h + 3) / 4;
+    } else {
+        *pitch = w * texture_texel_size(texture);
+        *rows = h;
     }
+}
 
-    if (hFocusWindow) {
-        gles->surface = eglCreateWindowSurface(
-            gles->display, config,
-            (EGLNativeWindowType)(uintptr_t)hFocusWindow, NULL);
+// Level storage is allocated on the first unlock or bind rather than at
+// creation. `data`, when given, fills the whole level in the same call;
+// whole compressed levels are re-specified this way too. The texture must
+// be bound.
+static void texture_allocate_level(GLES_Device *gles, GLES_Texture *texture, UINT level, const void *data) {
+    const GLES_TextureFormat *format = texture->gl_format;
+    UINT w, h;
+    texture_storage_size(texture, level, &w, &h);
+    if (!(texture->allocated_levels & 1u << level)) {
+        size_t bytes = texture_level_bytes(texture, level);
+        resource_grow(gles, &texture->resource, bytes);
+        gles->stats.TextureDeferredBytes -= bytes;
+    }
+    if (texture_compressed(texture)) {
+        // Compressed storage cannot be allocated without data
+        GLsizei size = (GLsizei)texture_level_bytes(texture, level);
+        void *zero = data ? NULL : calloc(1, (size_t)size);
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, format->gl_format, w, h, 0, size, data ? data : zero);
+        free(zero);
     } else {
-        const EGLint pbuffer_attribs[] = {EGL_WIDTH,
-                                          pPresentationParameters->BackBufferWidth,
-                                          EGL_HEIGHT,
-                                          pPresentationParameters->BackBufferHeight,
-                                          EGL_NONE};
-        gles->surface =
-            eglCreatePbufferSurface(gles->display, config, pbuffer_attribs);
+        glTexImage2D(GL_TEXTURE_2D, level, format->gl_format, w, h, 0, format->gl_format, format->gl_type, data);
     }
-    gles->context = eglCreateContext(gles->display, config, EGL_NO_CONTEXT, NULL);
-    if (!gles->surface || !gles->context || !eglMakeCurrent(gles->display, gles->surface, gles->surface, gles->context)) {
-        if (gles->context) eglDestroyContext(gles->display, gles->context);
-        if (gles->surface) eglDestroySurface(gles->display, gles->surface);
-        eglTerminate(gles->display);
-        free(gles);
-        return D3DERR_INVALIDCALL;
+    texture->allocated_levels |= 1u << level;
+}
+
+// The driver builds and allocates the rest of the chain from level 0
+static void texture_mark_generated(GLES_Device *gles, GLES_Texture *texture) {
+    for (UINT level = 1; level < texture->levels; level++) {
+        if (texture->allocated_levels & 1u << level) continue;
+        size_t bytes = texture_level_bytes(texture, level);
+        resource_grow(gles, &texture->resource, bytes);
+        texture->allocated_levels |= 1u << level;
+        gles->stats.TextureDeferredBytes -= bytes;
     }
+}
 
-    gles->viewport.X = 0;
-    gles->viewport.Y = 0;
-    gles->viewport.Width = pPresentationParameters->BackBufferWidth;
-    gles->viewport.Height = pPresentationParameters->BackBufferHeight;
+// Largest unpack alignment that makes GL step rows by exactly `pitch`
+static GLint unpack_alignment(UINT pitch) {
+    if (pitch % 8 == 0) return 8;
+    if (pitch % 4 == 0) return 4;
+    if (pitch % 2 == 0) return 2;
+    return 1;
+}
+
+// Deletes the copies a renaming texture is not using; tex_id stays
+static void texture_delete_renames(GLES_Texture *texture) {
+    for (UINT i = 0; i < GLES_MAX_TEXTURE_RENAMES; i++) {
+        if (texture->renames[i].tex_id && texture->renames[i].tex_id != texture->tex_id)
+            glDeleteTextures(1, &texture->renames[i].tex_id);
+    }
+    memset(texture->renames, 0, sizeof(texture->renames));
+    texture->rename_slot = 0;
+}
+
+// Gives up the texture's GL storage; levels count as deferred again until
+// it is restored. The caller does the accounting.
+static void texture_evict(GLES_Device *gles, GLES_Texture *texture) {
+    if (texture->palette_image) {
+        for (UINT i = 0; i < GLES_PALETTE_CACHE_SLOTS; i++) {
+            GLES_PaletteSlot *slot = &texture->palette_slots[i];
+            if (slot->tex_id) glDeleteTextures(1, &slot->tex_id);
+            slot->tex_id = 0;
+            slot->valid = FALSE;
+            slot->last_used = 0;
+        }
+    } else {
+        // Only a texture alone with its contents holds storage to evict
+        if (texture->shared) texture_unshare(gles, texture, FALSE);
+        texture_delete_renames(texture);
+        glDeleteTextures(1, &texture->tex_id);
+    }
+    texture->tex_id = 0;
+    if (texture->alpha_tex_id) glDeleteTextures(1, &texture->alpha_tex_id);
+    texture->alpha_tex_id = 0;
+    for (UINT level = 0; level < texture->levels; level++) {
+        if (texture->allocated_levels & 1u << level) gles->stats.TextureDeferredBytes += texture_level_bytes(texture, level);
+    }
+    texture->allocated_levels = 0;
+}
+
+// Re-creates an evicted texture from its copies and leaves it bound to the
+// active unit. P8 textures rebuild a palette copy when next bound instead.
+static void texture_restore(GLES_Device *gles, GLES_Texture *texture) {
+    texture->resource.evicted = FALSE;
+    if (texture->palette_image) return;
+    glGenTextures(1, &texture->tex_id);
+    texture->sampler = gl_default_sampler;
+    glBindTexture(GL_TEXTURE_2D, texture->tex_id);
+    if (texture->autogen_mipmap) glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
+    BOOL compressed = texture_compressed(texture);
+    for (UINT level = 0; level < texture->levels; level++) {
+        if (!(texture->backed_levels & 1u << level)) continue;
+        UINT w, h;
+        texture_storage_size(texture, level, &w, &h);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, compressed ? 1 : unpack_alignment(w * texture_texel_size(texture)));
+        texture_allocate_level(gles, texture, level, texture->backing + texture_level_offset(texture, level));
+        gles->stats.RestoreBytes += texture_level_bytes(texture, level);
+    }
+    if (texture->autogen_mipmap && (texture->backed_levels & 1u)) texture_mark_generated(gles, texture);
+    if (texture->alpha_backing) {
+        glGenTextures(1, &texture->alpha_tex_id);
+        texture->alpha_sampler = gl_default_sampler;
+        glBindTexture(GL_TEXTURE_2D, texture->alpha_tex_id);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (UINT level = 0; level < texture->levels; level++) {
+            UINT w, h;
+            texture_storage_size(texture, level, &w, &h);
+            resource_grow(gles, &texture->resource, (size_t)w * h);
+            glTexImage2D(GL_TEXTURE_2D, level, GL_ALPHA, w, h, 0, GL_ALPHA, GL_UNSIGNED_BYTE,
+                         texture->alpha_backing + texture_alpha_offset(texture, level));
+            gles->stats.RestoreBytes += (size_t)w * h;
+        }
+        glBindTexture(GL_TEXTURE_2D, texture->tex_id);
+    }
+}
+
+// A background load. Decode threads fill `levels`, the upload thread hands
+// them to GL, and the device thread takes the result over in
+// texture_finish_load.
+typedef struct GLES_TextureLoad {
+    GLES_LoadJob job;           // first, so loader steps can cast back
+    IDirect3DTexture8 *texture;
+    GLES_FileView view;         // the file, when the load mapped it
+    GLES_ImageInfo info;
+    UINT loaded;                // levels read from the file; the rest are filtered from them
+    BOOL copy_blocks;
+    DWORD filter;
+    DWORD mip_filter;
+    D3DCOLOR color_key;
+    BYTE *levels;               // every level in GL layout, at texture_level_offset
+    BYTE *source;               // NPOT storage: every level at its own size, which `levels` is built from
+    BYTE **blocks;              // decoded DXT formats: each level's blocks, kept for locks
+    uint32_t uploaded;          // levels `levels` holds
+    DWORD blocks_decoded;
+    HRESULT hr;
+    LPD3DGLESLOADCALLBACK callback;
+    void *context;
+} GLES_TextureLoad;
+
+static void texture_load_free(GLES_TextureLoad *load, UINT levels) {
+    for (UINT level = 0; load->blocks && level < levels; level++) free(load->blocks[level]);
+    free(load->blocks);
+    free(load->levels);
+    free(load->source);
+    image_unmap_file(&load->view);
+    free(load);
+}
+
+// Takes over a finished background load: the storage it gave GL is
+// accounted for, and managed textures keep its levels as their copy.
+// Returns FALSE while the load still runs, unless `wait` is set.
+static BOOL texture_finish_load(GLES_Device *gles, GLES_Texture *texture, BOOL wait) {
+    GLES_TextureLoad *load = texture->load;
+    if (!load) return TRUE;
+    if (!loader_done(&load->job)) {
+        if (!wait) return FALSE;
+        loader_wait(gles->loader, &load->job);
+    }
+    texture->load = NULL;
+    texture->load_status = load->hr;
+    if (load->hr == D3D_OK) {
+        for (UINT level = 0; level < texture->levels; level++) {
+            if (!(load->uploaded & 1u << level)) continue;
+            size_t bytes = texture_level_bytes(texture, level);
+            resource_grow(gles, &texture->resource, bytes);
+            texture->allocated_levels |= 1u << level;
+            gles->stats.TextureDeferredBytes -= bytes;
+            gles->stats.TextureUploadBytes += bytes;
+            if (texture->npot) gles->stats.NpotTexelsBuilt += (DWORD)(bytes / texture_texel_size(texture));
+            if (load->blocks) {
+                texture->locks[level].blocks = load->blocks[level];
+                load->blocks[level] = NULL;
+            }
+        }
+        if (texture->autogen_mipmap && (load->uploaded & 1u)) texture_mark_generated(gles, texture);
+        if (texture->resource.managed && !texture->palette_image) {
+            texture->backing = load->levels;
+            texture->backed_levels = load->uploaded;
+            load->levels = NULL;
+        }
+        if (texture->npot == GLES_NPOT_RESCALE) {
+            free(texture->npot_source);
+            texture->npot_source = load->source;
+            load->source = NULL;
+        }
+        gles->stats.TextureBlocksDecoded += load->blocks_decoded;
+    }
+    texture_load_free(load, texture->levels);
+    return TRUE;
+}
+
+// Abandons a load for a texture being released; whatever it gave GL goes
+// with the texture object
+static void texture_drop_load(GLES_Device *gles, GLES_Texture *texture) {
+    GLES_TextureLoad *load = texture->load;
+    if (!load) return;
+    if (gles->loader) loader_cancel(gles->loader, &load->job);
+    texture->load = NULL;
+    texture_load_free(load, texture->levels);
+}
+
+static ULONG D3DAPI tex_release(IDirect3DTexture8 *This) {
+    if (This && This->texture) {
+        GLES_Device *gles = This->device->gles;
+        scene_flush(gles);
+        for (DWORD stage = 0; stage < GLES_MAX_TEXTURE_STAGES; stage++) {
+            if (gles->state.textures[stage] == This->texture) gles->state.textures[stage] = NULL;
+            if (gles->applied.textures[stage] == This->texture) {
+                gles->applied.textures[stage] = NULL;
+                gles->loading_stages &= ~(1u << stage);
+                gles->texenv_dirty = TRUE;
+            }
+        }
+        texture_drop_load(gles, This->texture);
+        if (This->texture->palette_image) {
+            for (UINT i = 0; i < GLES_PALETTE_CACHE_SLOTS; i++) glDeleteTextures(1, &This->texture->palette_slots[i].tex_id);
+        } else if (This->texture->atlas) {
+            texture_leave_atlas(gles, This->texture);
+        } else {
+            if (This->texture->shared) texture_unshare(gles, This->texture, FALSE);
+            texture_delete_renames(This->texture);
+            glDeleteTextures(1, &This->texture->tex_id);
+        }
+        if (This->texture->alpha_tex_id) glDeleteTextures(1, &This->texture->alpha_tex_id);
+        resource_unlink(gles, &This->texture->resource);
+        for (UINT level = 0; level < This->texture->levels; level++) {
+            staging_release(&gles->staging, This->texture->locks[level].bits);
+            free(This->texture->locks[level].blocks);
+            if (!(This->texture->allocated_levels & 1u << level)) {
+                size_t bytes = texture_level_bytes(This->texture, level);
+                gles->stats.TextureDeferredBytes -= bytes;
+                gles->stats.TextureAvoidedBytes += bytes;
+            }
+        }
+        free(This->texture->locks);
+        free(This->texture->mip_source);
+        free(This->texture->palette_image);
+        free(This->texture->backing);
+        free(This->texture->alpha_backing);
+        free(This->texture->npot_source);
+        free(This->texture);
+    }
+    return common_release(This);
+}
+// Locks hand out staging memory covering just the rectangle; GL ES cannot
+// read textures back, so it is filled from the CPU copies instead: decoded
+// DXT levels keep their blocks, P8 levels their indices, and managed levels
+// their backing. Anything else, and D3DLOCK_DISCARD locks, start undefined.
+// Each level has its own lock, so several levels may be locked at once.
+static HRESULT D3DAPI tex_lock_rect(IDirect3DTexture8 *This, UINT Level, D3DLOCKED_RECT *pLockedRect, const RECT *pRect, DWORD Flags) {
+    GLES_Texture *texture = This->texture;
+    // A background load's levels land first
+    texture_finish_load(This->device->gles, texture, TRUE);
+    if (!pLockedRect || Level >= texture->levels || texture->locks[Level].bits) return D3DERR_INVALIDCALL;
+    UINT w, h;
+    texture_level_size(texture, Level, &w, &h);
+    RECT rect = {0, 0, (LONG)w, (LONG)h};
+    if (pRect) {
+        if (pRect->left < 0 || pRect->top < 0 || pRect->left >= pRect->right || pRect->top >= pRect->bottom ||
+            pRect->right > (LONG)w || pRect->bottom > (LONG)h)
+            return D3DERR_INVALIDCALL;
+        // DXT rectangles cover whole blocks
+        if (texture->gl_format->block_size &&
+            (pRect->left % 4 || pRect->top % 4 || (pRect->right % 4 && pRect->right != (LONG)w) ||
+             (pRect->bottom % 4 && pRect->bottom != (LONG)h)))
+            return D3DERR_INVALIDCALL;
+        // Compressed ETC1 levels take sub-rectangles only with GL_EXT_compressed_ETC1_RGB8_sub_texture
+        if (texture->gl_format->gl_format == GL_ETC1_RGB8_OES && !This->device->gles->etc1_sub_texture &&
+            (pRect->left || pRect->top || pRect->right != (LONG)w || pRect->bottom != (LONG)h))
+            return D3DERR_INVALIDCALL;
+        rect = *pRect;
+    }
+    UINT pitch, rows;
+    texture_lock_layout(texture, &rect, &pitch, &rows);
+    BYTE *bits = staging_acquire(&This->device->gles->staging, (size_t)pitch * rows);
+    if (!bits) return D3DERR_OUTOFVIDEOMEMORY;
+    // Writes go to a GL texture of its own
+    if (texture->shared && !(Flags & D3DLOCK_READONLY)) texture_unshare(This->device->gles, texture, TRUE);
+
+    GLES_TextureLock *lock = &texture->locks[Level];
+    if (lock->blocks) {
+        UINT block_size = texture->gl_format->block_size;
+        size_t level_pitch = (size_t)(w + 3) / 4 * block_size;
+        for (UINT row = 0; row < rows; row++)
+            memcpy(bits + (size_t)row * pitch, lock->blocks + (rect.top / 4 + row) * level_pitch + rect.left / 4 * block_size,
+                   pitch);
+    } else if (texture->palette_image) {
+        const BYTE *indices = texture->palette_image + texture_palette_offset(texture, Level);
+        for (UINT row = 0; row < rows; row++)
+            memcpy(bits + (size_t)row * pitch, indices + (size_t)(rect.top + row) * w + rect.left, pitch);
+    } else if (!(Flags & D3DLOCK_DISCARD) && texture->backing && (texture->backed_levels & 1u << Level)) {
+        // Texels the application leaves alone go back up unchanged
+        texture_read_rect(This->device->gles, texture, Level, &rect, bits, pitch);
+    }
+    lock->bits = bits;
+    lock->rect = rect;
+    lock->pitch = pitch;
+    lock->flags = Flags;
+    pLockedRect->Pitch = (int)pitch;
+    pLockedRect->pBits = bits;
+    return D3D_OK;
+}
+// Called for each full upload of level 0. Once the texture is rewritten
+// every frame (or from the start for D3DUSAGE_DYNAMIC), the first such
+// upload in a frame moves tex_id on to the next of its copies, so it does
+// not wait for frames still sampling the current one. Returns TRUE when
+// that copy has no storage yet, which is then accounted for here.
+static BOOL texture_rename(GLES_Device *gles, GLES_Texture *texture) {
+    if (texture->upload_frame == gles->frame) return FALSE;
+    texture->upload_streak = texture->upload_frame + 1 == gles->frame ? texture->upload_streak + 1 : 1;
+    texture->upload_frame = gles->frame;
+    if (!(texture->usage & D3DUSAGE_DYNAMIC) && texture->upload_streak < GLES_RENAME_STREAK) return FALSE;
+    // Nothing samples a level without storage; other levels would need
+    // uploading to every copy unless GL generates them
+    if (gles->texture_renames < 2 || !(texture->allocated_levels & 1u) || texture->alpha_tex_id || texture->shared ||
+        texture->atlas || (texture->levels > 1 && !texture->autogen_mipmap))
+        return FALSE;
+    GLES_RenameSlot *slot = &texture->renames[texture->rename_slot];
+    slot->tex_id = texture->tex_id;
+    slot->sampler = texture->sampler;
+    texture->rename_slot = (texture->rename_slot + 1) % gles->texture_renames;
+    slot = &texture->renames[texture->rename_slot];
+    BOOL fresh = !slot->tex_id;
+    if (fresh) {
+        glGenTextures(1, &slot->tex_id);
+        slot->sampler = gl_default_sampler;
+        glBindTexture(GL_TEXTURE_2D, slot->tex_id);
+        if (texture->autogen_mipmap) glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
+        for (UINT level = 0; level < texture->levels; level++) {
+            if (texture->allocated_levels & 1u << level)
+                resource_grow(gles, &texture->resource, texture_level_bytes(texture, level));
+        }
+    }
+    texture->tex_id = slot->tex_id;
+    texture->sampler = slot->sampler;
+    gles->stats.TextureRenames++;
+    return fresh;
+}
+
+// Points the units `texture` is bound on at its new tex_id, and at the part
+// of it the texture fills
+static void texture_rebind_stages(GLES_Device *gles, GLES_Texture *texture) {
+    for (UINT stage = 0; stage < gles->texture_units; stage++) {
+        UINT bit = 1u << stage;
+        if (gles->applied.textures[stage] != texture || ((gles->loading_stages | gles->texenv_white) & bit)) continue;
+        glActiveTexture(GL_TEXTURE0 + stage);
+        glBindTexture(GL_TEXTURE_2D, texture->tex_id);
+        texture_apply_sampler(gles, stage, texture);
+        texture_apply_coords(gles, stage, texture);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+// Recorded draws sample `texture` as GL holds it when they are replayed, and
+// the pending batch as it holds it now. Whichever uses it is submitted
+// before the texture changes.
+static void texture_flush_readers(GLES_Device *gles, const GLES_Texture *texture) {
+    if (gles->scene.draw_count && texture->scene_generation == gles->scene.generation) {
+        scene_flush(gles);
+        return;
+    }
+    if (!gles->batch.count) return;
+    for (DWORD stage = 0; stage < GLES_MAX_TEXTURE_STAGES; stage++) {
+        if (gles->applied.textures[stage] == texture) {
+            batch_flush(gles);
+            return;
+        }
+    }
+}
+
+// Copies GL-layout texels covering `rect` of `level`'s GL storage into a
+// managed texture's copy
+static void texture_store_backing(GLES_Texture *texture, UINT level, const RECT *rect, UINT pitch, const void *bits) {
+    BYTE *backing = texture_backing_level(texture, level);
+    if (!backing) return;
+    BOOL compressed = texture_compressed(texture);
+    UINT w = (UINT)(rect->right - rect->left), h = (UINT)(rect->bottom - rect->top);
+    UINT rows = compressed ? (h + 3) / 4 : h;
+    UINT level_w, level_h;
+    texture_storage_size(texture, level, &level_w, &level_h);
+    UINT unit = compressed ? texture->gl_format->block_size : texture_texel_size(texture);
+    size_t level_pitch = (size_t)(compressed ? (level_w + 3) / 4 : level_w) * unit;
+    size_t row_bytes = (size_t)(compressed ? (w + 3) / 4 : w) * unit;
+    BYTE *dst = backing + (size_t)(compressed ? rect->top / 4 : rect->top) * level_pitch +
+                (size_t)(compressed ? rect->left / 4 : rect->left) * unit;
+    for (UINT row = 0; row < rows; row++)
+        memcpy(dst + row * level_pitch, (const BYTE *)bits + (size_t)row * pitch, row_bytes);
+    texture->backed_levels |= 1u << level;
+}
+
+// Uploads GL-layout texels covering `rect` of `level`'s GL storage, giving
+// the level its storage first if it has none.
+static void texture_upload_storage(GLES_Device *gles, GLES_Texture *texture, UINT level, const RECT *rect, UINT pitch,
+                                   const void *bits) {
+    const GLES_TextureFormat *format = texture->gl_format;
+    GLsizei w = (GLsizei)(rect->right - rect->left);
+    GLsizei h = (GLsizei)(rect->bottom - rect->top);
+    BOOL compressed = texture_compressed(texture);
+    UINT rows = (UINT)(compressed ? (h + 3) / 4 : h);
+    UINT size = pitch * rows;
+    UINT level_w, level_h;
+    texture_storage_size(texture, level, &level_w, &level_h);
+    texture_store_backing(texture, level, rect, pitch, bits);
+    // An evicted texture picks the change up from its copy when restored
+    if (texture->resource.evicted) return;
+    texture_flush_readers(gles, texture);
+    BOOL whole = (UINT)w == level_w && (UINT)h == level_h;
+    GLuint previous = texture->tex_id;
+    BOOL fresh = whole && level == 0 && texture_rename(gles, texture);
+    glBindTexture(GL_TEXTURE_2D, texture->tex_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment(pitch));
+    BOOL allocated = (texture->allocated_levels & 1u << level) && !fresh;
+    // ETC1 without the sub-texture extension can only be replaced whole
+    if ((!allocated || compressed) && whole) {
+        texture_allocate_level(gles, texture, level, bits);
+    } else {
+        if (!allocated) texture_allocate_level(gles, texture, level, NULL);
+        if (compressed) {
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, level, (GLint)rect->left, (GLint)rect->top, w, h,
+                                      format->gl_format, (GLsizei)size, bits);
+        } else {
+            glTexSubImage2D(GL_TEXTURE_2D, level, (GLint)rect->left, (GLint)rect->top, w, h, format->gl_format,
+                            format->gl_type, bits);
+        }
+    }
+    if (texture->autogen_mipmap && level == 0) texture_mark_generated(gles, texture);
+    if (texture->tex_id != previous) texture_rebind_stages(gles, texture);
+    restore_texture_binding(gles);
+    gles->stats.TextureUploadBytes += size;
+}
+
+// Destination texels [first, end) of a bilinear scale from `src` to `dst`
+// texels whose taps may read source texels [lo, hi)
+static void npot_span(LONG lo, LONG hi, UINT src, UINT dst, LONG *first, LONG *end) {
+    double ratio = (double)dst / src;
+    // A texel either side covers the rounding of the fixed-point taps
+    LONG a = (LONG)floor((lo - 0.5) * ratio - 0.5) - 1;
+    LONG b = (LONG)ceil((hi + 0.5) * ratio - 0.5) + 1;
+    *first = a < 0 ? 0 : a;
+    *end = b > (LONG)dst ? (LONG)dst : b;
+}
+
+// The part of `level`'s GL storage that writing `rect` of its texels
+// changes: padding repeats the right and bottom edges, and a rescaled texel
+// depends on the texels its bilinear tap reads
+static void texture_npot_region(const GLES_Texture *texture, UINT level, const RECT *rect, RECT *out) {
+    UINT w, h, gl_w, gl_h;
+    texture_level_size(texture, level, &w, &h);
+    texture_storage_size(texture, level, &gl_w, &gl_h);
+    if (texture->npot == GLES_NPOT_PAD) {
+        *out = *rect;
+        if ((UINT)rect->right == w) out->right = (LONG)gl_w;
+        if ((UINT)rect->bottom == h) out->bottom = (LONG)gl_h;
+        return;
+    }
+    npot_span(rect->left, rect->right, w, gl_w, &out->left, &out->right);
+    npot_span(rect->top, rect->bottom, h, gl_h, &out->top, &out->bottom);
+}
+
+// Builds the GL texels of `out` into `dst`, rows `dst_pitch` apart, from
+// `level`'s texels in `src`, which cover `src_rect`: the whole level for
+// rescaled storage, at least the texels `out` repeats for padded storage.
+// `format` is the texture's, or its alpha plane's.
+static HRESULT texture_npot_build(const GLES_Texture *texture, const GLES_TextureFormat *format, UINT level,
+                                  const BYTE *src, size_t src_pitch, const RECT *src_rect, const RECT *out, BYTE *dst,
+                                  size_t dst_pitch, GLES_WorkerPool *pool) {
+    UINT w, h;
+    texture_level_size(texture, level, &w, &h);
+    if (texture->npot == GLES_NPOT_RESCALE) {
+        UINT gl_w, gl_h;
+        texture_storage_size(texture, level, &gl_w, &gl_h);
+        return texfilter_resample(format, src, src_pitch, w, h, dst, dst_pitch, gl_w, gl_h, out, pool);
+    }
+    UINT texel = format->texel_size;
+    LONG inside = (out->right < (LONG)w ? out->right : (LONG)w) - out->left;
+    for (LONG y = out->top; y < out->bottom; y++) {
+        const BYTE *row = src + (size_t)((y < (LONG)h ? y : (LONG)h - 1) - src_rect->top) * src_pitch;
+        BYTE *to = dst + (size_t)(y - out->top) * dst_pitch;
+        memcpy(to, row + (size_t)(out->left - src_rect->left) * texel, (size_t)inside * texel);
+        const BYTE *edge = row + (size_t)((LONG)w - 1 - src_rect->left) * texel;
+        for (LONG x = inside; x < out->right - out->left; x++) memcpy(to + (size_t)x * texel, edge, texel);
+    }
+    return D3D_OK;
+}
+
+static void atlas_page_free(GLES_Device *gles, GLES_AtlasPage *page) {
+    GLES_AtlasPage **link = &gles->atlas_pages;
+    while (*link != page) link = &(*link)->next;
+    *link = page->next;
+    glDeleteTextures(1, &page->tex_id);
+    atlas_pack_destroy(page->packer);
+    gles->resident_bytes -= page->gl_bytes;
+    gles->stats.ResidentBytes = (DWORD)gles->resident_bytes;
+    free(page);
+}
+
+// Places a new texture that qualifies for the atlas on a page of its GL
+// format, inside a border of one texel, starting a page when none has
+// room. Pages hold their storage from the start and are never evicted.
+// Returns FALSE when the texture is to have storage of its own.
+static BOOL texture_place_atlas(GLES_Device *gles, GLES_Texture *texture) {
+    const GLES_TextureFormat *format = texture->gl_format;
+    if (!gles->atlas_max_size || texture->pool != D3DPOOL_MANAGED || texture->levels != 1 ||
+        (texture->usage & D3DUSAGE_DYNAMIC) || texture->width > gles->atlas_max_size ||
+        texture->height > gles->atlas_max_size || format->gl_format == GL_PALETTE8_RGBA8_OES ||
+        (format->block_size && !format->decode))
+        return FALSE;
+    UINT w = texture->width + 2, h = texture->height + 2, x, y;
+    GLES_AtlasPage *page = gles->atlas_pages;
+    while (page && !(page->gl_format == format && atlas_pack_insert(page->packer, w, h, &x, &y))) page = page->next;
+    if (!page) {
+        page = calloc(1, sizeof(GLES_AtlasPage));
+        GLES_AtlasPacker *packer = page ? atlas_pack_create(GLES_ATLAS_PAGE_SIZE, GLES_ATLAS_PAGE_SIZE) : NULL;
+        if (!packer || !atlas_pack_insert(packer, w, h, &x, &y)) {
+            atlas_pack_destroy(packer);
+            free(page);
+            return FALSE;
+        }
+        page->gl_format = format;
+        page->packer = packer;
+        page->gl_bytes = (size_t)GLES_ATLAS_PAGE_SIZE * GLES_ATLAS_PAGE_SIZE * format->texel_size;
+        if (gles->resident_bytes + page->gl_bytes > gles->managed_budget)
+            resource_evict(gles, gles->resident_bytes + page->gl_bytes - gles->managed_budget, NULL);
+        gles->resident_bytes += page->gl_bytes;
+        gles->stats.ResidentBytes = (DWORD)gles->resident_bytes;
+        glGenTextures(1, &page->tex_id);
+        page->sampler = gl_default_sampler;
+        glBindTexture(GL_TEXTURE_2D, page->tex_id);
+        glTexImage2D(GL_TEXTURE_2D, 0, format->gl_format, GLES_ATLAS_PAGE_SIZE, GLES_ATLAS_PAGE_SIZE, 0,
+                     format->gl_format, format->gl_type, NULL);
+        restore_texture_binding(gles);
+        page->next = gles->atlas_pages;
+        gles->atlas_pages = page;
+    }
+    page->refs++;
+    texture->atlas = page;
+    texture->atlas_x = x + 1;
+    texture->atlas_y = y + 1;
+    texture->tex_id = page->tex_id;
+    texture->allocated_levels = 1;
+    gles->stats.AtlasTextures++;
+    return TRUE;
+}
+
+// Gives up the texture's place on its page, and the page with the last one
+static void texture_leave_atlas(GLES_Device *gles, GLES_Texture *texture) {
+    GLES_AtlasPage *page = texture->atlas;
+    texture->atlas = NULL;
+    texture->tex_id = 0;
+    gles->stats.AtlasTextures--;
+    if (--page->refs == 0) atlas_page_free(gles, page);
+}
+
+// Moves `texture` off its page to a GL texture of its own, for good. It
+// takes its contents along when `copy` is set; otherwise its level counts
+// as never allocated.
+static void texture_unatlas(GLES_Device *gles, GLES_Texture *texture, BOOL copy) {
+    // Pending batched draws sample it on the page
+    batch_flush(gles);
+    texture_leave_atlas(gles, texture);
+    glGenTextures(1, &texture->tex_id);
+    texture->sampler = gl_default_sampler;
+    texture->allocated_levels = 0;
+    gles->stats.TextureDeferredBytes += texture_level_bytes(texture, 0);
+    if (copy) {
+        const BYTE *backing = texture->backed_levels & 1u ? texture->backing : NULL;
+        glBindTexture(GL_TEXTURE_2D, texture->tex_id);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment(texture->width * texture_texel_size(texture)));
+        texture_allocate_level(gles, texture, 0, backing);
+        if (backing) gles->stats.TextureUploadBytes += texture_level_bytes(texture, 0);
+    }
+    texture_rebind_stages(gles, texture);
+    restore_texture_binding(gles);
+}
+
+// Atlased textures sample as with D3DTADDRESS_CLAMP only, so one bound to a
+// stage that wraps or mirrors leaves its page before the draw
+static void atlas_check_addressing(GLES_Device *gles) {
+    const uint32_t address = 1u << D3DTSS_ADDRESSU | 1u << D3DTSS_ADDRESSV;
+    for (UINT stage = 0; stage < gles->texture_units; stage++) {
+        GLES_Texture *texture = gles->applied.textures[stage];
+        if (!texture || !texture->atlas) continue;
+        const DWORD *states = gles->applied.texture_stage_states[stage];
+        if ((gles->applied.texture_stage_state_mask[stage] & address) != address ||
+            states[D3DTSS_ADDRESSU] != D3DTADDRESS_CLAMP || states[D3DTSS_ADDRESSV] != D3DTADDRESS_CLAMP)
+            texture_unatlas(gles, texture, TRUE);
+    }
+}
+
+// Whether binding `texture` to `stage` can leave the pending batch open:
+// draws on either side sample stage 0 only, from the same atlas page, and
+// each batch record carries where its texture sits. Coordinates baked onto
+// the page would come before a texture transform instead of after it.
+static BOOL atlas_switch_batches(const GLES_Device *gles, DWORD stage, const GLES_Texture *texture) {
+    const GLES_Texture *current = gles->applied.textures[0];
+    if (stage || !gles->batch.count || !texture || !texture->atlas || !current || current->atlas != texture->atlas ||
+        (gles->loading_stages & 1) || texture_transform_flags(&gles->applied, 0))
+        return FALSE;
+    for (UINT unit = 1; unit < GLES_MAX_TEXTURE_STAGES; unit++) {
+        if (gles->applied.textures[unit]) return FALSE;
+    }
+    return TRUE;
+}
+
+// Uploads texels covering `rect` of an atlased texture to its page, along
+// with the border texels beside whichever edges the rectangle reaches,
+// which repeat them so filtering clamps at the texture's edge
+static void atlas_upload(GLES_Device *gles, GLES_Texture *texture, const RECT *rect, UINT pitch, const void *bits) {
+    const GLES_TextureFormat *format = texture->gl_format;
+    UINT texel = format->texel_size;
+    LONG w = (LONG)texture->width, h = (LONG)texture->height;
+    texture_store_backing(texture, 0, rect, pitch, bits);
+    RECT out = {rect->left ? rect->left : -1, rect->top ? rect->top : -1, rect->right < w ? rect->right : w + 1,
+                rect->bottom < h ? rect->bottom : h + 1};
+    size_t row_bytes = (size_t)(rect->right - rect->left) * texel;
+    size_t out_pitch = (size_t)(out.right - out.left) * texel;
+    BYTE *built = staging_acquire(&gles->staging, out_pitch * (size_t)(out.bottom - out.top));
+    if (!built) return;
+    for (LONG y = out.top; y < out.bottom; y++) {
+        LONG from = y < rect->top ? rect->top : y >= rect->bottom ? rect->bottom - 1 : y;
+        const BYTE *row = (const BYTE *)bits + (size_t)(from - rect->top) * pitch;
+        BYTE *to = built + (size_t)(y - out.top) * out_pitch;
+        if (out.left < rect->left) {
+            memcpy(to, row, texel);
+            to += texel;
+        }
+        memcpy(to, row, row_bytes);
+        if (out.right > rect->right) memcpy(to + row_bytes, row + row_bytes - texel, texel);
+    }
+    texture_flush_readers(gles, texture);
+    glBindTexture(GL_TEXTURE_2D, texture->tex_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment((UINT)out_pitch));
+    glTexSubImage2D(GL_TEXTURE_2D, 0, (GLint)texture->atlas_x + out.left, (GLint)texture->atlas_y + out.top,
+                    (GLsizei)(out.right - out.left), (GLsizei)(out.bottom - out.top), format->gl_format,
+                    format->gl_type, built);
+    restore_texture_binding(gles);
+    gles->stats.TextureUploadBytes += out_pitch * (size_t)(out.bottom - out.top);
+    staging_release(&gles->staging, built);
+}
+
+// Uploads GL-layout texels covering `rect` of `level`. NPOT storage is
+// brought up to date around the rectangle only: padding repeats whichever
+// edges it touches, and rescaled levels keep their own texels to refilter
+// the GL texels near the change from.
+static void texture_upload(GLES_Device *gles, GLES_Texture *texture, UINT level, const RECT *rect, UINT pitch,
+                           const void *bits) {
+    if (texture->atlas) {
+        atlas_upload(gles, texture, rect, pitch, bits);
+        return;
+    }
+    if (!texture->npot) {
+        texture_upload_storage(gles, texture, level, rect, pitch, bits);
+        return;
+    }
+    UINT texel = texture_texel_size(texture);
+    const BYTE *src = bits;
+    size_t src_pitch = pitch;
+    RECT src_rect = *rect;
+    if (texture->npot == GLES_NPOT_RESCALE) {
+        UINT w, h;
+        texture_level_size(texture, level, &w, &h);
+        BYTE *source = texture->npot_source + texture_source_offset(texture, level);
+        size_t row_bytes = (size_t)(rect->right - rect->left) * texel;
+        for (LONG y = rect->top; y < rect->bottom; y++)
+            memcpy(source + ((size_t)y * w + (size_t)rect->left) * texel,
+                   (const BYTE *)bits + (size_t)(y - rect->top) * pitch, row_bytes);
+        src = source;
+        src_pitch = (size_t)w * texel;
+        src_rect = (RECT){0, 0, (LONG)w, (LONG)h};
+    }
+    RECT out;
+    texture_npot_region(texture, level, rect, &out);
+    size_t out_pitch = (size_t)(out.right - out.left) * texel;
+    BYTE *built = staging_acquire(&gles->staging, out_pitch * (size_t)(out.bottom - out.top));
+    if (!built) return;
+    if (texture_npot_build(texture, texture->gl_format, level, src, src_pitch, &src_rect, &out, built, out_pitch,
+                           device_workers(gles)) == D3D_OK) {
+        texture_upload_storage(gles, texture, level, &out, (UINT)out_pitch, built);
+        gles->stats.NpotTexelsBuilt += (DWORD)((out.right - out.left) * (out.bottom - out.top));
+    }
+    staging_release(&gles->staging, built);
+}
+
+static uint64_t dedup_hash(const BYTE *data, size_t size) {
+    uint64_t hash = 14695981039346656037ull ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 1099511628211ull;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; i++) hash = (hash ^ data[i]) * 1099511628211ull;
+    return hash;
+}
+
+// GL storage of every level, which a shared texture holds once for all
+static size_t texture_total_bytes(const GLES_Texture *texture) {
+    return texture_level_offset(texture, texture->levels);
+}
+
+// Level 0 of a shared texture in GL layout, NULL when it could not be kept
+static const BYTE *shared_texture_bits(const GLES_SharedTexture *entry) {
+    return entry->source ? entry->source->backing : entry->bits;
+}
+
+static void shared_texture_free(GLES_Device *gles, GLES_SharedTexture *entry) {
+    GLES_SharedTexture **link = &gles->shared_textures[entry->hash % GLES_DEDUP_BUCKETS];
+    while (*link != entry) link = &(*link)->next;
+    *link = entry->next;
+    free(entry->bits);
+    free(entry);
+}
+
+// On the first whole write of level 0, looks for a texture with the same
+// contents. A match gives this texture the same GL texture in place of its
+// own, and TRUE is returned so the upload is skipped. Otherwise this
+// texture's storage is what later matches will share, and its backing,
+// which the upload fills, what they are compared against.
+static BOOL texture_share(GLES_Device *gles, GLES_Texture *texture, UINT level, const GLES_TextureLock *lock) {
+    UINT w, h;
+    texture_level_size(texture, level, &w, &h);
+    if (!gles->texture_dedup || level || texture->dedup_checked || lock->rect.left || lock->rect.top ||
+        (UINT)lock->rect.right != w || (UINT)lock->rect.bottom != h)
+        return FALSE;
+    texture->dedup_checked = TRUE;
+    // Only level 0 is compared, so other levels must follow from it
+    if (!texture->resource.managed || texture->resource.evicted || (texture->usage & D3DUSAGE_DYNAMIC) ||
+        texture->alpha_tex_id || texture->npot || texture->atlas || (texture->levels > 1 && !texture->autogen_mipmap))
+        return FALSE;
+    size_t size = texture_level_bytes(texture, 0);
+    uint64_t hash = dedup_hash(lock->bits, size);
+    GLES_SharedTexture **bucket = &gles->shared_textures[hash % GLES_DEDUP_BUCKETS];
+    GLES_SharedTexture *entry = *bucket;
+    while (entry && !(entry->hash == hash && entry->gl_format == texture->gl_format && entry->width == w &&
+                      entry->height == h && entry->levels == texture->levels && shared_texture_bits(entry) &&
+                      !memcmp(shared_texture_bits(entry), lock->bits, size)))
+        entry = entry->next;
+    if (!entry) {
+        entry = texture_backing_level(texture, 0) ? calloc(1, sizeof(GLES_SharedTexture)) : NULL;
+        if (!entry) return FALSE;
+        *entry = (GLES_SharedTexture){*bucket, hash, texture->gl_format, w, h, texture->levels, texture, NULL, size,
+                                      texture->tex_id, texture->sampler, 1, texture, 0};
+        *bucket = entry;
+        texture->shared = entry;
+        return FALSE;
+    }
+
+    texture_flush_readers(gles, texture);
+    // From now on the storage belongs to every user rather than the first
+    if (entry->owner) {
+        entry->gl_bytes = entry->owner->resource.gl_bytes;
+        entry->owner->resource.gl_bytes = 0;
+        entry->owner = NULL;
+    }
+    glDeleteTextures(1, &texture->tex_id);
+    gles->resident_bytes -= texture->resource.gl_bytes;
+    gles->stats.ResidentBytes = (DWORD)gles->resident_bytes;
+    texture->resource.gl_bytes = 0;
+    for (UINT i = 0; i < texture->levels; i++) {
+        if (!(texture->allocated_levels & 1u << i)) gles->stats.TextureDeferredBytes -= texture_level_bytes(texture, i);
+    }
+    texture->allocated_levels = texture->levels < 32 ? (1u << texture->levels) - 1 : ~0u;
+    texture->tex_id = entry->tex_id;
+    texture->shared = entry;
+    entry->refs++;
+    gles->stats.TextureDedupHits++;
+    gles->stats.DedupSavedBytes += (DWORD)texture_total_bytes(texture);
+    texture_rebind_stages(gles, texture);
+    restore_texture_binding(gles);
+    return TRUE;
+}
+
+// Stops `texture` sharing. The last user keeps the GL texture; any other
+// gets a copy of the shared contents when `copy` is set, and no texture
+// at all otherwise.
+static void texture_unshare(GLES_Device *gles, GLES_Texture *texture, BOOL copy) {
+    GLES_SharedTexture *entry = texture->shared;
+    texture->shared = NULL;
+    texture->sampler = entry->sampler;
+    if (--entry->refs == 0) {
+        texture->resource.gl_bytes += entry->gl_bytes;
+        shared_texture_free(gles, entry);
+        return;
+    }
+    // The others need the contents once this texture's backing changes or
+    // goes. Failing that, nothing matches the entry any more, and copies made
+    // from it start undefined.
+    if (entry->source == texture) {
+        entry->bits = malloc(entry->size);
+        if (entry->bits) memcpy(entry->bits, texture->backing, entry->size);
+        entry->source = NULL;
+    }
+    gles->stats.DedupSavedBytes -= (DWORD)texture_total_bytes(texture);
+    texture->tex_id = 0;
+    if (!copy) return;
+
+    texture_flush_readers(gles, texture);
+    glGenTextures(1, &texture->tex_id);
+    texture->sampler = gl_default_sampler;
+    glBindTexture(GL_TEXTURE_2D, texture->tex_id);
+    if (texture->autogen_mipmap) glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
+    BOOL compressed = texture_compressed(texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, compressed ? 1 : unpack_alignment(texture->gl_width * texture_texel_size(texture)));
+    // Storage is accounted for again as if never allocated
+    UINT allocated = texture->allocated_levels;
+    texture->allocated_levels = 0;
+    for (UINT level = 0; level < texture->levels; level++) {
+        if (allocated & 1u << level) gles->stats.TextureDeferredBytes += texture_level_bytes(texture, level);
+    }
+    const BYTE *bits = shared_texture_bits(entry);
+    texture_allocate_level(gles, texture, 0, bits);
+    if (texture->autogen_mipmap) texture_mark_generated(gles, texture);
+    BYTE *backing = bits ? texture_backing_level(texture, 0) : NULL;
+    if (backing) {
+        memcpy(backing, bits, entry->size);
+        texture->backed_levels |= 1u;
+    }
+    if (bits) gles->stats.TextureUploadBytes += entry->size;
+    texture_rebind_stages(gles, texture);
+    restore_texture_binding(gles);
+}
+
+// GL ES cannot read textures back, so mipmapped textures keep the D3D-layout
+// texels last written to level 0 for D3DXFilterTexture to filter from.
+static void texture_keep_mip_source(GLES_Texture *texture, const GLES_TextureLock *lock) {
+    UINT texel = texture_texel_size(texture);
+    size_t level_pitch = (size_t)texture->width * texel;
+    if (!texture->mip_source) texture->mip_source = calloc(texture->height, level_pitch);
+    if (!texture->mip_source) return;
+    for (LONG y = lock->rect.top; y < lock->rect.bottom; y++)
+        memcpy(texture->mip_source + y * level_pitch + lock->rect.left * texel,
+               lock->bits + (size_t)(y - lock->rect.top) * lock->pitch, lock->pitch);
+}
+
+static GLES_WorkerPool *device_workers(GLES_Device *gles) {
+    if (!gles->workers) gles->workers = workers_create(0);
+    return gles->workers;
+}
+
+// Decodes the dirty blocks of each locked block row into its own strip
+typedef struct {
+    GLES_BlockDecode decode;
+    UINT block_size;
+    UINT texel_size;
+    const BYTE *blocks;
+    UINT pitch;
+    const UINT (*spans)[2];     // dirty blocks [first, end) per row
+    BYTE *texels;
+    size_t strip_size;
+} GLES_DecodeJob;
+
+static void decode_strips(void *ctx, size_t begin, size_t end) {
+    const GLES_DecodeJob *job = ctx;
+    for (size_t row = begin; row < end; row++) {
+        UINT first = job->spans[row][0], count = job->spans[row][1] - first;
+        if (count)
+            job->decode(job->blocks + row * job->pitch + first * job->block_size, count,
+                        job->texels + row * job->strip_size, (size_t)count * 4 * job->texel_size);
+    }
+}
+
+// Uploads a locked DXT rectangle for GLs that cannot sample DXT. Blocks are
+// compared against the copy of what GL holds, and only changed ones are
+// decoded and uploaded.
+static HRESULT texture_upload_blocks(GLES_Device *gles, GLES_Texture *texture, UINT level, GLES_TextureLock *lock) {
+    const GLES_TextureFormat *format = texture->gl_format;
+    const UINT block = format->block_size, texel = format->texel_size;
+    UINT level_w, level_h;
+    texture_level_size(texture, level, &level_w, &level_h);
+    size_t level_pitch = (size_t)(level_w + 3) / 4 * block;
+    BOOL fresh = !lock->blocks;
+    if (fresh) lock->blocks = malloc(level_pitch * ((level_h + 3) / 4));
+
+    const RECT *rect = &lock->rect;
+    UINT pitch, rows;
+    texture_lock_layout(texture, rect, &pitch, &rows);
+    UINT cols = pitch / block;
+    UINT (*spans)[2] = malloc(rows * sizeof(*spans));
+    BYTE *texels = staging_acquire(&gles->staging, (size_t)rows * cols * 16 * texel);
+    if (!spans || !texels) {
+        free(spans);
+        staging_release(&gles->staging, texels);
+        return D3DERR_OUTOFVIDEOMEMORY;
+    }
+
+    BOOL whole = TRUE;
+    DWORD decoded = 0;
+    for (UINT row = 0; row < rows; row++) {
+        const BYTE *src = lock->bits + (size_t)row * pitch;
+        BYTE *cached = lock->blocks ? lock->blocks + (rect->top / 4 + row) * level_pitch + rect->left / 4 * block : NULL;
+        UINT first = 0, end = cols;
+        if (!fresh && cached) {
+            while (first < cols && !memcmp(src + first * block, cached + first * block, block)) first++;
+            while (end > first && !memcmp(src + (end - 1) * block, cached + (end - 1) * block, block)) end--;
+        }
+        if (cached && end > first) memcpy(cached + first * block, src + first * block, (end - first) * block);
+        spans[row][0] = first;
+        spans[row][1] = end;
+        whole = whole && first == 0 && end == cols;
+        decoded += end - first;
+    }
+
+    GLES_DecodeJob job = {format->decode, block, texel, lock->bits, pitch, (const UINT (*)[2])spans,
+                          texels, (size_t)cols * 16 * texel};
+    // About 1K blocks per chunk
+    size_t grain = cols >= 1024 ? 1 : 1024 / cols;
+    workers_run(rows > grain ? device_workers(gles) : NULL, rows, grain, decode_strips, &job);
+    gles->stats.TextureBlocksDecoded += decoded;
+
+    UINT width = (UINT)(rect->right - rect->left);
+    if (whole && width % 4 == 0) {
+        // Full-width strips stack into one image
+        texture_upload(gles, texture, level, rect, width * texel, texels);
+    } else {
+        for (UINT row = 0; row < rows; row++) {
+            UINT first = spans[row][0], end = spans[row][1];
+            if (first == end) continue;
+            BYTE *strip = texels + row * job.strip_size;
+            RECT strip_rect = {rect->left + (LONG)first * 4, rect->top + (LONG)row * 4, rect->left + (LONG)end * 4,
+                               rect->top + (LONG)row * 4 + 4};
+            if (strip_rect.right > rect->right) strip_rect.right = rect->right;
+            if (strip_rect.bottom > rect->bottom) strip_rect.bottom = rect->bottom;
+            // Blocks overhanging a small level decode to texels GL must not see
+            size_t strip_pitch = (size_t)(end - first) * 4 * texel;
+            size_t valid_pitch = (size_t)(strip_rect.right - strip_rect.left) * texel;
+            for (LONG y = 1; valid_pitch < strip_pitch && y < strip_rect.bottom - strip_rect.top; y++)
+                memmove(strip + y * valid_pitch, strip + y * strip_pitch, valid_pitch);
+            texture_upload(gles, texture, level, &strip_rect, (UINT)valid_pitch, strip);
+        }
+    }
+    free(spans);
+    staging_release(&gles->staging, texels);
+    return D3D_OK;
+}
+
+static GLenum address_to_gl(const GLES_Device *gles, DWORD address) {
+    switch (address) {
+        case D3DTADDRESS_CLAMP: return GL_CLAMP_TO_EDGE;
+        case D3DTADDRESS_MIRROR: return gles->mirrored_repeat ? GL_MIRRORED_REPEAT_OES : GL_REPEAT;
+        default: return GL_REPEAT;
+    }
+}
+
+// The GL parameters for `stage`'s sampler states. Unset states keep the
+// shim's long-standing bilinear, wrapping default. Single-level textures
+// ignore MIPFILTER, since GL would treat them as incomplete.
+static void sampler_wanted(const GLES_Device *gles, DWORD stage, const GLES_Texture *texture, GLES_SamplerState *out) {
+    const DWORD *states = gles->applied.texture_stage_states[stage];
+    uint32_t mask = gles->applied.texture_stage_state_mask[stage];
+    DWORD min = mask & 1u << D3DTSS_MINFILTER ? states[D3DTSS_MINFILTER] : D3DTEXF_LINEAR;
+    DWORD mag = mask & 1u << D3DTSS_MAGFILTER ? states[D3DTSS_MAGFILTER] : D3DTEXF_LINEAR;
+    DWORD mip = mask & 1u << D3DTSS_MIPFILTER && texture->levels > 1 ? states[D3DTSS_MIPFILTER] : D3DTEXF_NONE;
+    BOOL linear = min >= D3DTEXF_LINEAR;
+    if (mip == D3DTEXF_NONE)
+        out->min_filter = linear ? GL_LINEAR : GL_NEAREST;
+    else if (mip == D3DTEXF_POINT)
+        out->min_filter = linear ? GL_LINEAR_MIPMAP_NEAREST : GL_NEAREST_MIPMAP_NEAREST;
+    else
+        out->min_filter = linear ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST_MIPMAP_LINEAR;
+    out->mag_filter = mag >= D3DTEXF_LINEAR ? GL_LINEAR : GL_NEAREST;
+    out->wrap_s = address_to_gl(gles, mask & 1u << D3DTSS_ADDRESSU ? states[D3DTSS_ADDRESSU] : D3DTADDRESS_WRAP);
+    out->wrap_t = address_to_gl(gles, mask & 1u << D3DTSS_ADDRESSV ? states[D3DTSS_ADDRESSV] : D3DTADDRESS_WRAP);
+}
+
+// Sends the parameters that differ to the texture bound on the active unit
+static void sampler_sync(GLES_Device *gles, GLES_SamplerState *current, const GLES_SamplerState *wanted) {
+    static const GLenum names[] = {GL_TEXTURE_MIN_FILTER, GL_TEXTURE_MAG_FILTER, GL_TEXTURE_WRAP_S, GL_TEXTURE_WRAP_T};
+    GLenum *have = &current->min_filter;
+    const GLenum *want = &wanted->min_filter;
+    for (UINT i = 0; i < 4; i++) {
+        if (have[i] == want[i]) continue;
+        glTexParameteri(GL_TEXTURE_2D, names[i], (GLint)want[i]);
+        have[i] = want[i];
+        gles->stats.SamplerUpdates++;
+    }
+}
+
+// Brings tex_id (or the bound palette copy), bound on the active unit, in
+// line with `stage`'s sampler states. The alpha plane follows when the
+// texture environment next binds it.
+static void texture_apply_sampler(GLES_Device *gles, DWORD stage, GLES_Texture *texture) {
+    GLES_SamplerState wanted;
+    sampler_wanted(gles, stage, texture, &wanted);
+    GLES_SamplerState *current = texture->shared  ? &texture->shared->sampler
+                                 : texture->atlas ? &texture->atlas->sampler
+                                                  : &texture->sampler;
+    for (UINT i = 0; texture->palette_image && i < GLES_PALETTE_CACHE_SLOTS; i++) {
+        if (texture->palette_slots[i].tex_id == texture->tex_id) current = &texture->palette_slots[i].sampler;
+    }
+    sampler_sync(gles, current, &wanted);
+    if (stage == 0 && texture->alpha_tex_id) gles->texenv_dirty = TRUE;
+}
+
+// GL ES bakes the palette into P8 texture images, so each texture keeps a
+// few copies built with recently used palettes. Binds the copy matching
+// `palette` on the active unit, which serves `stage`, rebuilding the least
+// recently used one when none does; tex_id follows the bound copy.
+static void texture_bind_palette(GLES_Device *gles, DWORD stage, GLES_Texture *texture, UINT palette) {
+    const GLES_Palette *source = palette < gles->palette_count ? &gles->palettes[palette] : NULL;
+    DWORD stamp = source ? source->stamp : 0;
+    GLES_PaletteSlot *slot = NULL, *victim = NULL;
+    for (UINT i = 0; i < GLES_PALETTE_CACHE_SLOTS && !slot; i++) {
+        GLES_PaletteSlot *candidate = &texture->palette_slots[i];
+        if (candidate->valid && candidate->stamp == stamp)
+            slot = candidate;
+        else if (!victim || (victim->valid && (!candidate->valid || candidate->last_used < victim->last_used)))
+            victim = candidate;
+    }
+    if (slot) {
+        glBindTexture(GL_TEXTURE_2D, slot->tex_id);
+    } else {
+        slot = victim;
+        if (!slot->tex_id) {
+            glGenTextures(1, &slot->tex_id);
+            slot->sampler = gl_default_sampler;
+        }
+        glBindTexture(GL_TEXTURE_2D, slot->tex_id);
+        if (source)
+            memcpy(texture->palette_image, source->entries, sizeof(source->entries));
+        else
+            memset(texture->palette_image, 0, sizeof(((GLES_Palette *)0)->entries));
+        // A negative level uploads that many mip levels after the first
+        GLsizei size = (GLsizei)texture_palette_offset(texture, texture->levels);
+        // Slots never bound hold no storage yet
+        if (!slot->last_used) resource_grow(gles, &texture->resource, (size_t)size);
+        glCompressedTexImage2D(GL_TEXTURE_2D, -(GLint)(texture->levels - 1), GL_PALETTE8_RGBA8_OES,
+                               (GLsizei)texture->width, (GLsizei)texture->height, 0, size, texture->palette_image);
+        slot->valid = TRUE;
+        slot->stamp = stamp;
+        for (UINT level = 0; level < texture->levels; level++) {
+            if (texture->allocated_levels & 1u << level) continue;
+            texture->allocated_levels |= 1u << level;
+            gles->stats.TextureDeferredBytes -= texture_level_bytes(texture, level);
+        }
+        gles->stats.PaletteUploads++;
+        gles->stats.TextureUploadBytes += size;
+    }
+    slot->last_used = ++texture->palette_tick;
+    texture->tex_id = slot->tex_id;
+    texture_apply_sampler(gles, stage, texture);
+}
+
+// Rebinds the palette copy of every stage showing `texture`
+static void texture_rebind_palette(GLES_Device *gles, const GLES_Texture *texture, UINT palette) {
+    for (DWORD stage = 0; stage < gles->texture_units; stage++) {
+        GLES_Texture *bound = gles->applied.textures[stage];
+        if (!bound || !bound->palette_image || (texture && bound != texture)) continue;
+        // The next draw puts back an alpha plane this displaces
+        if (gles->alpha_plane && stage == gles->alpha_plane) gles->texenv_dirty = TRUE;
+        glActiveTexture(GL_TEXTURE0 + stage);
+        texture_bind_palette(gles, stage, bound, palette);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+// P8 unlocks write the CPU copy of the indices. Every palette copy is then
+// stale; the bound one is rebuilt now and the others when next bound.
+static void texture_store_indices(GLES_Device *gles, GLES_Texture *texture, UINT level, const GLES_TextureLock *lock) {
+    UINT w, h;
+    texture_level_size(texture, level, &w, &h);
+    texture_flush_readers(gles, texture);
+    BYTE *indices = texture->palette_image + texture_palette_offset(texture, level);
+    for (LONG y = lock->rect.top; y < lock->rect.bottom; y++)
+        memcpy(indices + (size_t)y * w + lock->rect.left, lock->bits + (size_t)(y - lock->rect.top) * lock->pitch,
+               lock->pitch);
+    for (UINT i = 0; i < GLES_PALETTE_CACHE_SLOTS; i++) texture->palette_slots[i].valid = FALSE;
+    texture_rebind_palette(gles, texture, gles->applied.texture_palette);
+}
+
+static HRESULT D3DAPI tex_unlock_rect(IDirect3DTexture8 *This, UINT Level) {
+    GLES_Texture *texture = This->texture;
+    if (Level >= texture->levels || !texture->locks[Level].bits) return D3DERR_INVALIDCALL;
+    GLES_Device *gles = This->device->gles;
+    GLES_TextureLock *lock = &texture->locks[Level];
+    HRESULT hr = D3D_OK;
+    if (!(lock->flags & D3DLOCK_READONLY)) {
+        const GLES_TextureFormat *format = texture->gl_format;
+        size_t count = (size_t)(lock->rect.right - lock->rect.left) * (size_t)(lock->rect.bottom - lock->rect.top);
+        if (texture->palette_image) {
+            texture_store_indices(gles, texture, Level, lock);
+        } else if (format->decode) {
+            hr = texture_upload_blocks(gles, texture, Level, lock);
+        } else {
+            if (Level == 0 && texture->levels > 1 && !texture->autogen_mipmap && !format->block_size)
+                texture_keep_mip_source(texture, lock);
+            // The staging memory is ours again, so convert it in place
+            if (format->convert) format->convert(lock->bits, lock->bits, count);
+            if (!texture_share(gles, texture, Level, lock))
+                texture_upload(gles, texture, Level, &lock->rect, lock->pitch, lock->bits);
+        }
+    }
+    staging_release(&gles->staging, lock->bits);
+    lock->bits = NULL;
+    return hr;
+}
+static HRESULT D3DAPI tex_get_level_desc(IDirect3DTexture8 *This, UINT Level, D3DSURFACE_DESC *pDesc) {
+    if (!pDesc || Level >= This->texture->levels) return D3DERR_INVALIDCALL;
+    pDesc->Format = This->texture->format;
+    pDesc->Type = D3DRTYPE_TEXTURE;
+    pDesc->Usage = This->texture->usage;
+    pDesc->Pool = This->texture->pool;
+    pDesc->Width = This->texture->width >> Level ? This->texture->width >> Level : 1;
+    pDesc->Height = This->texture->height >> Level ? This->texture->height >> Level : 1;
+    return D3D_OK;
+}
+
+static DWORD D3DAPI tex_set_priority(IDirect3DTexture8 *This, DWORD PriorityNew) {
+    return resource_set_priority(&This->texture->resource, PriorityNew);
+}
+
+static DWORD D3DAPI tex_get_priority(IDirect3DTexture8 *This) { return This->texture->resource.priority; }
+
+// Makes the texture resident with storage for every level now, rather than
+// on the draw that first binds it
+static void D3DAPI tex_pre_load(IDirect3DTexture8 *This) {
+    GLES_Texture *texture = This->texture;
+    GLES_Device *gles = This->device->gles;
+    texture_finish_load(gles, texture, TRUE);
+    resource_touch(gles, &texture->resource);
+    if (texture->resource.evicted)
+        texture_restore(gles, texture);
+    else if (!texture->palette_image)
+        glBindTexture(GL_TEXTURE_2D, texture->tex_id);
+    if (texture->palette_image) {
+        texture_bind_palette(gles, 0, texture, gles->applied.texture_palette);
+    } else {
+        for (UINT level = 0; level < texture->levels; level++) {
+            if (!(texture->allocated_levels & 1u << level)) texture_allocate_level(gles, texture, level, NULL);
+        }
+    }
+    restore_texture_binding(gles);
+}
+
+static HRESULT D3DAPI surface_query_interface(IDirect3DSurface8 *This, REFIID riid, void **ppv) {
+    return common_query_interface(This, riid, ppv);
+}
+static ULONG D3DAPI surface_add_ref(IDirect3DSurface8 *This) { return common_add_ref(This); }
+static ULONG D3DAPI surface_release(IDirect3DSurface8 *This) { return common_release(This); }
+
+static HRESULT D3DAPI surface_get_desc(IDirect3DSurface8 *This, D3DSURFACE_DESC *pDesc) {
+    HRESULT hr = tex_get_level_desc(This->container, This->level, pDesc);
+    if (hr == D3D_OK) pDesc->Type = D3DRTYPE_SURFACE;
+    return hr;
+}
+
+static HRESULT D3DAPI surface_lock_rect(IDirect3DSurface8 *This, D3DLOCKED_RECT *pLockedRect, const RECT *pRect,
+                                        DWORD Flags) {
+    return tex_lock_rect(This->container, This->level, pLockedRect, pRect, Flags);
+}
+
+static HRESULT D3DAPI surface_unlock_rect(IDirect3DSurface8 *This) {
+    return tex_unlock_rect(This->container, This->level);
+}
+
+// Each call hands out a new view; releasing it leaves the texture alone
+static HRESULT D3DAPI tex_get_surface_level(IDirect3DTexture8 *This, UINT Level, IDirect3DSurface8 **ppSurfaceLevel) {
+    if (!ppSurfaceLevel || Level >= This->texture->levels) return D3DERR_INVALIDCALL;
+    static const IDirect3DSurface8Vtbl surface_vtbl = {
+        .QueryInterface = surface_query_interface,
+        .AddRef = surface_add_ref,
+        .Release = surface_release,
+        .GetDesc = surface_get_desc,
+        .LockRect = surface_lock_rect,
+        .UnlockRect = surface_unlock_rect
+    };
+    IDirect3DSurface8 *surface = calloc(1, sizeof(IDirect3DSurface8));
+    if (!surface) return E_OUTOFMEMORY;
+    surface->lpVtbl = &surface_vtbl;
+    surface->container = This;
+    surface->level = Level;
+    *ppSurfaceLevel = surface;
+    return D3D_OK;
+}
+
+static const IDirect3DDevice8Vtbl device_vtbl = {
+    .QueryInterface = d3d8_device_query_interface,
+    .AddRef = d3d8_device_add_ref,
+    .Release = d3d8_device_release,
+    .TestCooperativeLevel = d3d8_test_cooperative_level,
+    .GetAvailableTextureMem = d3d8_get_available_texture_mem,
+    .ResourceManagerDiscardBytes = d3d8_resource_manager_discard_bytes,
+    .GetDirect3D = d3d8_get_direct3d,
+    .GetDeviceCaps = device_get_device_caps,
+    .GetDisplayMode = d3d8_get_display_mode,
+    .GetCreationParameters = d3d8_get_creation_parameters,
+    .SetCursorProperties = d3d8_set_cursor_properties,
+    .SetCursorPosition = d3d8_set_cursor_position,
+    .ShowCursor = d3d8_show_cursor,
+    .CreateAdditionalSwapChain = d3d8_create_additional_swap_chain,
+    .Reset = d3d8_reset,
+    .Present = d3d8_present,
+    .GetBackBuffer = d3d8_get_back_buffer,
+    .GetRasterStatus = d3d8_get_raster_status,
+    .SetGammaRamp = d3d8_set_gamma_ramp,
+    .GetGammaRamp = d3d8_get_gamma_ramp,
+    .CreateVertexBuffer = d3d8_create_vertex_buffer,
+    .CreateIndexBuffer = d3d8_create_index_buffer,
+    .CreateTexture = d3d8_create_texture,
+    .SetTexture = d3d8_set_texture,
+    .SetTextureStageState = d3d8_set_texture_stage_state,
+    .ValidateDevice = d3d8_validate_device,
+    .SetRenderState = d3d8_set_render_state,
+    .BeginScene = d3d8_begin_scene,
+    .EndScene = d3d8_end_scene,
+    .SetStreamSource = d3d8_set_stream_source,
+    .SetIndices = d3d8_set_indices,
+    .SetViewport = d3d8_set_viewport,
+    .SetTransform = d3d8_set_transform,
+    .DrawIndexedPrimitive = d3d8_draw_indexed_primitive,
+    .CreateVertexShader = d3d8_create_vertex_shader,
+    .SetVertexShader = d3d8_set_vertex_shader,
+    .GetVertexShader = d3d8_get_vertex_shader,
+    .DeleteVertexShader = d3d8_delete_vertex_shader,
+    .SetPaletteEntries = d3d8_set_palette_entries,
+    .GetPaletteEntries = d3d8_get_palette_entries,
+    .SetCurrentTexturePalette = d3d8_set_current_texture_palette,
+    .GetCurrentTexturePalette = d3d8_get_current_texture_palette
+};
+static HRESULT D3DAPI d3d8_register_software_device(IDirect3D8 *This, void *pInitializeFunction) { return D3DERR_NOTAVAILABLE; }
+static UINT D3DAPI d3d8_get_adapter_count(IDirect3D8 *This) { return 1; }
+static HRESULT D3DAPI d3d8_get_adapter_identifier(IDirect3D8 *This,
+                                                  UINT Adapter,
+                                                  DWORD Flags,
+                                                  D3DADAPTER_IDENTIFIER8 *pIdentifier) {
+    if (Adapter != D3DADAPTER_DEFAULT || !pIdentifier) return D3DERR_INVALIDCALL;
+
+    memset(pIdentifier, 0, sizeof(*pIdentifier));
+
+    const char *renderer = (const char *)glGetString(GL_RENDERER);
+    if (!renderer) renderer = "d3d8_to_gles";
+    strncpy(pIdentifier->Driver, renderer, sizeof(pIdentifier->Driver) - 1);
+
+    const char *vendor = (const char *)glGetString(GL_VENDOR);
+    if (!vendor) vendor = "Unknown";
+    strncpy(pIdentifier->Description, vendor, sizeof(pIdentifier->Description) - 1);
+
+    return D3D_OK;
+}
+static UINT D3DAPI d3d8_get_adapter_mode_count(IDirect3D8 *This, UINT Adapter) { return 1; }
+static HRESULT D3DAPI d3d8_enum_adapter_modes(IDirect3D8 *This,
+                                              UINT Adapter,
+                                              UINT Mode,
+                                              D3DDISPLAYMODE *pMode) {
+    if (Adapter != D3DADAPTER_DEFAULT || Mode > 0 || !pMode)
+        return D3DERR_INVALIDCALL;
+
+    *pMode = g_current_display_mode;
+    return D3D_OK;
+}
+static HRESULT D3DAPI d3d8_get_adapter_display_mode(IDirect3D8 *This, UINT Adapter, D3DDISPLAYMODE *pMode) { return D3DERR_NOTAVAILABLE; }
+static HRESULT D3DAPI d3d8_check_device_type(IDirect3D8 *This, UINT Adapter, D3DDEVTYPE CheckType, D3DFORMAT DisplayFormat, D3DFORMAT BackBufferFormat, BOOL Windowed) { return D3D_OK; }
+static HRESULT D3DAPI d3d8_check_device_format(IDirect3D8 *This, UINT Adapter, D3DDEVTYPE DeviceType, D3DFORMAT AdapterFormat, DWORD Usage, D3DRESOURCETYPE RType, D3DFORMAT CheckFormat) {
+    if (RType == D3DRTYPE_TEXTURE && !texconv_find_format(CheckFormat, 0)) return D3DERR_NOTAVAILABLE;
+    return D3D_OK;
+}
+static HRESULT D3DAPI d3d8_check_device_multi_sample_type(IDirect3D8 *This, UINT Adapter, D3DDEVTYPE DeviceType, D3DFORMAT SurfaceFormat, BOOL Windowed, D3DMULTISAMPLE_TYPE MultiSampleType) { return D3DERR_NOTAVAILABLE; }
+static HRESULT D3DAPI d3d8_check_depth_stencil_match(IDirect3D8 *This, UINT Adapter, D3DDEVTYPE DeviceType, D3DFORMAT AdapterFormat, D3DFORMAT RenderTargetFormat, D3DFORMAT DepthStencilFormat) { return D3D_OK; }
+static HRESULT D3DAPI d3d8_get_device_caps(IDirect3D8 *This, UINT Adapter, D3DDEVTYPE DeviceType, D3DCAPS8 *pCaps) {
+    fill_d3d_caps(pCaps, DeviceType);
+    return D3D_OK;
+}
+static HMONITOR D3DAPI d3d8_get_adapter_monitor(IDirect3D8 *This, UINT Adapter) { return NULL; }
+
+// Helper: Whole-word match in a space-separated extension string
+static BOOL extension_listed(const char *extensions, const char *name) {
+    size_t length = strlen(name);
+    for (const char *p = extensions; p && (p = strstr(p, name)); p += length) {
+        if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0')) return TRUE;
+    }
+    return FALSE;
+}
+
+static BOOL gl_extension_supported(const char *name) {
+    return extension_listed((const char *)glGetString(GL_EXTENSIONS), name);
+}
+
+// Some drivers list compressed format extensions but reject the formats in
+// an ES 1.1 context, so upload one block to a scratch texture. Returns `cap` when it
+// succeeds, 0 otherwise.
+static DWORD gl_compressed_format_accepted(D3DFORMAT d3d_format, DWORD cap) {
+    const GLES_TextureFormat *format = texconv_find_format(d3d_format, cap);
+    static const BYTE block[16];
+    GLuint tex;
+    while (glGetError() != GL_NO_ERROR) {}
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glCompressedTexImage2D(GL_TEXTURE_2D, 0, format->gl_format, 4, 4, 0, (GLsizei)format->block_size, block);
+    BOOL accepted = glGetError() == GL_NO_ERROR;
+    glDeleteTextures(1, &tex);
+    return accepted ? cap : 0;
+}
+
+static HRESULT D3DAPI d3d8_create_device(IDirect3D8 *This, UINT Adapter, D3DDEVTYPE DeviceType,
+                                        HWND hFocusWindow, DWORD BehaviorFlags,
+                                        D3DPRESENT_PARAMETERS *pPresentationParameters,
+                                        IDirect3DDevice8 **ppReturnedDeviceInterface) {
+    if (Adapter != D3DADAPTER_DEFAULT || !pPresentationParameters || DeviceType == D3DDEVTYPE_SW) {
+        return D3DERR_INVALIDCALL;
+    }
+
+    GLES_Device *gles = calloc(1, sizeof(GLES_Device));
+    if (!gles) return D3DERR_OUTOFVIDEOMEMORY;
+
+    gles->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (!eglInitialize(gles->display, NULL, NULL)) {
+        gles->display =
+            eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                  (void *)(intptr_t)EGL_DEFAULT_DISPLAY,
+                                  NULL);
+        if (!eglInitialize(gles->display, NULL, NULL)) {
+            free(gles);
+            return D3DERR_INVALIDCALL;
+        }
+    }
+
+    BOOL want_window = hFocusWindow != NULL;
+    EGLConfig config =
+        choose_egl_config(gles->display, pPresentationParameters, want_window);
+    if (!config) {
+        eglTerminate(gles->display);
+        free(gles);
+        return D3DERR_INVALIDCALL;
+    }
+
+    if (hFocusWindow) {
+        gles->surface = eglCreateWindowSurface(
+            gles->display, config,
+            (EGLNativeWindowType)(uintptr_t)hFocusWindow, NULL);
+    } else {
+        const EGLint pbuffer_attribs[] = {EGL_WIDTH,
+                                          pPresentationParameters->BackBufferWidth,
+                                          EGL_HEIGHT,
+                                          pPresentationParameters->BackBufferHeight,
+                                          EGL_NONE};
+        gles->surface =
+            eglCreatePbufferSurface(gles->display, config, pbuffer_attribs);
+    }
+    gles->context = eglCreateContext(gles->display, config, EGL_NO_CONTEXT, NULL);
+    if (!gles->surface || !gles->context || !eglMakeCurrent(gles->display, gles->surface, gles->surface, gles->context)) {
+        if (gles->context) eglDestroyContext(gles->display, gles->context);
+        if (gles->surface) eglDestroySurface(gles->display, gles->surface);
+        eglTerminate(gles->display);
+        free(gles);
+        return D3DERR_INVALIDCALL;
+    }
+
+    // Background loads upload through a second context sharing this one's
+    // objects. Without it they load on the calling thread instead.
+    gles->loader_context = eglCreateContext(gles->display, config, gles->context, NULL);
+    gles->loader_surface = EGL_NO_SURFACE;
+    if (gles->loader_context != EGL_NO_CONTEXT &&
+        !extension_listed(eglQueryString(gles->display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+        const EGLint loader_attribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+        gles->loader_surface = eglCreatePbufferSurface(gles->display, config, loader_attribs);
+        if (gles->loader_surface == EGL_NO_SURFACE) {
+            eglDestroyContext(gles->display, gles->loader_context);
+            gles->loader_context = EGL_NO_CONTEXT;
+        }
+    }
+
+    gles->viewport.X = 0;
+    gles->viewport.Y = 0;
+    gles->viewport.Width = pPresentationParameters->BackBufferWidth;
+    gles->viewport.Height = pPresentationParameters->BackBufferHeight;
     gles->viewport.MinZ = 0.0f;
     gles->viewport.MaxZ = 1.0f;
     glViewport(0, 0, gles->viewport.Width, gles->viewport.Height);
@@ -1163,7 +2932,39 @@ static HRESULT D3DAPI d3d8_create_device(IDirect3D8 *This, UINT Adapter, D3DDEVT
     gles->stencil_fail = GL_KEEP;
     gles->stencil_zfail = GL_KEEP;
     gles->stencil_pass = GL_KEEP;
-    gles->texcoord_index0 = 0;
+    GLint units = 2;
+    glGetIntegerv(GL_MAX_TEXTURE_UNITS, &units);
+    gles->texture_units = units < GLES_MAX_TEXTURE_STAGES ? (UINT)units : GLES_MAX_TEXTURE_STAGES;
+    gles->resources.prev = gles->resources.next = &gles->resources;
+    gles->managed_budget = GLES_DEFAULT_MANAGED_BUDGET;
+    gles->texture_renames = GLES_MAX_TEXTURE_RENAMES;
+    gles->frame = 1;
+    gles->texenv_dirty = TRUE;
+    gles->bgra_supported = gl_extension_supported("GL_EXT_texture_format_BGRA8888");
+    gles->texture_bgra = gles->bgra_supported;
+    BOOL s3tc = gl_extension_supported("GL_EXT_texture_compression_s3tc");
+    if (s3tc || gl_extension_supported("GL_EXT_texture_compression_dxt1"))
+        gles->dxt_supported |= gl_compressed_format_accepted(D3DFMT_DXT1, TEXCONV_DXT1);
+    if (s3tc || gl_extension_supported("GL_ANGLE_texture_compression_dxt3"))
+        gles->dxt_supported |= gl_compressed_format_accepted(D3DFMT_DXT3, TEXCONV_DXT3);
+    if (s3tc || gl_extension_supported("GL_ANGLE_texture_compression_dxt5"))
+        gles->dxt_supported |= gl_compressed_format_accepted(D3DFMT_DXT5, TEXCONV_DXT5);
+    gles->texture_dxt = TRUE;
+    if (gl_extension_supported("GL_OES_compressed_ETC1_RGB8_texture"))
+        gles->etc1_supported = gl_compressed_format_accepted(D3DFMT_ETC1, TEXCONV_ETC1);
+    gles->etc1_sub_texture = gl_extension_supported("GL_EXT_compressed_ETC1_RGB8_sub_texture");
+    gles->mirrored_repeat = gl_extension_supported("GL_OES_texture_mirrored_repeat");
+    gles->lod_bias = gl_extension_supported("GL_EXT_texture_lod_bias");
+    gles->npot_supported = gl_extension_supported("GL_OES_texture_npot") ||
+                           gl_extension_supported("GL_ARB_texture_non_power_of_two") ||
+                           gl_extension_supported("GL_IMG_texture_npot");
+    gles->npot_mode = gles->npot_supported ? D3DGLES_NPOT_NATIVE : D3DGLES_NPOT_AUTO;
+    for (UINT unit = 0; unit < GLES_MAX_TEXTURE_STAGES; unit++) {
+        memcpy(gles->texcoord_transform[unit], texcoord_identity, sizeof(texcoord_identity));
+        D3DXMatrixIdentity(&gles->texture_matrices[unit]);
+        gles->texcoord_dims[unit] = 2;
+    }
+    gles->batch.vertex_limit = GLES_BATCH_DEFAULT_VERTEX_LIMIT;
     gles->present_params = *pPresentationParameters;
     gles->display_mode.Width = pPresentationParameters->BackBufferWidth;
     gles->display_mode.Height = pPresentationParameters->BackBufferHeight;
@@ -1174,6 +2975,8 @@ static HRESULT D3DAPI d3d8_create_device(IDirect3D8 *This, UINT Adapter, D3DDEVT
 
     IDirect3DDevice8 *device = calloc(1, sizeof(IDirect3DDevice8) + sizeof(IDirect3DDevice8Vtbl));
     if (!device) {
+        if (gles->loader_context != EGL_NO_CONTEXT) eglDestroyContext(gles->display, gles->loader_context);
+        if (gles->loader_surface != EGL_NO_SURFACE) eglDestroySurface(gles->display, gles->loader_surface);
         eglDestroyContext(gles->display, gles->context);
         eglDestroySurface(gles->display, gles->surface);
         eglTerminate(gles->display);
@@ -1191,14 +2994,32 @@ static HRESULT D3DAPI d3d8_create_device(IDirect3D8 *This, UINT Adapter, D3DDEVT
 
 // IDirect3DDevice8 methods
 static HRESULT D3DAPI d3d8_test_cooperative_level(IDirect3DDevice8 *This) { return D3D_OK; }
-static UINT D3DAPI d3d8_get_available_texture_mem(IDirect3DDevice8 *This) { return 1024 * 1024 * 256; }
-static HRESULT D3DAPI d3d8_resource_manager_discard_bytes(IDirect3DDevice8 *This, DWORD Bytes) { return D3D_OK; }
+// What is left of the budget for GL storage
+static UINT D3DAPI d3d8_get_available_texture_mem(IDirect3DDevice8 *This) {
+    GLES_Device *gles = This->gles;
+    return gles->resident_bytes < gles->managed_budget ? (UINT)(gles->managed_budget - gles->resident_bytes) : 0;
+}
+
+// Evicts managed resources that are not bound; 0 evicts all of them
+static HRESULT D3DAPI d3d8_resource_manager_discard_bytes(IDirect3DDevice8 *This, DWORD Bytes) {
+    GLES_Device *gles = This->gles;
+    // Recorded and batched draws keep their buffers resident
+    scene_flush(gles);
+    batch_flush(gles);
+    resource_evict(gles, Bytes ? (size_t)Bytes : SIZE_MAX, NULL);
+    return D3D_OK;
+}
 static HRESULT D3DAPI d3d8_get_direct3d(IDirect3DDevice8 *This, IDirect3D8 **ppD3D8) {
     *ppD3D8 = This->d3d8;
     return D3D_OK;
 }
 static HRESULT D3DAPI device_get_device_caps(IDirect3DDevice8 *This, D3DCAPS8 *pCaps) {
     fill_d3d_caps(pCaps, D3DDEVTYPE_HAL);
+    pCaps->MaxTextureBlendStages = pCaps->MaxSimultaneousTextures = This->gles->texture_units;
+    // Padded textures only sample as D3D expects with clamped coordinates
+    D3DGLES_NPOT_MODE npot = This->gles->npot_mode;
+    if (npot == D3DGLES_NPOT_AUTO || npot == D3DGLES_NPOT_PAD)
+        pCaps->TextureCaps |= D3DPTEXTURECAPS_POW2 | D3DPTEXTURECAPS_NONPOW2CONDITIONAL;
     return D3D_OK;
 }
 static HRESULT D3DAPI d3d8_get_display_mode(IDirect3DDevice8 *This, D3DDISPLAYMODE *pMode) {
@@ -1221,7 +3042,9 @@ static BOOL D3DAPI d3d8_show_cursor(IDirect3DDevice8 *This, BOOL bShow) { return
 static HRESULT D3DAPI d3d8_create_additional_swap_chain(IDirect3DDevice8 *This, D3DPRESENT_PARAMETERS *pPresentationParameters, IDirect3DSwapChain8 **pSwapChain) { return D3DERR_NOTAVAILABLE; }
 static HRESULT D3DAPI d3d8_reset(IDirect3DDevice8 *This, D3DPRESENT_PARAMETERS *pPresentationParameters) { return D3DERR_NOTAVAILABLE; }
 static HRESULT D3DAPI d3d8_present(IDirect3DDevice8 *This, CONST RECT *pSourceRect, CONST RECT *pDestRect, HWND hDestWindowOverride, CONST RGNDATA *pDirtyRegion) {
+    scene_flush(This->gles);
     eglSwapBuffers(This->gles->display, This->gles->surface);
+    This->gles->frame++;
     return D3D_OK;
 }
 static HRESULT D3DAPI d3d8_get_back_buffer(IDirect3DDevice8 *This, UINT BackBuffer, D3DBACKBUFFER_TYPE Type, IDirect3DSurface8 **ppBackBuffer) { return D3DERR_NOTAVAILABLE; }
@@ -1230,14 +3053,20 @@ static void D3DAPI d3d8_set_gamma_ramp(IDirect3DDevice8 *This, DWORD Flags, CONS
 static void D3DAPI d3d8_get_gamma_ramp(IDirect3DDevice8 *This, D3DGAMMARAMP *pRamp) {}
 static HRESULT D3DAPI d3d8_begin_scene(IDirect3DDevice8 *This) {
     d3d8_gles_log("BeginScene\n");
+    This->gles->scene.recording = This->gles->scene.enabled;
+    This->gles->scene.state_dirty = TRUE;
     return D3D_OK;
 }
 static HRESULT D3DAPI d3d8_end_scene(IDirect3DDevice8 *This) {
     d3d8_gles_log("EndScene\n");
+    scene_flush(This->gles);
+    This->gles->scene.recording = FALSE;
     return D3D_OK;
 }
 static HRESULT D3DAPI d3d8_set_viewport(IDirect3DDevice8 *This, CONST D3DVIEWPORT8 *pViewport) {
+    scene_flush(This->gles);
     This->gles->viewport = *pViewport;
+    This->gles->rhw_projection_valid = FALSE;
     glViewport(pViewport->X, pViewport->Y, pViewport->Width, pViewport->Height);
 #ifdef GL_VERSION_ES_CM_1_0
     glDepthRangef(pViewport->MinZ, pViewport->MaxZ);
@@ -1251,68 +3080,784 @@ static HRESULT D3DAPI d3d8_set_transform(IDirect3DDevice8 *This, D3DTRANSFORMSTA
     switch (State) {
         case D3DTS_WORLD:
             This->gles->world_matrix = *pMatrix;
+            This->gles->wvp_valid = FALSE;
             break;
         case D3DTS_VIEW:
+            scene_flush(This->gles);
             This->gles->view_matrix = *pMatrix;
+            This->gles->wvp_valid = FALSE;
             break;
         case D3DTS_PROJECTION:
+            scene_flush(This->gles);
             This->gles->projection_matrix = *pMatrix;
+            This->gles->wvp_valid = FALSE;
+            break;
+        case D3DTS_TEXTURE0:
+        case D3DTS_TEXTURE1:
+        case D3DTS_TEXTURE2:
+        case D3DTS_TEXTURE3:
+        case D3DTS_TEXTURE4:
+        case D3DTS_TEXTURE5:
+        case D3DTS_TEXTURE6:
+        case D3DTS_TEXTURE7: {
+            // Animated coordinates often set the same matrix again
+            UINT stage = State - D3DTS_TEXTURE0;
+            if (!memcmp(&This->gles->texture_matrices[stage], pMatrix, sizeof(D3DXMATRIX))) break;
+            // Recorded draws keep the matrices they were recorded with
+            if (!scene_defer_state(This->gles)) batch_flush(This->gles);
+            This->gles->texture_matrices[stage] = *pMatrix;
+            texture_matrix_touch(This->gles, stage);
             break;
+        }
         default:
             return D3DERR_INVALIDCALL;
     }
-    return D3D_OK;
+    return D3D_OK;
+}
+
+// Dynamic batching: small indexed triangle lists that share state are
+// pre-transformed into world space on the CPU and submitted as one draw.
+#define BATCH_HASH_SEED 0xcbf29ce484222325ULL
+#define BATCH_HASH_PRIME 0x100000001b3ULL
+
+static uint64_t batch_hash(const void *data, size_t size, uint64_t h) {
+    const BYTE *p = data;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, p + i, sizeof(word));
+        h = (h ^ word) * BATCH_HASH_PRIME;
+    }
+    for (; i < size; i++) h = (h ^ p[i]) * BATCH_HASH_PRIME;
+    return h;
+}
+
+static BOOL batch_reserve(void **data, size_t *capacity, size_t size) {
+    if (size <= *capacity) return TRUE;
+    size_t new_capacity = *capacity ? *capacity : 4096;
+    while (new_capacity < size) new_capacity *= 2;
+    void *p = realloc(*data, new_capacity);
+    if (!p) return FALSE;
+    *data = p;
+    *capacity = new_capacity;
+    return TRUE;
+}
+
+// Transform `count` float3 attributes at `data` (spaced `stride` bytes apart)
+// by the upper 3x4 of `m`; `w` selects points (1) or directions (0).
+static void batch_transform3(BYTE *data, UINT count, UINT stride, const D3DXMATRIX *m, float w) {
+#if defined(D3D8_GLES_SSE2)
+    __m128 r0 = _mm_loadu_ps(m->m[0]);
+    __m128 r1 = _mm_loadu_ps(m->m[1]);
+    __m128 r2 = _mm_loadu_ps(m->m[2]);
+    __m128 r3 = _mm_mul_ps(_mm_loadu_ps(m->m[3]), _mm_set1_ps(w));
+    for (UINT i = 0; i < count; i++, data += stride) {
+        float *v = (float *)data;
+        __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(v[0]), r0), _mm_mul_ps(_mm_set1_ps(v[1]), r1)),
+                              _mm_add_ps(_mm_mul_ps(_mm_set1_ps(v[2]), r2), r3));
+        _mm_storel_pi((__m64 *)v, r);
+        _mm_store_ss(v + 2, _mm_movehl_ps(r, r));
+    }
+#elif defined(D3D8_GLES_NEON)
+    float32x4_t r0 = vld1q_f32(m->m[0]);
+    float32x4_t r1 = vld1q_f32(m->m[1]);
+    float32x4_t r2 = vld1q_f32(m->m[2]);
+    float32x4_t r3 = vmulq_n_f32(vld1q_f32(m->m[3]), w);
+    for (UINT i = 0; i < count; i++, data += stride) {
+        float *v = (float *)data;
+        float32x4_t r = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(r3, r0, v[0]), r1, v[1]), r2, v[2]);
+        vst1_f32(v, vget_low_f32(r));
+        vst1q_lane_f32(v + 2, r, 2);
+    }
+#else
+    for (UINT i = 0; i < count; i++, data += stride) {
+        float *v = (float *)data;
+        float x = v[0], y = v[1], z = v[2];
+        v[0] = x * m->_11 + y * m->_21 + z * m->_31 + w * m->_41;
+        v[1] = x * m->_12 + y * m->_22 + z * m->_32 + w * m->_42;
+        v[2] = x * m->_13 + y * m->_23 + z * m->_33 + w * m->_43;
+    }
+#endif
+}
+
+static void batch_release_slot(GLES_BatchCacheSlot *slot) {
+    free(slot->records);
+    slot->records = NULL;
+    slot->record_count = 0;
+    slot->key = 0;
+}
+
+static void batch_destroy(GLES_Batch *batch) {
+    for (int i = 0; i < GLES_BATCH_CACHE_SLOTS; i++) {
+        GLES_BatchCacheSlot *slot = &batch->cache[i];
+        batch_release_slot(slot);
+        if (slot->vbo) glDeleteBuffers(1, &slot->vbo);
+        if (slot->ibo) glDeleteBuffers(1, &slot->ibo);
+        slot->vbo = slot->ibo = 0;
+    }
+    free(batch->vertices);
+    free(batch->indices);
+    batch->vertices = NULL;
+    batch->indices = NULL;
+    batch->vertices_capacity = batch->indices_capacity = 0;
+    batch->count = 0;
+}
+
+// A buffer going away must not leave pending draws or cache entries that
+// could later match a new buffer allocated at the same address.
+static void batch_forget_buffer(GLES_Device *gles, GLES_Buffer *buffer) {
+    GLES_Batch *batch = &gles->batch;
+    scene_flush(gles);
+    for (UINT i = 0; i < GLES_MAX_STREAMS; i++) {
+        if (gles->streams[i].buffer == buffer) memset(&gles->streams[i], 0, sizeof(gles->streams[i]));
+    }
+    if (gles->index_buffer == buffer) gles->index_buffer = NULL;
+    for (int i = 0; i < GLES_BATCH_CACHE_SLOTS; i++) {
+        GLES_BatchCacheSlot *slot = &batch->cache[i];
+        for (UINT r = 0; r < slot->record_count; r++) {
+            if (slot->records[r].vb == buffer || slot->records[r].ib == buffer) {
+                batch_release_slot(slot);
+                break;
+            }
+        }
+    }
+}
+
+static BOOL batch_try_add(GLES_Device *gles, D3DPRIMITIVETYPE type, UINT min_index,
+                          UINT num_vertices, UINT start_index, UINT primitive_count) {
+    GLES_Batch *batch = &gles->batch;
+    GLES_Buffer *vb = gles->streams[0].buffer;
+    GLES_Buffer *ib = gles->index_buffer;
+    const D3DXMATRIX *world = &gles->world_matrix;
+    DWORD fvf = gles->fvf;
+
+    if (!batch->enabled || type != D3DPT_TRIANGLELIST) return FALSE;
+    if (num_vertices == 0 || num_vertices > batch->vertex_limit || primitive_count == 0) return FALSE;
+    // Declarations may spread a vertex over several streams; only FVFs batch
+    if (gles->vertex_shader) return FALSE;
+    if (!(fvf & D3DFVF_XYZ) || (fvf & D3DFVF_XYZRHW) == D3DFVF_XYZRHW) return FALSE;
+    if (!vb || !ib || vb->locked || ib->locked || ib->format != D3DFMT_INDEX16) return FALSE;
+    if (ib->vbo_id != gles->current_ibo) return FALSE;
+    // Projective world matrices cannot be folded into positions
+    if (world->_14 != 0.0f || world->_24 != 0.0f || world->_34 != 0.0f || world->_44 != 1.0f) return FALSE;
+
+    UINT stride = gles->streams[0].stride ? gles->streams[0].stride : D3DXGetFVFVertexSize(fvf);
+    if (stride < D3DXGetFVFVertexSize(fvf)) return FALSE;
+    UINT index_count = primitive_count * 3;
+    UINT base_vertex = gles->base_vertex;
+    if (((uint64_t)base_vertex + min_index + num_vertices) * stride > vb->length) return FALSE;
+    if (((uint64_t)start_index + index_count) * sizeof(WORD) > ib->length) return FALSE;
+    const WORD *indices = (const WORD *)ib->shadow + start_index;
+    for (UINT i = 0; i < index_count; i++) {
+        if (indices[i] < min_index || (UINT)(indices[i] - min_index) >= num_vertices) return FALSE;
+    }
+
+    if (batch->count && (batch->fvf != fvf || batch->stride != stride || batch->count == GLES_BATCH_MAX_RECORDS ||
+                         batch->vertex_count + num_vertices > 0xFFFF))
+        batch_flush(gles);
+    if (!batch->count && (!batch->plan.valid || batch->plan.fvf != fvf)) compile_fvf_plan(fvf, &batch->plan);
+
+    GLES_BatchRecord *record = &batch->records[batch->count++];
+    memset(record, 0, sizeof(*record));
+    record->vb = vb;
+    record->ib = ib;
+    record->vb_version = vb->version;
+    record->ib_version = ib->version;
+    record->min_index = min_index;
+    record->base_vertex = base_vertex;
+    record->num_vertices = num_vertices;
+    record->start_index = start_index;
+    record->index_count = index_count;
+    record->world = *world;
+    texture_coords(gles->loading_stages & 1 ? NULL : gles->applied.textures[0], record->coords);
+    batch->fvf = fvf;
+    batch->stride = stride;
+    batch->vertex_count += num_vertices;
+    batch->index_count += index_count;
+    gles->stats.BatchedDraws++;
+    return TRUE;
+}
+
+// Maps the two floats at `offset` in each of `count` vertices, a texture
+// coordinate pair, into the part of an atlas page `coords` describe
+static void batch_bake_coords(BYTE *vertices, UINT count, UINT stride, UINT offset, const GLfloat coords[4]) {
+    for (UINT i = 0; i < count; i++) {
+        float *uv = (float *)(vertices + (size_t)i * stride + offset);
+        uv[0] = uv[0] * coords[0] + coords[2];
+        uv[1] = uv[1] * coords[1] + coords[3];
+    }
+}
+
+// Build the merged, world-space vertex and index data for the pending batch.
+// Records whose stage 0 textures sit in different places on an atlas page
+// have texture coordinate set `set` baked to page coordinates.
+static BOOL batch_build(GLES_Batch *batch, GLES_BatchCacheSlot *slot, UINT set) {
+    UINT stride = batch->stride;
+    if (!batch_reserve((void **)&batch->vertices, &batch->vertices_capacity, (size_t)batch->vertex_count * stride) ||
+        !batch_reserve((void **)&batch->indices, &batch->indices_capacity, (size_t)batch->index_count * sizeof(WORD)))
+        return FALSE;
+    GLES_BatchRecord *records = malloc(batch->count * sizeof(GLES_BatchRecord));
+    if (!records) return FALSE;
+    memcpy(records, batch->records, batch->count * sizeof(GLES_BatchRecord));
+
+    const GLES_VertexElement *baked = NULL;
+    for (UINT r = 1; r < batch->count; r++) {
+        if (memcmp(batch->records[r].coords, batch->records[0].coords, sizeof(batch->records[0].coords))) {
+            for (UINT i = 0; i < batch->plan.element_count; i++) {
+                const GLES_VertexElement *element = &batch->plan.elements[i];
+                if (element->array >= GLES_ARRAY_TEXCOORD0 && element->set == set && element->size >= 2)
+                    baked = element;
+            }
+            break;
+        }
+    }
+
+    BYTE *dst = batch->vertices;
+    WORD *dst_indices = batch->indices;
+    UINT base = 0;
+    for (UINT r = 0; r < batch->count; r++) {
+        const GLES_BatchRecord *record = &batch->records[r];
+        size_t first_vertex = (size_t)record->base_vertex + record->min_index;
+        memcpy(dst, record->vb->shadow + first_vertex * stride, (size_t)record->num_vertices * stride);
+        batch_transform3(dst, record->num_vertices, stride, &record->world, 1.0f);
+        if (batch->fvf & D3DFVF_NORMAL) {
+            // Normals go through the inverse transpose to survive non-uniform scale
+            D3DXMATRIX normal_matrix;
+            if (D3DXMatrixInverse(&normal_matrix, NULL, &record->world))
+                D3DXMatrixTranspose(&normal_matrix, &normal_matrix);
+            else
+                normal_matrix = record->world;
+            batch_transform3(dst + 12, record->num_vertices, stride, &normal_matrix, 0.0f);
+        }
+        if (baked) batch_bake_coords(dst, record->num_vertices, stride, baked->offset, record->coords);
+        const WORD *src_indices = (const WORD *)record->ib->shadow + record->start_index;
+        for (UINT i = 0; i < record->index_count; i++)
+            *dst_indices++ = (WORD)(src_indices[i] - record->min_index + base);
+        dst += (size_t)record->num_vertices * stride;
+        base += record->num_vertices;
+    }
+
+    if (!slot->vbo) glGenBuffers(1, &slot->vbo);
+    if (!slot->ibo) glGenBuffers(1, &slot->ibo);
+    glBindBuffer(GL_ARRAY_BUFFER, slot->vbo);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)batch->vertex_count * stride, batch->vertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, slot->ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)batch->index_count * sizeof(WORD), batch->indices, GL_STATIC_DRAW);
+
+    batch_release_slot(slot);
+    slot->records = records;
+    slot->record_count = batch->count;
+    slot->fvf = batch->fvf;
+    slot->stride = stride;
+    slot->index_count = batch->index_count;
+    slot->coords_set = set;
+    memcpy(slot->coords, baked ? texcoord_identity : records[0].coords, sizeof(slot->coords));
+    return TRUE;
+}
+
+// `coords`, when given, replace the stage 0 texture coordinate mapping for
+// this draw only
+static void draw_elements(GLES_Device *gles, const D3DXMATRIX *world, const GLES_VertexPlan *plan,
+                          const GLES_Stream *streams, GLuint ibo, UINT base_vertex, GLenum mode, GLsizei count,
+                          UINT start_index, const GLfloat *coords) {
+    load_draw_transform(gles, plan->rhw, world);
+    texenv_apply(gles);
+    if (coords) texcoord_load(gles, 0, coords);
+    bind_vertex_arrays(gles, plan, streams, base_vertex);
+    texture_matrices_load(gles);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glDrawElements(mode, count, GL_UNSIGNED_SHORT, (void *)(start_index * sizeof(WORD)));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    gles->stats.DrawCalls++;
+}
+
+// Draw one batch record straight from its application buffers
+static void batch_draw_record(GLES_Device *gles, const GLES_VertexPlan *plan, const GLES_BatchRecord *record,
+                              UINT stride) {
+    GLES_Stream stream = {record->vb, record->vb->vbo_id, stride};
+    draw_elements(gles, &record->world, plan, &stream, record->ib->vbo_id, record->base_vertex, GL_TRIANGLES,
+                  record->index_count, record->start_index, record->coords);
+}
+
+static void batch_flush(GLES_Device *gles) {
+    GLES_Batch *batch = &gles->batch;
+    if (!batch->count) return;
+
+    const GLES_VertexPlan *plan = &batch->plan;
+    DWORD set = gles->applied.texture_stage_state_mask[0] & 1u << D3DTSS_TEXCOORDINDEX
+                    ? gles->applied.texture_stage_states[0][D3DTSS_TEXCOORDINDEX]
+                    : 0;
+    if (batch->count == 1) {
+        // Nothing to merge; draw straight from the application buffers
+        batch_draw_record(gles, plan, &batch->records[0], batch->stride);
+    } else {
+        size_t records_size = batch->count * sizeof(GLES_BatchRecord);
+        uint64_t key = batch_hash(batch->records, records_size, BATCH_HASH_SEED ^ batch->fvf ^ batch->stride);
+        GLES_BatchCacheSlot *slot = NULL;
+        GLES_BatchCacheSlot *victim = &batch->cache[0];
+        for (int i = 0; i < GLES_BATCH_CACHE_SLOTS; i++) {
+            GLES_BatchCacheSlot *s = &batch->cache[i];
+            if (s->records && s->key == key && s->fvf == batch->fvf && s->stride == batch->stride &&
+                s->record_count == batch->count && s->coords_set == set &&
+                !memcmp(s->records, batch->records, records_size)) {
+                slot = s;
+                break;
+            }
+            if (s->last_used < victim->last_used) victim = s;
+        }
+
+        if (slot) {
+            gles->stats.BatchCacheHits++;
+        } else if (batch_build(batch, victim, (UINT)set)) {
+            slot = victim;
+            slot->key = key;
+        }
+
+        if (slot) {
+            slot->last_used = ++batch->tick;
+            GLES_Stream stream = {NULL, slot->vbo, slot->stride};
+            draw_elements(gles, NULL, plan, &stream, slot->ibo, 0, GL_TRIANGLES, slot->index_count, 0, slot->coords);
+        } else {
+            // Out of memory: fall back to one draw per record
+            for (UINT r = 0; r < batch->count; r++) batch_draw_record(gles, plan, &batch->records[r], batch->stride);
+        }
+    }
+
+    // Restore the application's bindings, and the mapping for the texture
+    // stage 0 has now
+    glBindBuffer(GL_ARRAY_BUFFER, gles->streams[0].vbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gles->current_ibo);
+    texture_apply_coords(gles, 0, gles->loading_stages & 1 ? NULL : gles->applied.textures[0]);
+    gles->stats.BatchFlushes++;
+    batch->count = 0;
+    batch->vertex_count = 0;
+    batch->index_count = 0;
+}
+
+static BOOL primitive_to_gl(D3DPRIMITIVETYPE type, UINT primitive_count, GLenum *mode, GLsizei *count) {
+    switch (type) {
+        case D3DPT_TRIANGLELIST:
+            *mode = GL_TRIANGLES;
+            *count = primitive_count * 3;
+            return TRUE;
+        case D3DPT_TRIANGLESTRIP:
+            *mode = GL_TRIANGLE_STRIP;
+            *count = primitive_count + 2;
+            return TRUE;
+        case D3DPT_POINTLIST:
+            *mode = GL_POINTS;
+            *count = primitive_count;
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+// Issue an indexed draw with the device's current streams, vertex plan and
+// world matrix, merging it into the dynamic batch when possible.
+static void draw_indexed(GLES_Device *gles, const GLES_VertexPlan *plan, D3DPRIMITIVETYPE type, UINT min_index,
+                         UINT num_vertices, UINT start_index, UINT primitive_count) {
+    GLenum mode;
+    GLsizei count;
+    if (!primitive_to_gl(type, primitive_count, &mode, &count)) return;
+    if (gles->atlas_pages) atlas_check_addressing(gles);
+    if (batch_try_add(gles, type, min_index, num_vertices, start_index, primitive_count))
+        return;
+    batch_flush(gles);
+    draw_elements(gles, &gles->world_matrix, plan, gles->streams, gles->current_ibo, gles->base_vertex, mode, count,
+                  start_index, NULL);
+}
+
+// Deferred scene submission
+static BOOL scene_reserve(void **data, UINT *capacity, UINT count, size_t size) {
+    if (count <= *capacity) return TRUE;
+    UINT new_capacity = *capacity ? *capacity * 2 : 64;
+    while (new_capacity < count) new_capacity *= 2;
+    void *p = realloc(*data, (size_t)new_capacity * size);
+    if (!p) return FALSE;
+    *data = p;
+    *capacity = new_capacity;
+    return TRUE;
+}
+
+static void scene_destroy(GLES_Scene *scene) {
+    free(scene->draws);
+    free(scene->states);
+    free(scene->sort_items);
+    memset(scene, 0, sizeof(*scene));
+}
+
+// Intern the device's current state block, returning its index in the scene
+static BOOL scene_intern_state(GLES_Device *gles, UINT *index) {
+    GLES_Scene *scene = &gles->scene;
+    if (!scene->state_dirty && scene->state_count) {
+        *index = scene->current_state;
+        return TRUE;
+    }
+    uint64_t hash = batch_hash(&gles->state, sizeof(gles->state), BATCH_HASH_SEED);
+    hash = batch_hash(gles->texture_matrices, sizeof(gles->texture_matrices), hash);
+    for (UINT i = 0; i < scene->state_count; i++) {
+        if (scene->states[i].hash == hash && !memcmp(&scene->states[i].block, &gles->state, sizeof(gles->state)) &&
+            !memcmp(scene->states[i].texture_matrices, gles->texture_matrices, sizeof(gles->texture_matrices))) {
+            scene->current_state = *index = i;
+            scene->state_dirty = FALSE;
+            return TRUE;
+        }
+    }
+    if (!scene_reserve((void **)&scene->states, &scene->state_capacity, scene->state_count + 1, sizeof(GLES_SceneState)))
+        return FALSE;
+    scene->states[scene->state_count].hash = hash;
+    scene->states[scene->state_count].block = gles->state;
+    memcpy(scene->states[scene->state_count].texture_matrices, gles->texture_matrices, sizeof(gles->texture_matrices));
+    scene->current_state = *index = scene->state_count++;
+    scene->state_dirty = FALSE;
+    return TRUE;
+}
+
+// Sort key: texture, vertex buffer, state hash, then front-to-back depth
+static uint64_t scene_sort_key(const GLES_Device *gles, const GLES_SceneDraw *draw) {
+    const GLES_SceneState *state = &gles->scene.states[draw->state];
+    uint64_t texture = state->block.textures[0] ? state->block.textures[0]->tex_id & 0xFFFF : 0;
+    uint64_t state_hash = state->hash & 0xFFFF;
+    uint64_t vbo = draw->streams[0].vbo & 0xFFF;
+    const D3DXMATRIX *view = &gles->view_matrix;
+    float z = draw->world._41 * view->_13 + draw->world._42 * view->_23 +
+              draw->world._43 * view->_33 + view->_43;
+    uint32_t depth_bits = 0;
+    // Non-negative floats order like their bit patterns
+    if (z > 0.0f) memcpy(&depth_bits, &z, sizeof(depth_bits));
+    return texture << 48 | vbo << 36 | state_hash << 20 | depth_bits >> 12;
+}
+
+// Stable LSD radix sort on the 64-bit keys, skipping bytes all keys share
+static GLES_SortItem *scene_radix_sort(GLES_SortItem *items, GLES_SortItem *scratch, UINT count) {
+    for (int shift = 0; shift < 64; shift += 8) {
+        UINT histogram[256] = {0};
+        for (UINT i = 0; i < count; i++) histogram[(items[i].key >> shift) & 0xFF]++;
+        if (histogram[(items[0].key >> shift) & 0xFF] == count) continue;
+        UINT offset = 0;
+        for (int b = 0; b < 256; b++) {
+            UINT n = histogram[b];
+            histogram[b] = offset;
+            offset += n;
+        }
+        for (UINT i = 0; i < count; i++) scratch[histogram[(items[i].key >> shift) & 0xFF]++] = items[i];
+        GLES_SortItem *tmp = items;
+        items = scratch;
+        scratch = tmp;
+    }
+    return items;
+}
+
+// Bring GL in line with `target`, touching only states that differ
+static void scene_apply_state(GLES_Device *gles, const GLES_StateBlock *target) {
+    GLES_StateBlock *applied = &gles->applied;
+    if (!memcmp(applied, target, sizeof(*target))) return;
+    // Moving to another texture on the same atlas page keeps the batch going
+    GLES_Texture *current = applied->textures[0];
+    applied->textures[0] = target->textures[0];
+    BOOL only_texture = !memcmp(applied, target, sizeof(*target));
+    applied->textures[0] = current;
+    if (only_texture && atlas_switch_batches(gles, 0, target->textures[0]))
+        gles->stats.AtlasSwitches++;
+    else
+        batch_flush(gles);
+    for (UINT i = 0; i < GLES_MAX_RENDER_STATES; i++) {
+        uint32_t bit = 1u << (i % 32);
+        if ((target->render_state_mask[i / 32] & bit) &&
+            (!(applied->render_state_mask[i / 32] & bit) || applied->render_states[i] != target->render_states[i]))
+            apply_render_state(gles, (D3DRENDERSTATETYPE)i, target->render_states[i]);
+    }
+    // P8 textures bind the copy built with the palette in effect
+    BOOL palette_changed = applied->texture_palette != target->texture_palette;
+    applied->texture_palette = target->texture_palette;
+    for (DWORD stage = 0; stage < GLES_MAX_TEXTURE_STAGES; stage++) {
+        GLES_Texture *texture = target->textures[stage];
+        if (applied->textures[stage] != texture || (palette_changed && texture && texture->palette_image))
+            apply_texture(gles, stage, texture);
+        for (UINT i = 0; i < GLES_MAX_TEXTURE_STAGE_STATES; i++) {
+            uint32_t bit = 1u << i;
+            if ((target->texture_stage_state_mask[stage] & bit) &&
+                (!(applied->texture_stage_state_mask[stage] & bit) ||
+                 applied->texture_stage_states[stage][i] != target->texture_stage_states[stage][i]))
+                apply_texture_stage_state(gles, stage, (D3DTEXTURESTAGESTATETYPE)i, target->texture_stage_states[stage][i]);
+        }
+    }
+}
+
+// Make `matrices` the D3DTS_TEXTUREn in effect, submitting the batch drawn
+// with the previous ones first
+static void scene_apply_texture_matrices(GLES_Device *gles, const D3DXMATRIX *matrices) {
+    for (DWORD stage = 0; stage < GLES_MAX_TEXTURE_STAGES; stage++) {
+        if (!memcmp(&gles->texture_matrices[stage], &matrices[stage], sizeof(D3DXMATRIX))) continue;
+        batch_flush(gles);
+        gles->texture_matrices[stage] = matrices[stage];
+        texture_matrix_touch(gles, stage);
+    }
+}
+
+static void scene_replay(GLES_Device *gles, const GLES_SceneDraw *draw) {
+    const GLES_SceneState *state = &gles->scene.states[draw->state];
+    scene_apply_state(gles, &state->block);
+    scene_apply_texture_matrices(gles, state->texture_matrices);
+    memcpy(gles->streams, draw->streams, sizeof(gles->streams));
+    gles->index_buffer = draw->ib;
+    gles->current_ibo = draw->ibo;
+    gles->fvf = draw->fvf;
+    gles->vertex_shader = draw->vertex_shader;
+    gles->base_vertex = draw->base_vertex;
+    gles->world_matrix = draw->world;
+    gles->wvp_valid = FALSE;
+    draw_indexed(gles, current_vertex_plan(gles), draw->type, draw->min_index, draw->num_vertices,
+                 draw->start_index, draw->primitive_count);
+}
+
+// `state` in `block`, or `unset` when the application never set it
+static DWORD scene_render_state(const GLES_StateBlock *block, D3DRENDERSTATETYPE state, DWORD unset) {
+    return block->render_state_mask[state / 32] & 1u << (state % 32) ? block->render_states[state] : unset;
+}
+
+// Whether a draw's result is the same wherever it lands among other such
+// draws: opaque, depth tested with LESS or LESSEQUAL, writing depth and not
+// using the stencil buffer. Unset states are GL's defaults, which leave the
+// depth test off.
+static BOOL scene_draw_sortable(const GLES_Scene *scene, const GLES_SceneDraw *draw) {
+    const GLES_StateBlock *block = &scene->states[draw->state].block;
+    DWORD zfunc = scene_render_state(block, D3DRS_ZFUNC, D3DCMP_LESS);
+    return !scene_render_state(block, D3DRS_ALPHABLENDENABLE, FALSE) &&
+           scene_render_state(block, D3DRS_ZENABLE, D3DZB_FALSE) != D3DZB_FALSE &&
+           scene_render_state(block, D3DRS_ZWRITEENABLE, TRUE) &&
+           (zfunc == D3DCMP_LESS || zfunc == D3DCMP_LESSEQUAL) &&
+           !scene_render_state(block, D3DRS_STENCILENABLE, FALSE);
+}
+
+// Submit the recorded draws in order, except that each run of sortable draws
+// between the others is sorted by key. Blended, overlay, sky and stencil
+// draws stay where the application put them. Recording continues afterwards
+// if a scene is open.
+static void scene_flush(GLES_Device *gles) {
+    GLES_Scene *scene = &gles->scene;
+    if (scene->draw_count) {
+        GLES_Stream streams[GLES_MAX_STREAMS];
+        memcpy(streams, gles->streams, sizeof(streams));
+        GLES_Buffer *index_buffer = gles->index_buffer;
+        GLuint ibo = gles->current_ibo;
+        DWORD fvf = gles->fvf;
+        DWORD vertex_shader = gles->vertex_shader;
+        UINT base_vertex = gles->base_vertex;
+        D3DXMATRIX world = gles->world_matrix;
+        D3DXMATRIX texture_matrices[GLES_MAX_TEXTURE_STAGES];
+        memcpy(texture_matrices, gles->texture_matrices, sizeof(texture_matrices));
+
+        // Without sort memory everything is replayed in submission order
+        BOOL sorted = scene_reserve((void **)&scene->sort_items, &scene->sort_capacity, scene->draw_count * 2,
+                                    sizeof(GLES_SortItem));
+        UINT run = 0;
+        for (UINT i = 0; i <= scene->draw_count; i++) {
+            const GLES_SceneDraw *draw = i < scene->draw_count ? &scene->draws[i] : NULL;
+            if (sorted && draw && scene_draw_sortable(scene, draw)) {
+                scene->sort_items[run].key = scene_sort_key(gles, draw);
+                scene->sort_items[run].index = i;
+                run++;
+                continue;
+            }
+            if (run) {
+                const GLES_SortItem *order =
+                    scene_radix_sort(scene->sort_items, scene->sort_items + scene->draw_count, run);
+                for (UINT j = 0; j < run; j++) scene_replay(gles, &scene->draws[order[j].index]);
+                run = 0;
+            }
+            if (draw) scene_replay(gles, draw);
+        }
+
+        // Leave GL and the device as the application last set them
+        memcpy(gles->streams, streams, sizeof(streams));
+        gles->index_buffer = index_buffer;
+        gles->current_ibo = ibo;
+        gles->fvf = fvf;
+        gles->vertex_shader = vertex_shader;
+        gles->base_vertex = base_vertex;
+        gles->world_matrix = world;
+        gles->wvp_valid = FALSE;
+        scene_apply_texture_matrices(gles, texture_matrices);
+        scene->draw_count = 0;
+    }
+    scene->generation++;
+    scene->state_count = 0;
+    scene->state_dirty = TRUE;
+    scene_apply_state(gles, &gles->state);
+    batch_flush(gles);
+}
+
+static BOOL scene_record(GLES_Device *gles, D3DPRIMITIVETYPE type, UINT min_index, UINT num_vertices,
+                         UINT start_index, UINT primitive_count) {
+    GLES_Scene *scene = &gles->scene;
+    UINT state;
+    if (!scene_intern_state(gles, &state) ||
+        !scene_reserve((void **)&scene->draws, &scene->draw_capacity, scene->draw_count + 1, sizeof(GLES_SceneDraw)))
+        return FALSE;
+    GLES_SceneDraw *draw = &scene->draws[scene->draw_count++];
+    draw->state = state;
+    for (DWORD stage = 0; stage < GLES_MAX_TEXTURE_STAGES; stage++) {
+        if (gles->state.textures[stage]) gles->state.textures[stage]->scene_generation = scene->generation;
+    }
+    memcpy(draw->streams, gles->streams, sizeof(draw->streams));
+    for (UINT i = 0; i < GLES_MAX_STREAMS; i++) {
+        if (draw->streams[i].buffer) draw->streams[i].buffer->scene_generation = scene->generation;
+    }
+    draw->ib = gles->index_buffer;
+    if (draw->ib) draw->ib->scene_generation = scene->generation;
+    draw->ibo = gles->current_ibo;
+    draw->fvf = gles->fvf;
+    draw->vertex_shader = gles->vertex_shader;
+    draw->base_vertex = gles->base_vertex;
+    draw->type = type;
+    draw->min_index = min_index;
+    draw->num_vertices = num_vertices;
+    draw->start_index = start_index;
+    draw->primitive_count = primitive_count;
+    draw->world = gles->world_matrix;
+    gles->stats.DeferredDraws++;
+    return TRUE;
 }
 
 static HRESULT D3DAPI d3d8_draw_indexed_primitive(IDirect3DDevice8 *This, D3DPRIMITIVETYPE PrimitiveType, UINT MinVertexIndex, UINT NumVertices, UINT StartIndex, UINT PrimitiveCount) {
     GLenum mode;
     GLsizei count;
-    switch (PrimitiveType) {
-        case D3DPT_TRIANGLELIST:
-            mode = GL_TRIANGLES;
-            count = PrimitiveCount * 3;
-            break;
-        case D3DPT_TRIANGLESTRIP:
-            mode = GL_TRIANGLE_STRIP;
-            count = PrimitiveCount + 2;
-            break;
-        case D3DPT_POINTLIST:
-            mode = GL_POINTS;
-            count = PrimitiveCount;
-            break;
-        default:
-            return D3DERR_NOTAVAILABLE;
-    }
+    if (!primitive_to_gl(PrimitiveType, PrimitiveCount, &mode, &count)) return D3DERR_NOTAVAILABLE;
+    GLES_Device *gles = This->gles;
+    const GLES_VertexPlan *plan = current_vertex_plan(gles);
+    if (!vertex_streams_bound(gles, plan)) return D3DERR_INVALIDCALL;
 
-    // Apply transformations
-    D3DXMATRIX wvp;
-    D3DXMatrixMultiply(&wvp, &This->gles->world_matrix, &This->gles->view_matrix);
-    D3DXMatrixMultiply(&wvp, &wvp, &This->gles->projection_matrix);
-    GLfloat gl_matrix[16];
-    d3d_to_gl_matrix(gl_matrix, &wvp);
-    glMatrixMode(GL_MODELVIEW);
-    glLoadMatrixf(gl_matrix);
+    if (gles->scene.recording &&
+        scene_record(gles, PrimitiveType, MinVertexIndex, NumVertices, StartIndex, PrimitiveCount))
+        return D3D_OK;
+    // Recording failed (out of memory): keep the submission order intact
+    if (gles->scene.recording) scene_flush(gles);
+    draw_indexed(gles, plan, PrimitiveType, MinVertexIndex, NumVertices, StartIndex, PrimitiveCount);
+    return D3D_OK;
+}
 
-    // Setup vertex attributes
-    BYTE *vb_data;
-    UINT stride = D3DXGetFVFVertexSize(This->gles->fvf);
-    if (This->gles->current_vbo) {
-        glBindBuffer(GL_ARRAY_BUFFER, This->gles->current_vbo);
-        setup_vertex_attributes(This->gles, This->gles->fvf, 0, stride);
-    } else {
-        return D3DERR_INVALIDCALL;
+// Multi-draw extension
+static HRESULT D3DAPI multi_draw_query_interface(ID3DGLESMultiDraw *This, REFIID riid, void **ppv) {
+    return d3d8_device_query_interface(This->device, riid, ppv);
+}
+static ULONG D3DAPI multi_draw_add_ref(ID3DGLESMultiDraw *This) { return common_add_ref(This); }
+// Owned by the device, which frees it on Release
+static ULONG D3DAPI multi_draw_release(ID3DGLESMultiDraw *This) { (void)This; return 1; }
+
+// Smallest index and index span of a draw, which batching needs
+static void index_range(const GLES_Buffer *ib, UINT start_index, UINT count, UINT *min_index, UINT *num_vertices) {
+    const WORD *indices = (const WORD *)ib->shadow + start_index;
+    WORD lo = 0xFFFF, hi = 0;
+    for (UINT i = 0; i < count; i++) {
+        if (indices[i] < lo) lo = indices[i];
+        if (indices[i] > hi) hi = indices[i];
+    }
+    *min_index = count ? lo : 0;
+    *num_vertices = count ? (UINT)(hi - lo) + 1 : 0;
+}
+
+static HRESULT D3DAPI multi_draw_draw_indexed_primitives(ID3DGLESMultiDraw *This, CONST D3DGLES_DRAW *pDraws, UINT DrawCount) {
+    GLES_Device *gles = This->device->gles;
+    GLES_Buffer *ib = gles->index_buffer;
+    if (DrawCount == 0) return D3D_OK;
+    const GLES_VertexPlan *plan = current_vertex_plan(gles);
+    if (!pDraws || !vertex_streams_bound(gles, plan) || !ib) return D3DERR_INVALIDCALL;
+
+    // Validate the whole array up front so a bad record draws nothing
+    UINT index_limit = ib->length / sizeof(WORD);
+    for (UINT i = 0; i < DrawCount; i++) {
+        GLenum mode;
+        GLsizei count;
+        if (!primitive_to_gl(pDraws[i].PrimitiveType, pDraws[i].PrimitiveCount, &mode, &count))
+            return D3DERR_NOTAVAILABLE;
+        if (pDraws[i].PrimitiveCount == 0 || (uint64_t)pDraws[i].StartIndex + (UINT)count > index_limit)
+            return D3DERR_INVALIDCALL;
     }
 
-    // Draw
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, This->gles->current_ibo);
-    glDrawElements(mode, count, GL_UNSIGNED_SHORT,
-                   (void *)(StartIndex * sizeof(WORD)));
+    UINT base_vertex = gles->base_vertex;
+    D3DXMATRIX world = gles->world_matrix;
+    if (gles->scene.recording || gles->batch.enabled) {
+        // Sorting and batching work per draw; feed them each record
+        for (UINT i = 0; i < DrawCount; i++) {
+            const D3DGLES_DRAW *draw = &pDraws[i];
+            GLenum mode;
+            GLsizei count;
+            UINT min_index, num_vertices;
+            primitive_to_gl(draw->PrimitiveType, draw->PrimitiveCount, &mode, &count);
+            index_range(ib, draw->StartIndex, count, &min_index, &num_vertices);
+            gles->base_vertex = draw->BaseVertexIndex;
+            gles->world_matrix = draw->pWorld ? *draw->pWorld : world;
+            gles->wvp_valid = FALSE;
+            if (gles->scene.recording &&
+                scene_record(gles, draw->PrimitiveType, min_index, num_vertices, draw->StartIndex, draw->PrimitiveCount))
+                continue;
+            if (gles->scene.recording) scene_flush(gles);
+            draw_indexed(gles, plan, draw->PrimitiveType, min_index, num_vertices, draw->StartIndex,
+                         draw->PrimitiveCount);
+        }
+        gles->base_vertex = base_vertex;
+        gles->world_matrix = world;
+        gles->wvp_valid = FALSE;
+        return D3D_OK;
+    }
 
+    // Direct path: bind once, then touch the matrix and attribute pointers
+    // only when a record changes them
+    BOOL rhw = plan->rhw;
+    D3DXMATRIX view_proj;
+    D3DXMatrixMultiply(&view_proj, &gles->view_matrix, &gles->projection_matrix);
+    UINT last_base = UINT_MAX;
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gles->current_ibo);
+    if (gles->atlas_pages) atlas_check_addressing(gles);
+    texenv_apply(gles);
+    // Starts from the current world matrix, which records without one use
+    load_draw_transform(gles, rhw, &gles->world_matrix);
+    const D3DXMATRIX *last_world = &gles->world_matrix;
+    for (UINT i = 0; i < DrawCount; i++) {
+        const D3DGLES_DRAW *draw = &pDraws[i];
+        const D3DXMATRIX *draw_world = draw->pWorld ? draw->pWorld : &gles->world_matrix;
+        GLenum mode;
+        GLsizei count;
+        primitive_to_gl(draw->PrimitiveType, draw->PrimitiveCount, &mode, &count);
+        if (draw->BaseVertexIndex != last_base) {
+            bind_vertex_arrays(gles, plan, gles->streams, draw->BaseVertexIndex);
+            texture_matrices_load(gles);
+            last_base = draw->BaseVertexIndex;
+        }
+        if (!rhw && draw_world != last_world) {
+            D3DXMATRIX wvp;
+            GLfloat gl_matrix[16];
+            D3DXMatrixMultiply(&wvp, draw_world, &view_proj);
+            d3d_to_gl_matrix(gl_matrix, &wvp);
+            glLoadMatrixf(gl_matrix);
+            last_world = draw_world;
+            gles->wvp_valid = draw_world == &gles->world_matrix;
+        }
+        glDrawElements(mode, count, GL_UNSIGNED_SHORT, (void *)(draw->StartIndex * sizeof(WORD)));
+        gles->stats.DrawCalls++;
+    }
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     return D3D_OK;
 }
 
+static ID3DGLESMultiDraw *multi_draw_create(IDirect3DDevice8 *device) {
+    static const ID3DGLESMultiDrawVtbl multi_draw_vtbl = {
+        .QueryInterface = multi_draw_query_interface,
+        .AddRef = multi_draw_add_ref,
+        .Release = multi_draw_release,
+        .DrawIndexedPrimitives = multi_draw_draw_indexed_primitives
+    };
+    ID3DGLESMultiDraw *multi_draw = calloc(1, sizeof(ID3DGLESMultiDraw));
+    if (!multi_draw) return NULL;
+    multi_draw->lpVtbl = &multi_draw_vtbl;
+    multi_draw->device = device;
+    return multi_draw;
+}
+
 // Vertex/Index Buffer methods
 static HRESULT D3DAPI d3d8_create_vertex_buffer(IDirect3DDevice8 *This, UINT Length, DWORD Usage, DWORD FVF, D3DPOOL Pool, IDirect3DVertexBuffer8 **ppVertexBuffer) {
     GLES_Buffer *buffer = calloc(1, sizeof(GLES_Buffer));
@@ -1322,16 +3867,24 @@ static HRESULT D3DAPI d3d8_create_vertex_buffer(IDirect3DDevice8 *This, UINT Len
     buffer->usage = Usage;
     buffer->fvf = FVF;
     buffer->pool = Pool;
+    buffer->shadow = calloc(1, Length ? Length : 1);
+    if (!buffer->shadow) {
+        free(buffer);
+        return D3DERR_OUTOFVIDEOMEMORY;
+    }
 
+    buffer->resource.managed = Pool == D3DPOOL_MANAGED;
+    resource_link(This->gles, &buffer->resource);
+    resource_grow(This->gles, &buffer->resource, Length);
     glGenBuffers(1, &buffer->vbo_id);
     glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo_id);
-    GLenum gl_usage = (Usage & D3DUSAGE_DYNAMIC) ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW;
-    glBufferData(GL_ARRAY_BUFFER, Length, NULL, gl_usage);
+    glBufferData(GL_ARRAY_BUFFER, Length, NULL, buffer_gl_usage(buffer));
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     IDirect3DVertexBuffer8 *vb = calloc(1, sizeof(IDirect3DVertexBuffer8) + sizeof(IDirect3DVertexBuffer8Vtbl));
     if (!vb) {
         glDeleteBuffers(1, &buffer->vbo_id);
+        free(buffer->shadow);
         free(buffer);
         return D3DERR_OUTOFVIDEOMEMORY;
     }
@@ -1360,8 +3913,25 @@ static HRESULT D3DAPI d3d8_create_vertex_buffer(IDirect3DDevice8 *This, UINT Len
     return D3D_OK;
 }
 
+// Record a state change made while a deferred scene is recording; it is
+// applied to GL when a draw that uses it is replayed.
+static BOOL scene_defer_state(GLES_Device *gles) {
+    if (!gles->scene.recording) return FALSE;
+    gles->scene.state_dirty = TRUE;
+    return TRUE;
+}
+
 static HRESULT D3DAPI d3d8_set_render_state(IDirect3DDevice8 *This, D3DRENDERSTATETYPE state, DWORD value) {
-    set_render_state(This->gles, state, value);
+    GLES_Device *gles = This->gles;
+    if ((DWORD)state < GLES_MAX_RENDER_STATES) {
+        gles->state.render_states[state] = value;
+        gles->state.render_state_mask[state / 32] |= 1u << (state % 32);
+        if (scene_defer_state(gles)) return D3D_OK;
+    } else {
+        scene_flush(gles);
+    }
+    batch_flush(gles);
+    apply_render_state(gles, state, value);
     return D3D_OK;
 }
 
@@ -1373,16 +3943,24 @@ static HRESULT D3DAPI d3d8_create_index_buffer(IDirect3DDevice8 *This, UINT Leng
     buffer->usage = Usage;
     buffer->format = Format;
     buffer->pool = Pool;
+    buffer->shadow = calloc(1, Length ? Length : 1);
+    if (!buffer->shadow) {
+        free(buffer);
+        return D3DERR_OUTOFVIDEOMEMORY;
+    }
 
+    buffer->resource.managed = Pool == D3DPOOL_MANAGED;
+    resource_link(This->gles, &buffer->resource);
+    resource_grow(This->gles, &buffer->resource, Length);
     glGenBuffers(1, &buffer->vbo_id);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer->vbo_id);
-    GLenum gl_usage = (Usage & D3DUSAGE_DYNAMIC) ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW;
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, Length, NULL, gl_usage);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, Length, NULL, buffer_gl_usage(buffer));
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
     IDirect3DIndexBuffer8 *ib = calloc(1, sizeof(IDirect3DIndexBuffer8) + sizeof(IDirect3DIndexBuffer8Vtbl));
     if (!ib) {
         glDeleteBuffers(1, &buffer->vbo_id);
+        free(buffer->shadow);
         free(buffer);
         return D3DERR_OUTOFVIDEOMEMORY;
     }
@@ -1412,267 +3990,1603 @@ static HRESULT D3DAPI d3d8_create_index_buffer(IDirect3DDevice8 *This, UINT Leng
 }
 
 static HRESULT D3DAPI d3d8_set_stream_source(IDirect3DDevice8 *This, UINT StreamNumber, IDirect3DVertexBuffer8 *pStreamData, UINT Stride) {
+    if (StreamNumber >= GLES_MAX_STREAMS) return D3DERR_INVALIDCALL;
+    GLES_Stream *stream = &This->gles->streams[StreamNumber];
     if (!pStreamData) {
+        memset(stream, 0, sizeof(*stream));
+        return D3D_OK;
+    }
+    // Draws bind each stream's buffer as they set up the client arrays
+    buffer_make_resident(This->gles, pStreamData->buffer, GL_ARRAY_BUFFER);
+    stream->buffer = pStreamData->buffer;
+    stream->vbo = pStreamData->buffer->vbo_id;
+    stream->stride = Stride;
+    return D3D_OK;
+}
+
+static HRESULT D3DAPI d3d8_set_indices(IDirect3DDevice8 *This, IDirect3DIndexBuffer8 *pIndexData, UINT BaseVertexIndex) {
+    if (!pIndexData) {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        This->gles->current_ibo = 0;
+        This->gles->index_buffer = NULL;
+        return D3D_OK;
+    }
+    buffer_make_resident(This->gles, pIndexData->buffer, GL_ELEMENT_ARRAY_BUFFER);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pIndexData->buffer->vbo_id);
+    This->gles->current_ibo = pIndexData->buffer->vbo_id;
+    This->gles->index_buffer = pIndexData->buffer;
+    This->gles->base_vertex = BaseVertexIndex;
+    return D3D_OK;
+}
+
+// Vertex shader declarations. Only fixed-function declarations are
+// supported: GL ES 1.1 cannot run vertex shader functions.
+static UINT vertex_type_size(DWORD type) {
+    switch (type) {
+        case D3DVSDT_FLOAT1: case D3DVSDT_D3DCOLOR: case D3DVSDT_UBYTE4: case D3DVSDT_SHORT2: return 4;
+        case D3DVSDT_FLOAT2: case D3DVSDT_SHORT4: return 8;
+        case D3DVSDT_FLOAT3: return 12;
+        case D3DVSDT_FLOAT4: return 16;
+        default: return 0;
+    }
+}
+
+// Map one declared register onto a GL client array. Registers fixed-function
+// GL ES cannot consume (blending, point size, specular, extra texture sets)
+// still take up space in the stream.
+static HRESULT compile_vertex_element(GLES_VertexPlan *plan, UINT stream, DWORD reg, DWORD type, UINT offset,
+                                      UINT *arrays) {
+    GLES_ArrayKind array;
+    GLenum gl_type = GL_FLOAT;
+    UINT size = 0;
+    UINT set = 0;
+    BOOL is_short = type == D3DVSDT_SHORT2 || type == D3DVSDT_SHORT4;
+    if (type >= D3DVSDT_FLOAT1 && type <= D3DVSDT_FLOAT4) size = (UINT)type + 1;
+    if (is_short) {
+        gl_type = GL_SHORT;
+        size = type == D3DVSDT_SHORT2 ? 2 : 4;
+    }
+
+    if (reg == D3DVSDE_POSITION) {
+        array = GLES_ARRAY_VERTEX;
+        if (size < 2) return D3DERR_INVALIDCALL;
+    } else if (reg == D3DVSDE_NORMAL) {
+        array = GLES_ARRAY_NORMAL;
+        if (type != D3DVSDT_FLOAT3) return D3DERR_INVALIDCALL;
+    } else if (reg == D3DVSDE_DIFFUSE) {
+        array = GLES_ARRAY_COLOR;
+        if (type == D3DVSDT_D3DCOLOR) {
+            gl_type = GL_UNSIGNED_BYTE;
+            size = 4;
+        } else if (type != D3DVSDT_FLOAT4) {
+            return D3DERR_INVALIDCALL;
+        }
+    } else if (reg >= D3DVSDE_TEXCOORD0 && reg < D3DVSDE_TEXCOORD0 + GLES_MAX_TEXTURE_STAGES) {
+        set = reg - D3DVSDE_TEXCOORD0;
+        array = GLES_ARRAY_TEXCOORD0 + set;
+        // GL ES texture coordinates have at least two components
+        if (size < 2) return D3DERR_INVALIDCALL;
+    } else {
+        return D3D_OK;
+    }
+
+    if (*arrays & (1u << array)) return D3DERR_INVALIDCALL;
+    *arrays |= 1u << array;
+    plan_add_element(plan, array, stream, size, gl_type, offset, set);
+    return D3D_OK;
+}
+
+// Compile a D3DVSD token stream into a vertex plan
+static HRESULT compile_declaration(const DWORD *decl, GLES_VertexPlan *plan) {
+    UINT stream = 0;
+    BOOL have_stream = FALSE;
+    UINT arrays = 0;
+    memset(plan, 0, sizeof(*plan));
+    plan->valid = TRUE;
+
+    for (DWORD token = *decl++; token != D3DVSD_END(); token = *decl++) {
+        switch ((token & D3DVSD_TOKENTYPEMASK) >> D3DVSD_TOKENTYPESHIFT) {
+            case D3DVSD_TOKEN_NOP:
+                break;
+            case D3DVSD_TOKEN_STREAM:
+                stream = token & D3DVSD_STREAMNUMBERMASK;
+                // Tessellator streams need N-patch support
+                if ((token & D3DVSD_STREAMTESSMASK) || stream >= GLES_MAX_STREAMS) return D3DERR_INVALIDCALL;
+                have_stream = TRUE;
+                break;
+            case D3DVSD_TOKEN_STREAMDATA: {
+                if (!have_stream) return D3DERR_INVALIDCALL;
+                if (token & D3DVSD_DATALOADTYPEMASK) {
+                    plan->strides[stream] += ((token & D3DVSD_SKIPCOUNTMASK) >> D3DVSD_SKIPCOUNTSHIFT) * 4;
+                    break;
+                }
+                DWORD type = (token & D3DVSD_DATATYPEMASK) >> D3DVSD_DATATYPESHIFT;
+                UINT size = vertex_type_size(type);
+                if (!size || plan->element_count == GLES_MAX_VERTEX_ELEMENTS) return D3DERR_INVALIDCALL;
+                HRESULT hr = compile_vertex_element(plan, stream, token & D3DVSD_VERTEXREGMASK, type,
+                                                    plan->strides[stream], &arrays);
+                if (FAILED(hr)) return hr;
+                plan->strides[stream] += size;
+                break;
+            }
+            case D3DVSD_TOKEN_CONSTMEM:
+                // Constants only matter to shader functions; skip their values
+                decl += ((token & D3DVSD_CONSTCOUNTMASK) >> D3DVSD_CONSTCOUNTSHIFT) * 4;
+                break;
+            case D3DVSD_TOKEN_EXT:
+                decl += (token & D3DVSD_EXTCOUNTMASK) >> D3DVSD_EXTCOUNTSHIFT;
+                break;
+            default:
+                return D3DERR_INVALIDCALL;
+        }
+    }
+    return D3D_OK;
+}
+
+static HRESULT D3DAPI d3d8_create_vertex_shader(IDirect3DDevice8 *This, CONST DWORD *pDeclaration, CONST DWORD *pFunction, DWORD *pHandle, DWORD Usage) {
+    (void)Usage;
+    if (!pDeclaration || !pHandle || pFunction) return D3DERR_INVALIDCALL;
+    GLES_Device *gles = This->gles;
+    GLES_VertexPlan plan;
+    HRESULT hr = compile_declaration(pDeclaration, &plan);
+    if (FAILED(hr)) return hr;
+
+    UINT index = 0;
+    while (index < gles->vertex_shader_count && gles->vertex_shaders[index].valid) index++;
+    if (index == gles->vertex_shader_count) {
+        GLES_VertexPlan *shaders = realloc(gles->vertex_shaders, (index + 1) * sizeof(GLES_VertexPlan));
+        if (!shaders) return E_OUTOFMEMORY;
+        gles->vertex_shaders = shaders;
+        gles->vertex_shader_count++;
+    }
+    gles->vertex_shaders[index] = plan;
+    *pHandle = GLES_VERTEX_SHADER_HANDLE_BASE + index + 1;
+    return D3D_OK;
+}
+
+static GLES_VertexPlan *vertex_shader_from_handle(GLES_Device *gles, DWORD Handle) {
+    if (Handle <= GLES_VERTEX_SHADER_HANDLE_BASE) return NULL;
+    DWORD index = Handle - GLES_VERTEX_SHADER_HANDLE_BASE - 1;
+    if (index >= gles->vertex_shader_count || !gles->vertex_shaders[index].valid) return NULL;
+    return &gles->vertex_shaders[index];
+}
+
+static HRESULT D3DAPI d3d8_set_vertex_shader(IDirect3DDevice8 *This, DWORD Handle) {
+    GLES_Device *gles = This->gles;
+    if (Handle <= GLES_VERTEX_SHADER_HANDLE_BASE) {
+        gles->vertex_shader = 0;
+        gles->fvf = Handle;
+        return D3D_OK;
+    }
+    if (!vertex_shader_from_handle(gles, Handle)) return D3DERR_INVALIDCALL;
+    gles->vertex_shader = Handle;
+    return D3D_OK;
+}
+
+static HRESULT D3DAPI d3d8_get_vertex_shader(IDirect3DDevice8 *This, DWORD *pHandle) {
+    if (!pHandle) return D3DERR_INVALIDCALL;
+    *pHandle = This->gles->vertex_shader ? This->gles->vertex_shader : This->gles->fvf;
+    return D3D_OK;
+}
+
+static HRESULT D3DAPI d3d8_delete_vertex_shader(IDirect3DDevice8 *This, DWORD Handle) {
+    GLES_Device *gles = This->gles;
+    GLES_VertexPlan *plan = vertex_shader_from_handle(gles, Handle);
+    if (!plan) return D3DERR_INVALIDCALL;
+    // Recorded draws look the declaration up again when they replay
+    scene_flush(gles);
+    plan->valid = FALSE;
+    if (gles->vertex_shader == Handle) gles->vertex_shader = 0;
+    return D3D_OK;
+}
+
+static HRESULT D3DAPI d3d8_vb_get_device(IDirect3DVertexBuffer8 *This, IDirect3DDevice8 **ppDevice) {
+    *ppDevice = This->device;
+    return D3D_OK;
+}
+
+static HRESULT D3DAPI d3d8_vb_set_private_data(IDirect3DVertexBuffer8 *This, REFGUID refguid, CONST void *pData, DWORD SizeOfData, DWORD Flags) { return D3DERR_NOTAVAILABLE; }
+static HRESULT D3DAPI d3d8_vb_get_private_data(IDirect3DVertexBuffer8 *This, REFGUID refguid, void *pData, DWORD *pSizeOfData) { return D3DERR_NOTAVAILABLE; }
+static HRESULT D3DAPI d3d8_vb_free_private_data(IDirect3DVertexBuffer8 *This, REFGUID refguid) { return D3DERR_NOTAVAILABLE; }
+static DWORD D3DAPI d3d8_vb_set_priority(IDirect3DVertexBuffer8 *This, DWORD PriorityNew) {
+    return resource_set_priority(&This->buffer->resource, PriorityNew);
+}
+static DWORD D3DAPI d3d8_vb_get_priority(IDirect3DVertexBuffer8 *This) { return This->buffer->resource.priority; }
+static void D3DAPI d3d8_vb_pre_load(IDirect3DVertexBuffer8 *This) { buffer_make_resident(This->device->gles, This->buffer, GL_ARRAY_BUFFER); }
+static D3DRESOURCETYPE D3DAPI d3d8_vb_get_type(IDirect3DVertexBuffer8 *This) { return D3DRTYPE_VERTEXBUFFER; }
+
+// Recorded draws and the pending batch read `buffer` when they are
+// submitted, so a lock submits them first if they use it. NOOVERWRITE
+// promises to leave what they read alone; DISCARD orphans the GL storage
+// whatever else it asks for.
+static void buffer_flush_readers(GLES_Device *gles, GLES_Buffer *buffer, DWORD flags) {
+    if ((flags & (D3DLOCK_NOOVERWRITE | D3DLOCK_DISCARD)) == D3DLOCK_NOOVERWRITE) return;
+    if (gles->scene.draw_count && buffer->scene_generation == gles->scene.generation) {
+        scene_flush(gles);
+        return;
+    }
+    for (UINT i = 0; i < gles->batch.count; i++) {
+        if (gles->batch.records[i].vb == buffer || gles->batch.records[i].ib == buffer) {
+            batch_flush(gles);
+            return;
+        }
+    }
+}
+
+static HRESULT D3DAPI d3d8_vb_lock(IDirect3DVertexBuffer8 *This, UINT OffsetToLock, UINT SizeToLock, BYTE **ppbData, DWORD Flags) {
+    GLES_Buffer *buffer = This->buffer;
+    if (!ppbData || OffsetToLock > buffer->length) return D3DERR_INVALIDCALL;
+    if (SizeToLock == 0) SizeToLock = buffer->length - OffsetToLock;
+    if (SizeToLock > buffer->length - OffsetToLock) return D3DERR_INVALIDCALL;
+
+    buffer_flush_readers(This->device->gles, buffer, Flags);
+
+    buffer->lock_offset = OffsetToLock;
+    buffer->lock_size = SizeToLock;
+    buffer->locked = TRUE;
+
+    // Evicted buffers only have their shadow copy until bound again
+    if (buffer->resource.evicted) {
+        *ppbData = buffer->shadow + OffsetToLock;
+        return D3D_OK;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo_id);
+    if (Flags & D3DLOCK_DISCARD) glBufferData(GL_ARRAY_BUFFER, buffer->length, NULL, buffer_gl_usage(buffer));
+    *ppbData = buffer->shadow + OffsetToLock;
+    return D3D_OK;
+}
+
+static HRESULT D3DAPI d3d8_vb_unlock(IDirect3DVertexBuffer8 *This) {
+    GLES_Buffer *buffer = This->buffer;
+    if (!buffer->locked) return D3DERR_INVALIDCALL;
+
+    if (!buffer->resource.evicted) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo_id);
+        glBufferSubData(GL_ARRAY_BUFFER, buffer->lock_offset, buffer->lock_size, buffer->shadow + buffer->lock_offset);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
-        This->gles->current_vbo = 0;
+    }
+
+    buffer->locked = FALSE;
+    buffer->version++;
+    return D3D_OK;
+}
+
+static HRESULT D3DAPI d3d8_vb_get_desc(IDirect3DVertexBuffer8 *This, D3DVERTEXBUFFER_DESC *pDesc) {
+    pDesc->Format = D3DFMT_VERTEXDATA;
+    pDesc->Type = D3DRTYPE_VERTEXBUFFER;
+    pDesc->Usage = This->buffer->usage;
+    pDesc->Pool = This->buffer->pool;
+    pDesc->Size = This->buffer->length;
+    pDesc->FVF = This->buffer->fvf;
+    return D3D_OK;
+}
+
+static HRESULT D3DAPI d3d8_ib_get_device(IDirect3DIndexBuffer8 *This, IDirect3DDevice8 **ppDevice) {
+    *ppDevice = This->device;
+    return D3D_OK;
+}
+
+static HRESULT D3DAPI d3d8_ib_set_private_data(IDirect3DIndexBuffer8 *This, REFGUID refguid, CONST void *pData, DWORD SizeOfData, DWORD Flags) { return D3DERR_NOTAVAILABLE; }
+static HRESULT D3DAPI d3d8_ib_get_private_data(IDirect3DIndexBuffer8 *This, REFGUID refguid, void *pData, DWORD *pSizeOfData) { return D3DERR_NOTAVAILABLE; }
+static HRESULT D3DAPI d3d8_ib_free_private_data(IDirect3DIndexBuffer8 *This, REFGUID refguid) { return D3DERR_NOTAVAILABLE; }
+static DWORD D3DAPI d3d8_ib_set_priority(IDirect3DIndexBuffer8 *This, DWORD PriorityNew) {
+    return resource_set_priority(&This->buffer->resource, PriorityNew);
+}
+static DWORD D3DAPI d3d8_ib_get_priority(IDirect3DIndexBuffer8 *This) { return This->buffer->resource.priority; }
+static void D3DAPI d3d8_ib_pre_load(IDirect3DIndexBuffer8 *This) { buffer_make_resident(This->device->gles, This->buffer, GL_ELEMENT_ARRAY_BUFFER); }
+static D3DRESOURCETYPE D3DAPI d3d8_ib_get_type(IDirect3DIndexBuffer8 *This) { return D3DRTYPE_INDEXBUFFER; }
+
+static HRESULT D3DAPI d3d8_ib_lock(IDirect3DIndexBuffer8 *This, UINT OffsetToLock, UINT SizeToLock, BYTE **ppbData, DWORD Flags) {
+    GLES_Buffer *buffer = This->buffer;
+    if (!ppbData || OffsetToLock > buffer->length) return D3DERR_INVALIDCALL;
+    if (SizeToLock == 0) SizeToLock = buffer->length - OffsetToLock;
+    if (SizeToLock > buffer->length - OffsetToLock) return D3DERR_INVALIDCALL;
+
+    buffer_flush_readers(This->device->gles, buffer, Flags);
+
+    buffer->lock_offset = OffsetToLock;
+    buffer->lock_size = SizeToLock;
+    buffer->locked = TRUE;
+
+    // Evicted buffers only have their shadow copy until bound again
+    if (buffer->resource.evicted) {
+        *ppbData = buffer->shadow + OffsetToLock;
         return D3D_OK;
     }
-    glBindBuffer(GL_ARRAY_BUFFER, pStreamData->buffer->vbo_id);
-    This->gles->current_vbo = pStreamData->buffer->vbo_id;
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer->vbo_id);
+    if (Flags & D3DLOCK_DISCARD) glBufferData(GL_ELEMENT_ARRAY_BUFFER, buffer->length, NULL, buffer_gl_usage(buffer));
+    *ppbData = buffer->shadow + OffsetToLock;
+    return D3D_OK;
+}
+
+static HRESULT D3DAPI d3d8_ib_unlock(IDirect3DIndexBuffer8 *This) {
+    GLES_Buffer *buffer = This->buffer;
+    if (!buffer->locked) return D3DERR_INVALIDCALL;
+
+    if (!buffer->resource.evicted) {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer->vbo_id);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, buffer->lock_offset, buffer->lock_size, buffer->shadow + buffer->lock_offset);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+
+    buffer->locked = FALSE;
+    buffer->version++;
+    return D3D_OK;
+}
+
+static HRESULT D3DAPI d3d8_ib_get_desc(IDirect3DIndexBuffer8 *This, D3DINDEXBUFFER_DESC *pDesc) {
+    pDesc->Format = This->buffer->format;
+    pDesc->Type = D3DRTYPE_INDEXBUFFER;
+    pDesc->Usage = This->buffer->usage;
+    pDesc->Pool = This->buffer->pool;
+    pDesc->Size = This->buffer->length;
+    return D3D_OK;
+}
+
+static UINT floor_pow2(UINT v) {
+    UINT p = 1;
+    while (p <= v / 2) p <<= 1;
+    return p;
+}
+
+// Picks how a texture GL cannot take at its own size is stored, and sets
+// its GL size to match
+static GLES_NpotStorage texture_choose_npot(const GLES_Device *gles, GLES_Texture *texture) {
+    UINT w = texture->width, h = texture->height;
+    if (gles->npot_mode == D3DGLES_NPOT_NATIVE || (!(w & (w - 1)) && !(h & (h - 1)))) return GLES_NPOT_NONE;
+    UINT pad_w = w & (w - 1) ? floor_pow2(w) * 2 : w, pad_h = h & (h - 1) ? floor_pow2(h) * 2 : h;
+    // Padded levels below the first would need their own coordinate scale
+    BOOL pad = texture->levels == 1 && gles->npot_mode != D3DGLES_NPOT_RESCALE;
+    // Automatic padding stops at twice the texels, except for dynamic
+    // textures, whose uploads it keeps cheap
+    if (pad && gles->npot_mode == D3DGLES_NPOT_AUTO && !(texture->usage & D3DUSAGE_DYNAMIC))
+        pad = (uint64_t)pad_w * pad_h <= 2 * (uint64_t)w * h;
+    if (pad) {
+        texture->gl_width = pad_w;
+        texture->gl_height = pad_h;
+        return GLES_NPOT_PAD;
+    }
+    // Single levels go to the nearer power of two; chains round down, which
+    // keeps as many levels
+    UINT down_w = floor_pow2(w), down_h = floor_pow2(h);
+    BOOL nearest = texture->levels == 1;
+    texture->gl_width = nearest && w - down_w >= pad_w - w ? pad_w : down_w;
+    texture->gl_height = nearest && h - down_h >= pad_h - h ? pad_h : down_h;
+    return GLES_NPOT_RESCALE;
+}
+
+static HRESULT D3DAPI d3d8_create_texture(IDirect3DDevice8 *This, UINT Width, UINT Height, UINT Levels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, IDirect3DTexture8 **ppTexture) {
+    DWORD caps = (This->gles->texture_bgra ? TEXCONV_BGRA : 0) | (This->gles->texture_dxt ? This->gles->dxt_supported : 0) |
+                 This->gles->etc1_supported;
+    const GLES_TextureFormat *format = texconv_find_format(Format, caps);
+    if (!format || !ppTexture || !Width || !Height || Levels > 32) return D3DERR_INVALIDCALL;
+    GLES_Texture *tex = calloc(1, sizeof(GLES_Texture));
+    if (!tex) return D3DERR_OUTOFVIDEOMEMORY;
+
+    tex->width = tex->gl_width = Width;
+    tex->height = tex->gl_height = Height;
+    // Zero asks for the full chain down to 1x1
+    tex->levels = Levels;
+    if (!Levels) {
+        for (UINT size = Width > Height ? Width : Height; size; size >>= 1) tex->levels++;
+    }
+    tex->format = Format;
+    tex->pool = Pool;
+    tex->usage = Usage;
+    tex->resource.managed = Pool == D3DPOOL_MANAGED;
+    tex->gl_format = format;
+    // Paletted storage is not padded or rescaled, and atlased textures need
+    // neither
+    BOOL paletted = format->gl_format == GL_PALETTE8_RGBA8_OES;
+    if (!paletted && !texture_place_atlas(This->gles, tex)) tex->npot = texture_choose_npot(This->gles, tex);
+    // Compressed blocks cannot be padded or rescaled, so they are decoded
+    if (tex->npot && format->block_size && !format->decode) format = texconv_find_format(Format, caps & TEXCONV_BGRA);
+    tex->gl_format = format;
+    // GL cannot generate mipmaps for compressed or paletted storage
+    tex->autogen_mipmap = This->gles->autogen_mipmap && tex->levels > 1 && !texture_compressed(tex) && !paletted;
+    tex->locks = calloc(tex->levels, sizeof(GLES_TextureLock));
+    if (paletted) tex->palette_image = calloc(1, texture_palette_offset(tex, tex->levels));
+    if (tex->npot == GLES_NPOT_RESCALE) tex->npot_source = calloc(1, texture_source_offset(tex, tex->levels));
+    if (!tex->locks || (paletted && !tex->palette_image) || (tex->npot == GLES_NPOT_RESCALE && !tex->npot_source)) {
+        if (tex->atlas) texture_leave_atlas(This->gles, tex);
+        free(tex->locks);
+        free(tex->npot_source);
+        free(tex);
+        return D3DERR_OUTOFVIDEOMEMORY;
+    }
+
+    // Filters and wrapping are sent when the texture is first bound
+    if (!tex->atlas) glGenTextures(1, &tex->tex_id);
+    tex->sampler = gl_default_sampler;
+    if (tex->autogen_mipmap) {
+        glBindTexture(GL_TEXTURE_2D, tex->tex_id);
+        glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
+        restore_texture_binding(This->gles);
+    }
+    tex->palette_slots[0].tex_id = paletted ? tex->tex_id : 0;
+    tex->palette_slots[0].sampler = tex->sampler;
+    for (UINT level = 0; level < tex->levels; level++) {
+        if (!(tex->allocated_levels & 1u << level))
+            This->gles->stats.TextureDeferredBytes += texture_level_bytes(tex, level);
+    }
+    tex->resource.is_texture = TRUE;
+    resource_link(This->gles, &tex->resource);
+
+    IDirect3DTexture8 *texture = calloc(1, sizeof(IDirect3DTexture8) + sizeof(IDirect3DTexture8Vtbl));
+    if (!texture) {
+        resource_unlink(This->gles, &tex->resource);
+        if (tex->atlas)
+            texture_leave_atlas(This->gles, tex);
+        else
+            glDeleteTextures(1, &tex->tex_id);
+        free(tex->locks);
+        free(tex->palette_image);
+        free(tex->npot_source);
+        free(tex);
+        return D3DERR_OUTOFVIDEOMEMORY;
+    }
+
+    static const IDirect3DTexture8Vtbl tex_vtbl = {
+        .QueryInterface = tex_query_interface,
+        .AddRef = tex_add_ref,
+        .Release = tex_release,
+        .LockRect = tex_lock_rect,
+        .UnlockRect = tex_unlock_rect,
+        .GetLevelDesc = tex_get_level_desc,
+        .GetSurfaceLevel = tex_get_surface_level,
+        .SetPriority = tex_set_priority,
+        .GetPriority = tex_get_priority,
+        .PreLoad = tex_pre_load
+    };
+    texture->lpVtbl = &tex_vtbl;
+    texture->texture = tex;
+    texture->device = This;
+
+    *ppTexture = texture;
+    return D3D_OK;
+}
+
+// Rebuilds levels 1..n-1 from level 0, each level filtered from the one above
+HRESULT WINAPI D3DXFilterTexture(LPDIRECT3DTEXTURE8 pTexture, CONST PALETTEENTRY *pPalette, UINT SrcLevel, DWORD Filter) {
+    (void)pPalette;
+    if (!pTexture) return D3DERR_INVALIDCALL;
+    GLES_Texture *texture = pTexture->texture;
+    GLES_Device *gles = pTexture->device->gles;
+    texture_finish_load(gles, texture, TRUE);
+    if (SrcLevel == (UINT)D3DX_DEFAULT) SrcLevel = 0;
+    // Only level 0 is kept on the CPU
+    if (SrcLevel != 0) return D3DERR_INVALIDCALL;
+    // GL regenerated the chain when level 0 was uploaded; nothing written yet means nothing to filter
+    if (texture->gl_format->block_size || texture->palette_image) return D3DERR_INVALIDCALL;
+    if (texture->autogen_mipmap || !texture->mip_source) return D3D_OK;
+
+    const GLES_TextureFormat *format = texture->gl_format;
+    UINT texel = format->texel_size;
+    const BYTE *src = texture->mip_source;
+    UINT src_w = texture->width, src_h = texture->height;
+    BYTE *filtered = NULL;
+    HRESULT hr = D3D_OK;
+    for (UINT level = 1; level < texture->levels && hr == D3D_OK; level++) {
+        UINT w, h;
+        texture_level_size(texture, level, &w, &h);
+        size_t size = (size_t)w * h * texel;
+        BYTE *dst = staging_acquire(&gles->staging, size);
+        BYTE *upload = format->convert ? staging_acquire(&gles->staging, size) : dst;
+        if (!dst || !upload) {
+            hr = D3DERR_OUTOFVIDEOMEMORY;
+        } else {
+            hr = texfilter_downsample(texture->format, texel, src, src_w, src_h, dst, w, h, Filter,
+                                      device_workers(gles));
+        }
+        if (hr == D3D_OK) {
+            // The next level filters from D3D-layout texels, so convert a copy
+            if (format->convert) format->convert(upload, dst, (size_t)w * h);
+            RECT rect = {0, 0, (LONG)w, (LONG)h};
+            texture_upload(gles, texture, level, &rect, w * texel, upload);
+            gles->stats.MipLevelsFiltered++;
+        }
+        if (upload != dst) staging_release(&gles->staging, upload);
+        staging_release(&gles->staging, filtered);
+        filtered = dst;
+        src = dst;
+        src_w = w;
+        src_h = h;
+    }
+    staging_release(&gles->staging, filtered);
+    return hr;
+}
+
+typedef struct {
+    LPD3DXFILL2D fn;
+    LPVOID data;
+    D3DFORMAT format;
+    UINT texel;
+    UINT width, height;
+    BYTE *bits;
+    int pitch;
+} GLES_FillJob;
+
+static uint32_t fill_channel(float v) {
+    if (!(v > 0.0f)) return 0;
+    return v >= 1.0f ? 255 : (uint32_t)(v * 255.0f + 0.5f);
+}
+
+// Rows [begin, end) of a level, evaluated a span at a time and packed
+// straight into the locked rows
+static void fill_rows(void *ctx, size_t begin, size_t end) {
+    enum { SPAN = 64 };
+    const GLES_FillJob *job = ctx;
+    D3DXVECTOR2 size = {1.0f / (float)job->width, 1.0f / (float)job->height};
+    uint32_t argb[SPAN];
+    for (size_t y = begin; y < end; y++) {
+        BYTE *row = job->bits + y * job->pitch;
+        D3DXVECTOR2 coord = {0.0f, ((float)y + 0.5f) * size.y};
+        for (UINT x = 0; x < job->width; x += SPAN) {
+            UINT count = job->width - x < SPAN ? job->width - x : SPAN;
+            for (UINT i = 0; i < count; i++) {
+                D3DXVECTOR4 out = {0.0f, 0.0f, 0.0f, 0.0f};
+                coord.x = ((float)(x + i) + 0.5f) * size.x;
+                job->fn(&out, &coord, &size, job->data);
+                argb[i] = fill_channel(out.w) << 24 | fill_channel(out.x) << 16 | fill_channel(out.y) << 8 |
+                          fill_channel(out.z);
+            }
+            image_store_argb(job->format, argb, count, row + (size_t)x * job->texel);
+        }
+    }
+}
+
+// Evaluates pFunction at every texel of every level. Levels are locked whole
+// and split into row bands across the device's worker threads.
+HRESULT WINAPI D3DXFillTexture(LPDIRECT3DTEXTURE8 pTexture, LPD3DXFILL2D pFunction, LPVOID pData) {
+    if (!pTexture || !pFunction) return D3DERR_INVALIDCALL;
+    GLES_Texture *texture = pTexture->texture;
+    GLES_Device *gles = pTexture->device->gles;
+    texture_finish_load(gles, texture, TRUE);
+    if (!image_can_store(texture->format)) return D3DERR_INVALIDCALL;
+    for (UINT level = 0; level < texture->levels; level++) {
+        GLES_FillJob job = {pFunction, pData, texture->format, texture_texel_size(texture), 0, 0, NULL, 0};
+        texture_level_size(texture, level, &job.width, &job.height);
+        D3DLOCKED_RECT rect;
+        HRESULT hr = pTexture->lpVtbl->LockRect(pTexture, level, &rect, NULL, 0);
+        if (hr != D3D_OK) return hr;
+        job.bits = rect.pBits;
+        job.pitch = rect.Pitch;
+        // Roughly 16K texels per chunk keeps small levels on the calling thread
+        size_t grain = 16384 / job.width + 1;
+        workers_run(job.height > grain ? device_workers(gles) : NULL, job.height, grain, fill_rows, &job);
+        hr = pTexture->lpVtbl->UnlockRect(pTexture, level);
+        if (hr != D3D_OK) return hr;
+    }
     return D3D_OK;
 }
 
-static HRESULT D3DAPI d3d8_set_indices(IDirect3DDevice8 *This, IDirect3DIndexBuffer8 *pIndexData, UINT BaseVertexIndex) {
-    if (!pIndexData) {
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-        This->gles->current_ibo = 0;
-        return D3D_OK;
+// GL ES cannot read textures back, so a level is read from the copy kept on
+// the CPU: a paletted texture's indices, a rescaled texture's source or a
+// managed texture's backing (turned back into D3D texels), or level 0's mip
+// source
+static HRESULT texture_read_rect(GLES_Device *gles, GLES_Texture *texture, UINT level, const RECT *rect, BYTE *dst,
+                                 size_t pitch) {
+    texture_finish_load(gles, texture, TRUE);
+    const GLES_TextureFormat *format = texture->gl_format;
+    if (format->block_size || texture->locks[level].bits) return D3DERR_INVALIDCALL;
+    UINT w, h;
+    texture_level_size(texture, level, &w, &h);
+    const BYTE *src;
+    GLES_TexelConvert revert = NULL;
+    if (texture->palette_image) {
+        src = texture->palette_image + texture_palette_offset(texture, level);
+    } else if (texture->npot_source) {
+        src = texture->npot_source + texture_source_offset(texture, level);
+        revert = format->revert;
+    } else if (texture->backing) {
+        // Padded rows are as long as the GL level
+        texture_storage_size(texture, level, &w, &h);
+        src = texture->backing + texture_level_offset(texture, level);
+        revert = format->revert;
+    } else if (level == 0 && texture->mip_source) {
+        src = texture->mip_source;
+    } else {
+        return D3DERR_INVALIDCALL;
+    }
+    UINT texel = texture_texel_size(texture);
+    UINT count = (UINT)(rect->right - rect->left);
+    for (LONG y = rect->top; y < rect->bottom; y++) {
+        BYTE *out = dst + (size_t)(y - rect->top) * pitch;
+        const BYTE *in = src + ((size_t)y * w + (size_t)rect->left) * texel;
+        if (revert)
+            revert(out, in, count);
+        else
+            memcpy(out, in, (size_t)count * texel);
     }
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pIndexData->buffer->vbo_id);
-    This->gles->current_ibo = pIndexData->buffer->vbo_id;
     return D3D_OK;
 }
 
-static HRESULT D3DAPI d3d8_vb_get_device(IDirect3DVertexBuffer8 *This, IDirect3DDevice8 **ppDevice) {
-    *ppDevice = This->device;
+// `rect` checked against the surface, or the whole surface when NULL
+static HRESULT surface_rect(IDirect3DSurface8 *surface, const RECT *rect, RECT *out) {
+    UINT w, h;
+    texture_level_size(surface->container->texture, surface->level, &w, &h);
+    *out = (RECT){0, 0, (LONG)w, (LONG)h};
+    if (!rect) return D3D_OK;
+    if (rect->left < 0 || rect->top < 0 || rect->left >= rect->right || rect->top >= rect->bottom ||
+        rect->right > (LONG)w || rect->bottom > (LONG)h)
+        return D3DERR_INVALIDCALL;
+    *out = *rect;
     return D3D_OK;
 }
 
-static HRESULT D3DAPI d3d8_vb_set_private_data(IDirect3DVertexBuffer8 *This, REFGUID refguid, CONST void *pData, DWORD SizeOfData, DWORD Flags) { return D3DERR_NOTAVAILABLE; }
-static HRESULT D3DAPI d3d8_vb_get_private_data(IDirect3DVertexBuffer8 *This, REFGUID refguid, void *pData, DWORD *pSizeOfData) { return D3DERR_NOTAVAILABLE; }
-static HRESULT D3DAPI d3d8_vb_free_private_data(IDirect3DVertexBuffer8 *This, REFGUID refguid) { return D3DERR_NOTAVAILABLE; }
-static DWORD D3DAPI d3d8_vb_set_priority(IDirect3DVertexBuffer8 *This, DWORD PriorityNew) { return 0; }
-static DWORD D3DAPI d3d8_vb_get_priority(IDirect3DVertexBuffer8 *This) { return 0; }
-static void D3DAPI d3d8_vb_pre_load(IDirect3DVertexBuffer8 *This) {}
-static D3DRESOURCETYPE D3DAPI d3d8_vb_get_type(IDirect3DVertexBuffer8 *This) { return D3DRTYPE_VERTEXBUFFER; }
-
-static HRESULT D3DAPI d3d8_vb_lock(IDirect3DVertexBuffer8 *This, UINT OffsetToLock, UINT SizeToLock, BYTE **ppbData, DWORD Flags) {
-    GLES_Buffer *buffer = This->buffer;
-    if (SizeToLock == 0) SizeToLock = buffer->length - OffsetToLock;
+// Locks the destination rectangle and lets image_convert scale and convert
+// `src` straight into it
+static HRESULT surface_load(IDirect3DSurface8 *dest, const RECT *dest_rect, const GLES_PixelRect *src,
+                            const PALETTEENTRY *palette, DWORD filter, D3DCOLOR color_key) {
+    GLES_Texture *texture = dest->container->texture;
+    RECT rect;
+    HRESULT hr = surface_rect(dest, dest_rect, &rect);
+    if (hr != D3D_OK) return hr;
+    if (!image_can_store(texture->format) || !image_can_fetch(src->format) || (src->format == D3DFMT_P8 && !palette))
+        return D3DERR_INVALIDCALL;
+    D3DLOCKED_RECT locked;
+    hr = dest->lpVtbl->LockRect(dest, &locked, &rect, 0);
+    if (hr != D3D_OK) return hr;
+    GLES_PixelRect dst = {texture->format, locked.pBits, (size_t)locked.Pitch, (UINT)(rect.right - rect.left),
+                          (UINT)(rect.bottom - rect.top)};
+    hr = image_convert(src, palette, &dst, filter, color_key, device_workers(dest->container->device->gles));
+    HRESULT unlocked = dest->lpVtbl->UnlockRect(dest);
+    return hr != D3D_OK ? hr : unlocked;
+}
 
-    buffer->lock_offset = OffsetToLock;
-    buffer->lock_size = SizeToLock;
+HRESULT WINAPI D3DXLoadSurfaceFromMemory(LPDIRECT3DSURFACE8 pDestSurface, CONST PALETTEENTRY *pDestPalette,
+                                         CONST RECT *pDestRect, LPCVOID pSrcMemory, D3DFORMAT SrcFormat,
+                                         UINT SrcPitch, CONST PALETTEENTRY *pSrcPalette, CONST RECT *pSrcRect,
+                                         DWORD Filter, D3DCOLOR ColorKey) {
+    (void)pDestPalette;
+    if (!pDestSurface || !pSrcMemory || !pSrcRect || pSrcRect->left < 0 || pSrcRect->top < 0 ||
+        pSrcRect->left >= pSrcRect->right || pSrcRect->top >= pSrcRect->bottom)
+        return D3DERR_INVALIDCALL;
+    UINT texel = image_texel_size(SrcFormat);
+    if (!texel || (UINT)(pSrcRect->right - pSrcRect->left) * texel > SrcPitch) return D3DERR_INVALIDCALL;
+    GLES_PixelRect src = {SrcFormat,
+                          (BYTE *)pSrcMemory + (size_t)pSrcRect->top * SrcPitch + (size_t)pSrcRect->left * texel,
+                          SrcPitch, (UINT)(pSrcRect->right - pSrcRect->left), (UINT)(pSrcRect->bottom - pSrcRect->top)};
+    return surface_load(pDestSurface, pDestRect, &src, pSrcPalette, Filter, ColorKey);
+}
 
-    buffer->temp_buffer = malloc(buffer->length);
-    if (!buffer->temp_buffer) return D3DERR_OUTOFVIDEOMEMORY;
+HRESULT WINAPI D3DXLoadSurfaceFromSurface(LPDIRECT3DSURFACE8 pDestSurface, CONST PALETTEENTRY *pDestPalette,
+                                          CONST RECT *pDestRect, LPDIRECT3DSURFACE8 pSrcSurface,
+                                          CONST PALETTEENTRY *pSrcPalette, CONST RECT *pSrcRect, DWORD Filter,
+                                          D3DCOLOR ColorKey) {
+    (void)pDestPalette;
+    if (!pDestSurface || !pSrcSurface) return D3DERR_INVALIDCALL;
+    GLES_Texture *texture = pSrcSurface->container->texture;
+    GLES_Device *gles = pSrcSurface->container->device->gles;
+    RECT rect;
+    HRESULT hr = surface_rect(pSrcSurface, pSrcRect, &rect);
+    if (hr != D3D_OK) return hr;
+    UINT texel = image_texel_size(texture->format);
+    if (!texel) return D3DERR_INVALIDCALL;
+    // Paletted sources default to the device's current palette
+    if (texture->format == D3DFMT_P8 && !pSrcPalette && gles->state.texture_palette < gles->palette_count)
+        pSrcPalette = gles->palettes[gles->state.texture_palette].entries;
+    GLES_PixelRect src = {texture->format, NULL, (size_t)(rect.right - rect.left) * texel,
+                          (UINT)(rect.right - rect.left), (UINT)(rect.bottom - rect.top)};
+    src.bits = staging_acquire(&gles->staging, src.pitch * src.height);
+    if (!src.bits) return D3DERR_OUTOFVIDEOMEMORY;
+    hr = texture_read_rect(gles, texture, pSrcSurface->level, &rect, src.bits, src.pitch);
+    if (hr == D3D_OK) hr = surface_load(pDestSurface, pDestRect, &src, pSrcPalette, Filter, ColorKey);
+    staging_release(&gles->staging, src.bits);
+    return hr;
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo_id);
-    if (Flags & D3DLOCK_DISCARD) {
-        GLenum usage = (buffer->usage & D3DUSAGE_DYNAMIC) ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW;
-        glBufferData(GL_ARRAY_BUFFER, buffer->length, NULL, usage);
+// ETC1 has no alpha, so cooked textures that need it carry an 8-bit plane
+// that is uploaded as a GL_ALPHA texture of its own. The plane is padded or
+// rescaled along with NPOT textures.
+static void texture_upload_alpha_plane(GLES_Device *gles, GLES_Texture *texture, UINT level, const BYTE *alpha) {
+    static const GLES_TextureFormat alpha_format = {
+        .d3d_format = D3DFMT_A8, .gl_format = GL_ALPHA, .gl_type = GL_UNSIGNED_BYTE, .texel_size = 1};
+    // The plane is sampled with the texture's own coordinates
+    if (texture->atlas) texture_unatlas(gles, texture, TRUE);
+    UINT w, h;
+    texture_storage_size(texture, level, &w, &h);
+    BYTE *built = NULL;
+    if (texture->npot) {
+        UINT src_w, src_h;
+        texture_level_size(texture, level, &src_w, &src_h);
+        RECT src_rect = {0, 0, (LONG)src_w, (LONG)src_h}, out = {0, 0, (LONG)w, (LONG)h};
+        built = staging_acquire(&gles->staging, (size_t)w * h);
+        if (!built || texture_npot_build(texture, &alpha_format, level, alpha, src_w, &src_rect, &out, built, w,
+                                         device_workers(gles)) != D3D_OK) {
+            staging_release(&gles->staging, built);
+            return;
+        }
+        alpha = built;
     }
-    *ppbData = buffer->temp_buffer + OffsetToLock;
-    return D3D_OK;
+    if (texture->resource.managed && !texture->alpha_backing)
+        texture->alpha_backing = calloc(1, texture_alpha_offset(texture, texture->levels));
+    if (texture->alpha_backing)
+        memcpy(texture->alpha_backing + texture_alpha_offset(texture, level), alpha, (size_t)w * h);
+    if (texture->resource.evicted) {
+        staging_release(&gles->staging, built);
+        return;
+    }
+    texture_flush_readers(gles, texture);
+    resource_grow(gles, &texture->resource, (size_t)w * h);
+    if (!texture->alpha_tex_id) {
+        glGenTextures(1, &texture->alpha_tex_id);
+        texture->alpha_sampler = gl_default_sampler;
+    }
+    glBindTexture(GL_TEXTURE_2D, texture->alpha_tex_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, level, GL_ALPHA, (GLsizei)w, (GLsizei)h, 0, GL_ALPHA, GL_UNSIGNED_BYTE, alpha);
+    restore_texture_binding(gles);
+    gles->stats.TextureUploadBytes += w * h;
+    staging_release(&gles->staging, built);
 }
 
-static HRESULT D3DAPI d3d8_vb_unlock(IDirect3DVertexBuffer8 *This) {
-    GLES_Buffer *buffer = This->buffer;
-    if (!buffer->temp_buffer) return D3DERR_INVALIDCALL;
+static BOOL texture_data_cooked(LPCVOID data, UINT size) {
+    uint32_t magic;
+    if (size < sizeof(magic)) return FALSE;
+    memcpy(&magic, data, sizeof(magic));
+    return magic == D3DGLES_COOKED_MAGIC;
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo_id);
-    glBufferSubData(GL_ARRAY_BUFFER, buffer->lock_offset, buffer->lock_size,
-                    buffer->temp_buffer + buffer->lock_offset);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+// Loads a D3DGLES_COOKED_HEADER container. The ETC1 blocks go to GL as they
+// are when it samples ETC1, and are decoded to 565 otherwise.
+static HRESULT texture_load_cooked(LPDIRECT3DDEVICE8 pDevice, LPCVOID pSrcData, UINT SrcDataSize,
+                                   D3DXIMAGE_INFO *pSrcInfo, LPDIRECT3DTEXTURE8 *ppTexture) {
+    D3DGLES_COOKED_HEADER header;
+    if (SrcDataSize < sizeof(header)) return D3DXERR_INVALIDDATA;
+    memcpy(&header, pSrcData, sizeof(header));
+    if (header.Magic != D3DGLES_COOKED_MAGIC || header.Version != D3DGLES_COOKED_VERSION || !header.Width ||
+        !header.Height || !header.Levels || header.Levels > 32)
+        return D3DXERR_INVALIDDATA;
+    UINT longest = header.Width > header.Height ? header.Width : header.Height;
+    if (header.Levels > 1 && !(longest >> (header.Levels - 1))) return D3DXERR_INVALIDDATA;
+    size_t needed = sizeof(header);
+    for (UINT level = 0; level < header.Levels; level++) {
+        size_t w = header.Width >> level ? header.Width >> level : 1;
+        size_t h = header.Height >> level ? header.Height >> level : 1;
+        needed += (w + 3) / 4 * ((h + 3) / 4) * 8;
+        if (header.Flags & D3DGLES_COOKED_ALPHA) needed += w * h;
+    }
+    if (needed > SrcDataSize) return D3DXERR_INVALIDDATA;
+    if (pSrcInfo) {
+        // DDS is the closest D3DX has to a block-compressed container
+        *pSrcInfo = (D3DXIMAGE_INFO){header.Width, header.Height, 1, header.Levels, D3DFMT_ETC1, D3DRTYPE_TEXTURE,
+                                     D3DXIFF_DDS};
+    }
 
-    free(buffer->temp_buffer);
-    buffer->temp_buffer = NULL;
+    IDirect3DTexture8 *texture = NULL;
+    HRESULT hr = pDevice->lpVtbl->CreateTexture(pDevice, header.Width, header.Height, header.Levels, 0, D3DFMT_ETC1,
+                                                D3DPOOL_MANAGED, &texture);
+    if (FAILED(hr)) return hr;
+    const BYTE *src = (const BYTE *)pSrcData + sizeof(header);
+    for (UINT level = 0; level < header.Levels && hr == D3D_OK; level++) {
+        D3DLOCKED_RECT rect;
+        UINT w, h;
+        texture_level_size(texture->texture, level, &w, &h);
+        size_t size = (size_t)(w + 3) / 4 * ((h + 3) / 4) * 8;
+        hr = texture->lpVtbl->LockRect(texture, level, &rect, NULL, 0);
+        if (hr != D3D_OK) break;
+        memcpy(rect.pBits, src, size);
+        hr = texture->lpVtbl->UnlockRect(texture, level);
+        src += size;
+    }
+    for (UINT level = 0; level < header.Levels && hr == D3D_OK && (header.Flags & D3DGLES_COOKED_ALPHA); level++) {
+        UINT w, h;
+        texture_level_size(texture->texture, level, &w, &h);
+        texture_upload_alpha_plane(pDevice->gles, texture->texture, level, src);
+        src += (size_t)w * h;
+    }
+    if (hr != D3D_OK) {
+        texture->lpVtbl->Release(texture);
+        return hr;
+    }
+    *ppTexture = texture;
     return D3D_OK;
 }
 
-static HRESULT D3DAPI d3d8_vb_get_desc(IDirect3DVertexBuffer8 *This, D3DVERTEXBUFFER_DESC *pDesc) {
-    pDesc->Format = D3DFMT_VERTEXDATA;
-    pDesc->Type = D3DRTYPE_VERTEXBUFFER;
-    pDesc->Usage = This->buffer->usage;
-    pDesc->Pool = This->buffer->pool;
-    pDesc->Size = This->buffer->length;
-    pDesc->FVF = This->buffer->fvf;
-    return D3D_OK;
+static BOOL format_is_block(D3DFORMAT format) {
+    return format == D3DFMT_ETC1 || (format >= D3DFMT_DXT1 && format <= D3DFMT_DXT5);
 }
 
-static HRESULT D3DAPI d3d8_ib_get_device(IDirect3DIndexBuffer8 *This, IDirect3DDevice8 **ppDevice) {
-    *ppDevice = This->device;
+// What a file loads into and how its levels are filled
+typedef struct {
+    UINT width;
+    UINT height;
+    UINT levels;
+    D3DFORMAT format;
+    BOOL copy_blocks;           // DXT blocks go in as they are
+    UINT loaded;                // levels read from the file; the rest are filtered from them
+} GLES_FilePlan;
+
+// Fills in the defaults D3DXCreateTextureFromFileInMemoryEx takes from the file
+static HRESULT texture_plan_file(const GLES_ImageInfo *info, UINT Width, UINT Height, UINT MipLevels,
+                                 D3DFORMAT Format, D3DCOLOR ColorKey, GLES_FilePlan *plan) {
+    if (!Width || Width == (UINT)D3DX_DEFAULT) Width = info->width;
+    if (!Height || Height == (UINT)D3DX_DEFAULT) Height = info->height;
+    BOOL scale = Width != info->width || Height != info->height;
+    UINT chain = 0;
+    for (UINT size = Width > Height ? Width : Height; size; size >>= 1) chain++;
+    // A DDS file's own chain is kept when it has one
+    if (!MipLevels || MipLevels == (UINT)D3DX_DEFAULT) MipLevels = info->levels > 1 && !scale ? info->levels : chain;
+    if (MipLevels > chain) MipLevels = chain;
+    // Blocks are only ever copied: there is no DXT encoder
+    BOOL copy_blocks = info->format != D3DFMT_UNKNOWN && !scale && !ColorKey && MipLevels <= info->levels &&
+                       (Format == D3DFMT_UNKNOWN || Format == info->format);
+    if (copy_blocks)
+        Format = info->format;
+    else if (Format == D3DFMT_UNKNOWN || format_is_block(Format))
+        Format = info->alpha || ColorKey ? D3DFMT_A8R8G8B8 : D3DFMT_X8R8G8B8;
+    else if (!image_can_store(Format))
+        return D3DERR_INVALIDCALL;
+    plan->width = Width;
+    plan->height = Height;
+    plan->levels = MipLevels;
+    plan->format = Format;
+    plan->copy_blocks = copy_blocks;
+    plan->loaded = scale ? 1 : info->levels < MipLevels ? info->levels : MipLevels;
     return D3D_OK;
 }
 
-static HRESULT D3DAPI d3d8_ib_set_private_data(IDirect3DIndexBuffer8 *This, REFGUID refguid, CONST void *pData, DWORD SizeOfData, DWORD Flags) { return D3DERR_NOTAVAILABLE; }
-static HRESULT D3DAPI d3d8_ib_get_private_data(IDirect3DIndexBuffer8 *This, REFGUID refguid, void *pData, DWORD *pSizeOfData) { return D3DERR_NOTAVAILABLE; }
-static HRESULT D3DAPI d3d8_ib_free_private_data(IDirect3DIndexBuffer8 *This, REFGUID refguid) { return D3DERR_NOTAVAILABLE; }
-static DWORD D3DAPI d3d8_ib_set_priority(IDirect3DIndexBuffer8 *This, DWORD PriorityNew) { return 0; }
-static DWORD D3DAPI d3d8_ib_get_priority(IDirect3DIndexBuffer8 *This) { return 0; }
-static void D3DAPI d3d8_ib_pre_load(IDirect3DIndexBuffer8 *This) {}
-static D3DRESOURCETYPE D3DAPI d3d8_ib_get_type(IDirect3DIndexBuffer8 *This) { return D3DRTYPE_INDEXBUFFER; }
+// BMP, TGA and DDS files decode level by level straight into the memory
+// LockRect hands out. DXT levels that need no scaling or colour key are
+// copied as they are; levels the file lacks are filtered from level 0 with
+// MipFilter. Cooked containers load as stored, ignoring the size, format
+// and filter arguments.
+HRESULT WINAPI D3DXCreateTextureFromFileInMemoryEx(LPDIRECT3DDEVICE8 pDevice, LPCVOID pSrcData, UINT SrcDataSize,
+                                                   UINT Width, UINT Height, UINT MipLevels, DWORD Usage,
+                                                   D3DFORMAT Format, D3DPOOL Pool, DWORD Filter, DWORD MipFilter,
+                                                   D3DCOLOR ColorKey, D3DXIMAGE_INFO *pSrcInfo,
+                                                   PALETTEENTRY *pPalette, LPDIRECT3DTEXTURE8 *ppTexture) {
+    // Textures are never created as P8, so there is no palette to return
+    (void)pPalette;
+    if (!pDevice || !pSrcData || !ppTexture) return D3DERR_INVALIDCALL;
+    if (texture_data_cooked(pSrcData, SrcDataSize))
+        return texture_load_cooked(pDevice, pSrcData, SrcDataSize, pSrcInfo, ppTexture);
+    GLES_ImageInfo info;
+    HRESULT hr = image_parse(pSrcData, SrcDataSize, &info);
+    if (hr != D3D_OK) return hr;
+    if (pSrcInfo) image_describe(&info, pSrcInfo);
+
+    GLES_FilePlan plan;
+    hr = texture_plan_file(&info, Width, Height, MipLevels, Format, ColorKey, &plan);
+    if (hr != D3D_OK) return hr;
+
+    IDirect3DTexture8 *texture = NULL;
+    hr = pDevice->lpVtbl->CreateTexture(pDevice, plan.width, plan.height, plan.levels, Usage, plan.format, Pool,
+                                        &texture);
+    if (hr != D3D_OK) return hr;
+    for (UINT level = 0; level < plan.loaded && hr == D3D_OK; level++) {
+        D3DLOCKED_RECT rect;
+        UINT w, h;
+        texture_level_size(texture->texture, level, &w, &h);
+        hr = texture->lpVtbl->LockRect(texture, level, &rect, NULL, 0);
+        if (hr != D3D_OK) break;
+        if (plan.copy_blocks)
+            hr = image_copy_blocks(&info, level, rect.pBits, (size_t)rect.Pitch);
+        else
+            hr = image_load(&info, level, plan.format, w, h, Filter, ColorKey, rect.pBits, (size_t)rect.Pitch);
+        HRESULT unlock = texture->lpVtbl->UnlockRect(texture, level);
+        if (hr == D3D_OK) hr = unlock;
+    }
+    if (hr == D3D_OK && plan.loaded < plan.levels && (MipFilter & 0xFF) != D3DX_FILTER_NONE)
+        hr = D3DXFilterTexture(texture, NULL, 0, MipFilter);
+    if (hr != D3D_OK) {
+        texture->lpVtbl->Release(texture);
+        return hr;
+    }
+    *ppTexture = texture;
+    return D3D_OK;
+}
 
-static HRESULT D3DAPI d3d8_ib_lock(IDirect3DIndexBuffer8 *This, UINT OffsetToLock, UINT SizeToLock, BYTE **ppbData, DWORD Flags) {
-    GLES_Buffer *buffer = This->buffer;
-    if (SizeToLock == 0) SizeToLock = buffer->length - OffsetToLock;
+HRESULT WINAPI D3DXCreateTextureFromFileInMemory(LPDIRECT3DDEVICE8 pDevice, LPCVOID pSrcData, UINT SrcDataSize,
+                                                 LPDIRECT3DTEXTURE8 *ppTexture) {
+    return D3DXCreateTextureFromFileInMemoryEx(pDevice, pSrcData, SrcDataSize, (UINT)D3DX_DEFAULT,
+                                               (UINT)D3DX_DEFAULT, (UINT)D3DX_DEFAULT, 0, D3DFMT_UNKNOWN, D3DPOOL_MANAGED, D3DX_DEFAULT,
+                                               D3DX_DEFAULT, 0, NULL, NULL, ppTexture);
+}
 
-    buffer->lock_offset = OffsetToLock;
-    buffer->lock_size = SizeToLock;
+// Files are memory-mapped, so decoding reads the page cache directly
+HRESULT WINAPI D3DXCreateTextureFromFileExA(LPDIRECT3DDEVICE8 pDevice, LPCSTR pSrcFile, UINT Width, UINT Height,
+                                            UINT MipLevels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool,
+                                            DWORD Filter, DWORD MipFilter, D3DCOLOR ColorKey,
+                                            D3DXIMAGE_INFO *pSrcInfo, PALETTEENTRY *pPalette,
+                                            LPDIRECT3DTEXTURE8 *ppTexture) {
+    if (!pDevice || !pSrcFile || !ppTexture) return D3DERR_INVALIDCALL;
+    GLES_FileView view;
+    HRESULT hr = image_map_file(pSrcFile, &view);
+    if (hr != D3D_OK) return hr;
+    if (view.size > UINT_MAX)
+        hr = D3DXERR_INVALIDDATA;
+    else
+        hr = D3DXCreateTextureFromFileInMemoryEx(pDevice, view.data, (UINT)view.size, Width, Height, MipLevels,
+                                                 Usage, Format, Pool, Filter, MipFilter, ColorKey, pSrcInfo,
+                                                 pPalette, ppTexture);
+    image_unmap_file(&view);
+    return hr;
+}
 
-    buffer->temp_buffer = malloc(buffer->length);
-    if (!buffer->temp_buffer) return D3DERR_OUTOFVIDEOMEMORY;
+HRESULT WINAPI D3DXCreateTextureFromFileA(LPDIRECT3DDEVICE8 pDevice, LPCSTR pSrcFile, LPDIRECT3DTEXTURE8 *ppTexture) {
+    return D3DXCreateTextureFromFileExA(pDevice, pSrcFile, (UINT)D3DX_DEFAULT, (UINT)D3DX_DEFAULT, (UINT)D3DX_DEFAULT, 0,
+                                        D3DFMT_UNKNOWN, D3DPOOL_MANAGED, D3DX_DEFAULT, D3DX_DEFAULT, 0, NULL, NULL,
+                                        ppTexture);
+}
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer->vbo_id);
-    if (Flags & D3DLOCK_DISCARD) {
-        GLenum usage = (buffer->usage & D3DUSAGE_DYNAMIC) ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW;
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, buffer->length, NULL, usage);
+// Decoded DXT formats: keeps `level`'s blocks for later locks and decodes
+// them into `dst` in GL layout
+static HRESULT texture_load_decode_blocks(GLES_TextureLoad *load, UINT level, BYTE *dst) {
+    const GLES_Texture *texture = load->texture->texture;
+    const GLES_TextureFormat *format = texture->gl_format;
+    UINT w, h;
+    texture_level_size(texture, level, &w, &h);
+    UINT cols = (w + 3) / 4, rows = (h + 3) / 4;
+    size_t pitch = (size_t)cols * format->block_size, strip_pitch = (size_t)cols * 4 * format->texel_size;
+    BYTE *blocks = malloc(pitch * rows);
+    BYTE *strip = malloc(strip_pitch * 4);
+    HRESULT hr = blocks && strip ? image_copy_blocks(&load->info, level, blocks, pitch) : D3DERR_OUTOFVIDEOMEMORY;
+    for (UINT row = 0; row < rows && hr == D3D_OK; row++) {
+        format->decode(blocks + row * pitch, cols, strip, strip_pitch);
+        // Levels smaller than a block keep only the texels they cover
+        for (UINT y = 0; y < 4 && row * 4 + y < h; y++)
+            memcpy(dst + (size_t)(row * 4 + y) * w * format->texel_size, strip + y * strip_pitch,
+                   (size_t)w * format->texel_size);
+    }
+    free(strip);
+    if (hr != D3D_OK) {
+        free(blocks);
+        return hr;
     }
-    *ppbData = buffer->temp_buffer + OffsetToLock;
+    load->blocks[level] = blocks;
+    load->blocks_decoded += cols * rows;
     return D3D_OK;
 }
 
-static HRESULT D3DAPI d3d8_ib_unlock(IDirect3DIndexBuffer8 *This) {
-    GLES_Buffer *buffer = This->buffer;
-    if (!buffer->temp_buffer) return D3DERR_INVALIDCALL;
+// Where the decode thread puts `level` at its own size
+static BYTE *texture_load_level(GLES_TextureLoad *load, UINT level) {
+    const GLES_Texture *texture = load->texture->texture;
+    if (load->source) return load->source + texture_source_offset(texture, level);
+    return load->levels + texture_level_offset(texture, level);
+}
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer->vbo_id);
-    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, buffer->lock_offset, buffer->lock_size,
-                    buffer->temp_buffer + buffer->lock_offset);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+// Decode thread: every level the texture gets, first in D3D layout so
+// missing levels can be filtered from the one above, then converted to GL
+// layout in place. NPOT storage is then built from the converted levels.
+static void texture_load_decode(GLES_LoadJob *job) {
+    GLES_TextureLoad *load = (GLES_TextureLoad *)job;
+    const GLES_Texture *texture = load->texture->texture;
+    const GLES_TextureFormat *format = texture->gl_format;
+    HRESULT hr = D3D_OK;
+    for (UINT level = 0; level < texture->levels && hr == D3D_OK && !job->cancelled; level++) {
+        UINT w, h;
+        texture_level_size(texture, level, &w, &h);
+        BYTE *dst = texture_load_level(load, level);
+        if (level < load->loaded) {
+            if (format->decode)
+                hr = texture_load_decode_blocks(load, level, dst);
+            else if (load->copy_blocks)
+                hr = image_copy_blocks(&load->info, level, dst, (size_t)(w + 3) / 4 * format->block_size);
+            else
+                hr = image_load(&load->info, level, texture->format, w, h, load->filter, load->color_key, dst,
+                                (size_t)w * format->texel_size);
+        } else if (texture->autogen_mipmap || format->block_size || (load->mip_filter & 0xFF) == D3DX_FILTER_NONE) {
+            // GL builds the chain, or it is left undefined as the synchronous load leaves it
+            break;
+        } else {
+            UINT src_w, src_h;
+            texture_level_size(texture, level - 1, &src_w, &src_h);
+            hr = texfilter_downsample(texture->format, format->texel_size, texture_load_level(load, level - 1), src_w,
+                                      src_h, dst, w, h, load->mip_filter, NULL);
+        }
+        if (hr == D3D_OK) load->uploaded |= 1u << level;
+    }
+    for (UINT level = 0; level < texture->levels && format->convert && !format->block_size; level++) {
+        if (!(load->uploaded & 1u << level)) continue;
+        UINT w, h;
+        texture_level_size(texture, level, &w, &h);
+        BYTE *bits = texture_load_level(load, level);
+        format->convert(bits, bits, (size_t)w * h);
+    }
+    for (UINT level = 0; level < texture->levels && load->source && hr == D3D_OK; level++) {
+        if (!(load->uploaded & 1u << level)) continue;
+        UINT w, h, gl_w, gl_h;
+        texture_level_size(texture, level, &w, &h);
+        texture_storage_size(texture, level, &gl_w, &gl_h);
+        RECT rect = {0, 0, (LONG)w, (LONG)h}, out = {0, 0, (LONG)gl_w, (LONG)gl_h};
+        hr = texture_npot_build(texture, format, level, texture_load_level(load, level), (size_t)w * format->texel_size,
+                                &rect, &out, load->levels + texture_level_offset(texture, level),
+                                (size_t)gl_w * format->texel_size, NULL);
+    }
+    load->hr = hr;
+}
 
-    free(buffer->temp_buffer);
-    buffer->temp_buffer = NULL;
-    return D3D_OK;
+// Upload thread. glFinish stands in for a fence: once the job is done the
+// device's context may sample everything uploaded here.
+static void texture_load_upload(GLES_LoadJob *job) {
+    GLES_TextureLoad *load = (GLES_TextureLoad *)job;
+    if (load->hr != D3D_OK) return;
+    const GLES_Texture *texture = load->texture->texture;
+    const GLES_TextureFormat *format = texture->gl_format;
+    BOOL compressed = texture_compressed(texture);
+    while (glGetError() != GL_NO_ERROR) {}
+    glBindTexture(GL_TEXTURE_2D, texture->tex_id);
+    for (UINT level = 0; level < texture->levels; level++) {
+        if (!(load->uploaded & 1u << level)) continue;
+        UINT w, h;
+        texture_storage_size(texture, level, &w, &h);
+        const BYTE *bits = load->levels + texture_level_offset(texture, level);
+        if (compressed) {
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, format->gl_format, w, h, 0,
+                                   (GLsizei)texture_level_bytes(texture, level), bits);
+        } else {
+            glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment(w * format->texel_size));
+            glTexImage2D(GL_TEXTURE_2D, level, format->gl_format, w, h, 0, format->gl_format, format->gl_type, bits);
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glFinish();
+    if (glGetError() != GL_NO_ERROR) load->hr = D3DERR_OUTOFVIDEOMEMORY;
 }
 
-static HRESULT D3DAPI d3d8_ib_get_desc(IDirect3DIndexBuffer8 *This, D3DINDEXBUFFER_DESC *pDesc) {
-    pDesc->Format = This->buffer->format;
-    pDesc->Type = D3DRTYPE_INDEXBUFFER;
-    pDesc->Usage = This->buffer->usage;
-    pDesc->Pool = This->buffer->pool;
-    pDesc->Size = This->buffer->length;
+static void texture_load_complete(GLES_LoadJob *job) {
+    GLES_TextureLoad *load = (GLES_TextureLoad *)job;
+    if (load->callback) load->callback(load->texture, load->hr, load->context);
+}
+
+// The device's background loader, started on first use. NULL when there is
+// no shared context or its thread cannot use it.
+static GLES_Loader *device_loader(GLES_Device *gles) {
+    if (!gles->loader && gles->loader_context != EGL_NO_CONTEXT) {
+        gles->loader = loader_create(gles->display, gles->loader_surface, gles->loader_context, 0);
+        // Not worth trying again
+        if (!gles->loader) {
+            eglDestroyContext(gles->display, gles->loader_context);
+            gles->loader_context = EGL_NO_CONTEXT;
+        }
+    }
+    return gles->loader;
+}
+
+// Shared by the async entry points. Takes over `view`, which holds the file
+// when one was mapped.
+static HRESULT texture_load_async(LPDIRECT3DDEVICE8 pDevice, GLES_FileView *view, LPCVOID pSrcData,
+                                  UINT SrcDataSize, UINT Width, UINT Height, UINT MipLevels, DWORD Usage,
+                                  D3DFORMAT Format, D3DPOOL Pool, DWORD Filter, DWORD MipFilter, D3DCOLOR ColorKey,
+                                  D3DXIMAGE_INFO *pSrcInfo, LPD3DGLESLOADCALLBACK pCallback, void *pContext,
+                                  LPDIRECT3DTEXTURE8 *ppTexture) {
+    GLES_Device *gles = pDevice->gles;
+    // Cooked containers are uploaded as stored, so there is nothing to hand off
+    if (texture_data_cooked(pSrcData, SrcDataSize) || !device_loader(gles)) {
+        HRESULT hr = D3DXCreateTextureFromFileInMemoryEx(pDevice, pSrcData, SrcDataSize, Width, Height, MipLevels,
+                                                         Usage, Format, Pool, Filter, MipFilter, ColorKey, pSrcInfo,
+                                                         NULL, ppTexture);
+        image_unmap_file(view);
+        if (hr == D3D_OK && pCallback) pCallback(*ppTexture, D3D_OK, pContext);
+        return hr;
+    }
+    GLES_TextureLoad *load = calloc(1, sizeof(GLES_TextureLoad));
+    if (!load) {
+        image_unmap_file(view);
+        return D3DERR_OUTOFVIDEOMEMORY;
+    }
+    load->view = *view;
+    GLES_FilePlan plan;
+    HRESULT hr = image_parse(pSrcData, SrcDataSize, &load->info);
+    if (hr == D3D_OK) {
+        if (pSrcInfo) image_describe(&load->info, pSrcInfo);
+        hr = texture_plan_file(&load->info, Width, Height, MipLevels, Format, ColorKey, &plan);
+    }
+    IDirect3DTexture8 *texture = NULL;
+    if (hr == D3D_OK)
+        hr = pDevice->lpVtbl->CreateTexture(pDevice, plan.width, plan.height, plan.levels, Usage, plan.format, Pool,
+                                            &texture);
+    if (hr != D3D_OK) {
+        texture_load_free(load, 0);
+        return hr;
+    }
+    GLES_Texture *tex = texture->texture;
+    // The upload thread gives the texture storage of its own
+    if (tex->atlas) texture_unatlas(gles, tex, FALSE);
+    load->levels = malloc(texture_level_offset(tex, tex->levels));
+    if (tex->gl_format->decode) load->blocks = calloc(tex->levels, sizeof(BYTE *));
+    if (tex->npot) load->source = malloc(texture_source_offset(tex, tex->levels));
+    if (!load->levels || (tex->gl_format->decode && !load->blocks) || (tex->npot && !load->source)) {
+        texture_load_free(load, tex->levels);
+        texture->lpVtbl->Release(texture);
+        return D3DERR_OUTOFVIDEOMEMORY;
+    }
+    load->job.decode = texture_load_decode;
+    load->job.upload = texture_load_upload;
+    load->job.complete = texture_load_complete;
+    load->texture = texture;
+    load->loaded = plan.loaded;
+    load->copy_blocks = plan.copy_blocks;
+    load->filter = Filter;
+    load->mip_filter = MipFilter;
+    load->color_key = ColorKey;
+    load->callback = pCallback;
+    load->context = pContext;
+    tex->load = load;
+    loader_submit(gles->loader, &load->job);
+    *ppTexture = texture;
     return D3D_OK;
 }
 
-static HRESULT D3DAPI d3d8_create_texture(IDirect3DDevice8 *This, UINT Width, UINT Height, UINT Levels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, IDirect3DTexture8 **ppTexture) {
-    (void)Usage;
-    (void)Pool;
-    GLES_Texture *tex = calloc(1, sizeof(GLES_Texture));
-    if (!tex) return D3DERR_OUTOFVIDEOMEMORY;
+// Parses the file on the calling thread, so bad data fails here rather
+// than in the callback
+HRESULT WINAPI D3DGLESCreateTextureFromFileInMemoryAsync(LPDIRECT3DDEVICE8 pDevice, LPCVOID pSrcData,
+                                                         UINT SrcDataSize, UINT Width, UINT Height, UINT MipLevels,
+                                                         DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, DWORD Filter,
+                                                         DWORD MipFilter, D3DCOLOR ColorKey,
+                                                         D3DXIMAGE_INFO *pSrcInfo, LPD3DGLESLOADCALLBACK pCallback,
+                                                         void *pContext, LPDIRECT3DTEXTURE8 *ppTexture) {
+    if (!pDevice || !pSrcData || !ppTexture) return D3DERR_INVALIDCALL;
+    GLES_FileView view = {0};
+    return texture_load_async(pDevice, &view, pSrcData, SrcDataSize, Width, Height, MipLevels, Usage, Format, Pool,
+                              Filter, MipFilter, ColorKey, pSrcInfo, pCallback, pContext, ppTexture);
+}
 
-    tex->width = Width;
-    tex->height = Height;
-    tex->levels = Levels ? Levels : 1;
-    tex->format = Format;
+// The file stays mapped until its load finishes
+HRESULT WINAPI D3DGLESCreateTextureFromFileAsyncA(LPDIRECT3DDEVICE8 pDevice, LPCSTR pSrcFile, UINT Width,
+                                                  UINT Height, UINT MipLevels, DWORD Usage, D3DFORMAT Format,
+                                                  D3DPOOL Pool, DWORD Filter, DWORD MipFilter, D3DCOLOR ColorKey,
+                                                  D3DXIMAGE_INFO *pSrcInfo, LPD3DGLESLOADCALLBACK pCallback,
+                                                  void *pContext, LPDIRECT3DTEXTURE8 *ppTexture) {
+    if (!pDevice || !pSrcFile || !ppTexture) return D3DERR_INVALIDCALL;
+    GLES_FileView view;
+    HRESULT hr = image_map_file(pSrcFile, &view);
+    if (hr != D3D_OK) return hr;
+    if (view.size > UINT_MAX) {
+        image_unmap_file(&view);
+        return D3DXERR_INVALIDDATA;
+    }
+    return texture_load_async(pDevice, &view, view.data, (UINT)view.size, Width, Height, MipLevels, Usage, Format,
+                              Pool, Filter, MipFilter, ColorKey, pSrcInfo, pCallback, pContext, ppTexture);
+}
 
-    glGenTextures(1, &tex->tex_id);
-    glBindTexture(GL_TEXTURE_2D, tex->tex_id);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    UINT w = Width, h = Height;
-    for (UINT level = 0; level < tex->levels; level++) {
-        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-        if (w > 1) w >>= 1;
-        if (h > 1) h >>= 1;
+HRESULT WINAPI D3DGLESGetTextureStatus(LPDIRECT3DTEXTURE8 pTexture, BOOL Wait) {
+    if (!pTexture) return D3DERR_INVALIDCALL;
+    GLES_Texture *texture = pTexture->texture;
+    if (!texture_finish_load(pTexture->device->gles, texture, Wait)) return D3DERR_WASSTILLDRAWING;
+    return texture->load_status;
+}
+
+// Sets the scale and offset `unit`'s texture matrix applies last, to be
+// loaded by the next draw unless it is there already
+static void texcoord_load(GLES_Device *gles, UINT unit, const GLfloat coords[4]) {
+    GLfloat *have = gles->texcoord_transform[unit];
+    if (!memcmp(have, coords, sizeof(gles->texcoord_transform[unit]))) return;
+    memcpy(have, coords, sizeof(gles->texcoord_transform[unit]));
+    gles->texture_matrix_dirty |= 1u << unit;
+}
+
+// Textures that fill only part of their GL texture have `unit` map
+// coordinates into that part while it samples them. NULL for `texture`
+// leaves the coordinates alone.
+static void texture_apply_coords(GLES_Device *gles, UINT unit, const GLES_Texture *texture) {
+    GLfloat coords[4];
+    texture_coords(texture, coords);
+    texcoord_load(gles, unit, coords);
+}
+
+// Builds `unit`'s GL texture matrix: stage `stage`'s D3DTS_TEXTUREn when its
+// D3DTSS_TEXTURETRANSFORMFLAGS are set, then the bound texture's scale and
+// offset. D3D matrices multiply row vectors, so m[i][j] takes input
+// component i to output j, which is GL's column-major element [i * 4 + j].
+static void texture_matrix_build(const GLES_Device *gles, UINT unit, DWORD stage, GLfloat out[16]) {
+    DWORD flags = texture_transform_flags(&gles->applied, stage);
+    UINT count = (UINT)(flags & ~(DWORD)D3DTTFF_PROJECTED);
+    D3DXMATRIX m;
+    if (count) {
+        m = gles->texture_matrices[stage];
+        // D3D reads coordinates with fewer than three components as
+        // (u, v, 1, 0), where GL has (s, t, 0, 1)
+        UINT dims = gles->texcoord_dims[unit];
+        if (dims < 3) memcpy(m.m[3], m.m[dims], sizeof(m.m[3]));
+        // GL always divides by q: the last counted output when projected,
+        // otherwise 1
+        for (UINT i = 0; i < 4; i++)
+            m.m[i][3] = flags & D3DTTFF_PROJECTED ? m.m[i][count - 1] : i == 3 ? 1.0f : 0.0f;
+    } else {
+        D3DXMatrixIdentity(&m);
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // The texture's scale and offset apply after the division by q
+    const GLfloat *coords = gles->texcoord_transform[unit];
+    for (UINT i = 0; i < 4; i++) {
+        m.m[i][0] = m.m[i][0] * coords[0] + m.m[i][3] * coords[2];
+        m.m[i][1] = m.m[i][1] * coords[1] + m.m[i][3] * coords[3];
+    }
+    memcpy(out, m.m, sizeof(m.m));
+}
 
-    IDirect3DTexture8 *texture = calloc(1, sizeof(IDirect3DTexture8) + sizeof(IDirect3DTexture8Vtbl));
-    if (!texture) {
-        glDeleteTextures(1, &tex->tex_id);
-        free(tex);
-        return D3DERR_OUTOFVIDEOMEMORY;
+// Loads the GL_TEXTURE matrix of each unit whose transform or texture
+// mapping changed since its last draw
+static void texture_matrices_load(GLES_Device *gles) {
+    UINT dirty = gles->texture_matrix_dirty & ((1u << gles->texture_units) - 1);
+    if (!dirty) return;
+    glMatrixMode(GL_TEXTURE);
+    for (UINT unit = 0; dirty >> unit; unit++) {
+        if (!(dirty & 1u << unit)) continue;
+        GLfloat matrix[16];
+        texture_matrix_build(gles, unit, gles->alpha_plane && unit == gles->alpha_plane ? 0 : unit, matrix);
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glLoadMatrixf(matrix);
+        gles->stats.TextureMatrixLoads++;
     }
+    glActiveTexture(GL_TEXTURE0);
+    glMatrixMode(GL_MODELVIEW);
+    gles->texture_matrix_dirty = 0;
+}
 
-    static const IDirect3DTexture8Vtbl tex_vtbl = {
-        .QueryInterface = tex_query_interface,
-        .AddRef = tex_add_ref,
-        .Release = tex_release,
-        .LockRect = tex_lock_rect,
-        .UnlockRect = tex_unlock_rect,
-        .GetLevelDesc = tex_get_level_desc
-    };
-    texture->lpVtbl = &tex_vtbl;
-    texture->texture = tex;
-    texture->device = This;
+// Binds `texture` on `stage`'s unit. Whether the unit textures at all is up
+// to the texture environment, which the next draw brings up to date.
+static void apply_texture(GLES_Device *gles, DWORD stage, GLES_Texture *texture) {
+    // A texture still loading binds nothing; draws check on it again
+    BOOL loading = texture && !texture_finish_load(gles, texture, FALSE);
+    if (stage < gles->texture_units) {
+        glActiveTexture(GL_TEXTURE0 + stage);
+        if (texture && !loading) {
+            resource_touch(gles, &texture->resource);
+            if (texture->resource.evicted) texture_restore(gles, texture);
+        }
+        if (!texture || loading) {
+            glBindTexture(GL_TEXTURE_2D, 0);
+        } else if (texture->palette_image) {
+            texture_bind_palette(gles, stage, texture, gles->applied.texture_palette);
+        } else {
+            glBindTexture(GL_TEXTURE_2D, texture->tex_id);
+            // Levels the app never wrote still need storage to sample from
+            for (UINT level = 0; level < texture->levels; level++) {
+                if (!(texture->allocated_levels & 1u << level)) texture_allocate_level(gles, texture, level, NULL);
+            }
+            texture_apply_sampler(gles, stage, texture);
+        }
+        texture_apply_coords(gles, stage, loading ? NULL : texture);
+        glActiveTexture(GL_TEXTURE0);
+        gles->texenv_white &= ~(1u << stage);
+    }
+    gles->applied.textures[stage] = texture;
+    gles->loading_stages = loading ? gles->loading_stages | 1u << stage : gles->loading_stages & ~(1u << stage);
+    gles->texenv_dirty = TRUE;
+    gles->stats.StateChanges++;
+}
 
-    *ppTexture = texture;
+static HRESULT D3DAPI d3d8_set_texture(IDirect3DDevice8 *This, DWORD Stage, IDirect3DTexture8 *pTexture) {
+    if (Stage >= GLES_MAX_TEXTURE_STAGES) return D3DERR_INVALIDCALL;
+    GLES_Device *gles = This->gles;
+    GLES_Texture *texture = pTexture ? pTexture->texture : NULL;
+    gles->state.textures[Stage] = texture;
+    if (scene_defer_state(gles)) return D3D_OK;
+    if (atlas_switch_batches(gles, Stage, texture))
+        gles->stats.AtlasSwitches++;
+    else
+        batch_flush(gles);
+    apply_texture(gles, Stage, texture);
     return D3D_OK;
 }
 
-static HRESULT D3DAPI d3d8_set_texture(IDirect3DDevice8 *This, DWORD Stage, IDirect3DTexture8 *pTexture) {
-    if (Stage != 0) return D3DERR_INVALIDCALL;
-    if (!pTexture) {
-        glBindTexture(GL_TEXTURE_2D, 0);
-        glDisable(GL_TEXTURE_2D);
-        return D3D_OK;
+static void apply_texture_palette(GLES_Device *gles, UINT palette) {
+    batch_flush(gles);
+    gles->applied.texture_palette = palette;
+    texture_rebind_palette(gles, NULL, palette);
+    gles->stats.StateChanges++;
+}
+
+static HRESULT D3DAPI d3d8_set_palette_entries(IDirect3DDevice8 *This, UINT PaletteNumber, CONST PALETTEENTRY *pEntries) {
+    GLES_Device *gles = This->gles;
+    if (!pEntries || PaletteNumber >= GLES_MAX_PALETTES) return D3DERR_INVALIDCALL;
+    if (PaletteNumber >= gles->palette_count) {
+        UINT count = PaletteNumber + 1;
+        GLES_Palette *palettes = realloc(gles->palettes, count * sizeof(GLES_Palette));
+        if (!palettes) return D3DERR_OUTOFVIDEOMEMORY;
+        memset(palettes + gles->palette_count, 0, (count - gles->palette_count) * sizeof(GLES_Palette));
+        gles->palettes = palettes;
+        gles->palette_count = count;
     }
-    glBindTexture(GL_TEXTURE_2D, pTexture->texture->tex_id);
-    glEnable(GL_TEXTURE_2D);
+    // Draws recorded so far keep the old colours
+    scene_flush(gles);
+    GLES_Palette *palette = &gles->palettes[PaletteNumber];
+    memcpy(palette->entries, pEntries, sizeof(palette->entries));
+    palette->stamp = ++gles->palette_stamp;
+    if (PaletteNumber == gles->applied.texture_palette) apply_texture_palette(gles, PaletteNumber);
     return D3D_OK;
 }
 
-static GLenum tex_arg_to_gl(DWORD arg) {
-    switch (arg & D3DTA_SELECTMASK) {
-        case D3DTA_DIFFUSE: return GL_PRIMARY_COLOR;
-        case D3DTA_CURRENT: return GL_PREVIOUS;
-        case D3DTA_TEXTURE: return GL_TEXTURE;
-        default: return GL_TEXTURE;
-    }
+static HRESULT D3DAPI d3d8_get_palette_entries(IDirect3DDevice8 *This, UINT PaletteNumber, PALETTEENTRY *pEntries) {
+    GLES_Device *gles = This->gles;
+    if (!pEntries || PaletteNumber >= gles->palette_count || !gles->palettes[PaletteNumber].stamp)
+        return D3DERR_INVALIDCALL;
+    memcpy(pEntries, gles->palettes[PaletteNumber].entries, sizeof(gles->palettes[PaletteNumber].entries));
+    return D3D_OK;
 }
 
-static HRESULT D3DAPI d3d8_set_texture_stage_state(IDirect3DDevice8 *This, DWORD Stage, D3DTEXTURESTAGESTATETYPE Type, DWORD Value) {
-    if (Stage != 0) return D3DERR_INVALIDCALL;
+static HRESULT D3DAPI d3d8_set_current_texture_palette(IDirect3DDevice8 *This, UINT PaletteNumber) {
+    GLES_Device *gles = This->gles;
+    if (PaletteNumber >= gles->palette_count || !gles->palettes[PaletteNumber].stamp) return D3DERR_INVALIDCALL;
+    gles->state.texture_palette = PaletteNumber;
+    if (scene_defer_state(gles)) return D3D_OK;
+    if (gles->applied.texture_palette != PaletteNumber) apply_texture_palette(gles, PaletteNumber);
+    return D3D_OK;
+}
+
+static HRESULT D3DAPI d3d8_get_current_texture_palette(IDirect3DDevice8 *This, UINT *PaletteNumber) {
+    if (!PaletteNumber) return D3DERR_INVALIDCALL;
+    *PaletteNumber = This->gles->state.texture_palette;
+    return D3D_OK;
+}
 
+static void apply_texture_stage_state(GLES_Device *gles, DWORD stage, D3DTEXTURESTAGESTATETYPE Type, DWORD Value) {
+    gles->applied.texture_stage_states[stage][Type] = Value;
+    gles->applied.texture_stage_state_mask[stage] |= 1u << Type;
+    gles->stats.StateChanges++;
     switch (Type) {
         case D3DTSS_COLOROP:
-            glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE);
-            switch (Value) {
-                case D3DTOP_MODULATE:
-                    glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_RGB, GL_MODULATE);
-                    break;
-                case D3DTOP_SELECTARG1:
-                    glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_RGB, GL_REPLACE);
-                    glTexEnvi(GL_TEXTURE_ENV, GL_SRC0_RGB, GL_TEXTURE);
-                    break;
-                case D3DTOP_SELECTARG2:
-                    glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_RGB, GL_REPLACE);
-                    glTexEnvi(GL_TEXTURE_ENV, GL_SRC0_RGB, GL_PREVIOUS);
-                    break;
-                default:
-                    return D3DERR_INVALIDCALL;
-            }
-            break;
         case D3DTSS_COLORARG1:
-            glTexEnvi(GL_TEXTURE_ENV, GL_SRC0_RGB, tex_arg_to_gl(Value));
-            break;
         case D3DTSS_COLORARG2:
-            glTexEnvi(GL_TEXTURE_ENV, GL_SRC1_RGB, tex_arg_to_gl(Value));
-            break;
+        case D3DTSS_COLORARG0:
         case D3DTSS_ALPHAOP:
-            glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE);
-            switch (Value) {
-                case D3DTOP_MODULATE:
-                    glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_ALPHA, GL_MODULATE);
-                    break;
-                case D3DTOP_SELECTARG1:
-                    glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_ALPHA, GL_REPLACE);
-                    glTexEnvi(GL_TEXTURE_ENV, GL_SRC0_ALPHA, GL_TEXTURE);
-                    break;
-                case D3DTOP_SELECTARG2:
-                    glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_ALPHA, GL_REPLACE);
-                    glTexEnvi(GL_TEXTURE_ENV, GL_SRC0_ALPHA, GL_PREVIOUS);
-                    break;
-                default:
-                    return D3DERR_INVALIDCALL;
+        case D3DTSS_ALPHAARG1:
+        case D3DTSS_ALPHAARG2:
+        case D3DTSS_ALPHAARG0:
+        case D3DTSS_TEXCOORDINDEX:
+            // Compiled with the rest of the cascade at the next draw
+            gles->texenv_dirty = TRUE;
+            break;
+        case D3DTSS_TEXTURETRANSFORMFLAGS:
+            texture_matrix_touch(gles, stage);
+            break;
+        case D3DTSS_MIPMAPLODBIAS:
+            // A float in the DWORD; per unit in GL, like in D3D
+            if (gles->lod_bias && stage < gles->texture_units) {
+                uint32_t bits = (uint32_t)Value;
+                GLfloat bias;
+                memcpy(&bias, &bits, sizeof(bias));
+                glActiveTexture(GL_TEXTURE0 + stage);
+                glTexEnvf(GL_TEXTURE_FILTER_CONTROL_EXT, GL_TEXTURE_LOD_BIAS_EXT, bias);
+                glActiveTexture(GL_TEXTURE0);
             }
             break;
-        case D3DTSS_ALPHAARG1:
-            glTexEnvi(GL_TEXTURE_ENV, GL_SRC0_ALPHA, tex_arg_to_gl(Value));
+        case D3DTSS_ADDRESSU:
+        case D3DTSS_ADDRESSV:
+        case D3DTSS_MAGFILTER:
+        case D3DTSS_MINFILTER:
+        case D3DTSS_MIPFILTER:
+            if (gles->applied.textures[stage] && stage < gles->texture_units) {
+                glActiveTexture(GL_TEXTURE0 + stage);
+                texture_apply_sampler(gles, stage, gles->applied.textures[stage]);
+                glActiveTexture(GL_TEXTURE0);
+            }
             break;
-        case D3DTSS_ALPHAARG2:
-            glTexEnvi(GL_TEXTURE_ENV, GL_SRC1_ALPHA, tex_arg_to_gl(Value));
+        default:
             break;
+    }
+}
+
+static BOOL texture_arg_valid(DWORD arg) {
+    return (arg & ~(DWORD)(D3DTA_SELECTMASK | D3DTA_COMPLEMENT | D3DTA_ALPHAREPLICATE)) == 0 &&
+           (arg & D3DTA_SELECTMASK) <= D3DTA_TEMP;
+}
+
+// Rejects values D3D does not define. Defined ops and arguments GL ES cannot
+// combine are stored, and ValidateDevice reports them.
+static BOOL texture_stage_state_supported(D3DTEXTURESTAGESTATETYPE Type, DWORD Value) {
+    switch (Type) {
+        case D3DTSS_COLOROP:
+        case D3DTSS_ALPHAOP:
+            return Value >= D3DTOP_DISABLE && Value <= D3DTOP_LERP;
+        case D3DTSS_COLORARG1:
+        case D3DTSS_COLORARG2:
+        case D3DTSS_COLORARG0:
+        case D3DTSS_ALPHAARG1:
+        case D3DTSS_ALPHAARG2:
+        case D3DTSS_ALPHAARG0:
+            return texture_arg_valid(Value);
+        // Every stage writes the current colour; there is no temporary register
+        case D3DTSS_RESULTARG:
+            return Value == D3DTA_CURRENT;
         case D3DTSS_TEXCOORDINDEX:
-            if (Value > 1) return D3DERR_INVALIDCALL;
-            This->gles->texcoord_index0 = Value;
-            break;
+            return Value < GLES_MAX_TEXTURE_STAGES;
+        case D3DTSS_TEXTURETRANSFORMFLAGS:
+            return (Value & ~(DWORD)D3DTTFF_PROJECTED) <= D3DTTFF_COUNT4;
+        case D3DTSS_ADDRESSU:
+        case D3DTSS_ADDRESSV:
+            return Value >= D3DTADDRESS_WRAP && Value <= D3DTADDRESS_CLAMP;
+        case D3DTSS_MAGFILTER:
+        case D3DTSS_MINFILTER:
+            return Value >= D3DTEXF_POINT && Value <= D3DTEXF_ANISOTROPIC;
+        case D3DTSS_MIPFILTER:
+            return Value <= D3DTEXF_LINEAR;
+        // MAXMIPLEVEL is accepted but GL ES 1.1 has no base level to map it to
+        case D3DTSS_MIPMAPLODBIAS:
+        case D3DTSS_MAXMIPLEVEL:
+            return TRUE;
         default:
-            return D3DERR_INVALIDCALL;
+            return FALSE;
     }
+}
+
+static HRESULT D3DAPI d3d8_set_texture_stage_state(IDirect3DDevice8 *This, DWORD Stage, D3DTEXTURESTAGESTATETYPE Type, DWORD Value) {
+    if (Stage >= GLES_MAX_TEXTURE_STAGES || !texture_stage_state_supported(Type, Value)) return D3DERR_INVALIDCALL;
+    GLES_Device *gles = This->gles;
+    gles->state.texture_stage_states[Stage][Type] = Value;
+    gles->state.texture_stage_state_mask[Stage] |= 1u << Type;
+    if (scene_defer_state(gles)) return D3D_OK;
+    batch_flush(gles);
+    apply_texture_stage_state(gles, Stage, Type, Value);
     return D3D_OK;
 }
 
+// The compiled form of `block`'s stage cascade, from the cache when an
+// identical cascade was compiled before
+static const GLES_TexEnvProgram *texenv_program(GLES_Device *gles, const GLES_StateBlock *block) {
+    GLES_TexEnvProgram key;
+    texenv_build_key(block, &key);
+    // Stages whose texture is still loading draw as if it were NULL
+    if (block == &gles->applied) key.textured &= ~gles->loading_stages;
+    GLES_TexEnvProgram *program = &gles->texenv_programs[texenv_hash(&key) % GLES_TEXENV_CACHE_SLOTS];
+    if (program->valid && program->textured == key.textured && !memcmp(program->key, key.key, sizeof(key.key)))
+        return program;
+    memcpy(program->key, key.key, sizeof(key.key));
+    program->textured = key.textured;
+    texenv_compile(program, gles->texture_units);
+    program->valid = TRUE;
+    gles->stats.CombinerCompiles++;
+    return program;
+}
+
+// Cooked ETC1 textures on stage 0 multiply their alpha plane into the
+// cascade's result on the unit after the last one in use. Returns that
+// unit, or 0 when there is no plane or no unit left for it.
+static UINT texenv_alpha_plane_unit(const GLES_Device *gles, const GLES_StateBlock *block,
+                                    const GLES_TexEnvProgram *program) {
+    const GLES_Texture *texture = block->textures[0];
+    // An evicted texture gets its plane back when it is bound
+    if (!texture || !(texture->alpha_tex_id || texture->alpha_backing) || !(program->enabled & 1)) return 0;
+    UINT unit = 1;
+    while (program->enabled >> unit) unit++;
+    return unit < gles->texture_units ? unit : 0;
+}
+
+static const GLES_Combiner alpha_plane_combiner = {
+    GL_REPLACE, GL_MODULATE,
+    {GL_PREVIOUS, 0, 0}, {GL_SRC_COLOR, 0, 0},
+    {GL_PREVIOUS, GL_TEXTURE, 0}, {GL_SRC_ALPHA, GL_SRC_ALPHA, 0},
+    1.0f, 1.0f,
+};
+
+// Sends the parts of `wanted` the active unit does not already hold. Zero
+// fields are ones the combiner does not read.
+static void texenv_send(GLES_Device *gles, GLES_Combiner *have, const GLES_Combiner *wanted) {
+    static const GLenum src_names[2][3] = {{GL_SRC0_RGB, GL_SRC1_RGB, GL_SRC2_RGB},
+                                           {GL_SRC0_ALPHA, GL_SRC1_ALPHA, GL_SRC2_ALPHA}};
+    static const GLenum operand_names[2][3] = {{GL_OPERAND0_RGB, GL_OPERAND1_RGB, GL_OPERAND2_RGB},
+                                               {GL_OPERAND0_ALPHA, GL_OPERAND1_ALPHA, GL_OPERAND2_ALPHA}};
+    if (!have->combine_rgb) glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE);
+    GLenum *have_combine[2] = {&have->combine_rgb, &have->combine_alpha};
+    const GLenum want_combine[2] = {wanted->combine_rgb, wanted->combine_alpha};
+    GLenum *have_src[2] = {have->src_rgb, have->src_alpha}, *have_operand[2] = {have->operand_rgb, have->operand_alpha};
+    const GLenum *want_src[2] = {wanted->src_rgb, wanted->src_alpha};
+    const GLenum *want_operand[2] = {wanted->operand_rgb, wanted->operand_alpha};
+    GLfloat *have_scale[2] = {&have->rgb_scale, &have->alpha_scale};
+    const GLfloat want_scale[2] = {wanted->rgb_scale, wanted->alpha_scale};
+    for (UINT half = 0; half < 2; half++) {
+        if (want_combine[half] && *have_combine[half] != want_combine[half]) {
+            glTexEnvi(GL_TEXTURE_ENV, half ? GL_COMBINE_ALPHA : GL_COMBINE_RGB, (GLint)want_combine[half]);
+            *have_combine[half] = want_combine[half];
+            gles->stats.CombinerUpdates++;
+        }
+        for (UINT i = 0; i < 3; i++) {
+            if (want_src[half][i] && have_src[half][i] != want_src[half][i]) {
+                glTexEnvi(GL_TEXTURE_ENV, src_names[half][i], (GLint)want_src[half][i]);
+                have_src[half][i] = want_src[half][i];
+                gles->stats.CombinerUpdates++;
+            }
+            if (want_operand[half][i] && have_operand[half][i] != want_operand[half][i]) {
+                glTexEnvi(GL_TEXTURE_ENV, operand_names[half][i], (GLint)want_operand[half][i]);
+                have_operand[half][i] = want_operand[half][i];
+                gles->stats.CombinerUpdates++;
+            }
+        }
+        if (want_scale[half] != 0.0f && *have_scale[half] != want_scale[half]) {
+            glTexEnvf(GL_TEXTURE_ENV, half ? GL_ALPHA_SCALE : GL_RGB_SCALE, want_scale[half]);
+            *have_scale[half] = want_scale[half];
+            gles->stats.CombinerUpdates++;
+        }
+    }
+}
+
+static void texenv_bind_white(GLES_Device *gles) {
+    if (gles->white_tex_id) {
+        glBindTexture(GL_TEXTURE_2D, gles->white_tex_id);
+        return;
+    }
+    static const BYTE white[4] = {0xFF, 0xFF, 0xFF, 0xFF};
+    glGenTextures(1, &gles->white_tex_id);
+    glBindTexture(GL_TEXTURE_2D, gles->white_tex_id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+}
+
+// Brings every texture unit in line with the applied stage cascade: which
+// units texture, what they bind in place of a stage texture, and their
+// combiners. Runs before draws, so a run of stage state changes compiles
+// once, and touches only units whose setup differs.
+static void texenv_apply(GLES_Device *gles) {
+    // Bind textures whose loads finished since they were set
+    for (UINT stage = 0; gles->loading_stages >> stage; stage++) {
+        GLES_Texture *texture = gles->applied.textures[stage];
+        if ((gles->loading_stages & 1u << stage) && (!texture->load || loader_done(&texture->load->job)))
+            apply_texture(gles, stage, texture);
+    }
+    if (!gles->texenv_dirty) return;
+    gles->texenv_dirty = FALSE;
+    const GLES_StateBlock *applied = &gles->applied;
+    const GLES_TexEnvProgram *program = texenv_program(gles, applied);
+    UINT plane = texenv_alpha_plane_unit(gles, applied, program);
+    UINT enabled = program->enabled | (plane ? 1u << plane : 0);
+    DWORD factor = applied->render_state_mask[D3DRS_TEXTUREFACTOR / 32] & 1u << (D3DRS_TEXTUREFACTOR % 32)
+                       ? applied->render_states[D3DRS_TEXTUREFACTOR]
+                       : 0xFFFFFFFF;
+    UINT active = 0;
+    for (UINT unit = 0; unit < gles->texture_units; unit++) {
+        UINT bit = 1u << unit;
+        BOOL white = (program->white & bit) != 0;
+        BOOL is_plane = plane && unit == plane;
+        BOOL rebind = is_plane || (gles->alpha_plane && unit == gles->alpha_plane) ||
+                      white != !!(gles->texenv_white & bit);
+        if (!rebind && !((enabled ^ gles->texenv_enabled) & bit) && !(enabled & bit)) continue;
+        if (active != unit) glActiveTexture(GL_TEXTURE0 + (active = unit));
+        if (is_plane) {
+            GLES_Texture *texture = applied->textures[0];
+            GLES_SamplerState wanted;
+            glBindTexture(GL_TEXTURE_2D, texture->alpha_tex_id);
+            sampler_wanted(gles, 0, texture, &wanted);
+            sampler_sync(gles, &texture->alpha_sampler, &wanted);
+            // The plane reads stage 0's coordinates, and is padded as its texture is
+            texture_apply_coords(gles, unit, texture);
+        } else if (white) {
+            if (!(gles->texenv_white & bit)) texenv_bind_white(gles);
+        } else if (rebind) {
+            GLES_Texture *texture = gles->loading_stages & bit ? NULL : applied->textures[unit];
+            glBindTexture(GL_TEXTURE_2D, texture ? texture->tex_id : 0);
+            texture_apply_coords(gles, unit, texture);
+        }
+        gles->texenv_white = (gles->texenv_white & ~bit) | (white && !is_plane ? bit : 0);
+        if ((enabled ^ gles->texenv_enabled) & bit) {
+            if (enabled & bit)
+                glEnable(GL_TEXTURE_2D);
+            else
+                glDisable(GL_TEXTURE_2D);
+            gles->texenv_enabled ^= bit;
+        }
+        if (!(enabled & bit)) continue;
+        texenv_send(gles, &gles->texenv_units[unit], is_plane ? &alpha_plane_combiner : &program->units[unit]);
+        if ((program->constant & bit) && !is_plane && gles->texenv_factor[unit] != factor) {
+            GLfloat color[4] = {(factor >> 16 & 0xFF) / 255.0f, (factor >> 8 & 0xFF) / 255.0f,
+                                (factor & 0xFF) / 255.0f, (factor >> 24 & 0xFF) / 255.0f};
+            glTexEnvfv(GL_TEXTURE_ENV, GL_TEXTURE_ENV_COLOR, color);
+            gles->texenv_factor[unit] = factor;
+            gles->stats.CombinerUpdates++;
+        }
+    }
+    if (active) glActiveTexture(GL_TEXTURE0);
+    // A plane unit transforms coordinates as stage 0 does
+    if (plane != gles->alpha_plane) gles->texture_matrix_dirty |= 1u << plane | 1u << gles->alpha_plane;
+    gles->alpha_plane = plane;
+}
+
+static HRESULT D3DAPI d3d8_validate_device(IDirect3DDevice8 *This, DWORD *pNumPasses) {
+    if (!pNumPasses) return D3DERR_INVALIDCALL;
+    GLES_Device *gles = This->gles;
+    const GLES_TexEnvProgram *program = texenv_program(gles, &gles->state);
+    HRESULT hr = program->status;
+    const GLES_Texture *texture = gles->state.textures[0];
+    if (hr == D3D_OK && texture && (texture->alpha_tex_id || texture->alpha_backing) && (program->enabled & 1) &&
+        !texenv_alpha_plane_unit(gles, &gles->state, program))
+        hr = D3DERR_TOOMANYOPERATIONS;
+    *pNumPasses = hr == D3D_OK ? 1 : 0;
+    return hr;
+}
+
 // D3DX functions
 HRESULT WINAPI D3DXCreateBuffer(DWORD NumBytes, LPD3DXBUFFER *ppBuffer) {
     ID3DXBuffer *buffer = calloc(1, sizeof(ID3DXBuffer) + sizeof(ID3DXBufferVtbl));
@@ -1736,8 +5650,8 @@ UINT WINAPI D3DXGetFVFVertexSize(DWORD FVF) {
 
     UINT size = (FVF & D3DFVF_XYZRHW) ? 4 * sizeof(float) : 3 * sizeof(float);
     if (FVF & D3DFVF_NORMAL) size += 3 * sizeof(float);
-    if (FVF & D3DFVF_DIFFUSE) size += sizeof(DWORD);
-    if (FVF & D3DFVF_SPECULAR) size += sizeof(DWORD);
+    if (FVF & D3DFVF_DIFFUSE) size += sizeof(uint32_t); // D3DCOLOR is 32-bit even where DWORD is not
+    if (FVF & D3DFVF_SPECULAR) size += sizeof(uint32_t);
 
     UINT tex_count = (FVF & D3DFVF_TEXCOUNT_MASK) >> D3DFVF_TEXCOUNT_SHIFT;
     if (tex_count > 2) return 0;
@@ -2276,6 +6190,80 @@ HRESULT WINAPI D3DXLoadMeshFromX(LPSTR pFilename, DWORD Options, LPDIRECT3DDEVIC
 HRESULT WINAPI D3DXCreateSkinMesh(DWORD NumFaces, DWORD NumVertices, DWORD NumBones, DWORD Options, CONST DWORD *pDeclaration, LPDIRECT3DDEVICE8 pD3D, LPD3DXSKINMESH *ppSkinMesh) { return D3DXERR_SKINNINGNOTSUPPORTED; }
 HRESULT WINAPI D3DXCreateSkinMeshFVF(DWORD NumFaces, DWORD NumVertices, DWORD NumBones, DWORD Options, DWORD FVF, LPDIRECT3DDEVICE8 pD3D, LPD3DXSKINMESH *ppSkinMesh) { return D3DXERR_SKINNINGNOTSUPPORTED; }
 
+// Shim-specific device options and statistics
+HRESULT WINAPI D3DGLESSetDeviceOption(LPDIRECT3DDEVICE8 pDevice, D3DGLES_OPTION Option, DWORD Value) {
+    if (!pDevice || !pDevice->gles) return D3DERR_INVALIDCALL;
+    GLES_Device *gles = pDevice->gles;
+    switch (Option) {
+        case D3DGLES_OPTION_DYNAMIC_BATCHING:
+            batch_flush(gles);
+            gles->batch.enabled = Value != 0;
+            break;
+        case D3DGLES_OPTION_BATCH_VERTEX_LIMIT:
+            if (Value == 0 || Value > 0xFFFF) return D3DERR_INVALIDCALL;
+            batch_flush(gles);
+            gles->batch.vertex_limit = Value;
+            break;
+        case D3DGLES_OPTION_DEFERRED_SCENE:
+            // Takes effect at the next BeginScene
+            gles->scene.enabled = Value != 0;
+            break;
+        case D3DGLES_OPTION_TEXTURE_BGRA:
+            // Takes effect for textures created afterwards
+            if (Value && !gles->bgra_supported) return D3DERR_NOTAVAILABLE;
+            gles->texture_bgra = Value != 0;
+            break;
+        case D3DGLES_OPTION_AUTOGEN_MIPMAP:
+            // Takes effect for textures created afterwards
+            gles->autogen_mipmap = Value != 0;
+            break;
+        case D3DGLES_OPTION_TEXTURE_DXT:
+            // Takes effect for textures created afterwards; unsupported DXT formats are decoded either way
+            if (Value && !gles->dxt_supported) return D3DERR_NOTAVAILABLE;
+            gles->texture_dxt = Value != 0;
+            break;
+        case D3DGLES_OPTION_MANAGED_BUDGET:
+            if (!Value) return D3DERR_INVALIDCALL;
+            gles->managed_budget = (size_t)Value;
+            // A smaller budget evicts down to it straight away
+            if (gles->resident_bytes > gles->managed_budget) {
+                scene_flush(gles);
+                batch_flush(gles);
+                resource_evict(gles, gles->resident_bytes - gles->managed_budget, NULL);
+            }
+            break;
+        case D3DGLES_OPTION_TEXTURE_DEDUP:
+            // Textures already sharing keep doing so
+            gles->texture_dedup = Value != 0;
+            break;
+        case D3DGLES_OPTION_TEXTURE_RENAMES:
+            // Textures already renaming keep the copies they have
+            if (!Value || Value > GLES_MAX_TEXTURE_RENAMES) return D3DERR_INVALIDCALL;
+            gles->texture_renames = Value;
+            break;
+        case D3DGLES_OPTION_NPOT_TEXTURES:
+            // Takes effect for textures created afterwards
+            if (Value > D3DGLES_NPOT_RESCALE) return D3DERR_INVALIDCALL;
+            if (Value == D3DGLES_NPOT_NATIVE && !gles->npot_supported) return D3DERR_NOTAVAILABLE;
+            gles->npot_mode = (D3DGLES_NPOT_MODE)Value;
+            break;
+        case D3DGLES_OPTION_TEXTURE_ATLAS:
+            // Takes effect for textures created afterwards
+            if (Value > GLES_ATLAS_MAX_TEXTURE) return D3DERR_INVALIDCALL;
+            gles->atlas_max_size = (UINT)Value;
+            break;
+        default:
+            return D3DERR_INVALIDCALL;
+    }
+    return D3D_OK;
+}
+
+HRESULT WINAPI D3DGLESGetDeviceStats(LPDIRECT3DDEVICE8 pDevice, D3DGLES_STATS *pStats) {
+    if (!pDevice || !pDevice->gles || !pStats) return D3DERR_INVALIDCALL;
+    *pStats = pDevice->gles->stats;
+    return D3D_OK;
+}
+
 // Direct3DCreate8
 // IUnknown-style helpers for IDirect3D8
 static HRESULT D3DAPI d3d8_query_interface(IDirect3D8 *This, REFIID riid, void **ppv) {
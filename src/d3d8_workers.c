@@ -0,0 +1,107 @@
+// src/d3d8_workers.c
+#include "d3d8_workers.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define WORKERS_MAX_THREADS 16
+
+struct GLES_WorkerPool {
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    pthread_t threads[WORKERS_MAX_THREADS];
+    unsigned thread_count;
+    unsigned generation;        // bumped for every job
+    unsigned busy;              // helpers that have not finished the current job
+    int shutdown;
+    GLES_WorkFn fn;
+    void *ctx;
+    size_t count;
+    size_t grain;
+    size_t next;                // first item not yet handed out
+};
+
+// Hands out chunks until the job runs dry. Called with the mutex held.
+static void run_chunks(GLES_WorkerPool *pool) {
+    while (pool->next < pool->count) {
+        size_t begin = pool->next;
+        size_t end = pool->count - begin > pool->grain ? begin + pool->grain : pool->count;
+        pool->next = end;
+        pthread_mutex_unlock(&pool->mutex);
+        pool->fn(pool->ctx, begin, end);
+        pthread_mutex_lock(&pool->mutex);
+    }
+}
+
+static void *worker_main(void *arg) {
+    GLES_WorkerPool *pool = arg;
+    unsigned seen = 0;
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        while (pool->generation == seen && !pool->shutdown) pthread_cond_wait(&pool->start, &pool->mutex);
+        if (pool->shutdown) break;
+        seen = pool->generation;
+        run_chunks(pool);
+        if (--pool->busy == 0) pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+GLES_WorkerPool *workers_create(unsigned threads) {
+    if (!threads) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 1 ? (unsigned)cpus - 1 : 0;
+    }
+    if (threads > WORKERS_MAX_THREADS) threads = WORKERS_MAX_THREADS;
+    if (!threads) return NULL;
+    GLES_WorkerPool *pool = calloc(1, sizeof(GLES_WorkerPool));
+    if (!pool) return NULL;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for (unsigned i = 0; i < threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) break;
+        pool->thread_count++;
+    }
+    if (!pool->thread_count) {
+        workers_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void workers_destroy(GLES_WorkerPool *pool) {
+    if (!pool) return;
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+    for (unsigned i = 0; i < pool->thread_count; i++) pthread_join(pool->threads[i], NULL);
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool);
+}
+
+void workers_run(GLES_WorkerPool *pool, size_t count, size_t grain, GLES_WorkFn fn, void *ctx) {
+    if (!grain) grain = 1;
+    // Not worth waking anyone for a single chunk
+    if (!pool || count <= grain) {
+        if (count) fn(ctx, 0, count);
+        return;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->count = count;
+    pool->grain = grain;
+    pool->next = 0;
+    pool->busy = pool->thread_count;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    run_chunks(pool);
+    while (pool->busy) pthread_cond_wait(&pool->done, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+}
@@ -0,0 +1,23 @@
+// src/d3d8_workers.h
+#ifndef D3D8_WORKERS_H
+#define D3D8_WORKERS_H
+
+#include <stddef.h>
+
+// Fixed pool of threads for data-parallel CPU work (mip filtering, block
+// decoding). One caller at a time; the caller takes part in the work.
+typedef struct GLES_WorkerPool GLES_WorkerPool;
+
+// Processes items [begin, end) of a job
+typedef void (*GLES_WorkFn)(void *ctx, size_t begin, size_t end);
+
+// `threads` == 0 picks one less than the number of online CPUs. Returns
+// NULL when no helper threads would be started.
+GLES_WorkerPool *workers_create(unsigned threads);
+void workers_destroy(GLES_WorkerPool *pool);
+
+// Runs `fn` over [0, count) in chunks of `grain` items and returns when all
+// chunks are done. A NULL pool runs everything on the calling thread.
+void workers_run(GLES_WorkerPool *pool, size_t count, size_t grain, GLES_WorkFn fn, void *ctx);
+
+#endif // D3D8_WORKERS_H
@@ -0,0 +1,218 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+  float x, y, z;
+  float u, v;
+} Vertex;
+
+#define BMP_PATH "async_texture_load_test.bmp"
+
+static atomic_int callbacks;
+static atomic_int gate;
+static atomic_int last_hr;
+static pthread_t main_thread;
+
+static void put16(BYTE *p, unsigned v) {
+  p[0] = (BYTE)v;
+  p[1] = (BYTE)(v >> 8);
+}
+
+static void put32(BYTE *p, unsigned v) {
+  put16(p, v & 0xffff);
+  put16(p + 2, v >> 16);
+}
+
+// 4x4 24-bit BMP of a single colour
+static void build_bmp(BYTE *file, BYTE r, BYTE g, BYTE b) {
+  memset(file, 0, 54);
+  file[0] = 'B';
+  file[1] = 'M';
+  put32(file + 2, 54 + 4 * 12);
+  put32(file + 10, 54);
+  put32(file + 14, 40);
+  put32(file + 18, 4);
+  put32(file + 22, 4);
+  put16(file + 26, 1);
+  put16(file + 28, 24);
+  for (int i = 0; i < 16; i++) {
+    file[54 + i * 3] = b;
+    file[54 + i * 3 + 1] = g;
+    file[54 + i * 3 + 2] = r;
+  }
+}
+
+// The first callback holds the upload thread until the test opens the gate,
+// so loads queued behind it stay pending
+static void WINAPI on_loaded(LPDIRECT3DTEXTURE8 texture, HRESULT hr,
+                             void *context) {
+  assert(texture);
+  assert(!pthread_equal(pthread_self(), main_thread));
+  atomic_store(&last_hr, (int)hr);
+  if (context)
+    while (!atomic_load(&gate)) sched_yield();
+  atomic_fetch_add(&callbacks, 1);
+}
+
+static void draw(IDirect3DDevice8 *device, unsigned char *pixel) {
+  glClear(GL_COLOR_BUFFER_BIT);
+  HRESULT hr = device->lpVtbl->DrawIndexedPrimitive(
+      device, D3DPT_TRIANGLELIST, 0, 4, 0, 2);
+  assert(hr == D3D_OK);
+  glReadPixels(4, 4, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+}
+
+int main(void) {
+  main_thread = pthread_self();
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_TEX1;
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 4 * sizeof(Vertex),
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  Vertex quad[4] = {{-1.0f, -1.0f, 0.5f, 0.0f, 1.0f},
+                    {1.0f, -1.0f, 0.5f, 1.0f, 1.0f},
+                    {-1.0f, 1.0f, 0.5f, 0.0f, 0.0f},
+                    {1.0f, 1.0f, 0.5f, 1.0f, 0.0f}};
+  BYTE *data;
+  vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  memcpy(data, quad, sizeof(quad));
+  vb->lpVtbl->Unlock(vb);
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+
+  device->lpVtbl->SetVertexShader(device, fvf);
+  device->lpVtbl->SetStreamSource(device, 0, vb, sizeof(Vertex));
+  device->lpVtbl->SetIndices(device, ib, 0);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  device->lpVtbl->SetRenderState(device, D3DRS_LIGHTING, FALSE);
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+  // Bad data fails on the calling thread, without a callback
+  IDirect3DTexture8 *texture = NULL;
+  BYTE junk[64] = {0x55, 0x55, 0x55};
+  hr = D3DGLESCreateTextureFromFileInMemoryAsync(
+      device, junk, sizeof(junk), (UINT)D3DX_DEFAULT, (UINT)D3DX_DEFAULT,
+      (UINT)D3DX_DEFAULT, 0, D3DFMT_UNKNOWN, D3DPOOL_MANAGED, D3DX_DEFAULT,
+      D3DX_DEFAULT, 0, NULL, on_loaded, NULL, &texture);
+  assert(hr == D3DXERR_INVALIDDATA);
+
+  BYTE red[54 + 48], blue[54 + 48], green[54 + 48];
+  build_bmp(red, 0xff, 0, 0);
+  build_bmp(blue, 0, 0, 0xff);
+  build_bmp(green, 0, 0xff, 0);
+
+  // The first load's callback blocks the upload thread
+  IDirect3DTexture8 *blocker = NULL, *pending = NULL, *dropped = NULL;
+  D3DXIMAGE_INFO info;
+  hr = D3DGLESCreateTextureFromFileInMemoryAsync(
+      device, red, sizeof(red), (UINT)D3DX_DEFAULT, (UINT)D3DX_DEFAULT,
+      (UINT)D3DX_DEFAULT, 0, D3DFMT_UNKNOWN, D3DPOOL_MANAGED, D3DX_DEFAULT,
+      D3DX_DEFAULT, 0, &info, on_loaded, &gate, &blocker);
+  assert(hr == D3D_OK && blocker);
+  assert(info.Width == 4 && info.Height == 4 && info.Format == D3DFMT_R8G8B8);
+  hr = D3DGLESCreateTextureFromFileInMemoryAsync(
+      device, blue, sizeof(blue), (UINT)D3DX_DEFAULT, (UINT)D3DX_DEFAULT,
+      (UINT)D3DX_DEFAULT, 0, D3DFMT_UNKNOWN, D3DPOOL_MANAGED, D3DX_DEFAULT,
+      D3DX_DEFAULT, 0, NULL, on_loaded, NULL, &pending);
+  assert(hr == D3D_OK && pending);
+  assert(D3DGLESGetTextureStatus(pending, FALSE) == D3DERR_WASSTILLDRAWING);
+
+  // A texture still loading draws as if none were set
+  device->lpVtbl->SetTexture(device, 0, pending);
+  unsigned char p[4];
+  draw(device, p);
+  assert(p[0] == 255 && p[1] == 255 && p[2] == 255);
+
+  // Releasing a pending texture cancels its load and its callback
+  hr = D3DGLESCreateTextureFromFileInMemoryAsync(
+      device, green, sizeof(green), 4, 4, 1, 0, D3DFMT_R5G6B5,
+      D3DPOOL_DEFAULT, D3DX_FILTER_NONE, D3DX_FILTER_NONE, 0, NULL, on_loaded,
+      NULL, &dropped);
+  assert(hr == D3D_OK && dropped);
+  dropped->lpVtbl->Release(dropped);
+  assert(atomic_load(&callbacks) == 0);
+
+  // Once the upload thread moves on, draws pick the texture up without
+  // another SetTexture
+  atomic_store(&gate, 1);
+  assert(D3DGLESGetTextureStatus(blocker, TRUE) == D3D_OK);
+  int tries = 0;
+  do {
+    struct timespec pause = {0, 1000000};
+    nanosleep(&pause, NULL);
+    draw(device, p);
+  } while (p[2] != 255 && ++tries < 5000);
+  assert(p[0] == 0 && p[1] == 0 && p[2] == 255);
+  assert(D3DGLESGetTextureStatus(pending, FALSE) == D3D_OK);
+  assert(atomic_load(&callbacks) == 2 && atomic_load(&last_hr) == D3D_OK);
+
+  // Files stay mapped until their load is done; waiting takes it over, and
+  // the levels it filtered are there to lock
+  FILE *out = fopen(BMP_PATH, "wb");
+  assert(out && fwrite(green, 1, sizeof(green), out) == sizeof(green));
+  fclose(out);
+  IDirect3DTexture8 *from_file = NULL;
+  hr = D3DGLESCreateTextureFromFileAsync(
+      device, BMP_PATH, (UINT)D3DX_DEFAULT, (UINT)D3DX_DEFAULT, 0, 0,
+      D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, D3DX_DEFAULT, D3DX_FILTER_BOX, 0, NULL,
+      NULL, NULL, &from_file);
+  remove(BMP_PATH);
+  assert(hr == D3D_OK && from_file);
+  assert(D3DGLESGetTextureStatus(from_file, TRUE) == D3D_OK);
+  D3DSURFACE_DESC desc;
+  assert(from_file->lpVtbl->GetLevelDesc(from_file, 2, &desc) == D3D_OK);
+  assert(desc.Width == 1 && desc.Format == D3DFMT_A8R8G8B8);
+  device->lpVtbl->SetTexture(device, 0, from_file);
+  draw(device, p);
+  assert(p[0] == 0 && p[1] == 255 && p[2] == 0);
+
+  D3DGLES_STATS stats;
+  assert(D3DGLESGetDeviceStats(device, &stats) == D3D_OK);
+  assert(stats.TextureUploadBytes > 0);
+  assert(glGetError() == GL_NO_ERROR);
+
+  device->lpVtbl->SetTexture(device, 0, NULL);
+  from_file->lpVtbl->Release(from_file);
+  pending->lpVtbl->Release(pending);
+  blocker->lpVtbl->Release(blocker);
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
@@ -0,0 +1,175 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <stdatomic.h>
+#include <string.h>
+
+typedef struct {
+  float x, y, z;
+  float u, v;
+} Vertex;
+
+static atomic_int texels;
+static atomic_int smallest_calls;
+
+// Red and green follow the texture coordinate
+static void WINAPI gradient(D3DXVECTOR4 *out, D3DXVECTOR2 *coord,
+                            D3DXVECTOR2 *size, LPVOID data) {
+  assert(data == &texels);
+  (void)size;
+  atomic_fetch_add(&texels, 1);
+  *out = (D3DXVECTOR4){coord->x, coord->y, 0.0f, 1.0f};
+}
+
+// Full red on the 8x8 level only, and counts calls for the 1x1 one
+static void WINAPI by_level(D3DXVECTOR4 *out, D3DXVECTOR2 *coord,
+                            D3DXVECTOR2 *size, LPVOID data) {
+  (void)data;
+  atomic_fetch_add(&texels, 1);
+  if (size->x == 1.0f) {
+    assert(size->y == 1.0f && coord->x == 0.5f && coord->y == 0.5f);
+    atomic_fetch_add(&smallest_calls, 1);
+  }
+  *out = (D3DXVECTOR4){size->x == 0.125f ? 1.0f : 0.0f, 0.0f, 0.0f, 1.0f};
+}
+
+// Out of range channels clamp
+static void WINAPI overbright(D3DXVECTOR4 *out, D3DXVECTOR2 *coord,
+                              D3DXVECTOR2 *size, LPVOID data) {
+  (void)coord;
+  (void)size;
+  (void)data;
+  *out = (D3DXVECTOR4){2.0f, -1.0f, 0.5f, 1.0f};
+}
+
+static void draw(IDirect3DDevice8 *device, IDirect3DTexture8 *texture,
+                 unsigned char pixels[8 * 8 * 4]) {
+  device->lpVtbl->SetTexture(device, 0, texture);
+  glClear(GL_COLOR_BUFFER_BIT);
+  HRESULT hr = device->lpVtbl->DrawIndexedPrimitive(
+      device, D3DPT_TRIANGLELIST, 0, 4, 0, 2);
+  assert(hr == D3D_OK);
+  glReadPixels(0, 0, 8, 8, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+  device->lpVtbl->SetTexture(device, 0, NULL);
+}
+
+static int near(int value, int expected) {
+  return value >= expected - 1 && value <= expected + 1;
+}
+
+int main(void) {
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_TEX1;
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 4 * sizeof(Vertex),
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  Vertex quad[4] = {{-1.0f, -1.0f, 0.5f, 0.0f, 1.0f},
+                    {1.0f, -1.0f, 0.5f, 1.0f, 1.0f},
+                    {-1.0f, 1.0f, 0.5f, 0.0f, 0.0f},
+                    {1.0f, 1.0f, 0.5f, 1.0f, 0.0f}};
+  BYTE *data;
+  vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  memcpy(data, quad, sizeof(quad));
+  vb->lpVtbl->Unlock(vb);
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+
+  device->lpVtbl->SetVertexShader(device, fvf);
+  device->lpVtbl->SetStreamSource(device, 0, vb, sizeof(Vertex));
+  device->lpVtbl->SetIndices(device, ib, 0);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  device->lpVtbl->SetRenderState(device, D3DRS_LIGHTING, FALSE);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_MINFILTER,
+                                       D3DTEXF_POINT);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_MAGFILTER,
+                                       D3DTEXF_POINT);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_MIPFILTER,
+                                       D3DTEXF_POINT);
+  glClearColor(0.0f, 0.0f, 1.0f, 1.0f);
+
+  // Each texel gets the function's value at its centre; the bottom screen
+  // row shows the last texture row
+  IDirect3DTexture8 *texture = NULL;
+  hr = device->lpVtbl->CreateTexture(device, 8, 8, 1, 0, D3DFMT_A8R8G8B8,
+                                     D3DPOOL_MANAGED, &texture);
+  assert(hr == D3D_OK && texture);
+  assert(D3DXFillTexture(texture, NULL, NULL) == D3DERR_INVALIDCALL);
+  assert(D3DXFillTexture(texture, gradient, &texels) == D3D_OK);
+  assert(atomic_load(&texels) == 64);
+  unsigned char p[8 * 8 * 4];
+  draw(device, texture, p);
+  for (int y = 0; y < 8; y++) {
+    for (int x = 0; x < 8; x++) {
+      const unsigned char *texel = p + (y * 8 + x) * 4;
+      assert(near(texel[0], (int)((x + 0.5f) / 8 * 255 + 0.5f)));
+      assert(near(texel[1], (int)((7 - y + 0.5f) / 8 * 255 + 0.5f)));
+      assert(texel[2] == 0);
+    }
+  }
+  texture->lpVtbl->Release(texture);
+
+  // Every level of the chain is filled, large ones across worker threads
+  atomic_store(&texels, 0);
+  hr = device->lpVtbl->CreateTexture(device, 256, 256, 0, 0, D3DFMT_X8R8G8B8,
+                                     D3DPOOL_MANAGED, &texture);
+  assert(hr == D3D_OK && texture);
+  assert(D3DXFillTexture(texture, by_level, NULL) == D3D_OK);
+  int expected = 0;
+  for (int size = 256; size; size /= 2) expected += size * size;
+  assert(atomic_load(&texels) == expected);
+  assert(atomic_load(&smallest_calls) == 1);
+  draw(device, texture, p);
+  assert(p[0] == 255 && p[1] == 0 && p[2] == 0);
+  texture->lpVtbl->Release(texture);
+
+  // Packed formats take the clamped value
+  hr = device->lpVtbl->CreateTexture(device, 8, 8, 1, 0, D3DFMT_R5G6B5,
+                                     D3DPOOL_DEFAULT, &texture);
+  assert(hr == D3D_OK && texture);
+  assert(D3DXFillTexture(texture, overbright, NULL) == D3D_OK);
+  draw(device, texture, p);
+  assert(p[0] == 255 && p[1] == 0 && p[2] >= 120 && p[2] <= 136);
+  texture->lpVtbl->Release(texture);
+
+  // Block-compressed textures cannot be filled texel by texel
+  hr = device->lpVtbl->CreateTexture(device, 8, 8, 1, 0, D3DFMT_DXT1,
+                                     D3DPOOL_MANAGED, &texture);
+  assert(hr == D3D_OK && texture);
+  assert(D3DXFillTexture(texture, overbright, NULL) == D3DERR_INVALIDCALL);
+  texture->lpVtbl->Release(texture);
+  assert(glGetError() == GL_NO_ERROR);
+
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
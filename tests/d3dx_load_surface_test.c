@@ -0,0 +1,255 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  float x, y, z;
+  float u, v;
+} Vertex;
+
+static IDirect3DDevice8 *device;
+static unsigned char screen[8 * 8 * 4];
+
+// Draws `texture` over the 8x8 screen, one texel per pixel
+static void draw(IDirect3DTexture8 *texture) {
+  device->lpVtbl->SetTexture(device, 0, texture);
+  glClear(GL_COLOR_BUFFER_BIT);
+  HRESULT hr = device->lpVtbl->DrawIndexedPrimitive(
+      device, D3DPT_TRIANGLELIST, 0, 4, 0, 2);
+  assert(hr == D3D_OK);
+  glReadPixels(0, 0, 8, 8, GL_RGBA, GL_UNSIGNED_BYTE, screen);
+  device->lpVtbl->SetTexture(device, 0, NULL);
+}
+
+// Texel (x, y) of the last draw; screen rows run bottom to top
+static const unsigned char *texel(int x, int y) {
+  return screen + ((7 - y) * 8 + x) * 4;
+}
+
+static int near(int value, int expected, int slack) {
+  return value >= expected - slack && value <= expected + slack;
+}
+
+static IDirect3DTexture8 *create(UINT size, D3DFORMAT format, D3DPOOL pool) {
+  IDirect3DTexture8 *texture = NULL;
+  HRESULT hr = device->lpVtbl->CreateTexture(device, size, size, 1, 0, format,
+                                             pool, &texture);
+  assert(hr == D3D_OK && texture);
+  return texture;
+}
+
+static IDirect3DSurface8 *level0(IDirect3DTexture8 *texture) {
+  IDirect3DSurface8 *surface = NULL;
+  assert(texture->lpVtbl->GetSurfaceLevel(texture, 0, &surface) == D3D_OK);
+  return surface;
+}
+
+int main(void) {
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_TEX1;
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 4 * sizeof(Vertex),
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  Vertex quad[4] = {{-1.0f, -1.0f, 0.5f, 0.0f, 1.0f},
+                    {1.0f, -1.0f, 0.5f, 1.0f, 1.0f},
+                    {-1.0f, 1.0f, 0.5f, 0.0f, 0.0f},
+                    {1.0f, 1.0f, 0.5f, 1.0f, 0.0f}};
+  BYTE *data;
+  vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  memcpy(data, quad, sizeof(quad));
+  vb->lpVtbl->Unlock(vb);
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+
+  device->lpVtbl->SetVertexShader(device, fvf);
+  device->lpVtbl->SetStreamSource(device, 0, vb, sizeof(Vertex));
+  device->lpVtbl->SetIndices(device, ib, 0);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  device->lpVtbl->SetRenderState(device, D3DRS_LIGHTING, FALSE);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_MINFILTER,
+                                       D3DTEXF_POINT);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_MAGFILTER,
+                                       D3DTEXF_POINT);
+  glClearColor(0.0f, 0.0f, 1.0f, 1.0f);
+
+  // Surfaces describe their texture level
+  IDirect3DTexture8 *target = create(8, D3DFMT_X8R8G8B8, D3DPOOL_MANAGED);
+  IDirect3DSurface8 *surface = NULL;
+  assert(target->lpVtbl->GetSurfaceLevel(target, 1, &surface) ==
+         D3DERR_INVALIDCALL);
+  surface = level0(target);
+  D3DSURFACE_DESC desc;
+  assert(surface->lpVtbl->GetDesc(surface, &desc) == D3D_OK);
+  assert(desc.Type == D3DRTYPE_SURFACE && desc.Width == 8 &&
+         desc.Format == D3DFMT_X8R8G8B8);
+
+  // A one-texel checkerboard halved: the box and linear filters average it,
+  // point sampling picks the black texels
+  unsigned int checker[16 * 16];
+  for (int i = 0; i < 256; i++)
+    checker[i] = (i % 16 + i / 16) & 1 ? 0xffffffff : 0xff000000;
+  RECT whole = {0, 0, 16, 16};
+  assert(D3DXLoadSurfaceFromMemory(surface, NULL, NULL, checker,
+                                   D3DFMT_A8R8G8B8, 64, NULL, NULL,
+                                   D3DX_FILTER_BOX, 0) == D3DERR_INVALIDCALL);
+  assert(D3DXLoadSurfaceFromMemory(surface, NULL, NULL, checker,
+                                   D3DFMT_A8R8G8B8, 64, NULL, &whole, 99,
+                                   0) == D3DERR_INVALIDCALL);
+  static const DWORD filters[3] = {D3DX_FILTER_BOX, D3DX_FILTER_LINEAR,
+                                   D3DX_FILTER_POINT};
+  for (int f = 0; f < 3; f++) {
+    hr = D3DXLoadSurfaceFromMemory(surface, NULL, NULL, checker,
+                                   D3DFMT_A8R8G8B8, 64, NULL, &whole,
+                                   filters[f], 0);
+    assert(hr == D3D_OK);
+    draw(target);
+    int expected = filters[f] == D3DX_FILTER_POINT ? 0 : 128;
+    for (int i = 0; i < 64; i++)
+      assert(near(screen[i * 4], expected, 1) &&
+             screen[i * 4 + 1] == screen[i * 4]);
+  }
+
+  // Colour keyed texels turn transparent black; a destination rectangle
+  // leaves the rest of the level alone
+  unsigned int keyed[4 * 8];
+  for (int i = 0; i < 32; i++) keyed[i] = i % 4 < 2 ? 0xff00ff00 : 0xffff0000;
+  RECT left = {0, 0, 4, 8}, source = {0, 0, 4, 8};
+  hr = D3DXLoadSurfaceFromMemory(surface, NULL, &left, keyed, D3DFMT_A8R8G8B8,
+                                 16, NULL, &source, D3DX_FILTER_NONE,
+                                 0xff00ff00);
+  assert(hr == D3D_OK);
+  draw(target);
+  assert(texel(0, 0)[0] == 0 && texel(0, 0)[1] == 0 && texel(0, 0)[2] == 0);
+  assert(texel(3, 7)[0] == 255 && texel(3, 7)[2] == 0);
+  assert(near(texel(6, 2)[0], 0, 1));
+  surface->lpVtbl->Release(surface);
+
+  // Formats convert on the way: L8 into R5G6B5
+  IDirect3DTexture8 *packed = create(8, D3DFMT_R5G6B5, D3DPOOL_DEFAULT);
+  surface = level0(packed);
+  BYTE grey[8 * 8];
+  memset(grey, 200, sizeof(grey));
+  RECT eight = {0, 0, 8, 8};
+  hr = D3DXLoadSurfaceFromMemory(surface, NULL, NULL, grey, D3DFMT_L8, 8, NULL,
+                                 &eight, D3DX_DEFAULT, 0);
+  assert(hr == D3D_OK);
+  draw(packed);
+  assert(near(texel(4, 4)[0], 200, 8) && near(texel(4, 4)[1], 200, 4));
+  surface->lpVtbl->Release(surface);
+
+  // Surface to surface reads the managed copy, which 4444 storage keeps
+  // rotated, and scales it up
+  IDirect3DTexture8 *small = create(4, D3DFMT_A4R4G4B4, D3DPOOL_MANAGED);
+  D3DLOCKED_RECT rect;
+  assert(small->lpVtbl->LockRect(small, 0, &rect, NULL, 0) == D3D_OK);
+  for (int y = 0; y < 4; y++)
+    for (int x = 0; x < 4; x++)
+      ((unsigned short *)((BYTE *)rect.pBits + y * rect.Pitch))[x] = 0xf0c4;
+  small->lpVtbl->UnlockRect(small, 0);
+  IDirect3DSurface8 *from = level0(small);
+  surface = level0(target);
+  hr = D3DXLoadSurfaceFromSurface(surface, NULL, NULL, from, NULL, NULL,
+                                  D3DX_FILTER_LINEAR, 0);
+  assert(hr == D3D_OK);
+  draw(target);
+  for (int i = 0; i < 64; i++)
+    assert(screen[i * 4] == 0 && screen[i * 4 + 1] == 0xcc &&
+           screen[i * 4 + 2] == 0x44);
+  from->lpVtbl->Release(from);
+  small->lpVtbl->Release(small);
+
+  // Paletted sources use the given palette or the device's current one
+  IDirect3DTexture8 *indexed = create(8, D3DFMT_P8, D3DPOOL_MANAGED);
+  assert(indexed->lpVtbl->LockRect(indexed, 0, &rect, NULL, 0) == D3D_OK);
+  for (int y = 0; y < 8; y++) memset((BYTE *)rect.pBits + y * rect.Pitch, 3, 8);
+  indexed->lpVtbl->UnlockRect(indexed, 0);
+  PALETTEENTRY palette[256];
+  memset(palette, 0, sizeof(palette));
+  palette[3] = (PALETTEENTRY){10, 20, 30, 255};
+  device->lpVtbl->SetPaletteEntries(device, 0, palette);
+  device->lpVtbl->SetCurrentTexturePalette(device, 0);
+  from = level0(indexed);
+  hr = D3DXLoadSurfaceFromSurface(surface, NULL, NULL, from, NULL, NULL,
+                                  D3DX_FILTER_POINT, 0);
+  assert(hr == D3D_OK);
+  draw(target);
+  assert(texel(5, 5)[0] == 10 && texel(5, 5)[1] == 20 && texel(5, 5)[2] == 30);
+  from->lpVtbl->Release(from);
+  indexed->lpVtbl->Release(indexed);
+
+  // Default-pool levels have no CPU copy to read; DXT cannot be written
+  from = level0(packed);
+  assert(D3DXLoadSurfaceFromSurface(surface, NULL, NULL, from, NULL, NULL,
+                                    D3DX_FILTER_POINT,
+                                    0) == D3DERR_INVALIDCALL);
+  from->lpVtbl->Release(from);
+  IDirect3DTexture8 *dxt = create(8, D3DFMT_DXT1, D3DPOOL_MANAGED);
+  IDirect3DSurface8 *compressed = level0(dxt);
+  assert(D3DXLoadSurfaceFromMemory(compressed, NULL, NULL, grey, D3DFMT_L8, 8,
+                                   NULL, &eight, D3DX_FILTER_POINT,
+                                   0) == D3DERR_INVALIDCALL);
+  compressed->lpVtbl->Release(compressed);
+  dxt->lpVtbl->Release(dxt);
+  packed->lpVtbl->Release(packed);
+
+  // Large images split into row bands; a red ramp box-filtered twice keeps
+  // its column averages
+  const int size = 512;
+  unsigned int *ramp = malloc((size_t)size * size * 4);
+  assert(ramp);
+  for (int i = 0; i < size * size; i++)
+    ramp[i] = 0xff000000u | (unsigned)(i % size / 2) << 16;
+  IDirect3DTexture8 *big = create(256, D3DFMT_A8R8G8B8, D3DPOOL_MANAGED);
+  IDirect3DSurface8 *half = level0(big);
+  RECT all = {0, 0, size, size};
+  hr = D3DXLoadSurfaceFromMemory(half, NULL, NULL, ramp, D3DFMT_A8R8G8B8,
+                                 size * 4, NULL, &all, D3DX_FILTER_BOX, 0);
+  assert(hr == D3D_OK);
+  free(ramp);
+  hr = D3DXLoadSurfaceFromSurface(surface, NULL, NULL, half, NULL, NULL,
+                                  D3DX_FILTER_BOX, 0);
+  assert(hr == D3D_OK);
+  draw(target);
+  for (int x = 0; x < 8; x++)
+    assert(near(texel(x, 3)[0], 32 * x + 16, 1) && texel(x, 3)[1] == 0);
+  half->lpVtbl->Release(half);
+  big->lpVtbl->Release(big);
+  assert(glGetError() == GL_NO_ERROR);
+
+  surface->lpVtbl->Release(surface);
+  target->lpVtbl->Release(target);
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
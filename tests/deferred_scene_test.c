@@ -0,0 +1,225 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <string.h>
+
+// Forward declarations for helper functions not in the public header
+UINT WINAPI D3DXGetFVFVertexSize(DWORD FVF);
+
+typedef struct {
+  float x, y, z;
+  float u, v;
+} Vertex;
+
+static IDirect3DTexture8 *create_solid_texture(IDirect3DDevice8 *device,
+                                               unsigned int color) {
+  IDirect3DTexture8 *texture = NULL;
+  HRESULT hr = device->lpVtbl->CreateTexture(device, 1, 1, 1, 0,
+                                             D3DFMT_A8R8G8B8,
+                                             D3DPOOL_MANAGED, &texture);
+  assert(hr == D3D_OK && texture);
+  D3DLOCKED_RECT rect;
+  hr = texture->lpVtbl->LockRect(texture, 0, &rect, NULL, 0);
+  assert(hr == D3D_OK);
+  memcpy(rect.pBits, &color, sizeof(color));
+  hr = texture->lpVtbl->UnlockRect(texture, 0);
+  assert(hr == D3D_OK);
+  return texture;
+}
+
+// One quad per quadrant, alternating between two textures, followed by an
+// additively blended quad over the top-right quadrant.
+static void draw_scene(IDirect3DDevice8 *device, IDirect3DTexture8 **textures,
+                       unsigned char *pixels) {
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  HRESULT hr = device->lpVtbl->BeginScene(device);
+  assert(hr == D3D_OK);
+  for (int i = 0; i < 5; i++) {
+    int quadrant = i < 4 ? i : 3;
+    D3DXMATRIX world;
+    D3DXMatrixIdentity(&world);
+    world._41 = (float)(quadrant % 2) - 1.0f;
+    world._42 = (float)(quadrant / 2) - 1.0f;
+    hr = device->lpVtbl->SetTransform(device, D3DTS_WORLD, &world);
+    assert(hr == D3D_OK);
+    hr = device->lpVtbl->SetTexture(device, 0, textures[i % 2]);
+    assert(hr == D3D_OK);
+    if (i == 4) {
+      device->lpVtbl->SetRenderState(device, D3DRS_ALPHABLENDENABLE, TRUE);
+      device->lpVtbl->SetRenderState(device, D3DRS_SRCBLEND, D3DBLEND_ONE);
+      device->lpVtbl->SetRenderState(device, D3DRS_DESTBLEND, D3DBLEND_ONE);
+    }
+    hr = device->lpVtbl->DrawIndexedPrimitive(device, D3DPT_TRIANGLELIST, 0, 4,
+                                              0, 2);
+    assert(hr == D3D_OK);
+  }
+  device->lpVtbl->SetRenderState(device, D3DRS_ALPHABLENDENABLE, FALSE);
+  hr = device->lpVtbl->EndScene(device);
+  assert(hr == D3D_OK);
+  glReadPixels(0, 0, 8, 8, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+}
+
+int main(void) {
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_TEX1;
+  UINT stride = D3DXGetFVFVertexSize(fvf);
+  assert(stride == sizeof(Vertex));
+
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 4 * stride,
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  Vertex quad[4] = {{0.0f, 0.0f, 0.5f, 0.0f, 0.0f},
+                    {1.0f, 0.0f, 0.5f, 1.0f, 0.0f},
+                    {0.0f, 1.0f, 0.5f, 0.0f, 1.0f},
+                    {1.0f, 1.0f, 0.5f, 1.0f, 1.0f}};
+  BYTE *data;
+  hr = vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  assert(hr == D3D_OK);
+  memcpy(data, quad, sizeof(quad));
+  vb->lpVtbl->Unlock(vb);
+
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  hr = ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  assert(hr == D3D_OK);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+
+  IDirect3DTexture8 *textures[2] = {
+      create_solid_texture(device, 0xff402010),
+      create_solid_texture(device, 0xff104020),
+  };
+
+  device->gles->fvf = fvf;
+  hr = device->lpVtbl->SetStreamSource(device, 0, vb, stride);
+  assert(hr == D3D_OK);
+  hr = device->lpVtbl->SetIndices(device, ib, 0);
+  assert(hr == D3D_OK);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+
+  unsigned char reference[8 * 8 * 4];
+  unsigned char deferred[8 * 8 * 4];
+  D3DGLES_STATS before, after;
+  D3DGLESGetDeviceStats(device, &before);
+  draw_scene(device, textures, reference);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.DeferredDraws == 0);
+  assert(after.StateChanges - before.StateChanges == 9);
+  // The two textures differ and the blended quad brightens its quadrant
+  assert(memcmp(reference, reference + 4 * 4, 4) != 0);
+  assert(reference[(7 * 8 + 7) * 4 + 1] > reference[(4 * 8) * 4 + 1]);
+
+  hr = D3DGLESSetDeviceOption(device, D3DGLES_OPTION_DEFERRED_SCENE, TRUE);
+  assert(hr == D3D_OK);
+  // Without depth testing the result depends on the order, which is kept
+  before = after;
+  draw_scene(device, textures, deferred);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(memcmp(reference, deferred, sizeof(reference)) == 0);
+  assert(after.DeferredDraws - before.DeferredDraws == 5);
+  DWORD in_order = after.StateChanges - before.StateChanges;
+
+  // With it the quads may be reordered; there is no depth buffer, so every
+  // fragment still passes
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, TRUE);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZFUNC, D3DCMP_LESSEQUAL);
+  D3DGLESGetDeviceStats(device, &before);
+  draw_scene(device, textures, deferred);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(memcmp(reference, deferred, sizeof(reference)) == 0);
+  assert(after.DeferredDraws - before.DeferredDraws == 5);
+  assert(after.DrawCalls - before.DrawCalls == 5);
+  // Opaque quads are grouped by texture: two binds instead of four, plus
+  // entering and leaving the blended state
+  assert(after.StateChanges - before.StateChanges <= 7);
+  assert(after.StateChanges - before.StateChanges < in_order);
+
+  // Outside a scene draws are not deferred
+  before = after;
+  hr = device->lpVtbl->DrawIndexedPrimitive(device, D3DPT_TRIANGLELIST, 0, 4, 0,
+                                            2);
+  assert(hr == D3D_OK);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.DeferredDraws == before.DeferredDraws);
+  assert(after.DrawCalls - before.DrawCalls == 1);
+
+  // Locks submit the recorded draws only when they read the buffer, and
+  // NOOVERWRITE promises not to touch what they read
+  IDirect3DVertexBuffer8 *other = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 4 * stride,
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &other);
+  assert(hr == D3D_OK && other);
+  device->lpVtbl->BeginScene(device);
+  before = after;
+  device->lpVtbl->DrawIndexedPrimitive(device, D3DPT_TRIANGLELIST, 0, 4, 0, 2);
+  assert(other->lpVtbl->Lock(other, 0, 0, &data, 0) == D3D_OK);
+  other->lpVtbl->Unlock(other);
+  assert(vb->lpVtbl->Lock(vb, 0, 0, &data, D3DLOCK_NOOVERWRITE) == D3D_OK);
+  vb->lpVtbl->Unlock(vb);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.DrawCalls == before.DrawCalls);
+  assert(vb->lpVtbl->Lock(vb, 0, 0, &data, 0) == D3D_OK);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.DrawCalls - before.DrawCalls == 1);
+  vb->lpVtbl->Unlock(vb);
+  device->lpVtbl->EndScene(device);
+  other->lpVtbl->Release(other);
+
+  // The same goes for uploads to textures the recorded draws sample, while
+  // texture matrices are recorded with the draws
+  device->lpVtbl->SetTexture(device, 0, textures[0]);
+  device->lpVtbl->BeginScene(device);
+  before = after;
+  device->lpVtbl->DrawIndexedPrimitive(device, D3DPT_TRIANGLELIST, 0, 4, 0, 2);
+  D3DXMATRIX scroll;
+  D3DXMatrixIdentity(&scroll);
+  scroll._31 = 0.5f;
+  device->lpVtbl->SetTransform(device, D3DTS_TEXTURE0, &scroll);
+  D3DLOCKED_RECT rect;
+  assert(textures[1]->lpVtbl->LockRect(textures[1], 0, &rect, NULL, 0) ==
+         D3D_OK);
+  textures[1]->lpVtbl->UnlockRect(textures[1], 0);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.DrawCalls == before.DrawCalls);
+  assert(textures[0]->lpVtbl->LockRect(textures[0], 0, &rect, NULL, 0) ==
+         D3D_OK);
+  textures[0]->lpVtbl->UnlockRect(textures[0], 0);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.DrawCalls - before.DrawCalls == 1);
+  device->lpVtbl->EndScene(device);
+
+  textures[0]->lpVtbl->Release(textures[0]);
+  textures[1]->lpVtbl->Release(textures[1]);
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
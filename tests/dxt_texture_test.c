@@ -0,0 +1,207 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <stdint.h>
+#include <string.h>
+
+// Internal block decoders, declared for direct checks
+void dxt1_decode_rgba5551(const BYTE *blocks, UINT count, void *dst, size_t pitch);
+void dxt3_decode_rgba4444(const BYTE *blocks, UINT count, void *dst, size_t pitch);
+void dxt5_decode_rgba8(const BYTE *blocks, UINT count, void *dst, size_t pitch);
+
+typedef struct {
+  float x, y, z;
+  float u, v;
+} Vertex;
+
+// DXT1 block of one 565 colour
+static void solid_block(BYTE block[8], WORD color) {
+  memset(block, 0, 8);
+  block[0] = (BYTE)color;
+  block[1] = (BYTE)(color >> 8);
+}
+
+static void check_decoders(void) {
+  // Red and blue endpoints; texel 1 takes index 2, texel 2 index 1
+  BYTE dxt1[8] = {0x00, 0xf8, 0x1f, 0x00, 0x18, 0, 0, 0};
+  uint16_t out16[16];
+  dxt1_decode_rgba5551(dxt1, 1, out16, 8);
+  assert(out16[0] == 0xf801);
+  assert(out16[1] == (21 << 11 | 10 << 1 | 1));
+  assert(out16[2] == (0x1f << 1 | 1));
+  // c0 <= c1 selects three colours and transparent black
+  BYTE punch[8] = {0x1f, 0x00, 0x00, 0xf8, 0x03, 0, 0, 0};
+  dxt1_decode_rgba5551(punch, 1, out16, 8);
+  assert(out16[0] == 0x0000 && out16[1] == (0x1f << 1 | 1));
+
+  BYTE dxt3[16] = {0x08, 0, 0, 0, 0, 0, 0, 0xf0, 0x00, 0xf8, 0x00, 0xf8};
+  dxt3_decode_rgba4444(dxt3, 1, out16, 8);
+  assert(out16[0] == 0xf008 && out16[1] == 0xf000);
+  assert(out16[15] == 0xf00f);
+
+  // Alpha ramp 255..0: texel 0 index 1, texel 1 index 2
+  BYTE dxt5[16] = {0xff, 0x00, 0x11, 0, 0, 0, 0, 0, 0x00, 0xf8, 0x00, 0xf8};
+  uint32_t out32[16];
+  dxt5_decode_rgba8(dxt5, 1, out32, 16);
+  assert(out32[0] == 0x000000ff);
+  assert(out32[1] == (218u << 24 | 0xff));
+  assert(out32[2] == 0xff0000ff);
+}
+
+static void fill_blocks(D3DLOCKED_RECT *rect, UINT rows, UINT cols, WORD color) {
+  for (UINT y = 0; y < rows; y++)
+    for (UINT x = 0; x < cols; x++)
+      solid_block((BYTE *)rect->pBits + y * rect->Pitch + x * 8, color);
+}
+
+static void draw(IDirect3DDevice8 *device, IDirect3DTexture8 *texture,
+                 unsigned char pixels[8 * 8 * 4]) {
+  device->lpVtbl->SetTexture(device, 0, texture);
+  glClear(GL_COLOR_BUFFER_BIT);
+  HRESULT hr = device->lpVtbl->DrawIndexedPrimitive(
+      device, D3DPT_TRIANGLELIST, 0, 4, 0, 2);
+  assert(hr == D3D_OK);
+  glReadPixels(0, 0, 8, 8, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+  device->lpVtbl->SetTexture(device, 0, NULL);
+}
+
+static const unsigned char *pixel_at(const unsigned char *pixels, int x, int y) {
+  return pixels + (y * 8 + x) * 4;
+}
+
+static void check_red_texture(IDirect3DDevice8 *device) {
+  IDirect3DTexture8 *texture = NULL;
+  HRESULT hr = device->lpVtbl->CreateTexture(device, 8, 8, 1, 0, D3DFMT_DXT1,
+                                             D3DPOOL_MANAGED, &texture);
+  assert(hr == D3D_OK && texture);
+  D3DLOCKED_RECT rect;
+  hr = texture->lpVtbl->LockRect(texture, 0, &rect, NULL, 0);
+  assert(hr == D3D_OK && rect.Pitch == 2 * 8);
+  fill_blocks(&rect, 2, 2, 0xf800);
+  assert(texture->lpVtbl->UnlockRect(texture, 0) == D3D_OK);
+  unsigned char pixels[8 * 8 * 4];
+  draw(device, texture, pixels);
+  assert(pixels[0] == 255 && pixels[1] == 0 && pixels[2] == 0);
+  texture->lpVtbl->Release(texture);
+}
+
+int main(void) {
+  check_decoders();
+
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+  assert(d3d->lpVtbl->CheckDeviceFormat(d3d, D3DADAPTER_DEFAULT,
+                                        D3DDEVTYPE_HAL, D3DFMT_X8R8G8B8, 0,
+                                        D3DRTYPE_TEXTURE,
+                                        D3DFMT_DXT5) == D3D_OK);
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_TEX1;
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 4 * sizeof(Vertex),
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  Vertex quad[4] = {{-1.0f, -1.0f, 0.5f, 0.0f, 1.0f},
+                    {1.0f, -1.0f, 0.5f, 1.0f, 1.0f},
+                    {-1.0f, 1.0f, 0.5f, 0.0f, 0.0f},
+                    {1.0f, 1.0f, 0.5f, 1.0f, 0.0f}};
+  BYTE *data;
+  vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  memcpy(data, quad, sizeof(quad));
+  vb->lpVtbl->Unlock(vb);
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+
+  device->lpVtbl->SetVertexShader(device, fvf);
+  device->lpVtbl->SetStreamSource(device, 0, vb, sizeof(Vertex));
+  device->lpVtbl->SetIndices(device, ib, 0);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+  // Compressed upload where the driver takes DXT, decoding otherwise
+  if (D3DGLESSetDeviceOption(device, D3DGLES_OPTION_TEXTURE_DXT, TRUE) ==
+      D3D_OK)
+    check_red_texture(device);
+  hr = D3DGLESSetDeviceOption(device, D3DGLES_OPTION_TEXTURE_DXT, FALSE);
+  assert(hr == D3D_OK);
+  check_red_texture(device);
+
+  // Decoded levels only redo the blocks that changed
+  D3DGLES_STATS before, after;
+  IDirect3DTexture8 *texture = NULL;
+  hr = device->lpVtbl->CreateTexture(device, 8, 8, 0, 0, D3DFMT_DXT1,
+                                     D3DPOOL_MANAGED, &texture);
+  assert(hr == D3D_OK);
+  D3DLOCKED_RECT rect;
+  D3DGLESGetDeviceStats(device, &before);
+  texture->lpVtbl->LockRect(texture, 0, &rect, NULL, 0);
+  fill_blocks(&rect, 2, 2, 0xf800);
+  texture->lpVtbl->UnlockRect(texture, 0);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.TextureBlocksDecoded - before.TextureBlocksDecoded == 4);
+
+  before = after;
+  hr = texture->lpVtbl->LockRect(texture, 0, &rect, NULL, 0);
+  assert(hr == D3D_OK && rect.pBits && ((BYTE *)rect.pBits)[1] == 0xf8);
+  texture->lpVtbl->UnlockRect(texture, 0);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.TextureBlocksDecoded == before.TextureBlocksDecoded);
+  assert(after.TextureUploadBytes == before.TextureUploadBytes);
+
+  before = after;
+  texture->lpVtbl->LockRect(texture, 0, &rect, NULL, 0);
+  solid_block(rect.pBits, 0x07e0);
+  texture->lpVtbl->UnlockRect(texture, 0);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.TextureBlocksDecoded - before.TextureBlocksDecoded == 1);
+  assert(after.TextureUploadBytes - before.TextureUploadBytes == 4 * 4 * 2);
+
+  // Sub-rectangles must cover whole blocks, except at the level edge
+  RECT misaligned = {1, 0, 4, 4};
+  assert(texture->lpVtbl->LockRect(texture, 0, &rect, &misaligned, 0) ==
+         D3DERR_INVALIDCALL);
+  for (UINT level = 1; level < 4; level++) {
+    hr = texture->lpVtbl->LockRect(texture, level, &rect, NULL, 0);
+    assert(hr == D3D_OK && rect.Pitch == 8);
+    solid_block(rect.pBits, 0x001f);
+    assert(texture->lpVtbl->UnlockRect(texture, level) == D3D_OK);
+  }
+
+  unsigned char pixels[8 * 8 * 4];
+  draw(device, texture, pixels);
+  const unsigned char *top_left = pixel_at(pixels, 1, 6);
+  const unsigned char *bottom_right = pixel_at(pixels, 6, 1);
+  assert(top_left[0] == 0 && top_left[1] == 255 && top_left[2] == 0);
+  assert(bottom_right[0] == 255 && bottom_right[1] == 0);
+  texture->lpVtbl->Release(texture);
+
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
@@ -0,0 +1,155 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <string.h>
+
+// Forward declarations for helper functions not in the public header
+UINT WINAPI D3DXGetFVFVertexSize(DWORD FVF);
+
+typedef struct {
+  float x, y, z;
+  unsigned int color;
+} Vertex;
+
+static const unsigned int colors[4] = {0xffff0000, 0xff00ff00, 0xff0000ff,
+                                       0xffffffff};
+
+// Draw four unit quads, one per viewport quadrant, each with its own world
+// matrix, and read back the 8x8 result.
+static void draw_quads(IDirect3DDevice8 *device, unsigned char *pixels) {
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  HRESULT hr = device->lpVtbl->BeginScene(device);
+  assert(hr == D3D_OK);
+  for (int i = 0; i < 4; i++) {
+    D3DXMATRIX world;
+    D3DXMatrixIdentity(&world);
+    world._41 = (float)(i % 2) - 1.0f;
+    world._42 = (float)(i / 2) - 1.0f;
+    hr = device->lpVtbl->SetTransform(device, D3DTS_WORLD, &world);
+    assert(hr == D3D_OK);
+    hr = device->lpVtbl->DrawIndexedPrimitive(device, D3DPT_TRIANGLELIST,
+                                              i * 4, 4, i * 6, 2);
+    assert(hr == D3D_OK);
+  }
+  hr = device->lpVtbl->EndScene(device);
+  assert(hr == D3D_OK);
+  glReadPixels(0, 0, 8, 8, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+}
+
+int main(void) {
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_DIFFUSE;
+  UINT stride = D3DXGetFVFVertexSize(fvf);
+  assert(stride == sizeof(Vertex));
+
+  // Four separately colored unit quads in one vertex/index buffer pair
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 16 * stride,
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  BYTE *data;
+  hr = vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  assert(hr == D3D_OK);
+  Vertex *verts = (Vertex *)data;
+  for (int i = 0; i < 4; i++) {
+    Vertex quad[4] = {{0.0f, 0.0f, 0.5f, colors[i]},
+                      {1.0f, 0.0f, 0.5f, colors[i]},
+                      {0.0f, 1.0f, 0.5f, colors[i]},
+                      {1.0f, 1.0f, 0.5f, colors[i]}};
+    memcpy(verts + i * 4, quad, sizeof(quad));
+  }
+  vb->lpVtbl->Unlock(vb);
+
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 24 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  hr = ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  assert(hr == D3D_OK);
+  WORD *indices = (WORD *)data;
+  for (int i = 0; i < 4; i++) {
+    WORD base = (WORD)(i * 4);
+    WORD quad[6] = {base, base + 1, base + 2, base + 2, base + 1, base + 3};
+    memcpy(indices + i * 6, quad, sizeof(quad));
+  }
+  ib->lpVtbl->Unlock(ib);
+
+  device->gles->fvf = fvf;
+  hr = device->lpVtbl->SetStreamSource(device, 0, vb, stride);
+  assert(hr == D3D_OK);
+  hr = device->lpVtbl->SetIndices(device, ib, 0);
+  assert(hr == D3D_OK);
+  hr = device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  assert(hr == D3D_OK);
+  hr = device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  assert(hr == D3D_OK);
+
+  // Reference image with batching disabled
+  unsigned char reference[8 * 8 * 4];
+  unsigned char batched[8 * 8 * 4];
+  D3DGLES_STATS stats;
+  draw_quads(device, reference);
+  hr = D3DGLESGetDeviceStats(device, &stats);
+  assert(hr == D3D_OK);
+  assert(stats.DrawCalls == 4 && stats.BatchedDraws == 0);
+  // Every quadrant is covered and the four quadrants differ
+  assert(memcmp(reference, reference + 4 * 4, 4) != 0);
+  assert(memcmp(reference, reference + (4 * 8) * 4, 4) != 0);
+  assert(reference[(7 * 8 + 7) * 4] == 255 && reference[(7 * 8 + 7) * 4 + 1] == 255);
+
+  hr = D3DGLESSetDeviceOption(device, D3DGLES_OPTION_DYNAMIC_BATCHING, TRUE);
+  assert(hr == D3D_OK);
+  draw_quads(device, batched);
+  assert(memcmp(reference, batched, sizeof(reference)) == 0);
+  hr = D3DGLESGetDeviceStats(device, &stats);
+  assert(hr == D3D_OK);
+  assert(stats.DrawCalls == 5 && stats.BatchedDraws == 4);
+  assert(stats.BatchFlushes == 1 && stats.BatchCacheHits == 0);
+
+  // Same buffers and matrices on the next frame reuse the cached batch
+  draw_quads(device, batched);
+  assert(memcmp(reference, batched, sizeof(reference)) == 0);
+  hr = D3DGLESGetDeviceStats(device, &stats);
+  assert(hr == D3D_OK);
+  assert(stats.DrawCalls == 6 && stats.BatchCacheHits == 1);
+
+  // Rewriting the vertex buffer invalidates the cached batch
+  hr = vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  assert(hr == D3D_OK);
+  vb->lpVtbl->Unlock(vb);
+  draw_quads(device, batched);
+  assert(memcmp(reference, batched, sizeof(reference)) == 0);
+  hr = D3DGLESGetDeviceStats(device, &stats);
+  assert(hr == D3D_OK);
+  assert(stats.BatchFlushes == 3 && stats.BatchCacheHits == 1);
+
+  assert(D3DGLESSetDeviceOption(device, D3DGLES_OPTION_BATCH_VERTEX_LIMIT,
+                                0) == D3DERR_INVALIDCALL);
+
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
@@ -0,0 +1,208 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Internal codec, declared for direct checks
+void etc1_encode_block(const uint32_t texels[16], BYTE block[8]);
+void etc1_decode_argb(const BYTE *blocks, UINT count, void *dst, size_t pitch);
+void etc1_decode_rgb565(const BYTE *blocks, UINT count, void *dst, size_t pitch);
+
+typedef struct {
+  float x, y, z;
+  float u, v;
+} Vertex;
+
+static int channel_error(uint32_t a, uint32_t b, int shift) {
+  int d = (int)(a >> shift & 0xff) - (int)(b >> shift & 0xff);
+  return d < 0 ? -d : d;
+}
+
+static int max_error(const uint32_t *a, const uint32_t *b) {
+  int worst = 0;
+  for (int i = 0; i < 16; i++)
+    for (int shift = 0; shift < 24; shift += 8) {
+      int e = channel_error(a[i], b[i], shift);
+      if (e > worst) worst = e;
+    }
+  return worst;
+}
+
+static void check_codec(void) {
+  uint32_t texels[16], decoded[16];
+  BYTE block[8];
+
+  // Flat colours come back almost exactly
+  for (int i = 0; i < 16; i++) texels[i] = 0xffff0000u;
+  etc1_encode_block(texels, block);
+  etc1_decode_argb(block, 1, decoded, 16);
+  assert(max_error(texels, decoded) <= 2);
+  uint16_t rgb565[16];
+  etc1_decode_rgb565(block, 1, rgb565, 8);
+  assert(rgb565[0] == 0xf800 && rgb565[15] == 0xf800);
+
+  // Two unrelated halves pick individual mode and a flip
+  for (int y = 0; y < 4; y++)
+    for (int x = 0; x < 4; x++)
+      texels[y * 4 + x] = y < 2 ? 0xff2040e0u : 0xffe0c020u;
+  etc1_encode_block(texels, block);
+  assert(block[3] & 1);
+  etc1_decode_argb(block, 1, decoded, 16);
+  assert(max_error(texels, decoded) <= 12);
+
+  // A grey ramp stays within the modifier table's reach
+  for (int i = 0; i < 16; i++) {
+    uint32_t v = (uint32_t)(i * 16);
+    texels[i] = 0xff000000u | v << 16 | v << 8 | v;
+  }
+  etc1_encode_block(texels, block);
+  etc1_decode_argb(block, 1, decoded, 16);
+  assert(max_error(texels, decoded) <= 40);
+}
+
+// 8x8, two levels of solid green ETC1; the alpha plane hides the right half
+static BYTE *build_container(UINT *size, BOOL alpha) {
+  uint32_t green[16];
+  BYTE block[8];
+  for (int i = 0; i < 16; i++) green[i] = 0xff00ff00u;
+  etc1_encode_block(green, block);
+  UINT blocks = 4 + 1, planes = alpha ? 64 + 16 : 0;
+  *size = sizeof(D3DGLES_COOKED_HEADER) + blocks * 8 + planes;
+  BYTE *data = calloc(1, *size);
+  D3DGLES_COOKED_HEADER header = {D3DGLES_COOKED_MAGIC, D3DGLES_COOKED_VERSION, 8, 8, 2,
+                                  alpha ? D3DGLES_COOKED_ALPHA : 0, {0, 0}};
+  memcpy(data, &header, sizeof(header));
+  BYTE *p = data + sizeof(header);
+  for (UINT i = 0; i < blocks; i++, p += 8) memcpy(p, block, 8);
+  for (UINT y = 0; alpha && y < 8; y++)
+    for (UINT x = 0; x < 8; x++) *p++ = x < 4 ? 0xff : 0x00;
+  if (alpha) memset(p, 0xff, 16);
+  return data;
+}
+
+static void draw(IDirect3DDevice8 *device, unsigned char pixels[8 * 8 * 4]) {
+  glClear(GL_COLOR_BUFFER_BIT);
+  HRESULT hr = device->lpVtbl->DrawIndexedPrimitive(
+      device, D3DPT_TRIANGLELIST, 0, 4, 0, 2);
+  assert(hr == D3D_OK);
+  glReadPixels(0, 0, 8, 8, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+}
+
+static const unsigned char *pixel_at(const unsigned char *pixels, int x, int y) {
+  return pixels + (y * 8 + x) * 4;
+}
+
+int main(void) {
+  check_codec();
+
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+  assert(d3d->lpVtbl->CheckDeviceFormat(d3d, D3DADAPTER_DEFAULT,
+                                        D3DDEVTYPE_HAL, D3DFMT_X8R8G8B8, 0,
+                                        D3DRTYPE_TEXTURE, D3DFMT_ETC1) == D3D_OK);
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_TEX1;
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 4 * sizeof(Vertex),
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  Vertex quad[4] = {{-1.0f, -1.0f, 0.5f, 0.0f, 1.0f},
+                    {1.0f, -1.0f, 0.5f, 1.0f, 1.0f},
+                    {-1.0f, 1.0f, 0.5f, 0.0f, 0.0f},
+                    {1.0f, 1.0f, 0.5f, 1.0f, 0.0f}};
+  BYTE *data;
+  vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  memcpy(data, quad, sizeof(quad));
+  vb->lpVtbl->Unlock(vb);
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+
+  device->lpVtbl->SetVertexShader(device, fvf);
+  device->lpVtbl->SetStreamSource(device, 0, vb, sizeof(Vertex));
+  device->lpVtbl->SetIndices(device, ib, 0);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+  // Anything but a well-formed container is rejected
+  UINT size;
+  BYTE *cooked = build_container(&size, FALSE);
+  IDirect3DTexture8 *texture = NULL;
+  assert(D3DXCreateTextureFromFileInMemory(device, cooked, size - 1,
+                                           &texture) == D3DXERR_INVALIDDATA);
+  cooked[0] ^= 0xff;
+  assert(D3DXCreateTextureFromFileInMemory(device, cooked, size, &texture) ==
+         D3DXERR_INVALIDDATA);
+  cooked[0] ^= 0xff;
+
+  // Opaque containers sample straight from the blocks
+  D3DGLES_STATS before, after;
+  D3DGLESGetDeviceStats(device, &before);
+  hr = D3DXCreateTextureFromFileInMemory(device, cooked, size, &texture);
+  assert(hr == D3D_OK && texture);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.TextureUploadBytes > before.TextureUploadBytes);
+  D3DSURFACE_DESC desc;
+  texture->lpVtbl->GetLevelDesc(texture, 1, &desc);
+  assert(desc.Format == D3DFMT_ETC1 && desc.Width == 4);
+  device->lpVtbl->SetTexture(device, 0, texture);
+  unsigned char pixels[8 * 8 * 4];
+  draw(device, pixels);
+  const unsigned char *p = pixel_at(pixels, 6, 4);
+  assert(p[0] < 8 && p[1] > 247 && p[2] < 8);
+  device->lpVtbl->SetTexture(device, 0, NULL);
+  texture->lpVtbl->Release(texture);
+  free(cooked);
+
+  // The alpha plane blends out the right half
+  cooked = build_container(&size, TRUE);
+  hr = D3DXCreateTextureFromFileInMemory(device, cooked, size, &texture);
+  assert(hr == D3D_OK);
+  free(cooked);
+  device->lpVtbl->SetRenderState(device, D3DRS_ALPHABLENDENABLE, TRUE);
+  device->lpVtbl->SetRenderState(device, D3DRS_SRCBLEND, D3DBLEND_SRCALPHA);
+  device->lpVtbl->SetRenderState(device, D3DRS_DESTBLEND, D3DBLEND_INVSRCALPHA);
+  device->lpVtbl->SetTexture(device, 0, texture);
+  draw(device, pixels);
+  assert(pixel_at(pixels, 1, 4)[1] > 247);
+  assert(pixel_at(pixels, 6, 4)[1] < 8);
+
+  // Unbinding drops the plane so plain textures are opaque again
+  device->lpVtbl->SetTexture(device, 0, NULL);
+  draw(device, pixels);
+  assert(pixel_at(pixels, 6, 4)[1] == 255);
+  assert(glGetError() == GL_NO_ERROR);
+  texture->lpVtbl->Release(texture);
+
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
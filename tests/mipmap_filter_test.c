@@ -0,0 +1,201 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Internal filter entry points, declared for direct checks
+typedef struct GLES_WorkerPool GLES_WorkerPool;
+GLES_WorkerPool *workers_create(unsigned threads);
+void workers_destroy(GLES_WorkerPool *pool);
+HRESULT texfilter_downsample(D3DFORMAT format, UINT texel_size, const void *src,
+                             UINT src_width, UINT src_height, void *dst,
+                             UINT dst_width, UINT dst_height, DWORD filter,
+                             GLES_WorkerPool *pool);
+
+typedef struct {
+  float x, y, z;
+  float u, v;
+} Vertex;
+
+static void check_filters(void) {
+  uint32_t argb[4] = {0x00000000, 0xffffffff, 0x00000000, 0xffffffff};
+  uint32_t out32 = 0;
+  assert(texfilter_downsample(D3DFMT_A8R8G8B8, 4, argb, 2, 2, &out32, 1, 1,
+                              D3DX_FILTER_BOX, NULL) == D3D_OK);
+  assert(out32 == 0x80808080);
+  assert(texfilter_downsample(D3DFMT_A8R8G8B8, 4, argb, 2, 2, &out32, 1, 1,
+                              D3DX_FILTER_POINT, NULL) == D3D_OK);
+  assert(out32 == 0x00000000);
+
+  // Packed formats average per bit field
+  uint16_t rgb565[4] = {0xf800, 0x0000, 0xf800, 0x0000};
+  uint16_t out16 = 0;
+  assert(texfilter_downsample(D3DFMT_R5G6B5, 2, rgb565, 2, 2, &out16, 1, 1,
+                              D3DX_DEFAULT, NULL) == D3D_OK);
+  assert(out16 == 0x8000);
+
+  // The triangle filter keeps a flat image flat, edges included
+  uint16_t flat[8 * 8], flat_out[4 * 4];
+  for (int i = 0; i < 64; i++) flat[i] = 0x7f40;
+  assert(texfilter_downsample(D3DFMT_A8L8, 2, flat, 8, 8, flat_out, 4, 4,
+                              D3DX_FILTER_TRIANGLE, NULL) == D3D_OK);
+  for (int i = 0; i < 16; i++) assert(flat_out[i] == 0x7f40);
+  assert(texfilter_downsample(D3DFMT_A8L8, 2, flat, 8, 8, flat_out, 4, 4, 99,
+                              NULL) == D3DERR_INVALIDCALL);
+
+  // Spreading rows over threads gives the same result as one thread
+  const UINT size = 512;
+  uint32_t *src = malloc(size * size * 4);
+  uint32_t *single = malloc(size / 2 * size / 2 * 4);
+  uint32_t *threaded = malloc(size / 2 * size / 2 * 4);
+  assert(src && single && threaded);
+  uint32_t seed = 12345;
+  for (UINT i = 0; i < size * size; i++) src[i] = seed = seed * 1664525u + 1013904223u;
+  GLES_WorkerPool *pool = workers_create(3);
+  assert(texfilter_downsample(D3DFMT_A8R8G8B8, 4, src, size, size, single,
+                              size / 2, size / 2, D3DX_FILTER_TRIANGLE,
+                              NULL) == D3D_OK);
+  assert(texfilter_downsample(D3DFMT_A8R8G8B8, 4, src, size, size, threaded,
+                              size / 2, size / 2, D3DX_FILTER_TRIANGLE,
+                              pool) == D3D_OK);
+  assert(memcmp(single, threaded, size / 2 * size / 2 * 4) == 0);
+  workers_destroy(pool);
+  free(threaded);
+  free(single);
+  free(src);
+}
+
+// 64x64 texture with a one-texel black/white checkerboard on level 0
+static IDirect3DTexture8 *checker_texture(IDirect3DDevice8 *device) {
+  IDirect3DTexture8 *texture = NULL;
+  HRESULT hr = device->lpVtbl->CreateTexture(device, 64, 64, 0, 0,
+                                             D3DFMT_X8R8G8B8, D3DPOOL_MANAGED,
+                                             &texture);
+  assert(hr == D3D_OK && texture);
+  D3DLOCKED_RECT rect;
+  hr = texture->lpVtbl->LockRect(texture, 0, &rect, NULL, 0);
+  assert(hr == D3D_OK);
+  for (UINT y = 0; y < 64; y++) {
+    unsigned int *row = (unsigned int *)((BYTE *)rect.pBits + y * rect.Pitch);
+    for (UINT x = 0; x < 64; x++) row[x] = (x + y) & 1 ? 0xffffffff : 0;
+  }
+  texture->lpVtbl->UnlockRect(texture, 0);
+  return texture;
+}
+
+// Draws `texture` over the 8x8 screen from its 8x8 mip level
+static void draw_mip(IDirect3DDevice8 *device, IDirect3DTexture8 *texture,
+                     unsigned char pixel[4]) {
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_MINFILTER,
+                                       D3DTEXF_POINT);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_MIPFILTER,
+                                       D3DTEXF_POINT);
+  device->lpVtbl->SetTexture(device, 0, texture);
+  glClear(GL_COLOR_BUFFER_BIT);
+  HRESULT hr = device->lpVtbl->DrawIndexedPrimitive(
+      device, D3DPT_TRIANGLELIST, 0, 4, 0, 2);
+  assert(hr == D3D_OK);
+  glReadPixels(3, 3, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+  device->lpVtbl->SetTexture(device, 0, NULL);
+}
+
+int main(void) {
+  check_filters();
+
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_TEX1;
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 4 * sizeof(Vertex),
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  Vertex quad[4] = {{-1.0f, -1.0f, 0.5f, 0.0f, 1.0f},
+                    {1.0f, -1.0f, 0.5f, 1.0f, 1.0f},
+                    {-1.0f, 1.0f, 0.5f, 0.0f, 0.0f},
+                    {1.0f, 1.0f, 0.5f, 1.0f, 0.0f}};
+  BYTE *data;
+  vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  memcpy(data, quad, sizeof(quad));
+  vb->lpVtbl->Unlock(vb);
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+
+  device->lpVtbl->SetVertexShader(device, fvf);
+  device->lpVtbl->SetStreamSource(device, 0, vb, sizeof(Vertex));
+  device->lpVtbl->SetIndices(device, ib, 0);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  glClearColor(0.0f, 0.0f, 1.0f, 1.0f);
+
+  // Levels = 0 builds the full chain; D3DXFilterTexture fills it on the CPU
+  D3DGLES_STATS before, after;
+  IDirect3DTexture8 *texture = checker_texture(device);
+  D3DSURFACE_DESC desc;
+  assert(texture->lpVtbl->GetLevelDesc(texture, 6, &desc) == D3D_OK &&
+         desc.Width == 1 && desc.Height == 1);
+  assert(texture->lpVtbl->GetLevelDesc(texture, 7, &desc) ==
+         D3DERR_INVALIDCALL);
+  assert(D3DXFilterTexture(texture, NULL, 1, D3DX_FILTER_BOX) ==
+         D3DERR_INVALIDCALL);
+  D3DGLESGetDeviceStats(device, &before);
+  hr = D3DXFilterTexture(texture, NULL, (UINT)D3DX_DEFAULT, D3DX_FILTER_BOX);
+  assert(hr == D3D_OK);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.MipLevelsFiltered - before.MipLevelsFiltered == 6);
+  unsigned char pixel[4];
+  draw_mip(device, texture, pixel);
+  assert(pixel[0] >= 126 && pixel[0] <= 130 && pixel[2] == pixel[0]);
+
+  // Point sampling picks one checker colour at every level
+  hr = D3DXFilterTexture(texture, NULL, 0, D3DX_FILTER_POINT);
+  assert(hr == D3D_OK);
+  draw_mip(device, texture, pixel);
+  assert(pixel[0] == 0 && pixel[1] == 0 && pixel[2] == 0);
+  texture->lpVtbl->Release(texture);
+
+  // With GL_GENERATE_MIPMAP the level 0 upload builds the chain
+  hr = D3DGLESSetDeviceOption(device, D3DGLES_OPTION_AUTOGEN_MIPMAP, TRUE);
+  assert(hr == D3D_OK);
+  D3DGLESGetDeviceStats(device, &before);
+  texture = checker_texture(device);
+  assert(D3DXFilterTexture(texture, NULL, 0, D3DX_FILTER_BOX) == D3D_OK);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.MipLevelsFiltered == before.MipLevelsFiltered);
+  assert(after.TextureDeferredBytes == before.TextureDeferredBytes);
+  draw_mip(device, texture, pixel);
+  assert(pixel[0] >= 120 && pixel[0] <= 136);
+  texture->lpVtbl->Release(texture);
+
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
@@ -0,0 +1,163 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <string.h>
+
+// Forward declarations for helper functions not in the public header
+UINT WINAPI D3DXGetFVFVertexSize(DWORD FVF);
+
+typedef struct {
+  float x, y, z;
+  unsigned int color;
+} Vertex;
+
+static const unsigned int colors[4] = {0xffff0000, 0xff00ff00, 0xff0000ff,
+                                       0xffffffff};
+
+int main(void) {
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  // Unknown interfaces are still refused
+  void *unknown = NULL;
+  GUID bogus = {0x12345678, 0x1234, 0x1234, {1, 2, 3, 4, 5, 6, 7, 8}};
+  assert(device->lpVtbl->QueryInterface(device, &bogus, &unknown) != D3D_OK);
+
+  ID3DGLESMultiDraw *multi = NULL;
+  hr = device->lpVtbl->QueryInterface(device, &IID_ID3DGLESMultiDraw,
+                                      (void **)&multi);
+  assert(hr == D3D_OK && multi);
+
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_DIFFUSE;
+  UINT stride = D3DXGetFVFVertexSize(fvf);
+  assert(stride == sizeof(Vertex));
+
+  // Four colored unit quads sharing one six-index list via base vertices
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 16 * stride,
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  BYTE *data;
+  hr = vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  assert(hr == D3D_OK);
+  for (int i = 0; i < 4; i++) {
+    Vertex quad[4] = {{0.0f, 0.0f, 0.5f, colors[i]},
+                      {1.0f, 0.0f, 0.5f, colors[i]},
+                      {0.0f, 1.0f, 0.5f, colors[i]},
+                      {1.0f, 1.0f, 0.5f, colors[i]}};
+    memcpy(data + i * sizeof(quad), quad, sizeof(quad));
+  }
+  vb->lpVtbl->Unlock(vb);
+
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  hr = ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  assert(hr == D3D_OK);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+
+  device->gles->fvf = fvf;
+  hr = device->lpVtbl->SetStreamSource(device, 0, vb, stride);
+  assert(hr == D3D_OK);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+
+  D3DXMATRIX worlds[4];
+  for (int i = 0; i < 4; i++) {
+    D3DXMatrixIdentity(&worlds[i]);
+    worlds[i]._41 = (float)(i % 2) - 1.0f;
+    worlds[i]._42 = (float)(i / 2) - 1.0f;
+  }
+
+  // Reference: one DrawIndexedPrimitive per quad
+  unsigned char reference[8 * 8 * 4];
+  unsigned char multi_pixels[8 * 8 * 4];
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  for (int i = 0; i < 4; i++) {
+    hr = device->lpVtbl->SetIndices(device, ib, i * 4);
+    assert(hr == D3D_OK);
+    device->lpVtbl->SetTransform(device, D3DTS_WORLD, &worlds[i]);
+    hr = device->lpVtbl->DrawIndexedPrimitive(device, D3DPT_TRIANGLELIST, 0, 4,
+                                              0, 2);
+    assert(hr == D3D_OK);
+  }
+  glReadPixels(0, 0, 8, 8, GL_RGBA, GL_UNSIGNED_BYTE, reference);
+  assert(memcmp(reference, reference + 4 * 4, 4) != 0);
+  assert(memcmp(reference, reference + (4 * 8) * 4, 4) != 0);
+
+  // The same quads in a single call
+  D3DGLES_DRAW draws[4];
+  for (int i = 0; i < 4; i++) {
+    draws[i].PrimitiveType = D3DPT_TRIANGLELIST;
+    draws[i].StartIndex = 0;
+    draws[i].PrimitiveCount = 2;
+    draws[i].BaseVertexIndex = i * 4;
+    draws[i].pWorld = &worlds[i];
+  }
+  hr = device->lpVtbl->SetIndices(device, ib, 0);
+  assert(hr == D3D_OK);
+  D3DGLES_STATS before, after;
+  D3DGLESGetDeviceStats(device, &before);
+  glClear(GL_COLOR_BUFFER_BIT);
+  hr = multi->lpVtbl->DrawIndexedPrimitives(multi, draws, 4);
+  assert(hr == D3D_OK);
+  glReadPixels(0, 0, 8, 8, GL_RGBA, GL_UNSIGNED_BYTE, multi_pixels);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.DrawCalls - before.DrawCalls == 4);
+  assert(memcmp(reference, multi_pixels, sizeof(reference)) == 0);
+
+  // With batching enabled the records merge into one draw
+  D3DGLESSetDeviceOption(device, D3DGLES_OPTION_DYNAMIC_BATCHING, TRUE);
+  before = after;
+  glClear(GL_COLOR_BUFFER_BIT);
+  hr = multi->lpVtbl->DrawIndexedPrimitives(multi, draws, 4);
+  assert(hr == D3D_OK);
+  device->lpVtbl->EndScene(device);
+  glReadPixels(0, 0, 8, 8, GL_RGBA, GL_UNSIGNED_BYTE, multi_pixels);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.BatchedDraws - before.BatchedDraws == 4);
+  assert(after.DrawCalls - before.DrawCalls == 1);
+  assert(memcmp(reference, multi_pixels, sizeof(reference)) == 0);
+  D3DGLESSetDeviceOption(device, D3DGLES_OPTION_DYNAMIC_BATCHING, FALSE);
+
+  // One bad record rejects the whole array
+  draws[2].StartIndex = 3;
+  before = after;
+  hr = multi->lpVtbl->DrawIndexedPrimitives(multi, draws, 4);
+  assert(hr == D3DERR_INVALIDCALL);
+  draws[2].StartIndex = 0;
+  draws[3].PrimitiveType = D3DPT_TRIANGLEFAN;
+  hr = multi->lpVtbl->DrawIndexedPrimitives(multi, draws, 4);
+  assert(hr == D3DERR_NOTAVAILABLE);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.DrawCalls == before.DrawCalls);
+
+  multi->lpVtbl->Release(multi);
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
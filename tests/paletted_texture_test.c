@@ -0,0 +1,197 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <string.h>
+
+typedef struct {
+  float x, y, z;
+  float u, v;
+} Vertex;
+
+// Index 1 takes `color`, index 2 is white, the rest black
+static void set_palette(IDirect3DDevice8 *device, UINT number, BYTE r, BYTE g,
+                        BYTE b) {
+  PALETTEENTRY entries[256];
+  memset(entries, 0, sizeof(entries));
+  for (int i = 0; i < 256; i++) entries[i].peFlags = 0xff;
+  entries[1] = (PALETTEENTRY){r, g, b, 0xff};
+  entries[2] = (PALETTEENTRY){0xff, 0xff, 0xff, 0xff};
+  HRESULT hr = device->lpVtbl->SetPaletteEntries(device, number, entries);
+  assert(hr == D3D_OK);
+}
+
+static void fill_level(IDirect3DTexture8 *texture, UINT level, BYTE index) {
+  D3DLOCKED_RECT rect;
+  D3DSURFACE_DESC desc;
+  texture->lpVtbl->GetLevelDesc(texture, level, &desc);
+  HRESULT hr = texture->lpVtbl->LockRect(texture, level, &rect, NULL, 0);
+  assert(hr == D3D_OK && (UINT)rect.Pitch == desc.Width);
+  memset(rect.pBits, index, desc.Width * desc.Height);
+  assert(texture->lpVtbl->UnlockRect(texture, level) == D3D_OK);
+}
+
+static void draw(IDirect3DDevice8 *device, unsigned char pixels[8 * 8 * 4]) {
+  glClear(GL_COLOR_BUFFER_BIT);
+  HRESULT hr = device->lpVtbl->DrawIndexedPrimitive(
+      device, D3DPT_TRIANGLELIST, 0, 4, 0, 2);
+  assert(hr == D3D_OK);
+  glReadPixels(0, 0, 8, 8, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+}
+
+static void check_pixel(const unsigned char *pixels, int x, int y, int r, int g,
+                        int b) {
+  const unsigned char *p = pixels + (y * 8 + x) * 4;
+  assert(p[0] == r && p[1] == g && p[2] == b);
+}
+
+int main(void) {
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+  assert(d3d->lpVtbl->CheckDeviceFormat(d3d, D3DADAPTER_DEFAULT,
+                                        D3DDEVTYPE_HAL, D3DFMT_X8R8G8B8, 0,
+                                        D3DRTYPE_TEXTURE, D3DFMT_P8) == D3D_OK);
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+  D3DCAPS8 caps;
+  device->lpVtbl->GetDeviceCaps(device, &caps);
+  assert(caps.TextureCaps & D3DPTEXTURECAPS_ALPHAPALETTE);
+
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_TEX1;
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 4 * sizeof(Vertex),
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  Vertex quad[4] = {{-1.0f, -1.0f, 0.5f, 0.0f, 1.0f},
+                    {1.0f, -1.0f, 0.5f, 1.0f, 1.0f},
+                    {-1.0f, 1.0f, 0.5f, 0.0f, 0.0f},
+                    {1.0f, 1.0f, 0.5f, 1.0f, 0.0f}};
+  BYTE *data;
+  vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  memcpy(data, quad, sizeof(quad));
+  vb->lpVtbl->Unlock(vb);
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+
+  device->lpVtbl->SetVertexShader(device, fvf);
+  device->lpVtbl->SetStreamSource(device, 0, vb, sizeof(Vertex));
+  device->lpVtbl->SetIndices(device, ib, 0);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+  // Palettes must be filled before they can be selected
+  assert(device->lpVtbl->SetCurrentTexturePalette(device, 1) ==
+         D3DERR_INVALIDCALL);
+  set_palette(device, 0, 0xff, 0, 0);
+  set_palette(device, 1, 0, 0xff, 0);
+  PALETTEENTRY entries[256];
+  assert(device->lpVtbl->GetPaletteEntries(device, 1, entries) == D3D_OK);
+  assert(entries[1].peGreen == 0xff && entries[1].peRed == 0);
+  assert(device->lpVtbl->GetPaletteEntries(device, 7, entries) ==
+         D3DERR_INVALIDCALL);
+  assert(device->lpVtbl->SetCurrentTexturePalette(device, 0) == D3D_OK);
+
+  IDirect3DTexture8 *texture = NULL;
+  hr = device->lpVtbl->CreateTexture(device, 8, 8, 1, 0, D3DFMT_P8,
+                                     D3DPOOL_MANAGED, &texture);
+  assert(hr == D3D_OK && texture);
+  fill_level(texture, 0, 1);
+  device->lpVtbl->SetTexture(device, 0, texture);
+
+  D3DGLES_STATS before, after;
+  unsigned char pixels[8 * 8 * 4];
+  D3DGLESGetDeviceStats(device, &before);
+  draw(device, pixels);
+  check_pixel(pixels, 4, 4, 255, 0, 0);
+
+  // Switching palettes builds a second copy once, then flips between them
+  device->lpVtbl->SetCurrentTexturePalette(device, 1);
+  draw(device, pixels);
+  check_pixel(pixels, 4, 4, 0, 255, 0);
+  device->lpVtbl->SetCurrentTexturePalette(device, 0);
+  draw(device, pixels);
+  check_pixel(pixels, 4, 4, 255, 0, 0);
+  device->lpVtbl->SetCurrentTexturePalette(device, 1);
+  draw(device, pixels);
+  check_pixel(pixels, 4, 4, 0, 255, 0);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.PaletteUploads - before.PaletteUploads == 1);
+  UINT current = 0;
+  assert(device->lpVtbl->GetCurrentTexturePalette(device, &current) == D3D_OK &&
+         current == 1);
+
+  // Editing the palette in use rebuilds the bound copy
+  before = after;
+  set_palette(device, 1, 0, 0, 0xff);
+  draw(device, pixels);
+  check_pixel(pixels, 4, 4, 0, 0, 255);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.PaletteUploads - before.PaletteUploads == 1);
+
+  // Locks return the indices, and a sub-rectangle updates only its texels
+  D3DLOCKED_RECT rect;
+  RECT corner = {0, 0, 4, 4};
+  hr = texture->lpVtbl->LockRect(texture, 0, &rect, &corner, 0);
+  assert(hr == D3D_OK && rect.Pitch == 4 && ((BYTE *)rect.pBits)[0] == 1);
+  for (int y = 0; y < 4; y++) memset((BYTE *)rect.pBits + y * rect.Pitch, 2, 4);
+  texture->lpVtbl->UnlockRect(texture, 0);
+  draw(device, pixels);
+  check_pixel(pixels, 1, 6, 255, 255, 255);
+  check_pixel(pixels, 6, 1, 0, 0, 255);
+
+  // Deferred scenes apply the palette each recorded draw was made with
+  hr = D3DGLESSetDeviceOption(device, D3DGLES_OPTION_DEFERRED_SCENE, TRUE);
+  assert(hr == D3D_OK);
+  device->lpVtbl->BeginScene(device);
+  device->lpVtbl->SetCurrentTexturePalette(device, 0);
+  draw(device, pixels);
+  device->lpVtbl->EndScene(device);
+  glReadPixels(0, 0, 8, 8, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+  check_pixel(pixels, 6, 1, 255, 0, 0);
+  hr = D3DGLESSetDeviceOption(device, D3DGLES_OPTION_DEFERRED_SCENE, FALSE);
+  assert(hr == D3D_OK);
+  device->lpVtbl->SetTexture(device, 0, NULL);
+  texture->lpVtbl->Release(texture);
+
+  // Mip chains upload with the palette in one call
+  hr = device->lpVtbl->CreateTexture(device, 8, 8, 0, 0, D3DFMT_P8,
+                                     D3DPOOL_MANAGED, &texture);
+  assert(hr == D3D_OK);
+  for (UINT level = 0; level < 4; level++) fill_level(texture, level, 1);
+  assert(D3DXFilterTexture(texture, NULL, 0, D3DX_FILTER_BOX) ==
+         D3DERR_INVALIDCALL);
+  device->lpVtbl->SetTexture(device, 0, texture);
+  draw(device, pixels);
+  check_pixel(pixels, 4, 4, 255, 0, 0);
+  assert(glGetError() == GL_NO_ERROR);
+  device->lpVtbl->SetTexture(device, 0, NULL);
+  texture->lpVtbl->Release(texture);
+
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
@@ -0,0 +1,199 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <string.h>
+
+typedef struct {
+  float x, y, z;
+  float u, v;
+} Vertex;
+
+#define TEXTURE_BYTES (4 * 4 * 4)
+
+static IDirect3DTexture8 *solid_texture(IDirect3DDevice8 *device,
+                                        unsigned int color) {
+  IDirect3DTexture8 *texture = NULL;
+  HRESULT hr = device->lpVtbl->CreateTexture(device, 4, 4, 1, 0,
+                                             D3DFMT_A8R8G8B8, D3DPOOL_MANAGED,
+                                             &texture);
+  assert(hr == D3D_OK && texture);
+  D3DLOCKED_RECT rect;
+  texture->lpVtbl->LockRect(texture, 0, &rect, NULL, 0);
+  for (int y = 0; y < 4; y++) {
+    unsigned int *row = (unsigned int *)((BYTE *)rect.pBits + y * rect.Pitch);
+    for (int x = 0; x < 4; x++) row[x] = color;
+  }
+  texture->lpVtbl->UnlockRect(texture, 0);
+  return texture;
+}
+
+// Quad from the left edge to `right`
+static void fill_quad(IDirect3DVertexBuffer8 *vb, float right) {
+  Vertex quad[4] = {{-1.0f, -1.0f, 0.5f, 0.0f, 1.0f},
+                    {right, -1.0f, 0.5f, 1.0f, 1.0f},
+                    {-1.0f, 1.0f, 0.5f, 0.0f, 0.0f},
+                    {right, 1.0f, 0.5f, 1.0f, 0.0f}};
+  BYTE *data;
+  vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  memcpy(data, quad, sizeof(quad));
+  vb->lpVtbl->Unlock(vb);
+}
+
+// Colour of the middle pixel with `texture` on stage 0
+static void draw(IDirect3DDevice8 *device, IDirect3DTexture8 *texture,
+                 unsigned char pixel[4]) {
+  device->lpVtbl->SetTexture(device, 0, texture);
+  glClear(GL_COLOR_BUFFER_BIT);
+  HRESULT hr = device->lpVtbl->DrawIndexedPrimitive(
+      device, D3DPT_TRIANGLELIST, 0, 4, 0, 2);
+  assert(hr == D3D_OK);
+  glReadPixels(4, 4, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+}
+
+static D3DGLES_STATS stats(IDirect3DDevice8 *device) {
+  D3DGLES_STATS s;
+  D3DGLESGetDeviceStats(device, &s);
+  return s;
+}
+
+int main(void) {
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_TEX1;
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 4 * sizeof(Vertex),
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  fill_quad(vb, 1.0f);
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  BYTE *data;
+  ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+  size_t buffer_bytes = 4 * sizeof(Vertex) + sizeof(indices);
+
+  device->lpVtbl->SetVertexShader(device, fvf);
+  device->lpVtbl->SetStreamSource(device, 0, vb, sizeof(Vertex));
+  device->lpVtbl->SetIndices(device, ib, 0);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+  IDirect3DTexture8 *red = solid_texture(device, 0xffff0000);
+  IDirect3DTexture8 *green = solid_texture(device, 0xff00ff00);
+  IDirect3DTexture8 *blue = solid_texture(device, 0xff0000ff);
+  assert(stats(device).ResidentBytes == buffer_bytes + 3 * TEXTURE_BYTES);
+  unsigned char p[4];
+
+  // Shrinking the budget evicts the least recently bound texture; bound
+  // buffers stay
+  DWORD budget = (DWORD)(buffer_bytes + 2 * TEXTURE_BYTES);
+  assert(D3DGLESSetDeviceOption(device, D3DGLES_OPTION_MANAGED_BUDGET, 0) ==
+         D3DERR_INVALIDCALL);
+  assert(D3DGLESSetDeviceOption(device, D3DGLES_OPTION_MANAGED_BUDGET,
+                                budget) == D3D_OK);
+  D3DGLES_STATS s = stats(device);
+  assert(s.Evictions == 1 && s.ResidentBytes == budget);
+  assert(device->lpVtbl->GetAvailableTextureMem(device) == 0);
+
+  // Binding it re-uploads its texels, evicting the next one in line
+  draw(device, red, p);
+  assert(p[0] == 255 && p[1] == 0 && p[2] == 0);
+  s = stats(device);
+  assert(s.RestoreBytes == TEXTURE_BYTES && s.Evictions == 2);
+  assert(s.ResidentBytes == budget);
+
+  // Priority outranks recency: blue was bound longest ago but survives
+  assert(blue->lpVtbl->SetPriority(blue, 1) == 0);
+  assert(blue->lpVtbl->GetPriority(blue) == 1);
+  draw(device, NULL, p);
+  green->lpVtbl->PreLoad(green);
+  s = stats(device);
+  assert(s.RestoreBytes == 2 * TEXTURE_BYTES && s.Evictions == 3);
+  draw(device, blue, p);
+  assert(p[0] == 0 && p[1] == 0 && p[2] == 255);
+  draw(device, green, p);
+  assert(p[0] == 0 && p[1] == 255 && p[2] == 0);
+  assert(stats(device).RestoreBytes == 2 * TEXTURE_BYTES);
+
+  // Writing an evicted texture updates its copy for the next restore
+  draw(device, red, p);
+  assert(p[0] == 255 && p[1] == 0 && p[2] == 0);
+  device->lpVtbl->ResourceManagerDiscardBytes(device, 0);
+  D3DLOCKED_RECT rect;
+  green->lpVtbl->LockRect(green, 0, &rect, NULL, 0);
+  for (int y = 0; y < 4; y++) {
+    unsigned int *row = (unsigned int *)((BYTE *)rect.pBits + y * rect.Pitch);
+    for (int x = 0; x < 4; x++) row[x] = 0xffffffff;
+  }
+  green->lpVtbl->UnlockRect(green, 0);
+  draw(device, green, p);
+  assert(p[0] == 255 && p[1] == 255 && p[2] == 255);
+
+  // Locks start from that copy, so texels left alone keep their colour
+  red->lpVtbl->LockRect(red, 0, &rect, NULL, D3DLOCK_READONLY);
+  assert(*(unsigned int *)rect.pBits == 0xffff0000);
+  red->lpVtbl->UnlockRect(red, 0);
+  green->lpVtbl->LockRect(green, 0, &rect, NULL, 0);
+  for (int y = 0; y < 4; y++) {
+    unsigned int *row = (unsigned int *)((BYTE *)rect.pBits + y * rect.Pitch);
+    for (int x = 0; x < 4; x++) assert(row[x] == 0xffffffff);
+  }
+  *(unsigned int *)rect.pBits = 0xff000000;
+  green->lpVtbl->UnlockRect(green, 0);
+  draw(device, green, p);
+  assert(p[0] == 255 && p[1] == 255 && p[2] == 255);
+
+  // Discarding everything spares only what is bound; unbound buffers go too
+  // and come back from their shadow copies
+  device->lpVtbl->SetStreamSource(device, 0, NULL, 0);
+  device->lpVtbl->SetIndices(device, NULL, 0);
+  device->lpVtbl->ResourceManagerDiscardBytes(device, 0);
+  assert(stats(device).ResidentBytes == TEXTURE_BYTES);
+  assert(device->lpVtbl->GetAvailableTextureMem(device) ==
+         budget - TEXTURE_BYTES);
+  fill_quad(vb, 0.0f);
+  device->lpVtbl->SetStreamSource(device, 0, vb, sizeof(Vertex));
+  device->lpVtbl->SetIndices(device, ib, 0);
+  draw(device, blue, p);
+  assert(p[0] == 0 && p[1] == 0 && p[2] == 0);
+  glReadPixels(1, 4, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, p);
+  assert(p[0] == 0 && p[1] == 0 && p[2] == 255);
+  assert(stats(device).ResidentBytes == buffer_bytes + 2 * TEXTURE_BYTES);
+  assert(glGetError() == GL_NO_ERROR);
+
+  device->lpVtbl->SetTexture(device, 0, NULL);
+  red->lpVtbl->Release(red);
+  green->lpVtbl->Release(green);
+  blue->lpVtbl->Release(blue);
+  assert(stats(device).ResidentBytes == buffer_bytes);
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  assert(stats(device).ResidentBytes == 0);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
@@ -0,0 +1,158 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <string.h>
+
+// Forward declarations for helper functions not in the public header
+UINT WINAPI D3DXGetFVFVertexSize(DWORD FVF);
+
+typedef struct {
+  float x, y, z, rhw;
+  unsigned int color;
+} ScreenVertex;
+
+typedef struct {
+  float x, y, z;
+  unsigned int color;
+} Vertex;
+
+static const unsigned char *pixel_at(const unsigned char *pixels, int x,
+                                     int y) {
+  // glReadPixels rows start at the bottom; D3D screen rows at the top
+  return pixels + ((7 - y) * 8 + x) * 4;
+}
+
+int main(void) {
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  // Screen-space quad covering pixels [2,6) x [1,3); D3D pixel centers sit
+  // on integer coordinates, so the edges are at -0.5 offsets
+  DWORD screen_fvf = D3DFVF_XYZRHW | D3DFVF_DIFFUSE;
+  UINT screen_stride = D3DXGetFVFVertexSize(screen_fvf);
+  assert(screen_stride == sizeof(ScreenVertex));
+  ScreenVertex screen_quad[4] = {
+      {1.5f, 0.5f, 0.5f, 1.0f, 0xffffffff},
+      {5.5f, 0.5f, 0.5f, 1.0f, 0xffffffff},
+      {1.5f, 2.5f, 0.5f, 1.0f, 0xffffffff},
+      {5.5f, 2.5f, 0.5f, 1.0f, 0xffffffff},
+  };
+  IDirect3DVertexBuffer8 *screen_vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, sizeof(screen_quad),
+                                          D3DUSAGE_WRITEONLY, screen_fvf,
+                                          D3DPOOL_MANAGED, &screen_vb);
+  assert(hr == D3D_OK);
+  BYTE *data;
+  hr = screen_vb->lpVtbl->Lock(screen_vb, 0, 0, &data, 0);
+  assert(hr == D3D_OK);
+  memcpy(data, screen_quad, sizeof(screen_quad));
+  screen_vb->lpVtbl->Unlock(screen_vb);
+
+  // A world-space quad covering the right half of clip space
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_DIFFUSE;
+  Vertex quad[4] = {
+      {0.0f, -1.0f, 0.5f, 0xffffffff},
+      {1.0f, -1.0f, 0.5f, 0xffffffff},
+      {0.0f, 1.0f, 0.5f, 0xffffffff},
+      {1.0f, 1.0f, 0.5f, 0xffffffff},
+  };
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, sizeof(quad),
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK);
+  hr = vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  assert(hr == D3D_OK);
+  memcpy(data, quad, sizeof(quad));
+  vb->lpVtbl->Unlock(vb);
+
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  hr = ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  assert(hr == D3D_OK);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+  hr = device->lpVtbl->SetIndices(device, ib, 0);
+  assert(hr == D3D_OK);
+
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, TRUE);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZFUNC, D3DCMP_ALWAYS);
+
+  unsigned char pixels[8 * 8 * 4];
+  for (int frame = 0; frame < 2; frame++) {
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    device->gles->fvf = screen_fvf;
+    device->lpVtbl->SetStreamSource(device, 0, screen_vb, screen_stride);
+    hr = device->lpVtbl->DrawIndexedPrimitive(device, D3DPT_TRIANGLELIST, 0, 4,
+                                              0, 2);
+    assert(hr == D3D_OK);
+    // The application's depth state survives pre-transformed draws
+    assert(glIsEnabled(GL_DEPTH_TEST));
+
+    glReadPixels(0, 0, 8, 8, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    for (int y = 0; y < 8; y++) {
+      for (int x = 0; x < 8; x++) {
+        int inside = x >= 2 && x < 6 && y >= 1 && y < 3;
+        assert(pixel_at(pixels, x, y)[0] == (inside ? 255 : 0));
+      }
+    }
+
+    // Switching back to transformed vertices restores the D3D transforms
+    glClear(GL_COLOR_BUFFER_BIT);
+    device->gles->fvf = fvf;
+    device->lpVtbl->SetStreamSource(device, 0, vb, sizeof(Vertex));
+    hr = device->lpVtbl->DrawIndexedPrimitive(device, D3DPT_TRIANGLELIST, 0, 4,
+                                              0, 2);
+    assert(hr == D3D_OK);
+    glReadPixels(0, 0, 8, 8, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    assert(pixel_at(pixels, 3, 4)[0] == 0);
+    assert(pixel_at(pixels, 4, 4)[0] == 255);
+    assert(pixel_at(pixels, 7, 0)[0] == 255);
+  }
+
+  // A new viewport refreshes the pixel-space projection
+  D3DVIEWPORT8 viewport = {0, 0, 4, 4, 0.0f, 1.0f};
+  hr = device->lpVtbl->SetViewport(device, &viewport);
+  assert(hr == D3D_OK);
+  glClear(GL_COLOR_BUFFER_BIT);
+  device->gles->fvf = screen_fvf;
+  device->lpVtbl->SetStreamSource(device, 0, screen_vb, screen_stride);
+  hr = device->lpVtbl->DrawIndexedPrimitive(device, D3DPT_TRIANGLELIST, 0, 4, 0,
+                                            2);
+  assert(hr == D3D_OK);
+  glReadPixels(0, 0, 8, 8, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+  // Same pixel size, clipped to the 4x4 viewport in the lower-left corner
+  int lit = 0;
+  for (int i = 0; i < 64; i++) lit += pixels[i * 4] == 255;
+  assert(lit == 4);
+
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  screen_vb->lpVtbl->Release(screen_vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
@@ -0,0 +1,175 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <string.h>
+
+typedef struct {
+  float x, y, z;
+  float u, v;
+} Vertex;
+
+// 2x2 texture: red and green on top, blue and white below
+static IDirect3DTexture8 *quad_texture(IDirect3DDevice8 *device) {
+  IDirect3DTexture8 *texture = NULL;
+  HRESULT hr = device->lpVtbl->CreateTexture(device, 2, 2, 1, 0,
+                                             D3DFMT_X8R8G8B8, D3DPOOL_MANAGED,
+                                             &texture);
+  assert(hr == D3D_OK && texture);
+  D3DLOCKED_RECT rect;
+  texture->lpVtbl->LockRect(texture, 0, &rect, NULL, 0);
+  unsigned int *row = rect.pBits;
+  row[0] = 0xffff0000;
+  row[1] = 0xff00ff00;
+  row = (unsigned int *)((BYTE *)rect.pBits + rect.Pitch);
+  row[0] = 0xff0000ff;
+  row[1] = 0xffffffff;
+  texture->lpVtbl->UnlockRect(texture, 0);
+  return texture;
+}
+
+static void set_stage(IDirect3DDevice8 *device, D3DTEXTURESTAGESTATETYPE type,
+                      DWORD value) {
+  HRESULT hr = device->lpVtbl->SetTextureStageState(device, 0, type, value);
+  assert(hr == D3D_OK);
+}
+
+static void draw(IDirect3DDevice8 *device, unsigned char pixels[8 * 8 * 4]) {
+  glClear(GL_COLOR_BUFFER_BIT);
+  HRESULT hr = device->lpVtbl->DrawIndexedPrimitive(
+      device, D3DPT_TRIANGLELIST, 0, 4, 0, 2);
+  assert(hr == D3D_OK);
+  glReadPixels(0, 0, 8, 8, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+}
+
+static const unsigned char *pixel_at(const unsigned char *pixels, int x, int y) {
+  return pixels + (y * 8 + x) * 4;
+}
+
+static void fill_quad(IDirect3DVertexBuffer8 *vb, float max_uv) {
+  Vertex quad[4] = {{-1.0f, -1.0f, 0.5f, 0.0f, max_uv},
+                    {1.0f, -1.0f, 0.5f, max_uv, max_uv},
+                    {-1.0f, 1.0f, 0.5f, 0.0f, 0.0f},
+                    {1.0f, 1.0f, 0.5f, max_uv, 0.0f}};
+  BYTE *data;
+  vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  memcpy(data, quad, sizeof(quad));
+  vb->lpVtbl->Unlock(vb);
+}
+
+int main(void) {
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_TEX1;
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 4 * sizeof(Vertex),
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  fill_quad(vb, 1.0f);
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  BYTE *data;
+  ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+
+  device->lpVtbl->SetVertexShader(device, fvf);
+  device->lpVtbl->SetStreamSource(device, 0, vb, sizeof(Vertex));
+  device->lpVtbl->SetIndices(device, ib, 0);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+  // Only modes GL ES can express are accepted
+  assert(device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_ADDRESSU, 4) ==
+         D3DERR_INVALIDCALL);
+  assert(device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_MIPFILTER,
+                                              D3DTEXF_ANISOTROPIC) ==
+         D3DERR_INVALIDCALL);
+  assert(device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_MAXMIPLEVEL,
+                                              0) == D3D_OK);
+
+  IDirect3DTexture8 *first = quad_texture(device);
+  IDirect3DTexture8 *second = quad_texture(device);
+  unsigned char pixels[8 * 8 * 4];
+
+  // Point sampling keeps each quadrant a flat colour
+  set_stage(device, D3DTSS_MAGFILTER, D3DTEXF_POINT);
+  set_stage(device, D3DTSS_MINFILTER, D3DTEXF_POINT);
+  device->lpVtbl->SetTexture(device, 0, first);
+  draw(device, pixels);
+  const unsigned char *p = pixel_at(pixels, 3, 6);
+  assert(p[0] == 255 && p[1] == 0 && p[2] == 0);
+
+  // Bilinear sampling blends across the middle
+  set_stage(device, D3DTSS_MAGFILTER, D3DTEXF_LINEAR);
+  draw(device, pixels);
+  p = pixel_at(pixels, 3, 6);
+  assert(p[1] > 0 && p[0] < 255);
+
+  // Clamping repeats the edge texels past 1.0 instead of the texture
+  set_stage(device, D3DTSS_MAGFILTER, D3DTEXF_POINT);
+  fill_quad(vb, 2.0f);
+  draw(device, pixels);
+  p = pixel_at(pixels, 5, 7);
+  assert(p[0] == 255 && p[1] == 0);
+  set_stage(device, D3DTSS_ADDRESSU, D3DTADDRESS_CLAMP);
+  set_stage(device, D3DTSS_ADDRESSV, D3DTADDRESS_CLAMP);
+  draw(device, pixels);
+  p = pixel_at(pixels, 5, 7);
+  assert(p[0] == 0 && p[1] == 255);
+
+  // Each texture object is updated once; rebinding with unchanged
+  // states sends nothing
+  D3DGLES_STATS before, after;
+  device->lpVtbl->SetTexture(device, 0, second);
+  D3DGLESGetDeviceStats(device, &before);
+  for (int i = 0; i < 4; i++) {
+    device->lpVtbl->SetTexture(device, 0, i & 1 ? first : second);
+    draw(device, pixels);
+  }
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.SamplerUpdates == before.SamplerUpdates);
+  p = pixel_at(pixels, 5, 7);
+  assert(p[0] == 0 && p[1] == 255);
+
+  // A change reaches the bound texture now and the other one on its next bind
+  before = after;
+  set_stage(device, D3DTSS_ADDRESSU, D3DTADDRESS_WRAP);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.SamplerUpdates - before.SamplerUpdates == 1);
+  device->lpVtbl->SetTexture(device, 0, second);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.SamplerUpdates - before.SamplerUpdates == 2);
+  assert(glGetError() == GL_NO_ERROR);
+
+  device->lpVtbl->SetTexture(device, 0, NULL);
+  first->lpVtbl->Release(first);
+  second->lpVtbl->Release(second);
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
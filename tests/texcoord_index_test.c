@@ -73,6 +73,10 @@ int main(void) {
 
     hr = device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_TEXCOORDINDEX, 1);
     assert(hr == D3D_OK);
+    hr = device->lpVtbl->SetTextureStageState(device, 1, D3DTSS_COLOROP, D3DTOP_MODULATE);
+    assert(hr == D3D_OK);
+    hr = device->lpVtbl->SetTextureStageState(device, 1, D3DTSS_TEXCOORDINDEX, 0);
+    assert(hr == D3D_OK);
 
     hr = device->lpVtbl->BeginScene(device);
     assert(hr == D3D_OK);
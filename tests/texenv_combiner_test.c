@@ -0,0 +1,178 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <string.h>
+
+typedef struct {
+  float x, y, z;
+  float u0, v0;
+  float u1, v1;
+} Vertex;
+
+static IDirect3DTexture8 *solid_texture(IDirect3DDevice8 *device,
+                                        unsigned int color) {
+  IDirect3DTexture8 *texture = NULL;
+  HRESULT hr = device->lpVtbl->CreateTexture(device, 2, 2, 1, 0,
+                                             D3DFMT_A8R8G8B8, D3DPOOL_MANAGED,
+                                             &texture);
+  assert(hr == D3D_OK && texture);
+  D3DLOCKED_RECT rect;
+  texture->lpVtbl->LockRect(texture, 0, &rect, NULL, 0);
+  for (int y = 0; y < 2; y++) {
+    unsigned int *row = (unsigned int *)((BYTE *)rect.pBits + y * rect.Pitch);
+    row[0] = row[1] = color;
+  }
+  texture->lpVtbl->UnlockRect(texture, 0);
+  return texture;
+}
+
+static void set_stage(IDirect3DDevice8 *device, DWORD stage,
+                      D3DTEXTURESTAGESTATETYPE type, DWORD value) {
+  HRESULT hr = device->lpVtbl->SetTextureStageState(device, stage, type, value);
+  assert(hr == D3D_OK);
+}
+
+// Colour of the middle pixel
+static void draw(IDirect3DDevice8 *device, unsigned char pixel[4]) {
+  glClear(GL_COLOR_BUFFER_BIT);
+  HRESULT hr = device->lpVtbl->DrawIndexedPrimitive(
+      device, D3DPT_TRIANGLELIST, 0, 4, 0, 2);
+  assert(hr == D3D_OK);
+  glReadPixels(4, 4, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+}
+
+static int near(unsigned char value, int expected) {
+  int d = (int)value - expected;
+  return d >= -3 && d <= 3;
+}
+
+int main(void) {
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+  D3DCAPS8 caps;
+  device->lpVtbl->GetDeviceCaps(device, &caps);
+  assert(caps.MaxTextureBlendStages >= 2);
+
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_TEX2;
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 4 * sizeof(Vertex),
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  Vertex quad[4] = {{-1.0f, -1.0f, 0.5f, 0.0f, 1.0f, 0.0f, 1.0f},
+                    {1.0f, -1.0f, 0.5f, 1.0f, 1.0f, 1.0f, 1.0f},
+                    {-1.0f, 1.0f, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f},
+                    {1.0f, 1.0f, 0.5f, 1.0f, 0.0f, 1.0f, 0.0f}};
+  BYTE *data;
+  vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  memcpy(data, quad, sizeof(quad));
+  vb->lpVtbl->Unlock(vb);
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+
+  device->lpVtbl->SetVertexShader(device, fvf);
+  device->lpVtbl->SetStreamSource(device, 0, vb, sizeof(Vertex));
+  device->lpVtbl->SetIndices(device, ib, 0);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+  IDirect3DTexture8 *base = solid_texture(device, 0xffff8000);
+  IDirect3DTexture8 *lightmap = solid_texture(device, 0xff808080);
+  unsigned char p[4];
+
+  // Stage 0 alone uses D3D's defaults
+  device->lpVtbl->SetTexture(device, 0, base);
+  draw(device, p);
+  assert(p[0] == 255 && near(p[1], 128) && p[2] == 0);
+
+  // A lightmap on stage 1 darkens the base texture
+  device->lpVtbl->SetTexture(device, 1, lightmap);
+  set_stage(device, 1, D3DTSS_COLOROP, D3DTOP_MODULATE);
+  set_stage(device, 1, D3DTSS_COLORARG1, D3DTA_TEXTURE);
+  set_stage(device, 1, D3DTSS_COLORARG2, D3DTA_CURRENT);
+  draw(device, p);
+  assert(near(p[0], 128) && near(p[1], 64) && p[2] == 0);
+  DWORD passes = 0;
+  assert(device->lpVtbl->ValidateDevice(device, &passes) == D3D_OK);
+  assert(passes == 1);
+
+  // MODULATE2X brightens it back
+  set_stage(device, 1, D3DTSS_COLOROP, D3DTOP_MODULATE2X);
+  draw(device, p);
+  assert(p[0] == 255 && near(p[1], 128) && p[2] == 0);
+
+  // A stage without a texture still combines the texture factor
+  device->lpVtbl->SetTexture(device, 1, NULL);
+  device->lpVtbl->SetRenderState(device, D3DRS_TEXTUREFACTOR, 0xff00ff00);
+  set_stage(device, 1, D3DTSS_COLOROP, D3DTOP_MODULATE);
+  set_stage(device, 1, D3DTSS_COLORARG1, D3DTA_TFACTOR);
+  draw(device, p);
+  assert(p[0] == 0 && near(p[1], 128) && p[2] == 0);
+  set_stage(device, 1, D3DTSS_COLORARG1, D3DTA_TFACTOR | D3DTA_COMPLEMENT);
+  draw(device, p);
+  assert(p[0] == 255 && p[1] == 0 && p[2] == 0);
+
+  // Going back to a cascade seen before reuses its compiled form
+  D3DGLES_STATS before, after;
+  D3DGLESGetDeviceStats(device, &before);
+  set_stage(device, 1, D3DTSS_COLORARG1, D3DTA_TFACTOR);
+  draw(device, p);
+  set_stage(device, 1, D3DTSS_COLORARG1, D3DTA_TFACTOR | D3DTA_COMPLEMENT);
+  draw(device, p);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.CombinerCompiles == before.CombinerCompiles);
+  assert(after.CombinerUpdates > before.CombinerUpdates);
+  assert(p[0] == 255 && p[1] == 0 && p[2] == 0);
+
+  // Ops GL ES cannot combine in one unit are reported, not drawn wrong
+  set_stage(device, 1, D3DTSS_COLOROP, D3DTOP_ADDSMOOTH);
+  assert(device->lpVtbl->ValidateDevice(device, &passes) ==
+         D3DERR_UNSUPPORTEDCOLOROPERATION);
+  assert(passes == 0);
+  set_stage(device, 1, D3DTSS_COLOROP, D3DTOP_MODULATE);
+  set_stage(device, 1, D3DTSS_ALPHAOP, D3DTOP_SELECTARG1);
+  set_stage(device, 1, D3DTSS_ALPHAARG1, D3DTA_SPECULAR);
+  assert(device->lpVtbl->ValidateDevice(device, &passes) ==
+         D3DERR_UNSUPPORTEDALPHAARG);
+  assert(device->lpVtbl->ValidateDevice(device, NULL) == D3DERR_INVALIDCALL);
+
+  // Disabling stage 1 ends the cascade at stage 0 again
+  set_stage(device, 1, D3DTSS_COLOROP, D3DTOP_DISABLE);
+  assert(device->lpVtbl->ValidateDevice(device, &passes) == D3D_OK);
+  draw(device, p);
+  assert(p[0] == 255 && near(p[1], 128) && p[2] == 0);
+  assert(glGetError() == GL_NO_ERROR);
+
+  device->lpVtbl->SetTexture(device, 0, NULL);
+  base->lpVtbl->Release(base);
+  lightmap->lpVtbl->Release(lightmap);
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
@@ -0,0 +1,209 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <string.h>
+
+typedef struct {
+  float x, y, z;
+  float u, v;
+} Vertex;
+
+#define PAGE_BYTES (512 * 512 * 4)
+#define TEXTURE_BYTES (4 * 4 * 4)
+
+// Fills `area` of level 0 with `color`
+static void fill(IDirect3DTexture8 *texture, const RECT *area,
+                 unsigned int color) {
+  D3DLOCKED_RECT rect;
+  HRESULT hr = texture->lpVtbl->LockRect(texture, 0, &rect, area, 0);
+  assert(hr == D3D_OK);
+  for (int y = 0; y < area->bottom - area->top; y++) {
+    unsigned int *row = (unsigned int *)((BYTE *)rect.pBits + y * rect.Pitch);
+    for (int x = 0; x < area->right - area->left; x++) row[x] = color;
+  }
+  texture->lpVtbl->UnlockRect(texture, 0);
+}
+
+// Left half `left`, right half `right`
+static IDirect3DTexture8 *create(IDirect3DDevice8 *device, unsigned int left,
+                                 unsigned int right) {
+  IDirect3DTexture8 *texture = NULL;
+  HRESULT hr = device->lpVtbl->CreateTexture(
+      device, 4, 4, 1, 0, D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, &texture);
+  assert(hr == D3D_OK && texture);
+  RECT half = {0, 0, 2, 4};
+  fill(texture, &half, left);
+  half.left = 2;
+  half.right = 4;
+  fill(texture, &half, right);
+  return texture;
+}
+
+// `a` on the left half of the target, `b` on the right, one row read back
+static void draw(IDirect3DDevice8 *device, IDirect3DTexture8 *a,
+                 IDirect3DTexture8 *b, unsigned int row[8]) {
+  glClear(GL_COLOR_BUFFER_BIT);
+  device->lpVtbl->BeginScene(device);
+  for (int i = 0; i < 2; i++) {
+    D3DXMATRIX world;
+    D3DXMatrixIdentity(&world);
+    world._41 = (float)i - 1.0f;
+    device->lpVtbl->SetTransform(device, D3DTS_WORLD, &world);
+    device->lpVtbl->SetTexture(device, 0, i ? b : a);
+    HRESULT hr = device->lpVtbl->DrawIndexedPrimitive(
+        device, D3DPT_TRIANGLELIST, 0, 4, 0, 2);
+    assert(hr == D3D_OK);
+  }
+  device->lpVtbl->EndScene(device);
+  glReadPixels(0, 4, 8, 1, GL_RGBA, GL_UNSIGNED_BYTE, row);
+}
+
+static D3DGLES_STATS stats(IDirect3DDevice8 *device) {
+  D3DGLES_STATS s;
+  D3DGLESGetDeviceStats(device, &s);
+  return s;
+}
+
+// GL_RGBA bytes read back as a little-endian word
+#define RED 0xff0000ffu
+#define GREEN 0xff00ff00u
+#define BLUE 0xffff0000u
+#define WHITE 0xffffffffu
+
+static void check(const unsigned int row[8], unsigned int a_left,
+                  unsigned int a_right, unsigned int b_left,
+                  unsigned int b_right) {
+  const unsigned int expected[8] = {a_left,  a_left,  a_right, a_right,
+                                    b_left,  b_left,  b_right, b_right};
+  assert(memcmp(row, expected, sizeof(expected)) == 0);
+}
+
+int main(void) {
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  // A quad one unit wide and the full target high
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_TEX1;
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 4 * sizeof(Vertex),
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  Vertex quad[4] = {{0.0f, -1.0f, 0.5f, 0.0f, 1.0f},
+                    {1.0f, -1.0f, 0.5f, 1.0f, 1.0f},
+                    {0.0f, 1.0f, 0.5f, 0.0f, 0.0f},
+                    {1.0f, 1.0f, 0.5f, 1.0f, 0.0f}};
+  BYTE *data;
+  vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  memcpy(data, quad, sizeof(quad));
+  vb->lpVtbl->Unlock(vb);
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+
+  device->lpVtbl->SetVertexShader(device, fvf);
+  device->lpVtbl->SetStreamSource(device, 0, vb, sizeof(Vertex));
+  device->lpVtbl->SetIndices(device, ib, 0);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  device->lpVtbl->SetRenderState(device, D3DRS_LIGHTING, FALSE);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_MINFILTER,
+                                       D3DTEXF_POINT);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_MAGFILTER,
+                                       D3DTEXF_POINT);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_ADDRESSU,
+                                       D3DTADDRESS_CLAMP);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_ADDRESSV,
+                                       D3DTADDRESS_CLAMP);
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+  assert(D3DGLESSetDeviceOption(device, D3DGLES_OPTION_TEXTURE_ATLAS, 129) ==
+         D3DERR_INVALIDCALL);
+  assert(D3DGLESSetDeviceOption(device, D3DGLES_OPTION_TEXTURE_ATLAS, 16) ==
+         D3D_OK);
+
+  // Both textures go on one page, which holds its storage from the start
+  DWORD base = stats(device).ResidentBytes;
+  IDirect3DTexture8 *a = create(device, 0xffff0000, 0xff0000ff);
+  IDirect3DTexture8 *b = create(device, 0xff00ff00, 0xffffffff);
+  assert(stats(device).AtlasTextures == 2);
+  assert(stats(device).ResidentBytes == base + PAGE_BYTES);
+  // Larger ones and mip chains keep storage of their own
+  IDirect3DTexture8 *large = NULL;
+  hr = device->lpVtbl->CreateTexture(device, 32, 32, 1, 0, D3DFMT_A8R8G8B8,
+                                     D3DPOOL_MANAGED, &large);
+  assert(hr == D3D_OK);
+  IDirect3DTexture8 *mipped = NULL;
+  hr = device->lpVtbl->CreateTexture(device, 4, 4, 0, 0, D3DFMT_A8R8G8B8,
+                                     D3DPOOL_MANAGED, &mipped);
+  assert(hr == D3D_OK);
+  assert(stats(device).AtlasTextures == 2);
+  mipped->lpVtbl->Release(mipped);
+  large->lpVtbl->Release(large);
+
+  // Each samples its own part of the page, clamped at its edges
+  unsigned int row[8];
+  draw(device, a, b, row);
+  check(row, RED, BLUE, GREEN, WHITE);
+  RECT edge = {3, 0, 4, 4};
+  fill(a, &edge, 0xff00ff00);
+  draw(device, a, b, row);
+  assert(row[2] == BLUE && row[3] == GREEN && row[4] == GREEN);
+  fill(a, &edge, 0xff0000ff);
+
+  // Switching between them keeps one batch going
+  assert(D3DGLESSetDeviceOption(device, D3DGLES_OPTION_DYNAMIC_BATCHING,
+                                TRUE) == D3D_OK);
+  D3DGLES_STATS before = stats(device);
+  draw(device, a, b, row);
+  check(row, RED, BLUE, GREEN, WHITE);
+  D3DGLES_STATS after = stats(device);
+  assert(after.BatchFlushes == before.BatchFlushes + 1);
+  assert(after.DrawCalls == before.DrawCalls + 1);
+  assert(after.AtlasSwitches == before.AtlasSwitches + 1);
+  // The next frame reuses the merged vertices
+  draw(device, a, b, row);
+  check(row, RED, BLUE, GREEN, WHITE);
+  assert(stats(device).BatchCacheHits == after.BatchCacheHits + 1);
+
+  // Wrapping takes both off the page for good, and frees it
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_ADDRESSU,
+                                       D3DTADDRESS_WRAP);
+  draw(device, a, b, row);
+  check(row, RED, BLUE, GREEN, WHITE);
+  assert(stats(device).AtlasTextures == 0);
+  assert(stats(device).ResidentBytes == base + 2 * TEXTURE_BYTES);
+  assert(glGetError() == GL_NO_ERROR);
+
+  device->lpVtbl->SetTexture(device, 0, NULL);
+  a->lpVtbl->Release(a);
+  b->lpVtbl->Release(b);
+  assert(stats(device).ResidentBytes == base);
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
@@ -0,0 +1,177 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <string.h>
+
+typedef struct {
+  float x, y, z;
+  float u, v;
+} Vertex;
+
+#define TEXTURE_BYTES (4 * 4 * 4)
+
+static IDirect3DTexture8 *solid_texture(IDirect3DDevice8 *device,
+                                        unsigned int color) {
+  IDirect3DTexture8 *texture = NULL;
+  HRESULT hr = device->lpVtbl->CreateTexture(device, 4, 4, 1, 0,
+                                             D3DFMT_A8R8G8B8, D3DPOOL_MANAGED,
+                                             &texture);
+  assert(hr == D3D_OK && texture);
+  D3DLOCKED_RECT rect;
+  texture->lpVtbl->LockRect(texture, 0, &rect, NULL, 0);
+  for (int y = 0; y < 4; y++) {
+    unsigned int *row = (unsigned int *)((BYTE *)rect.pBits + y * rect.Pitch);
+    for (int x = 0; x < 4; x++) row[x] = color;
+  }
+  texture->lpVtbl->UnlockRect(texture, 0);
+  return texture;
+}
+
+// Colour of the pixel at (x, y) with `texture` on stage 0
+static void draw(IDirect3DDevice8 *device, IDirect3DTexture8 *texture, int x,
+                 int y, unsigned char pixel[4]) {
+  device->lpVtbl->SetTexture(device, 0, texture);
+  glClear(GL_COLOR_BUFFER_BIT);
+  HRESULT hr = device->lpVtbl->DrawIndexedPrimitive(
+      device, D3DPT_TRIANGLELIST, 0, 4, 0, 2);
+  assert(hr == D3D_OK);
+  glReadPixels(x, y, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+}
+
+static D3DGLES_STATS stats(IDirect3DDevice8 *device) {
+  D3DGLES_STATS s;
+  D3DGLESGetDeviceStats(device, &s);
+  return s;
+}
+
+int main(void) {
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_TEX1;
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 4 * sizeof(Vertex),
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  Vertex quad[4] = {{-1.0f, -1.0f, 0.5f, 0.0f, 1.0f},
+                    {1.0f, -1.0f, 0.5f, 1.0f, 1.0f},
+                    {-1.0f, 1.0f, 0.5f, 0.0f, 0.0f},
+                    {1.0f, 1.0f, 0.5f, 1.0f, 0.0f}};
+  BYTE *data;
+  vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  memcpy(data, quad, sizeof(quad));
+  vb->lpVtbl->Unlock(vb);
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+
+  device->lpVtbl->SetVertexShader(device, fvf);
+  device->lpVtbl->SetStreamSource(device, 0, vb, sizeof(Vertex));
+  device->lpVtbl->SetIndices(device, ib, 0);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  device->lpVtbl->SetRenderState(device, D3DRS_LIGHTING, FALSE);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_MINFILTER,
+                                       D3DTEXF_POINT);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_MAGFILTER,
+                                       D3DTEXF_POINT);
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+  // Off by default
+  DWORD base = stats(device).ResidentBytes;
+  IDirect3DTexture8 *a = solid_texture(device, 0xffff0000);
+  IDirect3DTexture8 *b = solid_texture(device, 0xffff0000);
+  assert(stats(device).TextureDedupHits == 0);
+  assert(stats(device).ResidentBytes == base + 2 * TEXTURE_BYTES);
+  b->lpVtbl->Release(b);
+
+  // A second texture with the same contents takes the first one's storage
+  assert(D3DGLESSetDeviceOption(device, D3DGLES_OPTION_TEXTURE_DEDUP, TRUE) ==
+         D3D_OK);
+  IDirect3DTexture8 *c = solid_texture(device, 0xffff0000);
+  IDirect3DTexture8 *d = solid_texture(device, 0xffff0000);
+  IDirect3DTexture8 *blue = solid_texture(device, 0xff0000ff);
+  assert(stats(device).TextureDedupHits == 1);
+  assert(stats(device).DedupSavedBytes == TEXTURE_BYTES);
+  assert(stats(device).ResidentBytes == base + 3 * TEXTURE_BYTES);
+  unsigned char p[4];
+  draw(device, d, 4, 4, p);
+  assert(p[0] == 255 && p[1] == 0 && p[2] == 0);
+  draw(device, blue, 4, 4, p);
+  assert(p[0] == 0 && p[1] == 0 && p[2] == 255);
+
+  // The texture other copies came from can go first, and later ones still
+  // match its contents
+  IDirect3DTexture8 *e = solid_texture(device, 0xff0000ff);
+  assert(stats(device).TextureDedupHits == 2);
+  blue->lpVtbl->Release(blue);
+  draw(device, e, 4, 4, p);
+  assert(p[0] == 0 && p[1] == 0 && p[2] == 255);
+  IDirect3DTexture8 *f = solid_texture(device, 0xff0000ff);
+  assert(stats(device).TextureDedupHits == 3);
+  assert(stats(device).DedupSavedBytes == 2 * TEXTURE_BYTES);
+  f->lpVtbl->Release(f);
+
+  // Shared storage is never evicted
+  device->lpVtbl->SetTexture(device, 0, NULL);
+  device->lpVtbl->ResourceManagerDiscardBytes(device, 0);
+  assert(stats(device).ResidentBytes == base + 2 * TEXTURE_BYTES);
+  draw(device, c, 4, 4, p);
+  assert(p[0] == 255 && p[1] == 0 && p[2] == 0);
+
+  // Locking one copies the contents out first, so a partial write keeps the
+  // rest and leaves the other texture alone
+  D3DLOCKED_RECT rect;
+  RECT corner = {0, 0, 2, 2};
+  assert(d->lpVtbl->LockRect(d, 0, &rect, &corner, 0) == D3D_OK);
+  for (int y = 0; y < 2; y++) {
+    unsigned int *row = (unsigned int *)((BYTE *)rect.pBits + y * rect.Pitch);
+    row[0] = row[1] = 0xff00ff00;
+  }
+  d->lpVtbl->UnlockRect(d, 0);
+  assert(stats(device).DedupSavedBytes == 0);
+  draw(device, d, 1, 6, p);
+  assert(p[0] == 0 && p[1] == 255 && p[2] == 0);
+  draw(device, d, 6, 1, p);
+  assert(p[0] == 255 && p[1] == 0 && p[2] == 0);
+  draw(device, c, 1, 6, p);
+  assert(p[0] == 255 && p[1] == 0 && p[2] == 0);
+
+  assert(glGetError() == GL_NO_ERROR);
+
+  device->lpVtbl->SetTexture(device, 0, NULL);
+  e->lpVtbl->Release(e);
+  d->lpVtbl->Release(d);
+  c->lpVtbl->Release(c);
+  a->lpVtbl->Release(a);
+  assert(stats(device).ResidentBytes == base);
+  assert(stats(device).DedupSavedBytes == 0);
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
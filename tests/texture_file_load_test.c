@@ -0,0 +1,224 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Internal kernels, declared for direct checks
+void image_color_key(uint32_t *texels, size_t count, uint32_t key);
+void image_resample_argb(const uint32_t *src, UINT src_width, UINT src_height,
+                         uint32_t *dst, UINT width, UINT height, DWORD filter);
+
+typedef struct {
+  float x, y, z;
+  float u, v;
+} Vertex;
+
+#define BMP_PATH "texture_file_load_test.bmp"
+
+static void put16(BYTE *p, unsigned v) {
+  p[0] = (BYTE)v;
+  p[1] = (BYTE)(v >> 8);
+}
+
+static void put32(BYTE *p, unsigned v) {
+  put16(p, v & 0xffff);
+  put16(p + 2, v >> 16);
+}
+
+// 4x4 24-bit BMP: magenta left half, blue right half
+static void write_bmp(const char *path) {
+  BYTE file[54 + 4 * 12] = {'B', 'M'};
+  put32(file + 2, sizeof(file));
+  put32(file + 10, 54);
+  put32(file + 14, 40);
+  put32(file + 18, 4);
+  put32(file + 22, 4);
+  put16(file + 26, 1);
+  put16(file + 28, 24);
+  for (int y = 0; y < 4; y++)
+    for (int x = 0; x < 4; x++) {
+      BYTE *bgr = file + 54 + y * 12 + x * 3;
+      bgr[0] = 0xff;
+      bgr[1] = 0x00;
+      bgr[2] = x < 2 ? 0xff : 0x00;
+    }
+  FILE *out = fopen(path, "wb");
+  assert(out);
+  assert(fwrite(file, 1, sizeof(file), out) == sizeof(file));
+  fclose(out);
+}
+
+// 8x8 DXT1 DDS with both of its first two levels, in memory
+static UINT build_dds(BYTE *dds) {
+  memset(dds, 0, 128);
+  memcpy(dds, "DDS ", 4);
+  put32(dds + 4, 124);
+  put32(dds + 8, 0x1007 | 0x20000);
+  put32(dds + 12, 8);
+  put32(dds + 16, 8);
+  put32(dds + 28, 2);
+  put32(dds + 76, 32);
+  put32(dds + 80, 0x4);
+  put32(dds + 84, D3DFMT_DXT1);
+  // Solid red blocks: both endpoints 0xf800, every index 0
+  BYTE *p = dds + 128;
+  for (int i = 0; i < 4 + 1; i++, p += 8) {
+    memset(p, 0, 8);
+    put16(p, 0xf800);
+    put16(p + 2, 0xf800);
+  }
+  return (UINT)(p - dds);
+}
+
+static void check_kernels(void) {
+  uint32_t texels[7] = {0xffff00ff, 1, 0xffff00ff, 2, 3, 0xffff00ff, 4};
+  image_color_key(texels, 7, 0xffff00ff);
+  assert(texels[0] == 0 && texels[1] == 1 && texels[2] == 0);
+  assert(texels[4] == 3 && texels[5] == 0 && texels[6] == 4);
+
+  // Two rows stretched to four lerp between them
+  uint32_t rows[8] = {0, 0, 0, 0, 0x80808080, 0x80808080, 0x80808080,
+                      0x80808080};
+  uint32_t out[16];
+  image_resample_argb(rows, 4, 2, out, 4, 4, D3DX_FILTER_LINEAR);
+  assert(out[0] == 0 && out[4] == 0x20202020);
+  assert(out[8] == 0x60606060 && out[15] == 0x80808080);
+  image_resample_argb(rows, 4, 2, out, 4, 4, D3DX_FILTER_POINT);
+  assert(out[4] == 0 && out[8] == 0x80808080);
+  image_resample_argb(rows, 4, 2, out, 4, 4, D3DX_FILTER_NONE);
+  assert(out[4] == 0x80808080 && out[8] == 0 && out[15] == 0);
+}
+
+int main(void) {
+  check_kernels();
+
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_TEX1;
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 4 * sizeof(Vertex),
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  Vertex quad[4] = {{-1.0f, -1.0f, 0.5f, 0.0f, 1.0f},
+                    {1.0f, -1.0f, 0.5f, 1.0f, 1.0f},
+                    {-1.0f, 1.0f, 0.5f, 0.0f, 0.0f},
+                    {1.0f, 1.0f, 0.5f, 1.0f, 0.0f}};
+  BYTE *data;
+  vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  memcpy(data, quad, sizeof(quad));
+  vb->lpVtbl->Unlock(vb);
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+
+  device->lpVtbl->SetVertexShader(device, fvf);
+  device->lpVtbl->SetStreamSource(device, 0, vb, sizeof(Vertex));
+  device->lpVtbl->SetIndices(device, ib, 0);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  glClearColor(1.0f, 0.0f, 0.0f, 1.0f);
+
+  // Files that are missing or not images are told apart
+  IDirect3DTexture8 *texture = NULL;
+  assert(D3DXCreateTextureFromFile(device, "no_such_texture.bmp", &texture) ==
+         D3DERR_NOTFOUND);
+  BYTE junk[64] = {0x55, 0x55, 0x55};
+  assert(D3DXCreateTextureFromFileInMemory(device, junk, sizeof(junk),
+                                           &texture) == D3DXERR_INVALIDDATA);
+
+  // A colour-keyed BMP from disk lets the clear colour through where the key
+  // matched
+  write_bmp(BMP_PATH);
+  D3DXIMAGE_INFO info;
+  hr = D3DXCreateTextureFromFileEx(device, BMP_PATH, (UINT)D3DX_DEFAULT,
+                                   (UINT)D3DX_DEFAULT, 1, 0, D3DFMT_UNKNOWN,
+                                   D3DPOOL_MANAGED, D3DX_DEFAULT, D3DX_DEFAULT,
+                                   0xffff00ff, &info, NULL, &texture);
+  remove(BMP_PATH);
+  assert(hr == D3D_OK && texture);
+  assert(info.Width == 4 && info.Height == 4 && info.MipLevels == 1);
+  assert(info.Format == D3DFMT_R8G8B8 && info.ImageFileFormat == D3DXIFF_BMP);
+  D3DSURFACE_DESC desc;
+  texture->lpVtbl->GetLevelDesc(texture, 0, &desc);
+  assert(desc.Format == D3DFMT_A8R8G8B8 && desc.Width == 4);
+
+  device->lpVtbl->SetRenderState(device, D3DRS_ALPHABLENDENABLE, TRUE);
+  device->lpVtbl->SetRenderState(device, D3DRS_SRCBLEND, D3DBLEND_SRCALPHA);
+  device->lpVtbl->SetRenderState(device, D3DRS_DESTBLEND,
+                                 D3DBLEND_INVSRCALPHA);
+  device->lpVtbl->SetTexture(device, 0, texture);
+  glClear(GL_COLOR_BUFFER_BIT);
+  hr = device->lpVtbl->DrawIndexedPrimitive(device, D3DPT_TRIANGLELIST, 0, 4,
+                                            0, 2);
+  assert(hr == D3D_OK);
+  unsigned char p[4];
+  glReadPixels(1, 4, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, p);
+  assert(p[0] == 255 && p[1] == 0 && p[2] == 0);
+  glReadPixels(6, 4, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, p);
+  assert(p[0] == 0 && p[1] == 0 && p[2] == 255);
+  device->lpVtbl->SetTexture(device, 0, NULL);
+  texture->lpVtbl->Release(texture);
+
+  // DXT1 keeps its blocks and the file's own chain
+  BYTE dds[128 + 5 * 8];
+  UINT size = build_dds(dds);
+  hr = D3DXCreateTextureFromFileInMemoryEx(
+      device, dds, size, (UINT)D3DX_DEFAULT, (UINT)D3DX_DEFAULT,
+      (UINT)D3DX_DEFAULT, 0, D3DFMT_UNKNOWN, D3DPOOL_MANAGED, D3DX_DEFAULT,
+      D3DX_DEFAULT, 0, &info, NULL, &texture);
+  assert(hr == D3D_OK && texture);
+  assert(info.Format == D3DFMT_DXT1 && info.MipLevels == 2);
+  assert(info.ImageFileFormat == D3DXIFF_DDS);
+  assert(texture->lpVtbl->GetLevelDesc(texture, 1, &desc) == D3D_OK);
+  assert(desc.Format == D3DFMT_DXT1 && desc.Width == 4);
+  assert(texture->lpVtbl->GetLevelDesc(texture, 2, &desc) ==
+         D3DERR_INVALIDCALL);
+  texture->lpVtbl->Release(texture);
+
+  // Resizing decodes, so the same file comes back as 16-bit texels with a
+  // full chain filtered from level 0
+  hr = D3DXCreateTextureFromFileInMemoryEx(
+      device, dds, size, 16, 16, 0, 0, D3DFMT_R5G6B5, D3DPOOL_MANAGED,
+      D3DX_FILTER_POINT, D3DX_FILTER_BOX, 0, NULL, NULL, &texture);
+  assert(hr == D3D_OK && texture);
+  assert(texture->lpVtbl->GetLevelDesc(texture, 4, &desc) == D3D_OK);
+  assert(desc.Format == D3DFMT_R5G6B5 && desc.Width == 1);
+  D3DLOCKED_RECT rect;
+  texture->lpVtbl->LockRect(texture, 0, &rect, NULL, D3DLOCK_READONLY);
+  assert(((WORD *)rect.pBits)[15] == 0xf800);
+  texture->lpVtbl->UnlockRect(texture, 0);
+  texture->lpVtbl->Release(texture);
+  assert(glGetError() == GL_NO_ERROR);
+
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
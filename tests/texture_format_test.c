@@ -0,0 +1,227 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <stdint.h>
+#include <string.h>
+
+// Conversion kernels are internal; declare them for direct checks
+void texconv_a8r8g8b8_to_rgba(void *dst, const void *src, size_t count);
+void texconv_x8r8g8b8_to_rgba(void *dst, const void *src, size_t count);
+void texconv_x8r8g8b8_to_bgra(void *dst, const void *src, size_t count);
+void texconv_a1r5g5b5_to_rgba5551(void *dst, const void *src, size_t count);
+void texconv_x4r4g4b4_to_rgba4444(void *dst, const void *src, size_t count);
+
+typedef struct {
+  float x, y, z;
+  float u, v;
+} Vertex;
+
+static void check_kernels(void) {
+  // 19 texels exercise both the vector loop and the scalar tail
+  uint32_t src[19], dst[19];
+  for (int i = 0; i < 19; i++) src[i] = 0x00112233u + (uint32_t)i * 0x01010101u;
+  src[3] |= 0x80000000u;
+
+  texconv_a8r8g8b8_to_rgba(dst, src, 19);
+  for (int i = 0; i < 19; i++) {
+    const unsigned char *b = (const unsigned char *)&dst[i];
+    assert(b[0] == (src[i] >> 16 & 0xFF) && b[1] == (src[i] >> 8 & 0xFF));
+    assert(b[2] == (src[i] & 0xFF) && b[3] == src[i] >> 24);
+  }
+  texconv_x8r8g8b8_to_rgba(dst, src, 19);
+  for (int i = 0; i < 19; i++) {
+    const unsigned char *b = (const unsigned char *)&dst[i];
+    assert(b[0] == (src[i] >> 16 & 0xFF) && b[2] == (src[i] & 0xFF));
+    assert(b[3] == 0xFF);
+  }
+  texconv_x8r8g8b8_to_bgra(dst, src, 19);
+  for (int i = 0; i < 19; i++) assert(dst[i] == (src[i] | 0xFF000000u));
+
+  uint16_t src16[19], dst16[19];
+  for (int i = 0; i < 19; i++) src16[i] = (uint16_t)(0x8421u * (unsigned)i);
+  texconv_a1r5g5b5_to_rgba5551(dst16, src16, 19);
+  for (int i = 0; i < 19; i++)
+    assert(dst16[i] == (uint16_t)(src16[i] << 1 | src16[i] >> 15));
+  texconv_x4r4g4b4_to_rgba4444(dst16, src16, 19);
+  for (int i = 0; i < 19; i++)
+    assert(dst16[i] == (uint16_t)(src16[i] << 4 | 0xF));
+
+  // In place
+  memcpy(dst, src, sizeof(src));
+  texconv_a8r8g8b8_to_rgba(dst, dst, 19);
+  texconv_a8r8g8b8_to_rgba(dst, dst, 19);
+  assert(memcmp(dst, src, sizeof(src)) == 0);
+}
+
+static IDirect3DTexture8 *solid_texture(IDirect3DDevice8 *device,
+                                        D3DFORMAT format, const void *texel,
+                                        UINT size) {
+  IDirect3DTexture8 *texture = NULL;
+  HRESULT hr = device->lpVtbl->CreateTexture(device, 2, 2, 1, 0, format,
+                                             D3DPOOL_MANAGED, &texture);
+  assert(hr == D3D_OK && texture);
+  D3DLOCKED_RECT rect;
+  hr = texture->lpVtbl->LockRect(texture, 0, &rect, NULL, 0);
+  assert(hr == D3D_OK && rect.Pitch == (int)(2 * size));
+  for (int y = 0; y < 2; y++)
+    for (int x = 0; x < 2; x++)
+      memcpy((BYTE *)rect.pBits + y * rect.Pitch + x * size, texel, size);
+  texture->lpVtbl->UnlockRect(texture, 0);
+  return texture;
+}
+
+// Draw `texture` over the black screen and return the center pixel
+static void draw_texture(IDirect3DDevice8 *device, IDirect3DTexture8 *texture,
+                         unsigned char pixel[4]) {
+  glClear(GL_COLOR_BUFFER_BIT);
+  device->lpVtbl->SetTexture(device, 0, texture);
+  HRESULT hr = device->lpVtbl->DrawIndexedPrimitive(
+      device, D3DPT_TRIANGLELIST, 0, 4, 0, 2);
+  assert(hr == D3D_OK);
+  device->lpVtbl->SetTexture(device, 0, NULL);
+  glReadPixels(4, 4, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+}
+
+static void check_32bit(IDirect3DDevice8 *device) {
+  unsigned char pixel[4];
+  DWORD red = 0xffff0000;
+  IDirect3DTexture8 *texture =
+      solid_texture(device, D3DFMT_A8R8G8B8, &red, 4);
+  draw_texture(device, texture, pixel);
+  assert(pixel[0] == 255 && pixel[1] == 0 && pixel[2] == 0);
+  texture->lpVtbl->Release(texture);
+
+  // X8 textures are opaque whatever the X byte holds
+  DWORD green = 0x0000ff00;
+  device->lpVtbl->SetRenderState(device, D3DRS_ALPHABLENDENABLE, TRUE);
+  texture = solid_texture(device, D3DFMT_X8R8G8B8, &green, 4);
+  draw_texture(device, texture, pixel);
+  assert(pixel[0] == 0 && pixel[1] == 255 && pixel[2] == 0);
+  texture->lpVtbl->Release(texture);
+  device->lpVtbl->SetRenderState(device, D3DRS_ALPHABLENDENABLE, FALSE);
+}
+
+int main(void) {
+  check_kernels();
+
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_TEX1;
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 4 * sizeof(Vertex),
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  Vertex quad[4] = {{-1.0f, -1.0f, 0.5f, 0.0f, 1.0f},
+                    {1.0f, -1.0f, 0.5f, 1.0f, 1.0f},
+                    {-1.0f, 1.0f, 0.5f, 0.0f, 0.0f},
+                    {1.0f, 1.0f, 0.5f, 1.0f, 0.0f}};
+  BYTE *data;
+  vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  memcpy(data, quad, sizeof(quad));
+  vb->lpVtbl->Unlock(vb);
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+
+  device->lpVtbl->SetVertexShader(device, fvf);
+  device->lpVtbl->SetStreamSource(device, 0, vb, sizeof(Vertex));
+  device->lpVtbl->SetIndices(device, ib, 0);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  device->lpVtbl->SetRenderState(device, D3DRS_SRCBLEND, D3DBLEND_SRCALPHA);
+  device->lpVtbl->SetRenderState(device, D3DRS_DESTBLEND,
+                                 D3DBLEND_INVSRCALPHA);
+  glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+
+  // Converted RGBA storage, then zero-copy BGRA storage where available
+  hr = D3DGLESSetDeviceOption(device, D3DGLES_OPTION_TEXTURE_BGRA, FALSE);
+  assert(hr == D3D_OK);
+  check_32bit(device);
+  if (D3DGLESSetDeviceOption(device, D3DGLES_OPTION_TEXTURE_BGRA, TRUE) ==
+      D3D_OK)
+    check_32bit(device);
+
+  // Luminance formats keep their size
+  unsigned char pixel[4];
+  unsigned char gray = 0x80;
+  IDirect3DTexture8 *texture = solid_texture(device, D3DFMT_L8, &gray, 1);
+  draw_texture(device, texture, pixel);
+  assert(pixel[0] >= 0x7e && pixel[0] <= 0x82 && pixel[0] == pixel[1] &&
+         pixel[1] == pixel[2]);
+  texture->lpVtbl->Release(texture);
+  unsigned char luminance_alpha[2] = {0xff, 0x80};
+  texture = solid_texture(device, D3DFMT_A8L8, luminance_alpha, 2);
+  device->lpVtbl->SetRenderState(device, D3DRS_ALPHABLENDENABLE, TRUE);
+  draw_texture(device, texture, pixel);
+  device->lpVtbl->SetRenderState(device, D3DRS_ALPHABLENDENABLE, FALSE);
+  assert(pixel[0] >= 0x7e && pixel[0] <= 0x82);
+  texture->lpVtbl->Release(texture);
+  unsigned char alpha = 0x40;
+  texture = solid_texture(device, D3DFMT_A8, &alpha, 1);
+  texture->lpVtbl->Release(texture);
+
+  // 16-bit formats keep 16-bit staging and land with their alpha in place
+  WORD red565 = 0xf800;
+  texture = solid_texture(device, D3DFMT_R5G6B5, &red565, 2);
+  draw_texture(device, texture, pixel);
+  assert(pixel[0] == 255 && pixel[1] == 0 && pixel[2] == 0);
+  texture->lpVtbl->Release(texture);
+  device->lpVtbl->SetRenderState(device, D3DRS_ALPHABLENDENABLE, TRUE);
+  WORD clear_green = 0x03e0;
+  texture = solid_texture(device, D3DFMT_A1R5G5B5, &clear_green, 2);
+  draw_texture(device, texture, pixel);
+  assert(pixel[0] == 0 && pixel[1] == 0 && pixel[2] == 0);
+  texture->lpVtbl->Release(texture);
+  texture = solid_texture(device, D3DFMT_X1R5G5B5, &clear_green, 2);
+  draw_texture(device, texture, pixel);
+  assert(pixel[0] == 0 && pixel[1] == 255 && pixel[2] == 0);
+  texture->lpVtbl->Release(texture);
+  WORD blue4444 = 0xf00f;
+  texture = solid_texture(device, D3DFMT_A4R4G4B4, &blue4444, 2);
+  draw_texture(device, texture, pixel);
+  assert(pixel[0] == 0 && pixel[1] == 0 && pixel[2] == 255);
+  texture->lpVtbl->Release(texture);
+  device->lpVtbl->SetRenderState(device, D3DRS_ALPHABLENDENABLE, FALSE);
+
+  // Formats the shim cannot sample are refused
+  assert(device->lpVtbl->CreateTexture(device, 2, 2, 1, 0, D3DFMT_D16,
+                                       D3DPOOL_MANAGED,
+                                       &texture) == D3DERR_INVALIDCALL);
+  assert(d3d->lpVtbl->CheckDeviceFormat(d3d, D3DADAPTER_DEFAULT,
+                                        D3DDEVTYPE_HAL, D3DFMT_X8R8G8B8, 0,
+                                        D3DRTYPE_TEXTURE,
+                                        D3DFMT_D16) == D3DERR_NOTAVAILABLE);
+  assert(d3d->lpVtbl->CheckDeviceFormat(d3d, D3DADAPTER_DEFAULT,
+                                        D3DDEVTYPE_HAL, D3DFMT_X8R8G8B8, 0,
+                                        D3DRTYPE_TEXTURE, D3DFMT_L8) == D3D_OK);
+
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
@@ -0,0 +1,133 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <string.h>
+
+typedef struct {
+  float x, y, z;
+  float u, v;
+} Vertex;
+
+static void fill(D3DLOCKED_RECT *rect, UINT w, UINT h, DWORD color) {
+  for (UINT y = 0; y < h; y++) {
+    unsigned int *row = (unsigned int *)((BYTE *)rect->pBits + y * rect->Pitch);
+    for (UINT x = 0; x < w; x++) row[x] = (unsigned int)color;
+  }
+}
+
+int main(void) {
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  // Creation allocates nothing in GL
+  D3DGLES_STATS stats;
+  const DWORD chain = (64 * 64 + 32 * 32 + 16 * 16) * 4;
+  IDirect3DTexture8 *texture = NULL;
+  hr = device->lpVtbl->CreateTexture(device, 64, 64, 3, 0, D3DFMT_A8R8G8B8,
+                                     D3DPOOL_MANAGED, &texture);
+  assert(hr == D3D_OK && texture);
+  D3DGLESGetDeviceStats(device, &stats);
+  assert(stats.TextureDeferredBytes == chain);
+
+  // A whole-level write allocates and fills the level in one go
+  D3DLOCKED_RECT rect;
+  hr = texture->lpVtbl->LockRect(texture, 0, &rect, NULL, 0);
+  assert(hr == D3D_OK);
+  fill(&rect, 64, 64, 0xffff0000);
+  texture->lpVtbl->UnlockRect(texture, 0);
+  D3DGLESGetDeviceStats(device, &stats);
+  assert(stats.TextureDeferredBytes == chain - 64 * 64 * 4);
+  assert(stats.TextureUploadBytes == 64 * 64 * 4);
+
+  // A partial write allocates the level first; read-only locks allocate nothing
+  RECT corner = {0, 0, 4, 4};
+  hr = texture->lpVtbl->LockRect(texture, 2, &rect, &corner, D3DLOCK_READONLY);
+  assert(hr == D3D_OK);
+  texture->lpVtbl->UnlockRect(texture, 2);
+  hr = texture->lpVtbl->LockRect(texture, 1, &rect, &corner, 0);
+  assert(hr == D3D_OK);
+  fill(&rect, 4, 4, 0xff00ff00);
+  texture->lpVtbl->UnlockRect(texture, 1);
+  D3DGLESGetDeviceStats(device, &stats);
+  assert(stats.TextureDeferredBytes == 16 * 16 * 4);
+
+  // Binding allocates whatever is left
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_TEX1;
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 4 * sizeof(Vertex),
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  Vertex quad[4] = {{-1.0f, -1.0f, 0.5f, 0.0f, 1.0f},
+                    {1.0f, -1.0f, 0.5f, 1.0f, 1.0f},
+                    {-1.0f, 1.0f, 0.5f, 0.0f, 0.0f},
+                    {1.0f, 1.0f, 0.5f, 1.0f, 0.0f}};
+  BYTE *data;
+  vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  memcpy(data, quad, sizeof(quad));
+  vb->lpVtbl->Unlock(vb);
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+
+  device->lpVtbl->SetVertexShader(device, fvf);
+  device->lpVtbl->SetStreamSource(device, 0, vb, sizeof(Vertex));
+  device->lpVtbl->SetIndices(device, ib, 0);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  device->lpVtbl->SetTexture(device, 0, texture);
+  D3DGLESGetDeviceStats(device, &stats);
+  assert(stats.TextureDeferredBytes == 0);
+
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  hr = device->lpVtbl->DrawIndexedPrimitive(device, D3DPT_TRIANGLELIST, 0, 4, 0,
+                                            2);
+  assert(hr == D3D_OK);
+  unsigned char pixel[4];
+  glReadPixels(4, 4, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+  assert(pixel[0] == 255 && pixel[1] == 0 && pixel[2] == 0);
+  device->lpVtbl->SetTexture(device, 0, NULL);
+  texture->lpVtbl->Release(texture);
+
+  // Textures released before any use never cost GL memory
+  hr = device->lpVtbl->CreateTexture(device, 32, 16, 2, 0, D3DFMT_R5G6B5,
+                                     D3DPOOL_MANAGED, &texture);
+  assert(hr == D3D_OK);
+  texture->lpVtbl->Release(texture);
+  D3DGLESGetDeviceStats(device, &stats);
+  assert(stats.TextureDeferredBytes == 0);
+  assert(stats.TextureAvoidedBytes == (32 * 16 + 16 * 8) * 2);
+
+  assert(device->lpVtbl->CreateTexture(device, 0, 16, 1, 0, D3DFMT_A8R8G8B8,
+                                       D3DPOOL_MANAGED,
+                                       &texture) == D3DERR_INVALIDCALL);
+
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
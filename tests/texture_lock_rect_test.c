@@ -0,0 +1,160 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <string.h>
+
+// Forward declarations for helper functions not in the public header
+UINT WINAPI D3DXGetFVFVertexSize(DWORD FVF);
+
+typedef struct {
+  float x, y, z;
+  float u, v;
+} Vertex;
+
+static void fill(D3DLOCKED_RECT *rect, UINT w, UINT h, DWORD color) {
+  for (UINT y = 0; y < h; y++) {
+    unsigned int *row = (unsigned int *)((BYTE *)rect->pBits + y * rect->Pitch);
+    for (UINT x = 0; x < w; x++) row[x] = (unsigned int)color;
+  }
+}
+
+int main(void) {
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  IDirect3DTexture8 *texture = NULL;
+  hr = device->lpVtbl->CreateTexture(device, 16, 16, 2, 0, D3DFMT_A8R8G8B8,
+                                     D3DPOOL_MANAGED, &texture);
+  assert(hr == D3D_OK && texture);
+
+  // Whole level, then a rectangle in the middle
+  D3DGLES_STATS before, after;
+  D3DLOCKED_RECT rect;
+  D3DGLESGetDeviceStats(device, &before);
+  hr = texture->lpVtbl->LockRect(texture, 0, &rect, NULL, 0);
+  assert(hr == D3D_OK && rect.Pitch == 16 * 4);
+  fill(&rect, 16, 16, 0xffff0000);
+  hr = texture->lpVtbl->UnlockRect(texture, 0);
+  assert(hr == D3D_OK);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.TextureUploadBytes - before.TextureUploadBytes == 16 * 16 * 4);
+
+  RECT middle = {4, 4, 12, 12};
+  before = after;
+  hr = texture->lpVtbl->LockRect(texture, 0, &rect, &middle, 0);
+  assert(hr == D3D_OK && rect.Pitch == 8 * 4);
+  void *first_bits = rect.pBits;
+  fill(&rect, 8, 8, 0xff00ff00);
+
+  // Level 1 can be locked while level 0 is; level 0 cannot be locked twice
+  D3DLOCKED_RECT level1;
+  hr = texture->lpVtbl->LockRect(texture, 1, &level1, NULL, 0);
+  assert(hr == D3D_OK && level1.pBits != rect.pBits && level1.Pitch == 8 * 4);
+  fill(&level1, 8, 8, 0xff0000ff);
+  D3DLOCKED_RECT again;
+  assert(texture->lpVtbl->LockRect(texture, 0, &again, NULL, 0) ==
+         D3DERR_INVALIDCALL);
+  hr = texture->lpVtbl->UnlockRect(texture, 1);
+  assert(hr == D3D_OK);
+  hr = texture->lpVtbl->UnlockRect(texture, 0);
+  assert(hr == D3D_OK);
+  assert(texture->lpVtbl->UnlockRect(texture, 0) == D3DERR_INVALIDCALL);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.TextureUploadBytes - before.TextureUploadBytes ==
+         8 * 8 * 4 + 8 * 8 * 4);
+
+  // Staging memory is recycled; read-only locks upload nothing
+  before = after;
+  hr = texture->lpVtbl->LockRect(texture, 0, &rect, &middle, D3DLOCK_READONLY);
+  assert(hr == D3D_OK && rect.pBits == first_bits);
+  texture->lpVtbl->UnlockRect(texture, 0);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.TextureUploadBytes == before.TextureUploadBytes);
+
+  // Odd-width rectangles need a tighter unpack alignment
+  RECT odd = {1, 2, 4, 5};
+  hr = texture->lpVtbl->LockRect(texture, 1, &rect, &odd, 0);
+  assert(hr == D3D_OK && rect.Pitch == 3 * 4);
+  fill(&rect, 3, 3, 0xff0000ff);
+  texture->lpVtbl->UnlockRect(texture, 1);
+
+  RECT outside = {8, 8, 17, 12};
+  assert(texture->lpVtbl->LockRect(texture, 0, &rect, &outside, 0) ==
+         D3DERR_INVALIDCALL);
+  RECT empty = {4, 4, 4, 8};
+  assert(texture->lpVtbl->LockRect(texture, 0, &rect, &empty, 0) ==
+         D3DERR_INVALIDCALL);
+
+  // Draw the texture over the screen: the middle was replaced, the border kept
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_TEX1;
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 4 * sizeof(Vertex),
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  Vertex quad[4] = {{-1.0f, -1.0f, 0.5f, 0.0f, 1.0f},
+                    {1.0f, -1.0f, 0.5f, 1.0f, 1.0f},
+                    {-1.0f, 1.0f, 0.5f, 0.0f, 0.0f},
+                    {1.0f, 1.0f, 0.5f, 1.0f, 0.0f}};
+  BYTE *data;
+  vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  memcpy(data, quad, sizeof(quad));
+  vb->lpVtbl->Unlock(vb);
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+
+  device->lpVtbl->SetVertexShader(device, fvf);
+  device->lpVtbl->SetStreamSource(device, 0, vb, sizeof(Vertex));
+  device->lpVtbl->SetIndices(device, ib, 0);
+  device->lpVtbl->SetTexture(device, 0, texture);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  hr = device->lpVtbl->DrawIndexedPrimitive(device, D3DPT_TRIANGLELIST, 0, 4, 0,
+                                            2);
+  assert(hr == D3D_OK);
+  unsigned char pixels[8 * 8 * 4];
+  glReadPixels(0, 0, 8, 8, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+  const unsigned char *corner = pixels;
+  const unsigned char *center = pixels + (4 * 8 + 4) * 4;
+  const unsigned char *other_corner = pixels + (7 * 8 + 7) * 4;
+  assert(memcmp(corner, other_corner, 4) == 0);
+  assert(memcmp(corner, center, 4) != 0);
+  assert(corner[0] | corner[1] | corner[2]);
+  assert(center[0] | center[1] | center[2]);
+
+  device->lpVtbl->SetTexture(device, 0, NULL);
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  // Releasing a texture with a level still locked returns the staging memory
+  hr = texture->lpVtbl->LockRect(texture, 1, &rect, NULL, 0);
+  assert(hr == D3D_OK);
+  texture->lpVtbl->Release(texture);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
@@ -0,0 +1,302 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <string.h>
+
+typedef struct {
+  float x, y, z;
+  float u, v;
+} Vertex;
+
+#define RED 0xffff0000u
+#define GREEN 0xff00ff00u
+#define BLUE 0xff0000ffu
+
+static IDirect3DTexture8 *create(IDirect3DDevice8 *device, UINT w, UINT h,
+                                 UINT levels, DWORD usage, D3DFORMAT format) {
+  IDirect3DTexture8 *texture = NULL;
+  HRESULT hr = device->lpVtbl->CreateTexture(device, w, h, levels, usage,
+                                             format, D3DPOOL_MANAGED, &texture);
+  assert(hr == D3D_OK && texture);
+  return texture;
+}
+
+// Writes `area` of `level` (all of it when NULL): columns left of `split`
+// get `left`, the rest `right`
+static void fill(IDirect3DTexture8 *texture, UINT level, const RECT *area,
+                 LONG split, unsigned int left, unsigned int right) {
+  D3DSURFACE_DESC desc;
+  texture->lpVtbl->GetLevelDesc(texture, level, &desc);
+  RECT whole = {0, 0, (LONG)desc.Width, (LONG)desc.Height};
+  if (!area) area = &whole;
+  D3DLOCKED_RECT rect;
+  HRESULT hr = texture->lpVtbl->LockRect(texture, level, &rect, area, 0);
+  assert(hr == D3D_OK);
+  for (LONG y = area->top; y < area->bottom; y++) {
+    unsigned int *row =
+        (unsigned int *)((BYTE *)rect.pBits + (y - area->top) * rect.Pitch);
+    for (LONG x = area->left; x < area->right; x++)
+      row[x - area->left] = x < split ? left : right;
+  }
+  assert(texture->lpVtbl->UnlockRect(texture, level) == D3D_OK);
+}
+
+// Draws the full-viewport quad and reads back its top row, which samples
+// texel row 0
+static void draw(IDirect3DDevice8 *device, IDirect3DTexture8 *texture,
+                 unsigned char row[8][4]) {
+  device->lpVtbl->SetTexture(device, 0, texture);
+  glClear(GL_COLOR_BUFFER_BIT);
+  HRESULT hr = device->lpVtbl->DrawIndexedPrimitive(
+      device, D3DPT_TRIANGLELIST, 0, 4, 0, 2);
+  assert(hr == D3D_OK);
+  glReadPixels(0, 7, 8, 1, GL_RGBA, GL_UNSIGNED_BYTE, row);
+}
+
+static int is(const unsigned char p[4], unsigned int color) {
+  return p[0] == (color >> 16 & 0xff) && p[1] == (color >> 8 & 0xff) &&
+         p[2] == (color & 0xff);
+}
+
+static D3DGLES_STATS stats(IDirect3DDevice8 *device) {
+  D3DGLES_STATS s;
+  D3DGLESGetDeviceStats(device, &s);
+  return s;
+}
+
+static void put16(BYTE *p, unsigned v) {
+  p[0] = (BYTE)v;
+  p[1] = (BYTE)(v >> 8);
+}
+
+static void put32(BYTE *p, unsigned v) {
+  put16(p, v & 0xffff);
+  put16(p + 2, v >> 16);
+}
+
+int main(void) {
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_TEX1;
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 4 * sizeof(Vertex),
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  Vertex quad[4] = {{-1.0f, -1.0f, 0.5f, 0.0f, 1.0f},
+                    {1.0f, -1.0f, 0.5f, 1.0f, 1.0f},
+                    {-1.0f, 1.0f, 0.5f, 0.0f, 0.0f},
+                    {1.0f, 1.0f, 0.5f, 1.0f, 0.0f}};
+  BYTE *data;
+  vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  memcpy(data, quad, sizeof(quad));
+  vb->lpVtbl->Unlock(vb);
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+
+  device->lpVtbl->SetVertexShader(device, fvf);
+  device->lpVtbl->SetStreamSource(device, 0, vb, sizeof(Vertex));
+  device->lpVtbl->SetIndices(device, ib, 0);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  device->lpVtbl->SetRenderState(device, D3DRS_LIGHTING, FALSE);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_MINFILTER,
+                                       D3DTEXF_POINT);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_MAGFILTER,
+                                       D3DTEXF_POINT);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_ADDRESSU,
+                                       D3DTADDRESS_CLAMP);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_ADDRESSV,
+                                       D3DTADDRESS_CLAMP);
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+  // Native NPOT is only there when GL has it; otherwise padding may happen,
+  // which caps report as conditional NPOT support
+  D3DCAPS8 caps;
+  device->lpVtbl->GetDeviceCaps(device, &caps);
+  HRESULT native =
+      D3DGLESSetDeviceOption(device, D3DGLES_OPTION_NPOT_TEXTURES,
+                             D3DGLES_NPOT_NATIVE);
+  assert(native == (caps.TextureCaps & D3DPTEXTURECAPS_POW2
+                        ? D3DERR_NOTAVAILABLE
+                        : D3D_OK));
+  assert(D3DGLESSetDeviceOption(device, D3DGLES_OPTION_NPOT_TEXTURES, 4) ==
+         D3DERR_INVALIDCALL);
+  assert(D3DGLESSetDeviceOption(device, D3DGLES_OPTION_NPOT_TEXTURES,
+                                D3DGLES_NPOT_AUTO) == D3D_OK);
+  device->lpVtbl->GetDeviceCaps(device, &caps);
+  assert(caps.TextureCaps & D3DPTEXTURECAPS_NONPOW2CONDITIONAL);
+
+  // Padding: 6x5 sits in the corner of 8x8, and the texture matrix maps the
+  // quad onto its six columns. Pixel 3 samples texel 2, not 3.
+  assert(D3DGLESSetDeviceOption(device, D3DGLES_OPTION_NPOT_TEXTURES,
+                                D3DGLES_NPOT_PAD) == D3D_OK);
+  IDirect3DTexture8 *padded = create(device, 6, 5, 1, 0, D3DFMT_A8R8G8B8);
+  DWORD built = stats(device).NpotTexelsBuilt;
+  fill(padded, 0, NULL, 3, RED, GREEN);
+  assert(stats(device).NpotTexelsBuilt == built + 64);
+  unsigned char row[8][4];
+  draw(device, padded, row);
+  assert(is(row[0], RED) && is(row[3], RED));
+  assert(is(row[4], GREEN) && is(row[7], GREEN));
+  D3DSURFACE_DESC desc;
+  padded->lpVtbl->GetLevelDesc(padded, 0, &desc);
+  assert(desc.Width == 6 && desc.Height == 5);
+
+  // Later locks rebuild only what they touch, plus the padding beside an
+  // edge they reach
+  built = stats(device).NpotTexelsBuilt;
+  RECT corner = {0, 0, 2, 2};
+  fill(padded, 0, &corner, 2, BLUE, BLUE);
+  assert(stats(device).NpotTexelsBuilt == built + 4);
+  RECT edge = {4, 0, 6, 1};
+  fill(padded, 0, &edge, 0, BLUE, BLUE);
+  assert(stats(device).NpotTexelsBuilt == built + 4 + 4);
+  draw(device, padded, row);
+  assert(is(row[0], BLUE) && is(row[3], RED) && is(row[4], GREEN));
+  assert(is(row[7], BLUE));
+
+  // Reading back goes through the padded copy
+  IDirect3DTexture8 *copy = create(device, 6, 5, 1, 0, D3DFMT_A8R8G8B8);
+  IDirect3DSurface8 *from = NULL, *to = NULL;
+  padded->lpVtbl->GetSurfaceLevel(padded, 0, &from);
+  copy->lpVtbl->GetSurfaceLevel(copy, 0, &to);
+  hr = D3DXLoadSurfaceFromSurface(to, NULL, NULL, from, NULL, NULL,
+                                  D3DX_FILTER_POINT, 0);
+  assert(hr == D3D_OK);
+  draw(device, copy, row);
+  assert(is(row[0], BLUE) && is(row[3], RED) && is(row[7], BLUE));
+  to->lpVtbl->Release(to);
+  from->lpVtbl->Release(from);
+  copy->lpVtbl->Release(copy);
+
+  // Rescaling: 6x5 resamples to 8x4. A later lock refilters only the GL
+  // texels near it, from the rest of the level as last written.
+  assert(D3DGLESSetDeviceOption(device, D3DGLES_OPTION_NPOT_TEXTURES,
+                                D3DGLES_NPOT_RESCALE) == D3D_OK);
+  IDirect3DTexture8 *scaled = create(device, 6, 5, 1, 0, D3DFMT_A8R8G8B8);
+  built = stats(device).NpotTexelsBuilt;
+  fill(scaled, 0, NULL, 3, RED, GREEN);
+  assert(stats(device).NpotTexelsBuilt == built + 32);
+  draw(device, scaled, row);
+  assert(is(row[0], RED) && is(row[7], GREEN));
+  built = stats(device).NpotTexelsBuilt;
+  RECT dot = {0, 0, 1, 1};
+  fill(scaled, 0, &dot, 1, RED, RED);
+  DWORD rebuilt = stats(device).NpotTexelsBuilt - built;
+  assert(rebuilt > 0 && rebuilt < 32);
+  RECT right = {3, 0, 6, 5};
+  fill(scaled, 0, &right, 0, BLUE, BLUE);
+  draw(device, scaled, row);
+  assert(is(row[0], RED) && is(row[7], BLUE));
+
+  // Mip chains round down, so 6x6 keeps its three levels as 4x4, 2x2, 1x1
+  IDirect3DTexture8 *chain = create(device, 6, 6, 0, 0, D3DFMT_A8R8G8B8);
+  for (UINT level = 0; level < 3; level++) fill(chain, level, NULL, 0, 0, GREEN);
+  chain->lpVtbl->GetLevelDesc(chain, 1, &desc);
+  assert(desc.Width == 3 && desc.Height == 3);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_MIPFILTER,
+                                       D3DTEXF_POINT);
+  draw(device, chain, row);
+  assert(is(row[0], GREEN) && is(row[7], GREEN));
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_MIPFILTER,
+                                       D3DTEXF_NONE);
+
+  // Compressed NPOT blocks are decoded so they can be resampled
+  IDirect3DTexture8 *blocks = create(device, 12, 12, 1, 0, D3DFMT_DXT1);
+  D3DLOCKED_RECT locked;
+  assert(blocks->lpVtbl->LockRect(blocks, 0, &locked, NULL, 0) == D3D_OK);
+  static const BYTE red_block[8] = {0x00, 0xf8, 0x00, 0xf8, 0, 0, 0, 0};
+  for (int i = 0; i < 9; i++) memcpy((BYTE *)locked.pBits + i * 8, red_block, 8);
+  assert(blocks->lpVtbl->UnlockRect(blocks, 0) == D3D_OK);
+  draw(device, blocks, row);
+  assert(is(row[0], RED) && is(row[7], RED));
+
+  // Automatic choice: padding 6x6 to 8x8 costs under twice the texels, 5x5
+  // does not and rescales to 4x4, unless it is dynamic
+  assert(D3DGLESSetDeviceOption(device, D3DGLES_OPTION_NPOT_TEXTURES,
+                                D3DGLES_NPOT_AUTO) == D3D_OK);
+  DWORD resident = stats(device).ResidentBytes;
+  IDirect3DTexture8 *cheap = create(device, 6, 6, 1, 0, D3DFMT_A8R8G8B8);
+  fill(cheap, 0, NULL, 0, 0, GREEN);
+  assert(stats(device).ResidentBytes == resident + 8 * 8 * 4);
+  resident = stats(device).ResidentBytes;
+  IDirect3DTexture8 *costly = create(device, 5, 5, 1, 0, D3DFMT_A8R8G8B8);
+  fill(costly, 0, NULL, 0, 0, GREEN);
+  assert(stats(device).ResidentBytes == resident + 4 * 4 * 4);
+  resident = stats(device).ResidentBytes;
+  IDirect3DTexture8 *dynamic = NULL;
+  hr = device->lpVtbl->CreateTexture(device, 5, 5, 1, D3DUSAGE_DYNAMIC,
+                                     D3DFMT_A8R8G8B8, D3DPOOL_DEFAULT,
+                                     &dynamic);
+  assert(hr == D3D_OK && dynamic);
+  fill(dynamic, 0, NULL, 3, RED, GREEN);
+  assert(stats(device).ResidentBytes == resident + 8 * 8 * 4);
+  draw(device, dynamic, row);
+  assert(is(row[0], RED) && is(row[7], GREEN));
+
+  // Background loads build the storage on the decode thread: a 4x3 BMP
+  // rescales to 4x4
+  assert(D3DGLESSetDeviceOption(device, D3DGLES_OPTION_NPOT_TEXTURES,
+                                D3DGLES_NPOT_RESCALE) == D3D_OK);
+  BYTE bmp[54 + 4 * 3 * 3] = {'B', 'M'};
+  put32(bmp + 2, sizeof(bmp));
+  put32(bmp + 10, 54);
+  put32(bmp + 14, 40);
+  put32(bmp + 18, 4);
+  put32(bmp + 22, 3);
+  put16(bmp + 26, 1);
+  put16(bmp + 28, 24);
+  for (int i = 0; i < 12; i++) bmp[54 + i * 3] = 0xff;
+  IDirect3DTexture8 *loaded = NULL;
+  hr = D3DGLESCreateTextureFromFileInMemoryAsync(
+      device, bmp, sizeof(bmp), (UINT)D3DX_DEFAULT, (UINT)D3DX_DEFAULT, 1, 0,
+      D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, D3DX_DEFAULT, D3DX_DEFAULT, 0, NULL,
+      NULL, NULL, &loaded);
+  assert(hr == D3D_OK && loaded);
+  assert(D3DGLESGetTextureStatus(loaded, TRUE) == D3D_OK);
+  loaded->lpVtbl->GetLevelDesc(loaded, 0, &desc);
+  assert(desc.Width == 4 && desc.Height == 3);
+  draw(device, loaded, row);
+  assert(is(row[0], BLUE) && is(row[7], BLUE));
+  assert(glGetError() == GL_NO_ERROR);
+
+  device->lpVtbl->SetTexture(device, 0, NULL);
+  loaded->lpVtbl->Release(loaded);
+  dynamic->lpVtbl->Release(dynamic);
+  costly->lpVtbl->Release(costly);
+  cheap->lpVtbl->Release(cheap);
+  blocks->lpVtbl->Release(blocks);
+  chain->lpVtbl->Release(chain);
+  scaled->lpVtbl->Release(scaled);
+  padded->lpVtbl->Release(padded);
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
@@ -0,0 +1,182 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <string.h>
+
+typedef struct {
+  float x, y, z;
+  float u, v;
+} Vertex;
+
+#define TEXTURE_BYTES (4 * 4 * 4)
+
+// Fills `rect` of level 0 (all of it when NULL) with `color`
+static void fill(IDirect3DTexture8 *texture, const RECT *area,
+                 unsigned int color) {
+  D3DLOCKED_RECT rect;
+  HRESULT hr = texture->lpVtbl->LockRect(texture, 0, &rect, area, 0);
+  assert(hr == D3D_OK);
+  int w = area ? area->right - area->left : 4;
+  int h = area ? area->bottom - area->top : 4;
+  for (int y = 0; y < h; y++) {
+    unsigned int *row = (unsigned int *)((BYTE *)rect.pBits + y * rect.Pitch);
+    for (int x = 0; x < w; x++) row[x] = color;
+  }
+  texture->lpVtbl->UnlockRect(texture, 0);
+}
+
+// Colour of the middle pixel with whatever is bound on stage 0
+static void draw(IDirect3DDevice8 *device, unsigned char pixel[4]) {
+  glClear(GL_COLOR_BUFFER_BIT);
+  HRESULT hr = device->lpVtbl->DrawIndexedPrimitive(
+      device, D3DPT_TRIANGLELIST, 0, 4, 0, 2);
+  assert(hr == D3D_OK);
+  glReadPixels(4, 4, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+}
+
+static D3DGLES_STATS stats(IDirect3DDevice8 *device) {
+  D3DGLES_STATS s;
+  D3DGLESGetDeviceStats(device, &s);
+  return s;
+}
+
+static void present(IDirect3DDevice8 *device) {
+  device->lpVtbl->Present(device, NULL, NULL, NULL, NULL);
+}
+
+int main(void) {
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_TEX1;
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 4 * sizeof(Vertex),
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  Vertex quad[4] = {{-1.0f, -1.0f, 0.5f, 0.0f, 1.0f},
+                    {1.0f, -1.0f, 0.5f, 1.0f, 1.0f},
+                    {-1.0f, 1.0f, 0.5f, 0.0f, 0.0f},
+                    {1.0f, 1.0f, 0.5f, 1.0f, 0.0f}};
+  BYTE *data;
+  vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  memcpy(data, quad, sizeof(quad));
+  vb->lpVtbl->Unlock(vb);
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+
+  device->lpVtbl->SetVertexShader(device, fvf);
+  device->lpVtbl->SetStreamSource(device, 0, vb, sizeof(Vertex));
+  device->lpVtbl->SetIndices(device, ib, 0);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  device->lpVtbl->SetRenderState(device, D3DRS_LIGHTING, FALSE);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_MINFILTER,
+                                       D3DTEXF_POINT);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_MAGFILTER,
+                                       D3DTEXF_POINT);
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+  assert(D3DGLESSetDeviceOption(device, D3DGLES_OPTION_TEXTURE_RENAMES, 0) ==
+         D3DERR_INVALIDCALL);
+  assert(D3DGLESSetDeviceOption(device, D3DGLES_OPTION_TEXTURE_RENAMES, 4) ==
+         D3DERR_INVALIDCALL);
+
+  // Dynamic textures rename on the first full upload of every frame,
+  // cycling through three copies. Binding gave this one storage already.
+  DWORD base = stats(device).ResidentBytes;
+  IDirect3DTexture8 *video = NULL;
+  hr = device->lpVtbl->CreateTexture(device, 4, 4, 1, D3DUSAGE_DYNAMIC,
+                                     D3DFMT_A8R8G8B8, D3DPOOL_DEFAULT, &video);
+  assert(hr == D3D_OK && video);
+  D3DSURFACE_DESC desc;
+  video->lpVtbl->GetLevelDesc(video, 0, &desc);
+  assert(desc.Usage == D3DUSAGE_DYNAMIC);
+  device->lpVtbl->SetTexture(device, 0, video);
+  static const unsigned int colors[6] = {0xffff0000, 0xff00ff00, 0xff0000ff,
+                                         0xffffff00, 0xff00ffff, 0xffff00ff};
+  unsigned char p[4];
+  for (int frame = 0; frame < 6; frame++) {
+    fill(video, NULL, colors[frame]);
+    draw(device, p);
+    assert(p[0] == (colors[frame] >> 16 & 0xff));
+    assert(p[1] == (colors[frame] >> 8 & 0xff));
+    assert(p[2] == (colors[frame] & 0xff));
+    assert(stats(device).TextureRenames == (DWORD)frame + 1);
+    // Later uploads in the same frame go to the copy it already uses, as do
+    // partial ones
+    RECT corner = {0, 0, 2, 2};
+    fill(video, &corner, colors[frame]);
+    fill(video, NULL, colors[frame]);
+    assert(stats(device).TextureRenames == (DWORD)frame + 1);
+    present(device);
+  }
+  assert(stats(device).ResidentBytes == base + 3 * TEXTURE_BYTES);
+
+  // Other textures start renaming once they are rewritten three frames in a
+  // row; a frame without a full upload starts the count again
+  IDirect3DTexture8 *minimap = NULL;
+  hr = device->lpVtbl->CreateTexture(device, 4, 4, 1, 0, D3DFMT_A8R8G8B8,
+                                     D3DPOOL_MANAGED, &minimap);
+  assert(hr == D3D_OK && minimap);
+  device->lpVtbl->SetTexture(device, 0, minimap);
+  DWORD renames = stats(device).TextureRenames;
+  fill(minimap, NULL, colors[0]);
+  present(device);
+  fill(minimap, NULL, colors[1]);
+  present(device);
+  present(device);
+  fill(minimap, NULL, colors[2]);
+  present(device);
+  fill(minimap, NULL, colors[3]);
+  present(device);
+  assert(stats(device).TextureRenames == renames);
+  fill(minimap, NULL, colors[4]);
+  assert(stats(device).TextureRenames == renames + 1);
+  draw(device, p);
+  assert(p[0] == 0 && p[1] == 255 && p[2] == 255);
+  present(device);
+
+  // One copy turns renaming off
+  assert(D3DGLESSetDeviceOption(device, D3DGLES_OPTION_TEXTURE_RENAMES, 1) ==
+         D3D_OK);
+  renames = stats(device).TextureRenames;
+  fill(minimap, NULL, colors[5]);
+  draw(device, p);
+  assert(p[0] == 255 && p[1] == 0 && p[2] == 255);
+  assert(stats(device).TextureRenames == renames);
+  assert(glGetError() == GL_NO_ERROR);
+
+  device->lpVtbl->SetTexture(device, 0, NULL);
+  minimap->lpVtbl->Release(minimap);
+  video->lpVtbl->Release(video);
+  assert(stats(device).ResidentBytes == base);
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
@@ -34,7 +34,13 @@ int main(void) {
     assert(hr == D3D_OK && "SetTextureStageState COLORARG1 failed");
 
     hr = device->lpVtbl->SetTextureStageState(device, 1, D3DTSS_COLOROP, D3DTOP_MODULATE);
-    assert(hr == D3DERR_INVALIDCALL && "Stage1 should fail");
+    assert(hr == D3D_OK && "SetTextureStageState stage 1 failed");
+
+    hr = device->lpVtbl->SetTextureStageState(device, 8, D3DTSS_COLOROP, D3DTOP_MODULATE);
+    assert(hr == D3DERR_INVALIDCALL && "Stage 8 should fail");
+
+    hr = device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_COLORARG1, 0x40);
+    assert(hr == D3DERR_INVALIDCALL && "Undefined argument flags should fail");
 
     tex->lpVtbl->Release(tex);
     device->lpVtbl->Release(device);
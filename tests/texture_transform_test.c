@@ -0,0 +1,217 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <string.h>
+
+typedef struct {
+  float x, y, z;
+  float u, v;
+} Vertex;
+
+// GL_RGBA bytes read back as a little-endian word
+#define RED 0xff0000ffu
+#define BLUE 0xffff0000u
+
+// Left half red, right half blue
+static IDirect3DTexture8 *create(IDirect3DDevice8 *device) {
+  IDirect3DTexture8 *texture = NULL;
+  HRESULT hr = device->lpVtbl->CreateTexture(
+      device, 4, 4, 1, 0, D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, &texture);
+  assert(hr == D3D_OK && texture);
+  D3DLOCKED_RECT rect;
+  hr = texture->lpVtbl->LockRect(texture, 0, &rect, NULL, 0);
+  assert(hr == D3D_OK);
+  for (int y = 0; y < 4; y++) {
+    unsigned int *row = (unsigned int *)((BYTE *)rect.pBits + y * rect.Pitch);
+    for (int x = 0; x < 4; x++) row[x] = x < 2 ? 0xffff0000 : 0xff0000ff;
+  }
+  texture->lpVtbl->UnlockRect(texture, 0);
+  return texture;
+}
+
+// Draws the full-target quad and reads back one row
+static void draw(IDirect3DDevice8 *device, unsigned int row[8]) {
+  glClear(GL_COLOR_BUFFER_BIT);
+  HRESULT hr = device->lpVtbl->DrawIndexedPrimitive(
+      device, D3DPT_TRIANGLELIST, 0, 4, 0, 2);
+  assert(hr == D3D_OK);
+  glReadPixels(0, 4, 8, 1, GL_RGBA, GL_UNSIGNED_BYTE, row);
+}
+
+// Left four pixels `left`, right four `right`
+static void check(const unsigned int row[8], unsigned int left,
+                  unsigned int right) {
+  for (int i = 0; i < 8; i++) assert(row[i] == (i < 4 ? left : right));
+}
+
+static DWORD matrix_loads(IDirect3DDevice8 *device) {
+  D3DGLES_STATS s;
+  D3DGLESGetDeviceStats(device, &s);
+  return s.TextureMatrixLoads;
+}
+
+static void set_flags(IDirect3DDevice8 *device, DWORD flags) {
+  HRESULT hr = device->lpVtbl->SetTextureStageState(
+      device, 0, D3DTSS_TEXTURETRANSFORMFLAGS, flags);
+  assert(hr == D3D_OK);
+}
+
+int main(void) {
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_TEX1;
+  IDirect3DVertexBuffer8 *vb = NULL;
+  hr = device->lpVtbl->CreateVertexBuffer(device, 4 * sizeof(Vertex),
+                                          D3DUSAGE_WRITEONLY, fvf,
+                                          D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  Vertex quad[4] = {{-1.0f, -1.0f, 0.5f, 0.0f, 1.0f},
+                    {1.0f, -1.0f, 0.5f, 1.0f, 1.0f},
+                    {-1.0f, 1.0f, 0.5f, 0.0f, 0.0f},
+                    {1.0f, 1.0f, 0.5f, 1.0f, 0.0f}};
+  BYTE *data;
+  vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  memcpy(data, quad, sizeof(quad));
+  vb->lpVtbl->Unlock(vb);
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, 6 * sizeof(WORD),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  WORD indices[6] = {0, 1, 2, 2, 1, 3};
+  ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+
+  device->lpVtbl->SetVertexShader(device, fvf);
+  device->lpVtbl->SetStreamSource(device, 0, vb, sizeof(Vertex));
+  device->lpVtbl->SetIndices(device, ib, 0);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  device->lpVtbl->SetRenderState(device, D3DRS_LIGHTING, FALSE);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_MINFILTER,
+                                       D3DTEXF_POINT);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_MAGFILTER,
+                                       D3DTEXF_POINT);
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+  assert(device->lpVtbl->SetTextureStageState(
+             device, 0, D3DTSS_TEXTURETRANSFORMFLAGS, 5) ==
+         D3DERR_INVALIDCALL);
+
+  IDirect3DTexture8 *texture = create(device);
+  device->lpVtbl->SetTexture(device, 0, texture);
+  unsigned int row[8];
+  draw(device, row);
+  check(row, RED, BLUE);
+
+  // Scrolling by half the texture; the third row translates 2D coordinates,
+  // and is ignored while the flags are off
+  D3DXMATRIX scroll;
+  D3DXMatrixIdentity(&scroll);
+  scroll._31 = 0.5f;
+  hr = device->lpVtbl->SetTransform(device, D3DTS_TEXTURE0, &scroll);
+  assert(hr == D3D_OK);
+  draw(device, row);
+  check(row, RED, BLUE);
+  set_flags(device, D3DTTFF_COUNT2);
+  draw(device, row);
+  check(row, BLUE, RED);
+
+  // Nothing is reloaded until the matrix or flags change
+  DWORD loads = matrix_loads(device);
+  hr = device->lpVtbl->SetTransform(device, D3DTS_TEXTURE0, &scroll);
+  assert(hr == D3D_OK);
+  draw(device, row);
+  check(row, BLUE, RED);
+  assert(matrix_loads(device) == loads);
+  scroll._31 = 0.0f;
+  device->lpVtbl->SetTransform(device, D3DTS_TEXTURE0, &scroll);
+  draw(device, row);
+  check(row, RED, BLUE);
+  assert(matrix_loads(device) == loads + 1);
+
+  // Projected coordinates divide by the last counted output: w = 2 halves u
+  D3DXMATRIX project;
+  D3DXMatrixIdentity(&project);
+  project._33 = 2.0f;
+  device->lpVtbl->SetTransform(device, D3DTS_TEXTURE0, &project);
+  set_flags(device, D3DTTFF_COUNT3 | D3DTTFF_PROJECTED);
+  draw(device, row);
+  check(row, RED, RED);
+
+  // Turning the flags off again leaves the coordinates alone
+  set_flags(device, D3DTTFF_DISABLE);
+  draw(device, row);
+  check(row, RED, BLUE);
+
+  // Deferred draws keep the matrix they were recorded with
+  hr = D3DGLESSetDeviceOption(device, D3DGLES_OPTION_DEFERRED_SCENE, TRUE);
+  assert(hr == D3D_OK);
+  scroll._31 = 0.5f;
+  device->lpVtbl->SetTransform(device, D3DTS_TEXTURE0, &scroll);
+  set_flags(device, D3DTTFF_COUNT2);
+  glClear(GL_COLOR_BUFFER_BIT);
+  device->lpVtbl->BeginScene(device);
+  hr = device->lpVtbl->DrawIndexedPrimitive(device, D3DPT_TRIANGLELIST, 0, 4,
+                                            0, 2);
+  assert(hr == D3D_OK);
+  scroll._31 = 0.0f;
+  device->lpVtbl->SetTransform(device, D3DTS_TEXTURE0, &scroll);
+  device->lpVtbl->EndScene(device);
+  glReadPixels(0, 4, 8, 1, GL_RGBA, GL_UNSIGNED_BYTE, row);
+  check(row, BLUE, RED);
+  draw(device, row);
+  check(row, RED, BLUE);
+  set_flags(device, D3DTTFF_DISABLE);
+  D3DGLESSetDeviceOption(device, D3DGLES_OPTION_DEFERRED_SCENE, FALSE);
+
+  // Atlased textures map the transformed coordinates onto their page; they
+  // have to stay within the texture
+  hr = D3DGLESSetDeviceOption(device, D3DGLES_OPTION_TEXTURE_ATLAS, 16);
+  assert(hr == D3D_OK);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_ADDRESSU,
+                                       D3DTADDRESS_CLAMP);
+  device->lpVtbl->SetTextureStageState(device, 0, D3DTSS_ADDRESSV,
+                                       D3DTADDRESS_CLAMP);
+  IDirect3DTexture8 *atlased = create(device);
+  D3DGLES_STATS s;
+  D3DGLESGetDeviceStats(device, &s);
+  assert(s.AtlasTextures == 1);
+  device->lpVtbl->SetTexture(device, 0, atlased);
+  D3DXMATRIX zoom;
+  D3DXMatrixIdentity(&zoom);
+  zoom._11 = 0.5f;
+  zoom._31 = 0.5f;
+  device->lpVtbl->SetTransform(device, D3DTS_TEXTURE0, &zoom);
+  set_flags(device, D3DTTFF_COUNT2);
+  draw(device, row);
+  check(row, BLUE, BLUE);
+  assert(glGetError() == GL_NO_ERROR);
+
+  device->lpVtbl->SetTexture(device, 0, NULL);
+  atlased->lpVtbl->Release(atlased);
+  texture->lpVtbl->Release(texture);
+  ib->lpVtbl->Release(ib);
+  vb->lpVtbl->Release(vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
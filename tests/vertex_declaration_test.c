@@ -0,0 +1,242 @@
+#include <assert.h>
+#include <d3d8_to_gles.h>
+#include <string.h>
+
+// Forward declarations for helper functions not in the public header
+UINT WINAPI D3DXGetFVFVertexSize(DWORD FVF);
+HRESULT WINAPI D3DXDeclaratorFromFVF(DWORD FVF, DWORD Declaration[MAX_FVF_DECL_SIZE]);
+
+typedef struct {
+  float x, y, z;
+  unsigned int color;
+} Vertex;
+
+// Same layout with application data between vertices
+typedef struct {
+  float x, y, z;
+  unsigned int color;
+  float pad[2];
+} PaddedVertex;
+
+static const unsigned int colors[4] = {0xffff0000, 0xff00ff00, 0xff0000ff,
+                                       0xffffffff};
+
+static IDirect3DVertexBuffer8 *make_vb(IDirect3DDevice8 *device,
+                                       const void *src, UINT size) {
+  IDirect3DVertexBuffer8 *vb = NULL;
+  HRESULT hr = device->lpVtbl->CreateVertexBuffer(
+      device, size, D3DUSAGE_WRITEONLY, 0, D3DPOOL_MANAGED, &vb);
+  assert(hr == D3D_OK && vb);
+  BYTE *data;
+  hr = vb->lpVtbl->Lock(vb, 0, 0, &data, 0);
+  assert(hr == D3D_OK);
+  memcpy(data, src, size);
+  vb->lpVtbl->Unlock(vb);
+  return vb;
+}
+
+static void draw(IDirect3DDevice8 *device, unsigned char *pixels) {
+  glClear(GL_COLOR_BUFFER_BIT);
+  HRESULT hr = device->lpVtbl->DrawIndexedPrimitive(
+      device, D3DPT_TRIANGLELIST, 0, 16, 0, 8);
+  assert(hr == D3D_OK);
+  device->lpVtbl->EndScene(device);
+  glReadPixels(0, 0, 8, 8, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+}
+
+int main(void) {
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  assert(d3d && "Failed to create D3D8 interface");
+
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 8;
+  pp.BackBufferHeight = 8;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.hDeviceWindow = 0;
+  pp.Windowed = TRUE;
+  pp.EnableAutoDepthStencil = FALSE;
+  pp.FullScreen_PresentationInterval = D3DPRESENT_INTERVAL_IMMEDIATE;
+
+  IDirect3DDevice8 *device = NULL;
+  HRESULT hr =
+      d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL,
+                                pp.hDeviceWindow, 0, &pp, &device);
+  assert(hr == D3D_OK && "CreateDevice failed");
+
+  D3DCAPS8 caps;
+  device->lpVtbl->GetDeviceCaps(device, &caps);
+  assert(caps.MaxStreams >= 2);
+
+  // Four colored quads, one per screen quadrant
+  Vertex verts[16];
+  PaddedVertex padded[16];
+  float positions[16][3];
+  unsigned int vertex_colors[16];
+  WORD indices[24];
+  for (int q = 0; q < 4; q++) {
+    float x0 = (float)(q % 2) - 1.0f, y0 = (float)(q / 2) - 1.0f;
+    for (int v = 0; v < 4; v++) {
+      Vertex *vert = &verts[q * 4 + v];
+      vert->x = x0 + (float)(v % 2);
+      vert->y = y0 + (float)(v / 2);
+      vert->z = 0.5f;
+      vert->color = colors[q];
+      memset(&padded[q * 4 + v], 0xcd, sizeof(PaddedVertex));
+      memcpy(&padded[q * 4 + v], vert, sizeof(Vertex));
+      memcpy(positions[q * 4 + v], vert, sizeof(positions[0]));
+      vertex_colors[q * 4 + v] = vert->color;
+    }
+    WORD quad[6] = {0, 1, 2, 2, 1, 3};
+    for (int i = 0; i < 6; i++) indices[q * 6 + i] = (WORD)(quad[i] + q * 4);
+  }
+
+  IDirect3DVertexBuffer8 *tight_vb = make_vb(device, verts, sizeof(verts));
+  IDirect3DVertexBuffer8 *padded_vb = make_vb(device, padded, sizeof(padded));
+  IDirect3DVertexBuffer8 *position_vb =
+      make_vb(device, positions, sizeof(positions));
+  IDirect3DVertexBuffer8 *color_vb =
+      make_vb(device, vertex_colors, sizeof(vertex_colors));
+
+  IDirect3DIndexBuffer8 *ib = NULL;
+  hr = device->lpVtbl->CreateIndexBuffer(device, sizeof(indices),
+                                         D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                         D3DPOOL_MANAGED, &ib);
+  assert(hr == D3D_OK && ib);
+  BYTE *data;
+  hr = ib->lpVtbl->Lock(ib, 0, 0, &data, 0);
+  assert(hr == D3D_OK);
+  memcpy(data, indices, sizeof(indices));
+  ib->lpVtbl->Unlock(ib);
+  device->lpVtbl->SetIndices(device, ib, 0);
+  device->lpVtbl->SetRenderState(device, D3DRS_ZENABLE, FALSE);
+  device->lpVtbl->SetRenderState(device, D3DRS_CULLMODE, D3DCULL_NONE);
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+  // Reference: tightly packed FVF vertices
+  DWORD fvf = D3DFVF_XYZ | D3DFVF_DIFFUSE;
+  unsigned char reference[8 * 8 * 4];
+  unsigned char pixels[8 * 8 * 4];
+  hr = device->lpVtbl->SetVertexShader(device, fvf);
+  assert(hr == D3D_OK);
+  DWORD handle = 0;
+  device->lpVtbl->GetVertexShader(device, &handle);
+  assert(handle == fvf);
+  device->lpVtbl->SetStreamSource(device, 0, tight_vb,
+                                  D3DXGetFVFVertexSize(fvf));
+  draw(device, reference);
+  assert(memcmp(reference, reference + 4 * 4, 4) != 0);
+  assert(memcmp(reference, reference + (4 * 8) * 4, 4) != 0);
+
+  // The stream stride is honored, not recomputed from the FVF
+  device->lpVtbl->SetStreamSource(device, 0, padded_vb, sizeof(PaddedVertex));
+  draw(device, pixels);
+  assert(memcmp(reference, pixels, sizeof(reference)) == 0);
+
+  // Including when the draws are CPU-transformed into a batch
+  D3DGLESSetDeviceOption(device, D3DGLES_OPTION_DYNAMIC_BATCHING, TRUE);
+  D3DGLES_STATS before, after;
+  D3DGLESGetDeviceStats(device, &before);
+  draw(device, pixels);
+  D3DGLESGetDeviceStats(device, &after);
+  assert(after.BatchedDraws == before.BatchedDraws + 1);
+  assert(memcmp(reference, pixels, sizeof(reference)) == 0);
+  D3DGLESSetDeviceOption(device, D3DGLES_OPTION_DYNAMIC_BATCHING, FALSE);
+
+  // Positions and colors from separate streams
+  DWORD decl[] = {D3DVSD_STREAM(0), D3DVSD_REG(D3DVSDE_POSITION, D3DVSDT_FLOAT3),
+                  D3DVSD_STREAM(1), D3DVSD_REG(D3DVSDE_DIFFUSE, D3DVSDT_D3DCOLOR),
+                  D3DVSD_END()};
+  DWORD shader = 0;
+  hr = device->lpVtbl->CreateVertexShader(device, decl, NULL, &shader, 0);
+  assert(hr == D3D_OK && shader > 0xFFFF);
+  hr = device->lpVtbl->SetVertexShader(device, shader);
+  assert(hr == D3D_OK);
+  device->lpVtbl->GetVertexShader(device, &handle);
+  assert(handle == shader);
+  device->lpVtbl->SetStreamSource(device, 0, position_vb, sizeof(positions[0]));
+  device->lpVtbl->SetStreamSource(device, 1, NULL, 0);
+  // A declared stream without a buffer cannot be drawn
+  hr = device->lpVtbl->DrawIndexedPrimitive(device, D3DPT_TRIANGLELIST, 0, 16,
+                                            0, 8);
+  assert(hr == D3DERR_INVALIDCALL);
+  device->lpVtbl->SetStreamSource(device, 1, color_vb, sizeof(unsigned int));
+  draw(device, pixels);
+  assert(memcmp(reference, pixels, sizeof(reference)) == 0);
+
+  // Deferred scenes replay with the declaration that was current
+  D3DGLESSetDeviceOption(device, D3DGLES_OPTION_DEFERRED_SCENE, TRUE);
+  device->lpVtbl->BeginScene(device);
+  glClear(GL_COLOR_BUFFER_BIT);
+  hr = device->lpVtbl->DrawIndexedPrimitive(device, D3DPT_TRIANGLELIST, 0, 16,
+                                            0, 8);
+  assert(hr == D3D_OK);
+  device->lpVtbl->SetVertexShader(device, fvf);
+  device->lpVtbl->EndScene(device);
+  glReadPixels(0, 0, 8, 8, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+  assert(memcmp(reference, pixels, sizeof(reference)) == 0);
+  D3DGLESSetDeviceOption(device, D3DGLES_OPTION_DEFERRED_SCENE, FALSE);
+
+  // Skipped registers and padding inside a single stream
+  DWORD skip_decl[] = {D3DVSD_STREAM(0),
+                       D3DVSD_REG(D3DVSDE_POSITION, D3DVSDT_FLOAT3),
+                       D3DVSD_REG(D3DVSDE_DIFFUSE, D3DVSDT_D3DCOLOR),
+                       D3DVSD_SKIP(2), D3DVSD_END()};
+  DWORD skip_shader = 0;
+  hr = device->lpVtbl->CreateVertexShader(device, skip_decl, NULL,
+                                          &skip_shader, 0);
+  assert(hr == D3D_OK && skip_shader != shader);
+  device->lpVtbl->SetVertexShader(device, skip_shader);
+  device->lpVtbl->SetStreamSource(device, 0, padded_vb, 0);
+  draw(device, pixels);
+  assert(memcmp(reference, pixels, sizeof(reference)) == 0);
+
+  // Declarations generated from FVFs are accepted
+  DWORD generated[MAX_FVF_DECL_SIZE];
+  hr = D3DXDeclaratorFromFVF(D3DFVF_XYZ | D3DFVF_NORMAL | D3DFVF_TEX1,
+                             generated);
+  assert(hr == D3D_OK);
+  DWORD generated_shader = 0;
+  hr = device->lpVtbl->CreateVertexShader(device, generated, NULL,
+                                          &generated_shader, 0);
+  assert(hr == D3D_OK);
+
+  // Unsupported declarations and shader functions are refused
+  DWORD function[] = {0xFFFE0101, 0x0000FFFF};
+  DWORD bad = 0;
+  assert(device->lpVtbl->CreateVertexShader(device, decl, function, &bad, 0) ==
+         D3DERR_INVALIDCALL);
+  DWORD float1_texcoord[] = {D3DVSD_STREAM(0),
+                             D3DVSD_REG(D3DVSDE_POSITION, D3DVSDT_FLOAT3),
+                             D3DVSD_REG(D3DVSDE_TEXCOORD0, D3DVSDT_FLOAT1),
+                             D3DVSD_END()};
+  assert(device->lpVtbl->CreateVertexShader(device, float1_texcoord, NULL,
+                                            &bad, 0) == D3DERR_INVALIDCALL);
+  DWORD far_stream[] = {D3DVSD_STREAM(GLES_MAX_STREAMS),
+                        D3DVSD_REG(D3DVSDE_POSITION, D3DVSDT_FLOAT3),
+                        D3DVSD_END()};
+  assert(device->lpVtbl->CreateVertexShader(device, far_stream, NULL, &bad,
+                                            0) == D3DERR_INVALIDCALL);
+  assert(device->lpVtbl->SetStreamSource(device, GLES_MAX_STREAMS, tight_vb,
+                                         16) == D3DERR_INVALIDCALL);
+
+  // Deleted handles are invalid
+  hr = device->lpVtbl->DeleteVertexShader(device, skip_shader);
+  assert(hr == D3D_OK);
+  assert(device->lpVtbl->SetVertexShader(device, skip_shader) ==
+         D3DERR_INVALIDCALL);
+  assert(device->lpVtbl->DeleteVertexShader(device, skip_shader) ==
+         D3DERR_INVALIDCALL);
+  device->lpVtbl->DeleteVertexShader(device, shader);
+  device->lpVtbl->DeleteVertexShader(device, generated_shader);
+
+  ib->lpVtbl->Release(ib);
+  color_vb->lpVtbl->Release(color_vb);
+  position_vb->lpVtbl->Release(position_vb);
+  padded_vb->lpVtbl->Release(padded_vb);
+  tight_vb->lpVtbl->Release(tight_vb);
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return 0;
+}
@@ -0,0 +1,166 @@
+#include <d3d8_to_gles.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "d3d8_image.h"
+#include "d3d8_workers.h"
+
+static void print_help(const char *prog) {
+  printf("Usage: %s [options]\n", prog);
+  printf("Options:\n");
+  printf("  --iterations <n>    Conversions per case (default 10)\n");
+  printf("  --size <n>          Source width and height (default 2048)\n");
+  printf("  --threads <n>       Worker threads, 0 for one per CPU (default 0)\n");
+  printf("  --help              Display this help and exit\n");
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// What an image library without kernels does: one texel at a time, a
+// format switch per read and write, float bilinear weights
+static uint32_t naive_read(D3DFORMAT format, const BYTE *row, UINT x) {
+  if (format == D3DFMT_R5G6B5) {
+    uint16_t c = ((const uint16_t *)row)[x];
+    return 0xff000000u | (uint32_t)((c >> 11) * 255 / 31) << 16 |
+           (uint32_t)((c >> 5 & 0x3f) * 255 / 63) << 8 | (c & 0x1f) * 255 / 31;
+  }
+  return ((const uint32_t *)row)[x];
+}
+
+static void naive_write(D3DFORMAT format, BYTE *row, UINT x, uint32_t c) {
+  if (format == D3DFMT_R5G6B5)
+    ((uint16_t *)row)[x] = (uint16_t)((c >> 19 & 0x1f) << 11 |
+                                      (c >> 10 & 0x3f) << 5 | (c >> 3 & 0x1f));
+  else
+    ((uint32_t *)row)[x] = c;
+}
+
+static void naive_convert(const GLES_PixelRect *src, const GLES_PixelRect *dst,
+                          DWORD filter) {
+  float sx = (float)src->width / dst->width;
+  float sy = (float)src->height / dst->height;
+  for (UINT y = 0; y < dst->height; y++) {
+    for (UINT x = 0; x < dst->width; x++) {
+      float fx = (x + 0.5f) * sx - 0.5f, fy = (y + 0.5f) * sy - 0.5f;
+      uint32_t out = 0;
+      if (filter == D3DX_FILTER_POINT) {
+        out = naive_read(src->format, src->bits + (size_t)(fy + 0.5f) * src->pitch,
+                         (UINT)(fx + 0.5f));
+      } else {
+        if (fx < 0) fx = 0;
+        if (fy < 0) fy = 0;
+        UINT x0 = (UINT)fx, y0 = (UINT)fy;
+        UINT x1 = x0 + 1 < src->width ? x0 + 1 : x0;
+        UINT y1 = y0 + 1 < src->height ? y0 + 1 : y0;
+        float wx = fx - x0, wy = fy - y0;
+        uint32_t t[4] = {
+            naive_read(src->format, src->bits + y0 * src->pitch, x0),
+            naive_read(src->format, src->bits + y0 * src->pitch, x1),
+            naive_read(src->format, src->bits + y1 * src->pitch, x0),
+            naive_read(src->format, src->bits + y1 * src->pitch, x1)};
+        for (int c = 0; c < 32; c += 8) {
+          float top = (t[0] >> c & 0xff) * (1 - wx) + (t[1] >> c & 0xff) * wx;
+          float bottom = (t[2] >> c & 0xff) * (1 - wx) + (t[3] >> c & 0xff) * wx;
+          out |= (uint32_t)lrintf(top * (1 - wy) + bottom * wy) << c;
+        }
+      }
+      naive_write(dst->format, dst->bits + y * dst->pitch, x, out);
+    }
+  }
+}
+
+typedef struct {
+  const char *name;
+  D3DFORMAT src_format, dst_format;
+  DWORD filter;
+  UINT num, den; // destination size is the source size times num / den
+} Case;
+
+static BYTE *image(D3DFORMAT format, UINT size, size_t *pitch) {
+  *pitch = (size_t)size * (format == D3DFMT_R5G6B5 ? 2 : 4);
+  BYTE *bits = malloc(*pitch * size);
+  if (!bits) return NULL;
+  uint32_t seed = 12345;
+  for (size_t i = 0; i < *pitch * size; i++)
+    bits[i] = (BYTE)((seed = seed * 1664525u + 1013904223u) >> 24);
+  return bits;
+}
+
+int main(int argc, char **argv) {
+  unsigned iterations = 10, size = 2048, threads = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      iterations = (unsigned)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+      size = (unsigned)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threads = (unsigned)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--help") == 0) {
+      print_help(argv[0]);
+      return 0;
+    } else {
+      print_help(argv[0]);
+      return 1;
+    }
+  }
+  if (!iterations || size < 4 || size > 16384) {
+    print_help(argv[0]);
+    return 1;
+  }
+
+  static const Case cases[] = {
+      {"ARGB -> ARGB point 1/2", D3DFMT_A8R8G8B8, D3DFMT_A8R8G8B8,
+       D3DX_FILTER_POINT, 1, 2},
+      {"ARGB -> 565 linear 1/2", D3DFMT_A8R8G8B8, D3DFMT_R5G6B5,
+       D3DX_FILTER_LINEAR, 1, 2},
+      {"565 -> ARGB linear 3/2", D3DFMT_R5G6B5, D3DFMT_A8R8G8B8,
+       D3DX_FILTER_LINEAR, 3, 2},
+      {"ARGB -> ARGB box 1/4", D3DFMT_A8R8G8B8, D3DFMT_A8R8G8B8,
+       D3DX_FILTER_BOX, 1, 4},
+  };
+  GLES_WorkerPool *pool = workers_create(threads);
+  printf("%ux%u source, %u iterations\n", size, size, iterations);
+  printf("%-26s %12s %12s %12s\n", "case", "naive ms", "kernel ms",
+         "threaded ms");
+  int status = 0;
+  for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]) && !status; c++) {
+    const Case *test = &cases[c];
+    UINT dst_size = size * test->num / test->den;
+    GLES_PixelRect src = {test->src_format, NULL, 0, size, size};
+    GLES_PixelRect dst = {test->dst_format, NULL, 0, dst_size, dst_size};
+    src.bits = image(src.format, size, &src.pitch);
+    dst.bits = image(dst.format, dst_size, &dst.pitch);
+    if (!src.bits || !dst.bits) {
+      fprintf(stderr, "Out of memory\n");
+      status = 1;
+    }
+    double times[3] = {0, 0, 0};
+    for (int run = 0; run < 3 && !status; run++) {
+      double start = now();
+      for (unsigned i = 0; i < iterations && !status; i++) {
+        // The naive loop has no box filter; it interpolates instead
+        if (run == 0)
+          naive_convert(&src, &dst, test->filter);
+        else if (image_convert(&src, NULL, &dst, test->filter, 0,
+                               run == 2 ? pool : NULL) != D3D_OK)
+          status = 1;
+      }
+      times[run] = (now() - start) * 1e3 / iterations;
+    }
+    if (!status)
+      printf("%-26s %12.2f %12.2f %12.2f\n", test->name, times[0], times[1],
+             times[2]);
+    free(dst.bits);
+    free(src.bits);
+  }
+  workers_destroy(pool);
+  if (status) fprintf(stderr, "Conversion failed\n");
+  return status;
+}
@@ -0,0 +1,189 @@
+#include <d3d8_to_gles.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "d3d8_etc1.h"
+#include "d3d8_image.h"
+#include "d3d8_texfilter.h"
+#include "d3d8_workers.h"
+
+typedef enum { ALPHA_AUTO, ALPHA_ON, ALPHA_OFF } AlphaMode;
+
+typedef struct {
+  UINT width, height;
+  uint32_t *texels; // A8R8G8B8, tightly packed
+} Level;
+
+static void print_help(const char *prog) {
+  printf("Usage: %s [options] <input.dds|bmp|tga> <output>\n", prog);
+  printf("Options:\n");
+  printf("  --mips              Build a full box-filtered mip chain\n");
+  printf("                      (default keeps the levels a DDS file has)\n");
+  printf("  --alpha <mode>      auto, on or off (default auto: only when\n");
+  printf("                      some texel is not opaque)\n");
+  printf("  --threads <n>       Encoder threads, 0 for one per CPU (default 0)\n");
+  printf("  --help              Display this help and exit\n");
+}
+
+static BYTE *read_file(const char *path, size_t *size) {
+  FILE *file = fopen(path, "rb");
+  if (!file) return NULL;
+  BYTE *data = NULL;
+  long length;
+  if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) > 0 &&
+      fseek(file, 0, SEEK_SET) == 0) {
+    data = malloc((size_t)length);
+    if (data && fread(data, 1, (size_t)length, file) != (size_t)length) {
+      free(data);
+      data = NULL;
+    }
+    *size = (size_t)length;
+  }
+  fclose(file);
+  return data;
+}
+
+static void put32(BYTE *p, uint32_t v) {
+  for (int i = 0; i < 4; i++) p[i] = (BYTE)(v >> (8 * i));
+}
+
+static BOOL any_translucent(const Level *level) {
+  size_t count = (size_t)level->width * level->height;
+  for (size_t i = 0; i < count; i++)
+    if (level->texels[i] >> 24 != 0xFF) return TRUE;
+  return FALSE;
+}
+
+static UINT chain_length(UINT width, UINT height) {
+  UINT levels = 0;
+  for (UINT size = width > height ? width : height; size; size >>= 1) levels++;
+  return levels;
+}
+
+int main(int argc, char **argv) {
+  const char *input = NULL, *output = NULL;
+  BOOL mips = FALSE;
+  AlphaMode alpha_mode = ALPHA_AUTO;
+  unsigned threads = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--mips") == 0) {
+      mips = TRUE;
+    } else if (strcmp(argv[i], "--alpha") == 0 && i + 1 < argc) {
+      ++i;
+      if (strcmp(argv[i], "auto") == 0) {
+        alpha_mode = ALPHA_AUTO;
+      } else if (strcmp(argv[i], "on") == 0) {
+        alpha_mode = ALPHA_ON;
+      } else if (strcmp(argv[i], "off") == 0) {
+        alpha_mode = ALPHA_OFF;
+      } else {
+        print_help(argv[0]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threads = (unsigned)atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--help") == 0) {
+      print_help(argv[0]);
+      return 0;
+    } else if (argv[i][0] != '-' && !input) {
+      input = argv[i];
+    } else if (argv[i][0] != '-' && !output) {
+      output = argv[i];
+    } else {
+      print_help(argv[0]);
+      return 1;
+    }
+  }
+  if (!input || !output) {
+    print_help(argv[0]);
+    return 1;
+  }
+
+  size_t size = 0;
+  BYTE *data = read_file(input, &size);
+  if (!data) {
+    fprintf(stderr, "Cannot read %s\n", input);
+    return 1;
+  }
+  GLES_ImageInfo info;
+  if (FAILED(image_parse(data, size, &info))) {
+    fprintf(stderr, "%s is not a supported DDS, BMP or TGA file\n", input);
+    free(data);
+    return 1;
+  }
+
+  // The calling thread encodes too, so n threads means n - 1 helpers
+  GLES_WorkerPool *pool = threads == 1 ? NULL : workers_create(threads ? threads - 1 : 0);
+  UINT count = mips ? chain_length(info.width, info.height) : info.levels;
+  Level *levels = calloc(count, sizeof(Level));
+  int status = levels ? 0 : 1;
+  for (UINT i = 0; i < count && status == 0; i++) {
+    Level *level = &levels[i];
+    level->width = info.width >> i ? info.width >> i : 1;
+    level->height = info.height >> i ? info.height >> i : 1;
+    level->texels = malloc((size_t)level->width * level->height * 4);
+    if (!level->texels) {
+      status = 1;
+    } else if (i == 0 || !mips) {
+      status = FAILED(image_decode_argb(&info, i, level->texels,
+                                        (size_t)level->width * 4));
+    } else {
+      const Level *above = &levels[i - 1];
+      status = FAILED(texfilter_downsample(
+          D3DFMT_A8R8G8B8, 4, above->texels, above->width, above->height,
+          level->texels, level->width, level->height, D3DX_FILTER_BOX, pool));
+    }
+  }
+  free(data);
+
+  BOOL alpha = status == 0 &&
+               (alpha_mode == ALPHA_ON ||
+                (alpha_mode == ALPHA_AUTO && any_translucent(&levels[0])));
+  FILE *file = status == 0 ? fopen(output, "wb") : NULL;
+  if (status == 0 && !file) {
+    fprintf(stderr, "Cannot write %s\n", output);
+    status = 1;
+  }
+  if (file) {
+    BYTE header[sizeof(D3DGLES_COOKED_HEADER)] = {0};
+    put32(header, D3DGLES_COOKED_MAGIC);
+    put32(header + 4, D3DGLES_COOKED_VERSION);
+    put32(header + 8, info.width);
+    put32(header + 12, info.height);
+    put32(header + 16, count);
+    put32(header + 20, alpha ? D3DGLES_COOKED_ALPHA : 0);
+    if (fwrite(header, sizeof(header), 1, file) != 1) status = 1;
+    for (UINT i = 0; i < count && status == 0; i++) {
+      const Level *level = &levels[i];
+      size_t bytes = (size_t)((level->width + 3) / 4) *
+                     ((level->height + 3) / 4) * 8;
+      BYTE *blocks = malloc(bytes);
+      if (!blocks) {
+        status = 1;
+        break;
+      }
+      etc1_encode_image(level->texels, level->width, level->height,
+                        (size_t)level->width * 4, blocks, pool);
+      if (fwrite(blocks, bytes, 1, file) != 1) status = 1;
+      free(blocks);
+    }
+    for (UINT i = 0; i < count && status == 0 && alpha; i++) {
+      const Level *level = &levels[i];
+      size_t texels = (size_t)level->width * level->height;
+      for (size_t t = 0; t < texels && status == 0; t++)
+        if (fputc((int)(level->texels[t] >> 24), file) == EOF) status = 1;
+    }
+    if (fclose(file) != 0) status = 1;
+    if (status != 0) fprintf(stderr, "Failed writing %s\n", output);
+  }
+
+  if (status == 0)
+    printf("%s: %ux%u, %u level%s, %s\n", output, info.width, info.height,
+           count, count == 1 ? "" : "s", alpha ? "ETC1 + alpha" : "ETC1");
+  for (UINT i = 0; levels && i < count; i++) free(levels[i].texels);
+  free(levels);
+  workers_destroy(pool);
+  return status;
+}
@@ -0,0 +1,205 @@
+#include <d3d8_to_gles.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static void print_help(const char *prog) {
+  printf("Usage: %s [options] [file.dds|bmp|tga ...]\n", prog);
+  printf("Options:\n");
+  printf("  --iterations <n>    Loads per file (default 20)\n");
+  printf("  --size <n>          Width and height of the generated files\n");
+  printf("                      used when no file is given (default 1024)\n");
+  printf("  --help              Display this help and exit\n");
+}
+
+static void put16(BYTE *p, unsigned v) {
+  p[0] = (BYTE)v;
+  p[1] = (BYTE)(v >> 8);
+}
+
+static void put32(BYTE *p, unsigned v) {
+  put16(p, v & 0xffff);
+  put16(p + 2, v >> 16);
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Writes `size` bytes from `data` to a new temporary file named after `kind`
+static char *write_temp(const char *kind, const BYTE *data, size_t size) {
+  char *path = malloc(64);
+  if (!path) return NULL;
+  snprintf(path, 64, "/tmp/d3d8_texload_%s_XXXXXX", kind);
+  int fd = mkstemp(path);
+  if (fd < 0 || write(fd, data, size) != (ssize_t)size) {
+    if (fd >= 0) close(fd);
+    free(path);
+    return NULL;
+  }
+  close(fd);
+  return path;
+}
+
+static BYTE texel(UINT x, UINT y, int channel) {
+  return (BYTE)(x * (channel + 1) + y * (3 - channel));
+}
+
+// 32-bit BMP, 24-bit TGA and DXT1 DDS of the same gradient
+static char *generate(const char *kind, UINT size) {
+  size_t texels = (size_t)size * size, bytes;
+  BYTE *data;
+  if (!strcmp(kind, "bmp")) {
+    bytes = 54 + texels * 4;
+    if (!(data = calloc(1, bytes))) return NULL;
+    data[0] = 'B';
+    data[1] = 'M';
+    put32(data + 2, (unsigned)bytes);
+    put32(data + 10, 54);
+    put32(data + 14, 40);
+    put32(data + 18, size);
+    put32(data + 22, size);
+    put16(data + 26, 1);
+    put16(data + 28, 32);
+    for (size_t i = 0; i < texels; i++)
+      for (int c = 0; c < 4; c++)
+        data[54 + i * 4 + c] = texel(i % size, i / size, c);
+  } else if (!strcmp(kind, "tga")) {
+    bytes = 18 + texels * 3;
+    if (!(data = calloc(1, bytes))) return NULL;
+    data[2] = 2;
+    put16(data + 12, size);
+    put16(data + 14, size);
+    data[16] = 24;
+    for (size_t i = 0; i < texels; i++)
+      for (int c = 0; c < 3; c++)
+        data[18 + i * 3 + c] = texel(i % size, i / size, c);
+  } else {
+    size_t blocks = (size_t)((size + 3) / 4) * ((size + 3) / 4);
+    bytes = 128 + blocks * 8;
+    if (!(data = calloc(1, bytes))) return NULL;
+    memcpy(data, "DDS ", 4);
+    put32(data + 4, 124);
+    put32(data + 8, 0x1007);
+    put32(data + 12, size);
+    put32(data + 16, size);
+    put32(data + 76, 32);
+    put32(data + 80, 0x4);
+    put32(data + 84, D3DFMT_DXT1);
+    for (size_t i = 0; i < blocks; i++) {
+      BYTE *block = data + 128 + i * 8;
+      put16(block, (unsigned)(i * 2654435761u) & 0xffff);
+      put16(block + 2, (unsigned)(i * 40503u) & 0xffff);
+      put32(block + 4, (unsigned)(i * 2246822519u));
+    }
+  }
+  char *path = write_temp(kind, data, bytes);
+  free(data);
+  return path;
+}
+
+// Loads `path` `iterations` times and prints the file throughput
+static int bench(IDirect3DDevice8 *device, const char *path,
+                 unsigned iterations) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    fprintf(stderr, "Cannot open %s\n", path);
+    return 1;
+  }
+  fseek(file, 0, SEEK_END);
+  long bytes = ftell(file);
+  fclose(file);
+
+  D3DXIMAGE_INFO info;
+  double start = now();
+  for (unsigned i = 0; i < iterations; i++) {
+    IDirect3DTexture8 *texture = NULL;
+    HRESULT hr = D3DXCreateTextureFromFileEx(
+        device, path, (UINT)D3DX_DEFAULT, (UINT)D3DX_DEFAULT,
+        (UINT)D3DX_DEFAULT, 0, D3DFMT_UNKNOWN, D3DPOOL_MANAGED, D3DX_DEFAULT,
+        D3DX_DEFAULT, 0, &info, NULL, &texture);
+    if (hr != D3D_OK) {
+      fprintf(stderr, "Loading %s failed: 0x%lx\n", path, (long)hr);
+      return 1;
+    }
+    texture->lpVtbl->Release(texture);
+  }
+  double seconds = now() - start;
+  printf("%s: %ux%u, %u levels, %.2f ms per load, %.1f MB/s\n", path,
+         info.Width, info.Height, info.MipLevels, seconds * 1e3 / iterations,
+         (double)bytes * iterations / seconds / (1024.0 * 1024.0));
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  unsigned iterations = 20, size = 1024;
+  int first_file = argc;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      iterations = (unsigned)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+      size = (unsigned)strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--help") == 0) {
+      print_help(argv[0]);
+      return 0;
+    } else if (argv[i][0] == '-') {
+      print_help(argv[0]);
+      return 1;
+    } else {
+      first_file = i;
+      break;
+    }
+  }
+  if (!iterations || !size || size > 16384) {
+    print_help(argv[0]);
+    return 1;
+  }
+
+  IDirect3D8 *d3d = Direct3DCreate8(D3D_SDK_VERSION);
+  if (!d3d) {
+    fprintf(stderr, "Direct3DCreate8 failed\n");
+    return 1;
+  }
+  D3DPRESENT_PARAMETERS pp = {0};
+  pp.BackBufferWidth = 64;
+  pp.BackBufferHeight = 64;
+  pp.BackBufferFormat = D3DFMT_X8R8G8B8;
+  pp.BackBufferCount = 1;
+  pp.SwapEffect = D3DSWAPEFFECT_DISCARD;
+  pp.Windowed = TRUE;
+  IDirect3DDevice8 *device = NULL;
+  if (d3d->lpVtbl->CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, 0, 0,
+                                &pp, &device) != D3D_OK) {
+    fprintf(stderr, "CreateDevice failed\n");
+    d3d->lpVtbl->Release(d3d);
+    return 1;
+  }
+
+  int status = 0;
+  if (first_file < argc) {
+    for (int i = first_file; i < argc && !status; i++)
+      status = bench(device, argv[i], iterations);
+  } else {
+    static const char *kinds[] = {"bmp", "tga", "dds"};
+    for (int i = 0; i < 3 && !status; i++) {
+      char *path = generate(kinds[i], size);
+      if (!path) {
+        fprintf(stderr, "Cannot write a temporary %s file\n", kinds[i]);
+        status = 1;
+        break;
+      }
+      status = bench(device, path, iterations);
+      remove(path);
+      free(path);
+    }
+  }
+
+  device->lpVtbl->Release(device);
+  d3d->lpVtbl->Release(d3d);
+  return status;
+}